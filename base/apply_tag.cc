@@ -18,33 +18,80 @@
 #include "omaha/base/apply_tag.h"
 #include <atlrx.h>
 #include <vector>
-#include "base/scoped_ptr.h"
-#include "omaha/base/utils.h"
+#include "omaha/base/debug.h"
 #include "omaha/base/extractor.h"
+#include "omaha/base/utils.h"
 
 namespace omaha {
 
+namespace {
+
 const char kMagicBytes[] = "Gact";
 const uint32 kPEHeaderOffset = 60;
+const uint32 kCertDirAddressOffset = 152;
+const uint32 kCertDirInfoSize = 4 + 4;
 
-ApplyTag::ApplyTag()
-    : prev_tag_string_length_(0),
-      prev_cert_length_(0),
-      append_(0) {}
+uint32 GetUint32(const void* p) {
+  ASSERT1(p);
 
-bool ApplyTag::IsValidTagString(const char* tag_string) {
+  const uint32* pu = reinterpret_cast<const uint32*>(p);
+  return *pu;
+}
+
+bool IsValidTagString(CAtlRegExp<CAtlRECharTraitsA>* regex,
+                      const char* tag_string) {
+  ASSERT1(regex);
   ASSERT1(tag_string);
 
-  CAtlRegExp<CAtlRECharTraitsA> regex;
-  REParseError error = regex.Parse(kValidTagStringRegEx);
-  if (error != REPARSE_ERROR_OK) {
-    return false;
+  CAtlREMatchContext<CAtlRECharTraitsA> context;
+  return !!regex->Match(tag_string, &context);
+}
+
+// Builds the tag buffer, which contains the existing tag, if any, followed by
+// the new tag string.
+// The format of the tag buffer is:
+// 000000-000003: 4-byte magic (big-endian)
+// 000004-000005: unsigned 16-bit int string length (big-endian)
+// 000006-??????: ASCII string
+void CreateTagBuffer(const std::vector<char>& prev_tag_string,
+                     const char* tag_string,
+                     int tag_string_length,
+                     std::vector<char>* tag_buffer) {
+  ASSERT1(tag_string);
+  ASSERT1(tag_string_length > 0);
+  ASSERT1(tag_buffer);
+
+  const int prev_tag_string_length = prev_tag_string.size();
+  int tag_string_len = tag_string_length + prev_tag_string_length;
+  int kMagicBytesLen = ::lstrlenA(kMagicBytes);
+  int tag_header_len = kMagicBytesLen + 2;
+  int unpadded_tag_buffer_len = tag_string_len + tag_header_len;
+  // The tag buffer should be padded to multiples of 8, otherwise it will
+  // break the signature of the executable file.
+  int padded_tag_buffer_length = (unpadded_tag_buffer_len + 15) & (-8);
+
+  tag_buffer->clear();
+  tag_buffer->resize(padded_tag_buffer_length, 0);
+  memcpy(&tag_buffer->front(), kMagicBytes, kMagicBytesLen);
+  (*tag_buffer)[kMagicBytesLen] =
+      static_cast<char>((tag_string_len & 0xff00) >> 8);
+  (*tag_buffer)[kMagicBytesLen+1] = static_cast<char>(tag_string_len & 0xff);
+
+  if (prev_tag_string_length > 0) {
+    memcpy(&tag_buffer->front() + tag_header_len,
+           &prev_tag_string.front(),
+           prev_tag_string_length);
   }
 
-  CAtlREMatchContext<CAtlRECharTraitsA> context;
-  return !!regex.Match(tag_string, &context);
+  memcpy(&tag_buffer->front() + tag_header_len + prev_tag_string_length,
+         tag_string,
+         tag_string_length);
 }
 
+}  // namespace
+
+ApplyTag::ApplyTag() : append_(0) {}
+
 HRESULT ApplyTag::Init(const TCHAR* signed_exe_file,
                        const char* tag_string,
                        int tag_string_length,
@@ -59,7 +106,9 @@ HRESULT ApplyTag::Init(const TCHAR* signed_exe_file,
   append_ = append;
 
   // Check the tag_string for invalid characters.
-  if (!IsValidTagString(tag_string)) {
+  CAtlRegExp<CAtlRECharTraitsA> regex;
+  if (regex.Parse(kValidTagStringRegEx) != REPARSE_ERROR_OK ||
+      !IsValidTagString(&regex, tag_string)) {
     return E_INVALIDARG;
   }
 
@@ -71,174 +120,205 @@ HRESULT ApplyTag::Init(const TCHAR* signed_exe_file,
 }
 
 HRESULT ApplyTag::EmbedTagString() {
-  std::vector<byte> input_file_buffer;
-  HRESULT hr = ReadEntireFile(signed_exe_file_, 0, &input_file_buffer);
+  ASSERT1(!tag_string_.empty());
+
+  BatchApplyTag batch;
+  HRESULT hr = batch.Init(signed_exe_file_, append_);
   if (FAILED(hr)) {
     return hr;
   }
 
-  ASSERT1(!input_file_buffer.empty());
-  VERIFY1(ReadExistingTag(&input_file_buffer));
-  if (!append_ && prev_tag_string_length_) {
-    // If there is a previous tag and the append flag is not set, then
-    // we should error out.
-    return APPLYTAG_E_ALREADY_TAGGED;
-  }
+  // The tag string was validated by Init, and may not be null-terminated.
+  std::vector<char> tag_string(tag_string_);
+  tag_string.push_back('\0');
+  return batch.EmbedTagString(&tag_string.front(),
+                              tag_string_.size(),
+                              tagged_file_);
+}
 
-  if (!CreateBufferToWrite()) {
-    return E_FAIL;
-  }
+BatchApplyTag::BatchApplyTag()
+    : data_(NULL),
+      data_length_(0),
+      cert_dir_length_offset_(0),
+      cert_dir_offset_(0),
+      cert_length_(0),
+      append_(false) {}
 
-  // The input_file_buffer might contain the previously read tag, in which
-  // case the buffer_data_ is larger than the actual output buffer length.
-  // The real output buffer length is returned by the ApplyTagToBuffer
-  // method.
-  buffer_data_.resize(input_file_buffer.size() + tag_buffer_.size());
+HRESULT BatchApplyTag::Init(const TCHAR* signed_exe_file, bool append) {
+  ASSERT1(signed_exe_file);
+  ASSERT1(!data_);
 
-  copy(input_file_buffer.begin(),
-       input_file_buffer.end(),
-       buffer_data_.begin());
+  append_ = append;
 
-  int output_length = 0;
-  if (!ApplyTagToBuffer(&output_length))
+  if (valid_tag_regex_.Parse(kValidTagStringRegEx) != REPARSE_ERROR_OK) {
     return E_FAIL;
+  }
 
-  std::vector<byte> output_buffer(output_length);
-  ASSERT1(static_cast<size_t>(output_length) <= buffer_data_.size());
-  copy(buffer_data_.begin(),
-       buffer_data_.begin() + output_length,
-       output_buffer.begin());
-  return WriteEntireFile(tagged_file_, output_buffer);
-}
+  reset(file_, ::CreateFile(signed_exe_file,
+                            GENERIC_READ,
+                            FILE_SHARE_READ,
+                            NULL,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                            NULL));
+  if (!file_) {
+    return HRESULTFromLastError();
+  }
 
-uint32 ApplyTag::GetUint32(const void* p) {
-  ASSERT1(p);
+  data_length_ = ::GetFileSize(get(file_), NULL);
+  if (data_length_ == INVALID_FILE_SIZE) {
+    return HRESULTFromLastError();
+  }
 
-  const uint32* pu = reinterpret_cast<const uint32*>(p);
-  return *pu;
-}
+  reset(mapping_, ::CreateFileMapping(get(file_),
+                                      NULL,
+                                      PAGE_READONLY,
+                                      0,
+                                      0,
+                                      NULL));
+  if (!mapping_) {
+    return HRESULTFromLastError();
+  }
 
-void ApplyTag::PutUint32(uint32 i, void* p) {
-  ASSERT1(p);
+  reset(view_, ::MapViewOfFile(get(mapping_), FILE_MAP_READ, 0, 0, 0));
+  if (!view_) {
+    return HRESULTFromLastError();
+  }
+  data_ = static_cast<const char*>(get(view_));
 
-  uint32* pu = reinterpret_cast<uint32*>(p);
-  *pu = i;
+  return ReadCertificateDirectory();
 }
 
-bool ApplyTag::ReadExistingTag(std::vector<byte>* binary) {
-  ASSERT1(binary);
+HRESULT BatchApplyTag::ReadCertificateDirectory() {
+  ASSERT1(data_);
 
-  int len = 0;
+  if (data_length_ < kPEHeaderOffset + sizeof(uint32)) {
+    return E_FAIL;
+  }
+  const uint32 peheader = GetUint32(data_ + kPEHeaderOffset);
+  if (peheader + kCertDirAddressOffset + kCertDirInfoSize > data_length_) {
+    return E_FAIL;
+  }
+
+  // Read certificate directory info.
+  cert_dir_length_offset_ = peheader + kCertDirAddressOffset + 4;
+  cert_dir_offset_ = GetUint32(data_ + peheader + kCertDirAddressOffset);
+  const uint32 cert_dir_len = GetUint32(data_ + cert_dir_length_offset_);
+  if (cert_dir_offset_ < cert_dir_length_offset_ + 4 ||
+      cert_dir_offset_ + cert_dir_len > data_length_) {
+    return E_FAIL;
+  }
+
+  // The certificate length is set even if there is no previous tag.
   TagExtractor tag;
-  char* bin = reinterpret_cast<char*>(&binary->front());
-  ASSERT1(bin);
-  if (tag.ExtractTag(bin, binary->size(), NULL, &len)) {
-    prev_tag_string_.resize(len);
-    if (tag.ExtractTag(bin, binary->size(), &prev_tag_string_.front(), &len)) {
+  int len = 0;
+  if (tag.ExtractTag(data_, data_length_, NULL, &len)) {
+    std::vector<char> prev_tag_string(len);
+    if (tag.ExtractTag(data_, data_length_, &prev_tag_string.front(), &len)) {
       // The extractor returns the actual length
       // of the string + 1 for the terminating null.
-      prev_tag_string_length_ = len - 1;
+      prev_tag_string_.assign(prev_tag_string.begin(),
+                              prev_tag_string.begin() + len - 1);
     }
   }
+  cert_length_ = tag.cert_length();
 
-  // Set the existing certificate length even if previous
-  // tag does not exist.
-  prev_cert_length_ = tag.cert_length();
-  return true;
-}
-
-bool ApplyTag::CreateBufferToWrite() {
-  ASSERT1(!append_ && !prev_tag_string_length_ || append_);
-  ASSERT1(!tag_string_.empty());
-  ASSERT1(!prev_tag_string_.size() ||
-          prev_tag_string_.size() ==
-          static_cast<size_t>(prev_tag_string_length_ + 1));
-
-  // Build the tag buffer.
-  // The format of the tag buffer is:
-  // 000000-000003: 4-byte magic (big-endian)
-  // 000004-000005: unsigned 16-bit int string length (big-endian)
-  // 000006-??????: ASCII string
-  int tag_string_len = tag_string_.size() + prev_tag_string_length_;
-  int kMagicBytesLen = ::lstrlenA(kMagicBytes);
-  int tag_header_len = kMagicBytesLen + 2;
-  int unpadded_tag_buffer_len = tag_string_len + tag_header_len;
-  // The tag buffer should be padded to multiples of 8, otherwise it will
-  // break the signature of the executable file.
-  int padded_tag_buffer_length = (unpadded_tag_buffer_len + 15) & (-8);
-
-  tag_buffer_.clear();
-  tag_buffer_.resize(padded_tag_buffer_length, 0);
-  memcpy(&tag_buffer_.front(), kMagicBytes, kMagicBytesLen);
-  tag_buffer_[kMagicBytesLen] =
-      static_cast<char>((tag_string_len & 0xff00) >> 8);
-  tag_buffer_[kMagicBytesLen+1] = static_cast<char>(tag_string_len & 0xff);
+  if (!append_ && !prev_tag_string_.empty()) {
+    // If there is a previous tag and the append flag is not set, then
+    // we should error out.
+    return APPLYTAG_E_ALREADY_TAGGED;
+  }
 
-  if (prev_tag_string_length_ > 0) {
-    copy(prev_tag_string_.begin(),
-         prev_tag_string_.end(),
-         tag_buffer_.begin() + tag_header_len);
+  // The tag replaces everything that follows the certificate, which is
+  // expected to be last in the file.
+  const int prev_pad_length = static_cast<int>(cert_dir_len) - cert_length_ -
+                              static_cast<int>(prev_tag_string_.size());
+  ASSERT1(prev_pad_length >= 0);
+  ASSERT1(cert_dir_offset_ + cert_dir_len == data_length_);
+  if (prev_pad_length < 0 || cert_length_ < static_cast<int>(sizeof(uint32))) {
+    return E_FAIL;
   }
 
-  copy(tag_string_.begin(),
-       tag_string_.end(),
-       tag_buffer_.begin() + tag_header_len + prev_tag_string_length_);
-  ASSERT1(static_cast<int>(tag_buffer_.size()) == padded_tag_buffer_length);
+  // Check the certificate struct length.
+  const uint32 cert_struct_len = GetUint32(data_ + cert_dir_offset_);
+  ASSERT1(!(cert_struct_len > cert_dir_len ||
+            cert_struct_len < cert_dir_len - 8));
+  UNREFERENCED_PARAMETER(cert_struct_len);
 
-  return true;
+  return S_OK;
 }
 
-bool ApplyTag::ApplyTagToBuffer(int* output_len) {
-  ASSERT1(output_len);
+HRESULT BatchApplyTag::EmbedTagString(const char* tag_string,
+                                      int tag_string_length,
+                                      const TCHAR* tagged_file) {
+  ASSERT1(tag_string);
+  ASSERT1(tag_string_length > 0);
+  ASSERT1(tagged_file);
+
+  if (!data_) {
+    return E_UNEXPECTED;
+  }
 
-  uint32 original_data_len = buffer_data_.size() - tag_buffer_.size();
-  uint32 peheader = GetUint32(&buffer_data_.front() + kPEHeaderOffset);
-  uint32 kCertDirAddressOffset = 152;
-  uint32 kCertDirInfoSize = 4 + 4;
+  // Check the tag_string for invalid characters.
+  if (!IsValidTagString(&valid_tag_regex_, tag_string)) {
+    return E_INVALIDARG;
+  }
 
-  ASSERT1(peheader + kCertDirAddressOffset + kCertDirInfoSize <=
-          original_data_len);
+  std::vector<char> tag_buffer;
+  CreateTagBuffer(prev_tag_string_, tag_string, tag_string_length, &tag_buffer);
+  return WriteTaggedFile(tag_buffer, tagged_file);
+}
 
-  // Read certificate directory info.
-  uint32 cert_dir_offset = GetUint32(&buffer_data_.front() + peheader +
-                                     kCertDirAddressOffset);
-  if (cert_dir_offset == 0)
-    return false;
-  uint32 cert_dir_len = GetUint32(&buffer_data_.front() + peheader +
-                                  kCertDirAddressOffset + 4);
-  ASSERT1(cert_dir_offset + cert_dir_len <= original_data_len);
-
-  // Calculate the new output length.
-  int prev_pad_length = cert_dir_len - prev_cert_length_ -
-                        prev_tag_string_length_;
-  ASSERT1(prev_pad_length >= 0);
-  int orig_dir_len = cert_dir_len - prev_tag_string_length_ -
-                     prev_pad_length;
-  ASSERT1(orig_dir_len == prev_cert_length_);
-  int output_length = original_data_len - prev_tag_string_length_ -
-                      prev_pad_length + tag_buffer_.size();
-  *output_len = output_length;
-  ASSERT1(static_cast<size_t>(output_length) <= buffer_data_.size());
-  ASSERT1(output_length >= orig_dir_len);
-
-  // Increase the size of certificate directory.
-  int new_cert_len = prev_cert_length_ + tag_buffer_.size();
-  PutUint32(new_cert_len,
-            &buffer_data_.front() + peheader + kCertDirAddressOffset + 4);
-
-  // Read certificate struct info.
-  uint32 cert_struct_len = GetUint32(&buffer_data_.front() + cert_dir_offset);
-  ASSERT1(!(cert_struct_len > cert_dir_len ||
-            cert_struct_len < cert_dir_len - 8));
+HRESULT BatchApplyTag::WriteTaggedFile(const std::vector<char>& tag_buffer,
+                                       const TCHAR* tagged_file) const {
+  ASSERT1(!tag_buffer.empty());
+  ASSERT1(tagged_file);
 
-  // Increase the certificate struct size.
-  PutUint32(new_cert_len, &buffer_data_.front() + cert_dir_offset);
+  scoped_hfile file(::CreateFile(tagged_file,
+                                 GENERIC_WRITE,
+                                 0,
+                                 NULL,
+                                 CREATE_ALWAYS,
+                                 FILE_ATTRIBUTE_NORMAL,
+                                 NULL));
+  if (!file) {
+    return HRESULTFromLastError();
+  }
 
-  // Copy the tag buffer.
-  copy(tag_buffer_.begin(), tag_buffer_.end(),
-       buffer_data_.begin() + cert_dir_offset + prev_cert_length_);
+  // The size of the certificate directory and the size of the certificate
+  // struct both grow by the size of the tag buffer.
+  const uint32 new_cert_len = cert_length_ + tag_buffer.size();
+
+  struct Chunk {
+    const void* data;
+    uint32 length;
+  };
+  const Chunk chunks[] = {
+    {data_, cert_dir_length_offset_},
+    {&new_cert_len, sizeof(new_cert_len)},
+    {data_ + cert_dir_length_offset_ + sizeof(uint32),
+     cert_dir_offset_ - cert_dir_length_offset_ - sizeof(uint32)},
+    {&new_cert_len, sizeof(new_cert_len)},
+    {data_ + cert_dir_offset_ + sizeof(uint32),
+     cert_length_ - sizeof(uint32)},
+    {&tag_buffer.front(), tag_buffer.size()},
+  };
+
+  for (size_t i = 0; i != arraysize(chunks); ++i) {
+    DWORD bytes_written = 0;
+    if (!::WriteFile(get(file),
+                     chunks[i].data,
+                     chunks[i].length,
+                     &bytes_written,
+                     NULL)) {
+      return HRESULTFromLastError();
+    }
+    if (bytes_written != chunks[i].length) {
+      return E_FAIL;
+    }
+  }
 
-  return true;
+  return S_OK;
 }
 
 }  // namespace omaha
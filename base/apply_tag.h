@@ -17,6 +17,7 @@
 #define OMAHA_COMMON_APPLY_TAG_H__
 
 #include <atlbase.h>
+#include <atlrx.h>
 #include <atlstr.h>
 
 #include <vector>
@@ -24,6 +25,7 @@
 #include "base/basictypes.h"
 #include "base/scoped_ptr.h"
 #include "omaha/base/error.h"
+#include "omaha/base/scoped_any.h"
 
 namespace omaha {
 
@@ -43,6 +45,7 @@ const char* const kValidTagStringRegEx = "^[-%{}/&=.,_a-zA-Z0-9_]*$";
 // <Signature>Gact.<tag_len><tag_string>
 // There are no restrictions on the tag_string, it is just treated
 // as a sequence of bytes.
+// The tagged file must not be the signed file.
 class ApplyTag {
  public:
   ApplyTag();
@@ -54,25 +57,9 @@ class ApplyTag {
   HRESULT EmbedTagString();
 
  private:
-  static uint32 GetUint32(const void* p);
-  static void PutUint32(uint32 i, void* p);
-  bool ReadExistingTag(std::vector<byte>* binary);
-  bool CreateBufferToWrite();
-  bool ApplyTagToBuffer(int* output_len);
-  bool IsValidTagString(const char* tag_string);
-
   // The string to be tagged into the binary.
   std::vector<char> tag_string_;
 
-  // Existing tag string inside the binary.
-  std::vector<char> prev_tag_string_;
-
-  // This is prev_tag_string_.size - 1, to exclude the terminating null.
-  int prev_tag_string_length_;
-
-  // Length of the certificate inside the binary.
-  int prev_cert_length_;
-
   // The input binary to be tagged.
   CString signed_exe_file_;
 
@@ -82,14 +69,59 @@ class ApplyTag {
   // Whether to append the tag string to the existing one.
   bool append_;
 
-  // Internal buffer to hold the appended string.
-  std::vector<char> tag_buffer_;
+  DISALLOW_EVIL_CONSTRUCTORS(ApplyTag);
+};
 
-  // The output buffer that contains the original binary
-  // data with the tagged information.
-  std::vector<char> buffer_data_;
+// Stamps tag strings into many copies of the same signed file, the same way
+// ApplyTag does. The signed file is mapped, and its certificate directory and
+// existing tag are read, once by Init. Each tagged file is then written
+// straight from the mapped view: only the two certificate length fields
+// differ from the signed file, and the tag follows the certificate. The
+// tagged files must not be the signed file.
+class BatchApplyTag {
+ public:
+  BatchApplyTag();
 
-  DISALLOW_EVIL_CONSTRUCTORS(ApplyTag);
+  // Returns APPLYTAG_E_ALREADY_TAGGED if the file is tagged and append is
+  // false.
+  HRESULT Init(const TCHAR* signed_exe_file, bool append);
+
+  // Writes a copy of the signed file tagged with tag_string. Returns
+  // E_INVALIDARG if the tag string contains invalid characters.
+  HRESULT EmbedTagString(const char* tag_string,
+                         int tag_string_length,
+                         const TCHAR* tagged_file);
+
+ private:
+  HRESULT ReadCertificateDirectory();
+  HRESULT WriteTaggedFile(const std::vector<char>& tag_buffer,
+                          const TCHAR* tagged_file) const;
+
+  scoped_hfile file_;
+  scoped_file_mapping mapping_;
+  scoped_file_view view_;
+
+  // The mapped signed file.
+  const char* data_;
+  uint32 data_length_;
+
+  // Offsets of the length field of the certificate directory entry in the
+  // PE header and of the certificate directory.
+  uint32 cert_dir_length_offset_;
+  uint32 cert_dir_offset_;
+
+  // Length of the certificate, excluding the tag and its padding.
+  int cert_length_;
+
+  // Existing tag string inside the binary, without the terminating null.
+  std::vector<char> prev_tag_string_;
+
+  bool append_;
+
+  // Parsed from kValidTagStringRegEx by Init.
+  CAtlRegExp<CAtlRECharTraitsA> valid_tag_regex_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(BatchApplyTag);
 };
 
 }  // namespace omaha
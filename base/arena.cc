@@ -0,0 +1,67 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/arena.h"
+#include "omaha/base/debug.h"
+
+namespace omaha {
+
+Arena::Arena(size_t block_size)
+    : block_size_(block_size),
+      next_(NULL),
+      remaining_(0),
+      num_allocations_(0),
+      bytes_reserved_(0),
+      bytes_used_(0) {
+  ASSERT1(block_size >= kAlignment);
+}
+
+Arena::~Arena() {
+  for (size_t i = 0; i != blocks_.size(); ++i) {
+    delete [] blocks_[i];
+  }
+}
+
+void* Arena::Allocate(size_t size) {
+  const size_t aligned_size = (size + kAlignment - 1) & ~(kAlignment - 1);
+
+  ++num_allocations_;
+  bytes_used_ += aligned_size;
+
+  if (aligned_size > block_size_ / 4) {
+    // Keeps the free part of the current block for the next allocations.
+    return AllocateBlock(aligned_size);
+  }
+
+  if (aligned_size > remaining_) {
+    next_ = AllocateBlock(block_size_);
+    remaining_ = block_size_;
+  }
+
+  void* p = next_;
+  next_ += aligned_size;
+  remaining_ -= aligned_size;
+  return p;
+}
+
+char* Arena::AllocateBlock(size_t size) {
+  char* block = new char[size];
+  ASSERT1((reinterpret_cast<uintptr_t>(block) & (kAlignment - 1)) == 0);
+  blocks_.push_back(block);
+  bytes_reserved_ += size;
+  return block;
+}
+
+}  // namespace omaha
@@ -0,0 +1,80 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// Arena allocates memory for objects that are released together. Memory is
+// carved out of large blocks, so allocating many small objects costs a few
+// heap allocations, and the blocks are released at once when the arena is
+// destroyed. Memory is never returned to the arena before then.
+//
+// Arena is not thread safe. The callers serialize the calls to Allocate().
+
+#ifndef OMAHA_BASE_ARENA_H_
+#define OMAHA_BASE_ARENA_H_
+
+#include <windows.h>
+#include <vector>
+#include "base/basictypes.h"
+
+namespace omaha {
+
+class Arena {
+ public:
+  static const size_t kDefaultBlockSize = 16 * 1024;
+
+  // Allocations are aligned on kAlignment bytes.
+  static const size_t kAlignment = MEMORY_ALLOCATION_ALIGNMENT;
+
+  explicit Arena(size_t block_size);
+  ~Arena();
+
+  // Returns a block of at least size bytes that is valid until the arena is
+  // destroyed. Allocations larger than a quarter of the block size get a
+  // block of their own.
+  void* Allocate(size_t size);
+
+  // The number of calls to Allocate().
+  size_t num_allocations() const { return num_allocations_; }
+
+  // The number of blocks allocated from the heap.
+  size_t num_blocks() const { return blocks_.size(); }
+
+  // The bytes allocated from the heap, including the unused part of the
+  // blocks.
+  size_t bytes_reserved() const { return bytes_reserved_; }
+
+  // The bytes returned by Allocate(), including the alignment padding.
+  size_t bytes_used() const { return bytes_used_; }
+
+ private:
+  char* AllocateBlock(size_t size);
+
+  const size_t block_size_;
+
+  std::vector<char*> blocks_;
+
+  // The free part of the current block.
+  char* next_;
+  size_t remaining_;
+
+  size_t num_allocations_;
+  size_t bytes_reserved_;
+  size_t bytes_used_;
+
+  DISALLOW_COPY_AND_ASSIGN(Arena);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_BASE_ARENA_H_
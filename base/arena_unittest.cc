@@ -0,0 +1,82 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/arena.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+bool IsAligned(const void* p) {
+  return (reinterpret_cast<uintptr_t>(p) & (Arena::kAlignment - 1)) == 0;
+}
+
+}  // namespace
+
+TEST(ArenaTest, Empty) {
+  Arena arena(Arena::kDefaultBlockSize);
+  EXPECT_EQ(0, arena.num_allocations());
+  EXPECT_EQ(0, arena.num_blocks());
+  EXPECT_EQ(0, arena.bytes_reserved());
+  EXPECT_EQ(0, arena.bytes_used());
+}
+
+TEST(ArenaTest, Allocate_SmallObjectsShareBlock) {
+  Arena arena(1024);
+
+  char* p1 = static_cast<char*>(arena.Allocate(1));
+  char* p2 = static_cast<char*>(arena.Allocate(10));
+  char* p3 = static_cast<char*>(arena.Allocate(Arena::kAlignment));
+  EXPECT_TRUE(IsAligned(p1));
+  EXPECT_TRUE(IsAligned(p2));
+  EXPECT_TRUE(IsAligned(p3));
+  EXPECT_EQ(p1 + Arena::kAlignment, p2);
+  EXPECT_LT(p2, p3);
+
+  EXPECT_EQ(3, arena.num_allocations());
+  EXPECT_EQ(1, arena.num_blocks());
+  EXPECT_EQ(1024, arena.bytes_reserved());
+}
+
+TEST(ArenaTest, Allocate_NewBlockWhenFull) {
+  Arena arena(1024);
+
+  for (int i = 0; i != 8; ++i) {
+    memset(arena.Allocate(128), i, 128);
+  }
+  EXPECT_EQ(1, arena.num_blocks());
+
+  memset(arena.Allocate(128), 0, 128);
+  EXPECT_EQ(2, arena.num_blocks());
+  EXPECT_EQ(9, arena.num_allocations());
+  EXPECT_EQ(9 * 128, arena.bytes_used());
+}
+
+TEST(ArenaTest, Allocate_LargeObjectGetsOwnBlock) {
+  Arena arena(1024);
+
+  char* small1 = static_cast<char*>(arena.Allocate(16));
+  void* large = arena.Allocate(1000);
+  char* small2 = static_cast<char*>(arena.Allocate(16));
+  memset(large, 0, 1000);
+
+  // The large allocation does not waste the free part of the current block.
+  EXPECT_EQ(small1 + 16, small2);
+  EXPECT_EQ(2, arena.num_blocks());
+  EXPECT_LE(1024 + 1000, arena.bytes_reserved());
+}
+
+}  // namespace omaha
@@ -23,6 +23,28 @@
 
 namespace omaha {
 
+namespace {
+
+// Returns the argument without its leading and trailing spaces, the same as
+// CString::Trim(_T(" ")) does, without copying the argument.
+const wchar_t* TrimSpaces(const wchar_t* arg, int* length) {
+  ASSERT1(arg);
+  ASSERT1(length);
+
+  while (*arg == L' ') {
+    ++arg;
+  }
+  const wchar_t* end = arg + wcslen(arg);
+  while (end != arg && *(end - 1) == L' ') {
+    --end;
+  }
+
+  *length = static_cast<int>(end - arg);
+  return arg;
+}
+
+}  // namespace
+
 namespace internal {
 
 void CommandLineParserArgs::Reset() {
@@ -32,12 +54,11 @@ void CommandLineParserArgs::Reset() {
 // Assumes switch_name is already lower case.
 HRESULT CommandLineParserArgs::AddSwitch(const CString& switch_name) {
   ASSERT1(CString(switch_name).MakeLower().Compare(switch_name) == 0);
-  if (switch_arguments_.find(switch_name) != switch_arguments_.end()) {
+  if (!switch_arguments_.insert(
+          std::make_pair(switch_name, StringVector())).second) {
     return E_INVALIDARG;
   }
 
-  StringVector string_vector;
-  switch_arguments_[switch_name] = string_vector;
   return S_OK;
 }
 
@@ -120,18 +141,13 @@ HRESULT CommandLineParserArgs::GetSwitchArgumentValue(
   CString switch_name_lower = switch_name;
   switch_name_lower.MakeLower();
 
-  int count = 0;
-  HRESULT hr = GetSwitchArgumentCount(switch_name_lower, &count);
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  if (argument_index >= count) {
+  SwitchAndArgumentsMapIter iter = switch_arguments_.find(switch_name_lower);
+  if (iter == switch_arguments_.end()) {
     return E_INVALIDARG;
   }
 
-  SwitchAndArgumentsMapIter iter = switch_arguments_.find(switch_name_lower);
-  if (iter == switch_arguments_.end()) {
+  if (argument_index < 0 ||
+      argument_index >= static_cast<int>((*iter).second.size())) {
     return E_INVALIDARG;
   }
 
@@ -149,11 +165,16 @@ CommandLineParser::CommandLineParser() {
 CommandLineParser::~CommandLineParser() {
 }
 
+// The command line is parsed in place. Only the leading spaces need to be
+// skipped since CommandLineToArgvW ignores the trailing spaces.
 HRESULT CommandLineParser::ParseFromString(const wchar_t* command_line) {
-  CString command_line_str(command_line);
-  command_line_str.Trim(_T(" "));
+  const wchar_t* begin = command_line ? command_line : L"";
+  while (*begin == L' ') {
+    ++begin;
+  }
 
-  if (command_line_str.IsEmpty()) {
+  CString command_line_str;
+  if (!*begin) {
     // If the first arg to CommandLineToArgvW "is an empty string the function
     // returns the path to the current executable file." However, it does not
     // correctly handle the case when the path contains spaces - it breaks the
@@ -164,10 +185,11 @@ HRESULT CommandLineParser::ParseFromString(const wchar_t* command_line) {
                                 CStrBuf(command_line_str, MAX_PATH),
                                 MAX_PATH));
     EnclosePath(&command_line_str);
+    begin = command_line_str;
   }
 
   int argc = 0;
-  wchar_t** argv = ::CommandLineToArgvW(command_line_str, &argc);
+  wchar_t** argv = ::CommandLineToArgvW(begin, &argc);
   if (!argv) {
     return HRESULTFromLastError();
   }
@@ -199,7 +221,7 @@ HRESULT CommandLineParser::ParseFromArgv(int argc, wchar_t** argv) {
 
   if (argc == 1) {
     // We only have the program name.  So, we're done parsing.
-    ASSERT1(!IsSwitch(argv[0]));
+    ASSERT1(!IsSwitch(argv[0], static_cast<int>(wcslen(argv[0]))));
     return S_OK;
   }
 
@@ -209,13 +231,10 @@ HRESULT CommandLineParser::ParseFromArgv(int argc, wchar_t** argv) {
   // Start parsing at the first argument after the program name (index 1).
   for (int i = 1; i < argc; ++i) {
     HRESULT hr = S_OK;
-    CString token = argv[i];
-    token.Trim(_T(" "));
-    if (IsSwitch(token)) {
-      hr = StripSwitchNameFromArgv(token, &current_switch_name);
-      if (FAILED(hr)) {
-        return hr;
-      }
+    int length = 0;
+    const wchar_t* token = TrimSpaces(argv[i], &length);
+    if (IsSwitch(token, length)) {
+      current_switch_name = GetSwitchName(token, length);
       hr = AddSwitch(current_switch_name);
       if (FAILED(hr)) {
         CORE_LOG(LE, (_T("[AddSwitch failed][%s][0x%x]"),
@@ -223,11 +242,8 @@ HRESULT CommandLineParser::ParseFromArgv(int argc, wchar_t** argv) {
         return hr;
       }
       is_optional_switch = false;
-    } else if (IsOptionalSwitch(token)) {
-      hr = StripOptionalSwitchNameFromArgv(token, &current_switch_name);
-      if (FAILED(hr)) {
-        return hr;
-      }
+    } else if (IsOptionalSwitch(token, length)) {
+      current_switch_name = GetSwitchName(token + 1, length - 1);
       hr = AddOptionalSwitch(current_switch_name);
       if (FAILED(hr)) {
         CORE_LOG(LE, (_T("[AddOptionalSwitch failed][%s][0x%x]"),
@@ -236,13 +252,14 @@ HRESULT CommandLineParser::ParseFromArgv(int argc, wchar_t** argv) {
       }
       is_optional_switch = true;
     } else {
+      const CString argument(token, length);
       hr = is_optional_switch ?
-          AddOptionalSwitchArgument(current_switch_name, token) :
-          AddSwitchArgument(current_switch_name, token);
+          AddOptionalSwitchArgument(current_switch_name, argument) :
+          AddSwitchArgument(current_switch_name, argument);
 
       if (FAILED(hr)) {
         CORE_LOG(LE, (_T("[Adding switch argument failed][%d][%s][%s][0x%x]"),
-                      is_optional_switch, current_switch_name, token, hr));
+                      is_optional_switch, current_switch_name, argument, hr));
         return hr;
       }
     }
@@ -251,9 +268,11 @@ HRESULT CommandLineParser::ParseFromArgv(int argc, wchar_t** argv) {
   return S_OK;
 }
 
-bool CommandLineParser::IsSwitch(const CString& param) const {
+bool CommandLineParser::IsSwitch(const wchar_t* param, int length) {
+  ASSERT1(param);
+
   // Switches must have a prefix (/) or (-), and at least one character.
-  if (param.GetLength() < 2) {
+  if (length < 2) {
     return false;
   }
 
@@ -263,41 +282,28 @@ bool CommandLineParser::IsSwitch(const CString& param) const {
   // * foo.exe /switch arg     -- /switch is a switch, arg is an arg
   // * foo.exe /switch "/x y"  -- /switch is a switch, '/x y' is an arg and it
   //   will get here _without_ the quotes.
-  // If param_str starts with / and contains no spaces, then it's a switch.
-  return ((param[0] == _T('/')) || (param[0] == _T('-'))) &&
-          (param.Find(_T(" ")) == -1) &&
-          (param.Find(_T("%20")) == -1);
+  // If param starts with / and contains no spaces, then it's a switch. Only
+  // spaces follow param in the argv string, so the search for "%20" may run to
+  // the end of the string.
+  return ((param[0] == L'/') || (param[0] == L'-')) &&
+          !wmemchr(param, L' ', length) &&
+          !wcsstr(param, L"%20");
 }
 
-bool CommandLineParser::IsOptionalSwitch(const CString& param) const {
+bool CommandLineParser::IsOptionalSwitch(const wchar_t* param, int length) {
+  ASSERT1(param);
+
   // Optional switches must have a prefix ([/) or ([-), and at least one
   // character.
-  return param[0] == _T('[') && IsSwitch(param.Right(param.GetLength() - 1));
+  return length > 0 && param[0] == L'[' && IsSwitch(param + 1, length - 1);
 }
 
-HRESULT CommandLineParser::StripSwitchNameFromArgv(const CString& param,
-                                                   CString* switch_name) {
-  ASSERT1(switch_name);
-
-  if (!IsSwitch(param)) {
-    return E_INVALIDARG;
-  }
-
-  *switch_name = param.Right(param.GetLength() - 1);
-  switch_name->Trim(_T(" "));
-  switch_name->MakeLower();
-  return S_OK;
-}
-
-HRESULT CommandLineParser::StripOptionalSwitchNameFromArgv(const CString& param,
-                                                           CString* name) {
-  ASSERT1(name);
-
-  if (!IsOptionalSwitch(param)) {
-    return E_INVALIDARG;
-  }
+CString CommandLineParser::GetSwitchName(const wchar_t* param, int length) {
+  ASSERT1(IsSwitch(param, length));
 
-  return StripSwitchNameFromArgv(param.Right(param.GetLength() - 1), name);
+  CString switch_name(param + 1, length - 1);
+  switch_name.MakeLower();
+  return switch_name;
 }
 
 void CommandLineParser::Reset() {
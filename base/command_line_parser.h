@@ -87,10 +87,14 @@ class CommandLineParser {
       CString* argument_value) const;
 
  private:
-  bool IsSwitch(const CString& param) const;
-  HRESULT StripSwitchNameFromArgv(const CString& param, CString* switch_name);
-  bool IsOptionalSwitch(const CString& param) const;
-  HRESULT StripOptionalSwitchNameFromArgv(const CString& param, CString* name);
+  // The parameters are classified in place, without copying them. param
+  // points into a null-terminated argv string and length excludes the
+  // trailing spaces of the string.
+  static bool IsSwitch(const wchar_t* param, int length);
+  static bool IsOptionalSwitch(const wchar_t* param, int length);
+
+  // Returns the lower case name of the switch param.
+  static CString GetSwitchName(const wchar_t* param, int length);
 
   void Reset();
 
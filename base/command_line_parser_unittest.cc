@@ -172,4 +172,52 @@ TEST(CommandLineParserTest, ParseFromString_SpaceInPathWithQuotes) {
   EXPECT_STREQ(_T("bar"), arg_value);
 }
 
+TEST(CommandLineParserTest, ParseFromString_LeadingAndTrailingSpaces) {
+  CommandLineParser parser;
+  int arg_count = 0;
+  CString arg_value;
+  EXPECT_SUCCEEDED(parser.ParseFromString(_T("  f.exe /Foo \" bar \"  ")));
+  EXPECT_EQ(1, parser.GetSwitchCount());
+  EXPECT_TRUE(parser.HasSwitch(_T("foo")));
+  EXPECT_SUCCEEDED(parser.GetSwitchArgumentCount(_T("FOO"), &arg_count));
+  EXPECT_EQ(1, arg_count);
+  EXPECT_SUCCEEDED(parser.GetSwitchArgumentValue(_T("foo"), 0, &arg_value));
+  EXPECT_STREQ(_T("bar"), arg_value);
+  EXPECT_FAILED(parser.GetSwitchArgumentValue(_T("foo"), 1, &arg_value));
+  EXPECT_FAILED(parser.GetSwitchArgumentValue(_T("foo"), -1, &arg_value));
+}
+
+TEST(CommandLineParserTest, ParseFromString_EncodedSpaceIsNotSwitch) {
+  CommandLineParser parser;
+  CString arg_value;
+  EXPECT_SUCCEEDED(parser.ParseFromString(_T("f.exe /foo /bar%20baz")));
+  EXPECT_EQ(1, parser.GetSwitchCount());
+  EXPECT_SUCCEEDED(parser.GetSwitchArgumentValue(_T("foo"), 0, &arg_value));
+  EXPECT_STREQ(_T("/bar%20baz"), arg_value);
+}
+
+TEST(CommandLineParserTest, ParseFromString_DuplicateSwitch) {
+  CommandLineParser parser;
+  EXPECT_FAILED(parser.ParseFromString(_T("f.exe /foo /FOO")));
+}
+
+TEST(CommandLineParserTest, ParseFromString_OptionalSwitches) {
+  CommandLineParser parser;
+  int arg_count = 0;
+  CString arg_value;
+  EXPECT_SUCCEEDED(parser.ParseFromString(
+      _T("gu.exe /install x [/oem [/appargs y \"[z\"")));
+  EXPECT_EQ(1, parser.GetSwitchCount());
+  EXPECT_TRUE(parser.HasSwitch(_T("install")));
+  EXPECT_EQ(2, parser.GetOptionalSwitchCount());
+  EXPECT_TRUE(parser.HasOptionalSwitch(_T("oem")));
+  EXPECT_TRUE(parser.HasOptionalSwitch(_T("appargs")));
+  EXPECT_SUCCEEDED(parser.GetOptionalSwitchArgumentCount(_T("appargs"),
+                                                         &arg_count));
+  EXPECT_EQ(2, arg_count);
+  EXPECT_SUCCEEDED(
+      parser.GetOptionalSwitchArgumentValue(_T("appargs"), 1, &arg_value));
+  EXPECT_STREQ(_T("[z"), arg_value);
+}
+
 }  // namespace omaha
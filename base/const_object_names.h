@@ -115,6 +115,14 @@ const TCHAR* const kRegistryAccessMutex =
 const TCHAR* const kOptUserIdLock =
     _T("{D19BAF17-7C87-467E-8D63-6C4B1C836373}");
 
+// Serializes access to the crash upload queue.
+const TCHAR* const kCrashUploadQueueLock =
+    _T("{D2F8F24C-7FAB-4AE2-ABE5-5F8E5647E990}");
+
+// Held by the process uploading the crashes from the crash upload queue.
+const TCHAR* const kCrashUploadQueueUploaderLock =
+    _T("{9FE1AF9F-EF7A-42B8-A5F3-07614D1B0C2D}");
+
 // The name of the shared memory objects containing the serialized COM
 // interface pointers exposed by the machine core.
 // TODO(omaha): Rename these constants to remove "GoogleUpdate".
@@ -256,6 +256,14 @@ const TCHAR* const kRegValueProxyHost               = _T("ProxyHost");
 const TCHAR* const kRegValueProxyPort               = _T("ProxyPort");
 const TCHAR* const kRegValueMID                     = _T("mid");
 
+// When set, the spans recorded by each process are written to a Chrome trace
+// event file in this directory when the process exits.
+const TCHAR* const kRegValueTraceDirectory          = _T("TraceDirectory");
+
+// When non-zero, the contention of the instrumented locks is recorded and
+// logged when the process exits. See base/lock_stats.h.
+const TCHAR* const kRegValueLockStats               = _T("LockStats");
+
 // The values below can be overriden in unofficial builds.
 const TCHAR* const kRegValueNameWindowsInstalling = _T("WindowsInstalling");
 
@@ -439,6 +439,10 @@ const ULONG kFacilityOmaha = 67;
 
 // Crash handling error codes.
 
+// The crash upload queue is full and the crash was discarded.
+#define GOOPDATE_E_CRASH_QUEUE_FULL                          \
+    MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0xFFF9)
+
 // The crash reporting cannot start the crash server for
 // out-of-process crash handling.
 #define GOOPDATE_E_CRASH_START_SERVER_FAILED                 \
@@ -209,6 +209,64 @@ TEST(ExtractorTest, AlreadyTaggedError) {
   extractor.CloseFile();
 }
 
+// The files tagged by BatchApplyTag are identical to the files tagged by
+// ApplyTag.
+TEST(BatchApplyTagTest, EmbedExtract) {
+  CString signed_exe_file;
+  signed_exe_file.Format(_T("%s\\%s\\%s"),
+                         app_util::GetCurrentModuleDirectory(),
+                         kFilePath, kFileName);
+
+  TCHAR temp_path[MAX_PATH] = {0};
+  ASSERT_NE(::GetTempPath(MAX_PATH, temp_path), 0);
+
+  omaha::BatchApplyTag batch;
+  ASSERT_HRESULT_SUCCEEDED(batch.Init(signed_exe_file, false));
+
+  const char* const tag_strings[] = {"a", kTagString, "appguid=1&lang=en"};
+  for (size_t i = 0; i != arraysize(tag_strings); ++i) {
+    const char* const tag_string = tag_strings[i];
+
+    CString tagged_file;
+    tagged_file.Format(_T("%sbatch%d%s"), temp_path, i, kFileName);
+    ASSERT_HRESULT_SUCCEEDED(batch.EmbedTagString(tag_string,
+                                                  strlen(tag_string),
+                                                  tagged_file));
+    ON_SCOPE_EXIT(::DeleteFile, tagged_file);
+
+    CString expected_tagged_file;
+    expected_tagged_file.Format(_T("%sexpected%d%s"), temp_path, i, kFileName);
+    omaha::ApplyTag tag;
+    ASSERT_HRESULT_SUCCEEDED(tag.Init(signed_exe_file,
+                                      tag_string,
+                                      strlen(tag_string),
+                                      expected_tagged_file,
+                                      false));
+    ASSERT_SUCCEEDED(tag.EmbedTagString());
+    ON_SCOPE_EXIT(::DeleteFile, expected_tagged_file);
+
+    std::vector<byte> tagged;
+    std::vector<byte> expected_tagged;
+    ASSERT_SUCCEEDED(ReadEntireFile(tagged_file, 0, &tagged));
+    ASSERT_SUCCEEDED(ReadEntireFile(expected_tagged_file, 0, &expected_tagged));
+    EXPECT_TRUE(tagged == expected_tagged);
+
+    TagExtractor extractor;
+    ASSERT_TRUE(extractor.OpenFile(tagged_file));
+    int tag_buffer_size = 0;
+    ASSERT_TRUE(extractor.ExtractTag(NULL, &tag_buffer_size));
+    ASSERT_EQ(strlen(tag_string) + 1, tag_buffer_size);
+    scoped_array<char> tag_buffer(new char[tag_buffer_size]);
+    ASSERT_TRUE(extractor.ExtractTag(tag_buffer.get(), &tag_buffer_size));
+    EXPECT_STREQ(tag_string, tag_buffer.get());
+    extractor.CloseFile();
+  }
+
+  EXPECT_EQ(E_INVALIDARG, batch.EmbedTagString("abcd asdf",
+                                               strlen("abcd asdf"),
+                                               _T("out.txt")));
+}
+
 TEST(ApplyTagTest, InvalidCharsTest) {
   // Accepted Regex = [-%{}/\a&=._]*
   CString signed_exe_file;
@@ -0,0 +1,191 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/lock_stats.h"
+#include <algorithm>
+#include "omaha/base/debug.h"
+#include "omaha/base/utils.h"
+
+namespace omaha {
+
+// Nothing here logs: the logging lock is instrumented and logging while a
+// sample is recorded would recurse.
+class LockStats::Entry {
+ public:
+  explicit Entry(const TCHAR* name) : name(name) {}
+
+  const CString name;
+  LLock lock;
+  Data data;    // Protected by lock.
+
+ private:
+  DISALLOW_EVIL_CONSTRUCTORS(Entry);
+};
+
+volatile LONG LockStats::is_enabled_ = 0;
+LockStatsObserver* volatile LockStats::observer_ = NULL;
+LockStats::EntryMap LockStats::entries_;
+LLock LockStats::lock_;
+
+namespace {
+
+bool IsWaitedForMore(const LockStats::Data& a, const LockStats::Data& b) {
+  return a.total_wait_us > b.total_wait_us;
+}
+
+}  // namespace
+
+LockStats::Data::Data()
+    : acquires(0),
+      contended_acquires(0),
+      total_wait_us(0),
+      max_wait_us(0),
+      total_hold_us(0) {
+  for (int i = 0; i != kNumBuckets; ++i) {
+    wait_buckets[i] = 0;
+    hold_buckets[i] = 0;
+  }
+}
+
+void LockStats::Enable(LockStatsObserver* observer) {
+  interlocked_exchange_pointer(&observer_, observer);
+  ::InterlockedExchange(&is_enabled_, 1);
+}
+
+void LockStats::Disable() {
+  ::InterlockedExchange(&is_enabled_, 0);
+  interlocked_exchange_pointer(&observer_,
+                               static_cast<LockStatsObserver*>(NULL));
+}
+
+LockStats::Entry* LockStats::GetEntry(const TCHAR* name) {
+  ASSERT1(name);
+
+  __mutexScope(lock_);
+  Entry*& entry = entries_[name];
+  if (!entry) {
+    entry = new Entry(name);
+  }
+  return entry;
+}
+
+void LockStats::Record(Entry* entry, ULONGLONG wait_ticks,
+                       ULONGLONG hold_ticks) {
+  ASSERT1(entry);
+
+  const int64 wait_us = TicksToUs(wait_ticks);
+  const int64 hold_us = TicksToUs(hold_ticks);
+
+  __mutexBlock(entry->lock) {
+    Data& data = entry->data;
+    ++data.acquires;
+    if (wait_us > 0) {
+      ++data.contended_acquires;
+    }
+    data.total_wait_us += wait_us;
+    data.max_wait_us = std::max(data.max_wait_us, wait_us);
+    data.total_hold_us += hold_us;
+    ++data.wait_buckets[GetBucketIndex(wait_us)];
+    ++data.hold_buckets[GetBucketIndex(hold_us)];
+
+    // Inserts the hold in the list of the longest holds, if it belongs there.
+    int i = kNumLongestHolds;
+    while (i > 0 && data.longest_holds[i - 1].hold_us < hold_us) {
+      if (i < kNumLongestHolds) {
+        data.longest_holds[i] = data.longest_holds[i - 1];
+      }
+      --i;
+    }
+    if (i < kNumLongestHolds) {
+      data.longest_holds[i].thread_id = ::GetCurrentThreadId();
+      data.longest_holds[i].hold_us = hold_us;
+    }
+  }
+
+  // Reads the observer with a full barrier, without writing to it.
+  LockStatsObserver* observer = static_cast<LockStatsObserver*>(
+      ::InterlockedCompareExchangePointer(
+          reinterpret_cast<PVOID volatile*>(&observer_), NULL, NULL));
+  if (observer) {
+    observer->OnLockReleased(entry->name, wait_us, hold_us);
+  }
+}
+
+void LockStats::GetStats(std::vector<Data>* stats) {
+  ASSERT1(stats);
+
+  __mutexScope(lock_);
+  for (EntryMap::const_iterator it = entries_.begin();
+       it != entries_.end();
+       ++it) {
+    __mutexScope(it->second->lock);
+    stats->push_back(it->second->data);
+    stats->back().name = it->second->name;
+  }
+  std::stable_sort(stats->begin(), stats->end(), IsWaitedForMore);
+}
+
+void LockStats::Dump(CString* text) {
+  ASSERT1(text);
+
+  std::vector<Data> stats;
+  GetStats(&stats);
+
+  for (size_t i = 0; i != stats.size(); ++i) {
+    const Data& data = stats[i];
+    text->AppendFormat(_T("[%s][acquires %u][contended %u]")
+                       _T("[wait us total %I64d max %I64d]")
+                       _T("[hold us total %I64d]"),
+                       data.name,
+                       data.acquires,
+                       data.contended_acquires,
+                       data.total_wait_us,
+                       data.max_wait_us,
+                       data.total_hold_us);
+    for (int j = 0; j != kNumLongestHolds; ++j) {
+      const Hold& hold = data.longest_holds[j];
+      if (hold.hold_us) {
+        text->AppendFormat(_T("[held %I64d us by thread %u]"),
+                           hold.hold_us, hold.thread_id);
+      }
+    }
+    text->Append(_T("\r\n"));
+  }
+}
+
+void LockStats::Clear() {
+  __mutexScope(lock_);
+  for (EntryMap::iterator it = entries_.begin(); it != entries_.end(); ++it) {
+    __mutexScope(it->second->lock);
+    it->second->data = Data();
+  }
+}
+
+int LockStats::GetBucketIndex(int64 us) {
+  int index = 0;
+  while (us > 0 && index < kNumBuckets - 1) {
+    us >>= 1;
+    ++index;
+  }
+  return index;
+}
+
+int64 LockStats::TicksToUs(ULONGLONG ticks) {
+  const ULONGLONG frequency = HighresTimer::GetTimerFrequency();
+  ASSERT1(frequency);
+  return static_cast<int64>(ticks * 1000000 / frequency);
+}
+
+}  // namespace omaha
@@ -0,0 +1,216 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// Opt-in lock contention statistics. A lock is instrumented by declaring it
+// as an InstrumentedLock of an LLock or a GLock, with a name:
+//
+//   InstrumentedLock<LLock> lock_(_T("AppBundle"));
+//
+// When the statistics are enabled, each outermost acquisition of the lock
+// records how long the caller waited for it and how long it was then held.
+// The samples of all the locks with the same name are aggregated, so all the
+// bundle locks, for instance, are reported together. When the statistics are
+// disabled, an instrumented lock costs a check of a global flag.
+
+#ifndef OMAHA_BASE_LOCK_STATS_H_
+#define OMAHA_BASE_LOCK_STATS_H_
+
+#include <windows.h>
+#include <atlstr.h>
+#include <map>
+#include <vector>
+#include "base/basictypes.h"
+#include "omaha/base/debug.h"
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/synchronized.h"
+
+namespace omaha {
+
+// Receives the samples as they are recorded, for instance to feed metrics.
+class LockStatsObserver {
+ public:
+  virtual ~LockStatsObserver() {}
+
+  // Called after an instrumented lock is released, on the releasing thread and
+  // without the lock held.
+  virtual void OnLockReleased(const TCHAR* name,
+                              int64 wait_us,
+                              int64 hold_us) = 0;
+};
+
+class LockStats {
+ public:
+  // The histograms have a bucket for waits and holds under 1 us, then a bucket
+  // for each power of two of microseconds. The last bucket counts everything
+  // from 2^(kNumBuckets - 2) us, about 4 seconds, up.
+  static const int kNumBuckets = 24;
+
+  // The number of longest holds kept for each lock name.
+  static const int kNumLongestHolds = 4;
+
+  struct Hold {
+    Hold() : thread_id(0), hold_us(0) {}
+
+    DWORD thread_id;
+    int64 hold_us;
+  };
+
+  struct Data {
+    Data();
+
+    CString name;
+    uint32 acquires;
+    uint32 contended_acquires;    // Acquires that waited at least 1 us.
+    int64 total_wait_us;
+    int64 max_wait_us;
+    int64 total_hold_us;
+    uint32 wait_buckets[kNumBuckets];
+    uint32 hold_buckets[kNumBuckets];
+    Hold longest_holds[kNumLongestHolds];   // Longest first.
+  };
+
+  // The statistics of the locks that share a name.
+  class Entry;
+
+  // Starts recording. The observer is not owned and may be NULL. It must stay
+  // valid until Disable() is called and the locks in use are released.
+  static void Enable(LockStatsObserver* observer);
+
+  // Stops recording. The statistics recorded so far are kept.
+  static void Disable();
+
+  static bool IsEnabled() { return is_enabled_ != 0; }
+
+  // Returns the entry for the name, creating it if needed. The name must be a
+  // string literal. Entries live until the process exits.
+  static Entry* GetEntry(const TCHAR* name);
+
+  // Adds a sample to the entry.
+  static void Record(Entry* entry, ULONGLONG wait_ticks, ULONGLONG hold_ticks);
+
+  // Returns the statistics of each lock name, the most waited for first.
+  static void GetStats(std::vector<Data>* stats);
+
+  // Formats the statistics of each lock name as text, one line per name
+  // followed by the longest holds.
+  static void Dump(CString* text);
+
+  // Discards the statistics recorded so far.
+  static void Clear();
+
+  // Returns the histogram bucket of a duration in microseconds.
+  static int GetBucketIndex(int64 us);
+
+ private:
+  typedef std::map<CString, Entry*> EntryMap;
+
+  static int64 TicksToUs(ULONGLONG ticks);
+
+  static volatile LONG is_enabled_;
+  static LockStatsObserver* volatile observer_;
+  static EntryMap entries_;
+  static LLock lock_;
+
+  DISALLOW_IMPLICIT_CONSTRUCTORS(LockStats);
+};
+
+// Wraps an LLock or a GLock and records its statistics. The lock is used the
+// same way as the lock it wraps, and can be passed where the wrapped type is
+// expected.
+template <typename T>
+class InstrumentedLock : public T {
+ public:
+  explicit InstrumentedLock(const TCHAR* name)
+      : name_(name),
+        entry_(NULL),
+        depth_(0),
+        acquire_ticks_(0),
+        wait_ticks_(0) {
+    ASSERT1(name);
+  }
+
+  virtual bool Lock() const {
+    const ULONGLONG start_ticks = GetStartTicks();
+    return OnAcquired(T::Lock(), start_ticks);
+  }
+
+  virtual bool Lock(DWORD wait_ms) const {
+    const ULONGLONG start_ticks = GetStartTicks();
+    return OnAcquired(T::Lock(wait_ms), start_ticks);
+  }
+
+  virtual bool Unlock() const {
+    ASSERT1(depth_ > 0);
+    if (--depth_ != 0 || !acquire_ticks_) {
+      return T::Unlock();
+    }
+
+    const ULONGLONG hold_ticks =
+        HighresTimer::GetCurrentTicks() - acquire_ticks_;
+    const ULONGLONG wait_ticks = wait_ticks_;
+    acquire_ticks_ = 0;
+
+    // The sample is recorded after the release so that recording does not
+    // add to the hold time seen by the waiters.
+    const bool result = T::Unlock();
+    LockStats::Record(GetEntry(), wait_ticks, hold_ticks);
+    return result;
+  }
+
+  const TCHAR* name() const { return name_; }
+
+ private:
+  static ULONGLONG GetStartTicks() {
+    return LockStats::IsEnabled() ? HighresTimer::GetCurrentTicks() : 0;
+  }
+
+  // Tracks the recursion depth, which is only modified by the owner, and times
+  // the outermost acquisition if the statistics were enabled when it started.
+  bool OnAcquired(bool is_acquired, ULONGLONG start_ticks) const {
+    if (!is_acquired) {
+      return false;
+    }
+
+    if (depth_++ == 0 && start_ticks) {
+      acquire_ticks_ = HighresTimer::GetCurrentTicks();
+      wait_ticks_ = acquire_ticks_ - start_ticks;
+    }
+    return true;
+  }
+
+  // Threads racing to cache the entry all store the same pointer.
+  LockStats::Entry* GetEntry() const {
+    LockStats::Entry* entry = entry_;
+    if (!entry) {
+      entry = LockStats::GetEntry(name_);
+      entry_ = entry;
+    }
+    return entry;
+  }
+
+  const TCHAR* const name_;
+  mutable LockStats::Entry* volatile entry_;
+
+  // Owned by the thread that holds the lock.
+  mutable int depth_;
+  mutable ULONGLONG acquire_ticks_;
+  mutable ULONGLONG wait_ticks_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(InstrumentedLock);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_BASE_LOCK_STATS_H_
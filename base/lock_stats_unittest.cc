@@ -0,0 +1,197 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <vector>
+#include "omaha/base/lock_stats.h"
+#include "omaha/base/thread.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+class RecordingObserver : public LockStatsObserver {
+ public:
+  RecordingObserver() : num_samples_(0), hold_us_(0) {}
+
+  virtual void OnLockReleased(const TCHAR* name,
+                              int64 wait_us,
+                              int64 hold_us) {
+    UNREFERENCED_PARAMETER(wait_us);
+    name_ = name;
+    ++num_samples_;
+    hold_us_ = hold_us;
+  }
+
+  CString name_;
+  int num_samples_;
+  int64 hold_us_;
+};
+
+class LockRunnable : public Runnable {
+ public:
+  explicit LockRunnable(const LLock* lock) : lock_(lock) {}
+  virtual void Run() {
+    __mutexScope(*lock_);
+  }
+
+ private:
+  const LLock* lock_;
+};
+
+const LockStats::Data* FindStats(const std::vector<LockStats::Data>& stats,
+                                 const TCHAR* name) {
+  for (size_t i = 0; i != stats.size(); ++i) {
+    if (stats[i].name == name) {
+      return &stats[i];
+    }
+  }
+  return NULL;
+}
+
+}  // namespace
+
+class LockStatsTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    LockStats::Disable();
+    LockStats::Clear();
+  }
+
+  virtual void TearDown() {
+    LockStats::Disable();
+    LockStats::Clear();
+  }
+};
+
+TEST_F(LockStatsTest, GetBucketIndex) {
+  EXPECT_EQ(0, LockStats::GetBucketIndex(0));
+  EXPECT_EQ(1, LockStats::GetBucketIndex(1));
+  EXPECT_EQ(2, LockStats::GetBucketIndex(2));
+  EXPECT_EQ(2, LockStats::GetBucketIndex(3));
+  EXPECT_EQ(3, LockStats::GetBucketIndex(4));
+  EXPECT_EQ(11, LockStats::GetBucketIndex(1024));
+  EXPECT_EQ(LockStats::kNumBuckets - 1,
+            LockStats::GetBucketIndex(kint64max));
+}
+
+TEST_F(LockStatsTest, Disabled) {
+  InstrumentedLock<LLock> lock(_T("LockStatsTest.Disabled"));
+  {
+    __mutexScope(lock);
+  }
+
+  std::vector<LockStats::Data> stats;
+  LockStats::GetStats(&stats);
+  EXPECT_TRUE(FindStats(stats, _T("LockStatsTest.Disabled")) == NULL);
+}
+
+TEST_F(LockStatsTest, Acquires) {
+  RecordingObserver observer;
+  LockStats::Enable(&observer);
+
+  InstrumentedLock<LLock> lock(_T("LockStatsTest.Acquires"));
+  for (int i = 0; i != 3; ++i) {
+    __mutexScope(lock);
+    ::Sleep(2);
+  }
+
+  std::vector<LockStats::Data> stats;
+  LockStats::GetStats(&stats);
+  const LockStats::Data* data = FindStats(stats, _T("LockStatsTest.Acquires"));
+  ASSERT_TRUE(data != NULL);
+  EXPECT_EQ(3, data->acquires);
+  EXPECT_LE(3 * 1000, data->total_hold_us);
+
+  uint32 num_holds = 0;
+  for (int i = 0; i != LockStats::kNumBuckets; ++i) {
+    num_holds += data->hold_buckets[i];
+  }
+  EXPECT_EQ(3, num_holds);
+
+  // The longest holds are sorted and attributed to this thread.
+  EXPECT_EQ(::GetCurrentThreadId(), data->longest_holds[0].thread_id);
+  EXPECT_GE(data->longest_holds[0].hold_us, data->longest_holds[1].hold_us);
+  EXPECT_GE(data->longest_holds[1].hold_us, data->longest_holds[2].hold_us);
+  EXPECT_EQ(0, data->longest_holds[3].hold_us);
+
+  EXPECT_STREQ(_T("LockStatsTest.Acquires"), observer.name_);
+  EXPECT_EQ(3, observer.num_samples_);
+}
+
+// Only the outermost acquisition of a recursive lock is recorded.
+TEST_F(LockStatsTest, Recursion) {
+  LockStats::Enable(NULL);
+
+  InstrumentedLock<LLock> lock(_T("LockStatsTest.Recursion"));
+  {
+    __mutexScope(lock);
+    __mutexScope(lock);
+  }
+
+  std::vector<LockStats::Data> stats;
+  LockStats::GetStats(&stats);
+  const LockStats::Data* data = FindStats(stats, _T("LockStatsTest.Recursion"));
+  ASSERT_TRUE(data != NULL);
+  EXPECT_EQ(1, data->acquires);
+}
+
+TEST_F(LockStatsTest, Contention) {
+  LockStats::Enable(NULL);
+
+  InstrumentedLock<LLock> lock(_T("LockStatsTest.Contention"));
+  LockRunnable runnable(&lock);
+  Thread thread;
+  __mutexBlock(lock) {
+    ASSERT_TRUE(thread.Start(&runnable));
+    ::Sleep(50);
+  }
+  ASSERT_TRUE(thread.WaitTillExit(INFINITE));
+
+  std::vector<LockStats::Data> stats;
+  LockStats::GetStats(&stats);
+  const LockStats::Data* data =
+      FindStats(stats, _T("LockStatsTest.Contention"));
+  ASSERT_TRUE(data != NULL);
+  EXPECT_EQ(2, data->acquires);
+  EXPECT_EQ(1, data->contended_acquires);
+  EXPECT_LE(10 * 1000, data->max_wait_us);
+
+  // The contended lock is listed first.
+  EXPECT_STREQ(_T("LockStatsTest.Contention"), stats[0].name);
+
+  CString text;
+  LockStats::Dump(&text);
+  EXPECT_NE(-1, text.Find(_T("[LockStatsTest.Contention][acquires 2]")));
+}
+
+TEST_F(LockStatsTest, Clear) {
+  LockStats::Enable(NULL);
+
+  InstrumentedLock<LLock> lock(_T("LockStatsTest.Clear"));
+  {
+    __mutexScope(lock);
+  }
+  LockStats::Clear();
+
+  std::vector<LockStats::Data> stats;
+  LockStats::GetStats(&stats);
+  const LockStats::Data* data = FindStats(stats, _T("LockStatsTest.Clear"));
+  ASSERT_TRUE(data != NULL);
+  EXPECT_EQ(0, data->acquires);
+  EXPECT_EQ(0, data->total_hold_us);
+}
+
+}  // namespace omaha
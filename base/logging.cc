@@ -186,6 +186,7 @@ Logging::Logging()
       debug_out_writer_(NULL),
       etw_log_writer_(NULL),
       is_initializing_(false),
+      lock_(_T("Logging")),
       log_file_name_(kDefaultLogFileName),
       config_file_path_(GetConfigurationFilePath()) {
   g_last_category_check_time = 0;
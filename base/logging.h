@@ -22,6 +22,7 @@
 #define OMAHA_BASE_LOGGING_H_
 
 #include "omaha/base/constants.h"
+#include "omaha/base/lock_stats.h"
 #include "omaha/base/synchronized.h"
 #include "omaha/base/time.h"
 
@@ -437,7 +438,7 @@ class Logging {
   CString proc_name_;
 
   // Serializes changing logging init/uninit/enable/disable status.
-  LLock lock_;
+  InstrumentedLock<LLock> lock_;
 
   // Bunch of settings from the config .ini file.
   bool logging_enabled_;     // Checks if logging is enabled.
@@ -33,6 +33,7 @@
 #include "omaha/base/disk.h"
 #include "omaha/base/error.h"
 #include "omaha/base/logging.h"
+#include "omaha/base/process_index.h"
 #include "omaha/base/scoped_any.h"
 #include "omaha/base/string.h"
 #include "omaha/base/system.h"
@@ -710,29 +711,24 @@ HRESULT Process::FindProcesses(uint32 exclude_mask,
   // Clear the output queue
   process_ids_found->clear();
 
-  // Get the list of process identifiers.
-  uint32 process_ids[kMaxProcesses] = {0};
-  uint32 bytes_returned = 0;
-  if (!::EnumProcesses(reinterpret_cast<DWORD*>(process_ids),
-                       sizeof(process_ids),
-                       reinterpret_cast<DWORD*>(&bytes_returned))) {
-    HRESULT hr = HRESULTFromLastError();
+  // In Vista, SeDebugPrivilege is required to open the process not owned by
+  // current user. Also required for XP admins to open Local System processes
+  // with PROCESS_QUERY_INFORMATION access rights.
+  System::AdjustPrivilege(SE_DEBUG_NAME, true);
+
+  // Get the list of process identifiers. The owners and the command lines of
+  // the processes are cached by the index.
+  ProcessIndex& process_index = ProcessIndex::Instance();
+  std::vector<uint32> process_ids;
+  HRESULT hr = process_index.Refresh(&process_ids);
+  if (FAILED(hr)) {
     UTIL_LOG(LEVEL_ERROR, (_T("[Process::FindProcesses-fail to EnumProcesses]")
                            _T("[0x%x]"), hr));
     return hr;
   }
 
   // Enumerate all processes
-  int num_processes = bytes_returned / sizeof(process_ids[0]);
-  // We have found an elevated number of crashes in 1.2.584.15114 on what
-  // we believe are Italian systems. The first step to solving this Italian job
-  // is to assert on the condition while we are further testing this.
-  ASSERT1(num_processes <= kMaxProcesses);
-
-  // In Vista, SeDebugPrivilege is required to open the process not owned by
-  // current user. Also required for XP admins to open Local System processes
-  // with PROCESS_QUERY_INFORMATION access rights.
-  System::AdjustPrivilege(SE_DEBUG_NAME, true);
+  const int num_processes = process_ids.size();
 
   const uint32 cur_process_id = ::GetCurrentProcessId();
 
@@ -740,13 +736,13 @@ HRESULT Process::FindProcesses(uint32 exclude_mask,
   if (exclude_mask & EXCLUDE_PARENT_PROCESS) {
     Process current_process(cur_process_id);
     uint32 ppid = 0;
-    HRESULT hr = current_process.GetParentProcessId(&ppid);
+    hr = current_process.GetParentProcessId(&ppid);
     parent_process_id = SUCCEEDED(hr) ? ppid : 0;
   }
 
   // Get SID of current user
   CString cur_user_sid;
-  HRESULT hr = omaha::user_info::GetProcessUser(NULL, NULL, &cur_user_sid);
+  hr = omaha::user_info::GetProcessUser(NULL, NULL, &cur_user_sid);
   if (FAILED(hr)) {
     return hr;
   }
@@ -779,7 +775,7 @@ HRESULT Process::FindProcesses(uint32 exclude_mask,
     // So if the owner_sid is empty, the process is sure not to be owned by the
     // current user.
     CString owner_sid;
-    Process::GetProcessOwner(process_ids[i], &owner_sid);
+    process_index.GetOwner(process_ids[i], &owner_sid);
 
     if ((exclude_mask & INCLUDE_ONLY_PROCESS_OWNED_BY_USER) &&
       owner_sid != user_sid) {
@@ -804,7 +800,8 @@ HRESULT Process::FindProcesses(uint32 exclude_mask,
     if (exclude_mask & EXCLUDE_PROCESS_COMMAND_LINE_CONTAINING_STRING ||
         exclude_mask & INCLUDE_PROCESS_COMMAND_LINE_CONTAINING_STRING) {
       CString process_command_line;
-      HRESULT hr = GetCommandLine(process_ids[i], &process_command_line);
+      HRESULT hr = process_index.GetCommandLine(process_ids[i],
+                                                &process_command_line);
       if (FAILED(hr)) {
         UTIL_LOG(L4,
           (_T("[Excluding process could not get command line][%d]"),
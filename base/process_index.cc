@@ -0,0 +1,208 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/process_index.h"
+#include <psapi.h>
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/process.h"
+#include "omaha/base/scoped_any.h"
+
+namespace omaha {
+
+namespace {
+
+class Win32ProcessSource : public ProcessSourceInterface {
+ public:
+  Win32ProcessSource() {}
+
+  virtual HRESULT GetProcessIds(std::vector<uint32>* process_ids) {
+    ASSERT1(process_ids);
+
+    uint32 ids[kMaxProcesses] = {0};
+    uint32 bytes_returned = 0;
+    if (!::EnumProcesses(reinterpret_cast<DWORD*>(ids),
+                         sizeof(ids),
+                         reinterpret_cast<DWORD*>(&bytes_returned))) {
+      HRESULT hr = HRESULTFromLastError();
+      UTIL_LOG(LE, (_T("[EnumProcesses failed][0x%x]"), hr));
+      return hr;
+    }
+
+    const int num_processes = bytes_returned / sizeof(ids[0]);
+    ASSERT1(num_processes <= kMaxProcesses);
+    process_ids->assign(ids, ids + num_processes);
+    return S_OK;
+  }
+
+  virtual ULONGLONG GetStartTime(uint32 process_id) {
+    scoped_process process(::OpenProcess(PROCESS_QUERY_INFORMATION,
+                                         false,
+                                         process_id));
+    if (!valid(process)) {
+      return 0;
+    }
+
+    FILETIME creation_time = {0};
+    FILETIME exit_time = {0};
+    FILETIME kernel_time = {0};
+    FILETIME user_time = {0};
+    if (!::GetProcessTimes(get(process),
+                           &creation_time,
+                           &exit_time,
+                           &kernel_time,
+                           &user_time)) {
+      return 0;
+    }
+
+    ULARGE_INTEGER start_time = {0};
+    start_time.LowPart = creation_time.dwLowDateTime;
+    start_time.HighPart = creation_time.dwHighDateTime;
+    return start_time.QuadPart;
+  }
+
+  virtual HRESULT GetOwner(uint32 process_id, CString* owner_sid) {
+    return Process::GetProcessOwner(process_id, owner_sid);
+  }
+
+  virtual HRESULT GetCommandLine(uint32 process_id, CString* command_line) {
+    return Process::GetCommandLine(process_id, command_line);
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Win32ProcessSource);
+};
+
+}  // namespace
+
+ProcessIndex* ProcessIndex::instance_ = NULL;
+LLock ProcessIndex::instance_lock_;
+
+ProcessIndex::ProcessIndex(ProcessSourceInterface* source) : source_(source) {
+  ASSERT1(source);
+}
+
+ProcessIndex& ProcessIndex::Instance() {
+  __mutexScope(instance_lock_);
+  if (!instance_) {
+    instance_ = new ProcessIndex(new Win32ProcessSource);
+  }
+  return *instance_;
+}
+
+void ProcessIndex::DeleteInstance() {
+  __mutexScope(instance_lock_);
+  delete instance_;
+  instance_ = NULL;
+}
+
+HRESULT ProcessIndex::Refresh(std::vector<uint32>* process_ids) {
+  ASSERT1(process_ids);
+
+  HRESULT hr = source_->GetProcessIds(process_ids);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  // The start times are read without the lock held.
+  std::vector<ULONGLONG> start_times(process_ids->size());
+  for (size_t i = 0; i != process_ids->size(); ++i) {
+    const uint32 process_id = (*process_ids)[i];
+    start_times[i] = process_id ? source_->GetStartTime(process_id) : 0;
+  }
+
+  __mutexScope(lock_);
+
+  // Keeps the entries of the processes that are still running and adds the
+  // new processes. A process with the same id and a different start time is a
+  // new process.
+  EntryMap entries;
+  int num_new_processes = 0;
+  for (size_t i = 0; i != process_ids->size(); ++i) {
+    Entry& entry = entries[(*process_ids)[i]];
+    EntryMap::iterator it = entries_.find((*process_ids)[i]);
+    if (it != entries_.end() && it->second.start_time == start_times[i]) {
+      entry = it->second;
+    } else {
+      entry.start_time = start_times[i];
+      ++num_new_processes;
+    }
+  }
+  entries_.swap(entries);
+
+  UTIL_LOG(L4, (_T("[ProcessIndex::Refresh][processes=%u][new=%d]"),
+                process_ids->size(), num_new_processes));
+  return S_OK;
+}
+
+HRESULT ProcessIndex::GetOwner(uint32 process_id, CString* owner_sid) {
+  return GetAttribute(process_id,
+                      &Entry::has_owner,
+                      &Entry::owner_sid,
+                      &ProcessSourceInterface::GetOwner,
+                      owner_sid);
+}
+
+HRESULT ProcessIndex::GetCommandLine(uint32 process_id, CString* command_line) {
+  return GetAttribute(process_id,
+                      &Entry::has_command_line,
+                      &Entry::command_line,
+                      &ProcessSourceInterface::GetCommandLine,
+                      command_line);
+}
+
+HRESULT ProcessIndex::GetAttribute(uint32 process_id,
+                                   bool Entry::*has_value,
+                                   CString Entry::*value,
+                                   ReadFun read,
+                                   CString* result) {
+  ASSERT1(result);
+
+  ULONGLONG start_time = 0;
+  __mutexBlock(lock_) {
+    EntryMap::const_iterator it = entries_.find(process_id);
+    if (it != entries_.end()) {
+      if (it->second.*has_value) {
+        *result = it->second.*value;
+        return S_OK;
+      }
+      start_time = it->second.start_time;
+    }
+  }
+
+  CString read_value;
+  HRESULT hr = (source_.get()->*read)(process_id, &read_value);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  // The value is only cached if the process can be told apart from a later
+  // process with the same id, and is still the process found by the last
+  // refresh.
+  __mutexBlock(lock_) {
+    EntryMap::iterator it = entries_.find(process_id);
+    if (start_time && it != entries_.end() &&
+        it->second.start_time == start_time) {
+      it->second.*has_value = true;
+      it->second.*value = read_value;
+    }
+  }
+
+  *result = read_value;
+  return S_OK;
+}
+
+}  // namespace omaha
@@ -0,0 +1,108 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// ProcessIndex caches the attributes of the running processes that are
+// expensive to read, the owner and the command line, so that searching the
+// processes repeatedly, as setup and the shutdown handling do, only reads them
+// for the processes started since the previous search.
+//
+// A process is identified by its id and its start time, since ids are reused.
+// Refresh() enumerates the processes and reads their start times; the other
+// attributes are read when first requested. Failures to read an attribute, and
+// the attributes of the processes whose start time cannot be read, are not
+// cached.
+
+#ifndef OMAHA_BASE_PROCESS_INDEX_H_
+#define OMAHA_BASE_PROCESS_INDEX_H_
+
+#include <windows.h>
+#include <atlstr.h>
+#include <map>
+#include <vector>
+#include "base/basictypes.h"
+#include "base/scoped_ptr.h"
+#include "omaha/base/synchronized.h"
+
+namespace omaha {
+
+// Reads the processes from the system. Replaced in the unit tests.
+class ProcessSourceInterface {
+ public:
+  virtual ~ProcessSourceInterface() {}
+
+  virtual HRESULT GetProcessIds(std::vector<uint32>* process_ids) = 0;
+
+  // Returns the creation time of the process, or 0 if it cannot be read.
+  virtual ULONGLONG GetStartTime(uint32 process_id) = 0;
+
+  virtual HRESULT GetOwner(uint32 process_id, CString* owner_sid) = 0;
+  virtual HRESULT GetCommandLine(uint32 process_id, CString* command_line) = 0;
+};
+
+class ProcessIndex {
+ public:
+  // Takes ownership of the source.
+  explicit ProcessIndex(ProcessSourceInterface* source);
+
+  // Returns the index of the processes of the system.
+  static ProcessIndex& Instance();
+  static void DeleteInstance();
+
+  // Enumerates the processes, drops the processes that have exited and
+  // returns the ids of the running processes.
+  HRESULT Refresh(std::vector<uint32>* process_ids);
+
+  // Return the attributes of a process found by the last Refresh, reading them
+  // if they are not cached.
+  HRESULT GetOwner(uint32 process_id, CString* owner_sid);
+  HRESULT GetCommandLine(uint32 process_id, CString* command_line);
+
+ private:
+  struct Entry {
+    Entry() : start_time(0), has_owner(false), has_command_line(false) {}
+
+    ULONGLONG start_time;
+    bool has_owner;
+    bool has_command_line;
+    CString owner_sid;
+    CString command_line;
+  };
+
+  typedef std::map<uint32, Entry> EntryMap;
+  typedef HRESULT (ProcessSourceInterface::*ReadFun)(uint32, CString*);
+
+  // Returns the cached attribute of the process or reads it from the source
+  // and caches it. The source is called without lock_ held.
+  HRESULT GetAttribute(uint32 process_id,
+                       bool Entry::*has_value,
+                       CString Entry::*value,
+                       ReadFun read,
+                       CString* result);
+
+  scoped_ptr<ProcessSourceInterface> source_;
+
+  EntryMap entries_;    // Protected by lock_.
+  LLock lock_;
+
+  static ProcessIndex* instance_;
+  static LLock instance_lock_;
+
+  friend class ProcessIndexTest;
+  DISALLOW_COPY_AND_ASSIGN(ProcessIndex);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_BASE_PROCESS_INDEX_H_
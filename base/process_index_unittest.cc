@@ -0,0 +1,163 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <map>
+#include <vector>
+#include "omaha/base/process_index.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+class FakeProcessSource : public ProcessSourceInterface {
+ public:
+  FakeProcessSource()
+      : fail_command_line_(false),
+        num_owner_reads_(0),
+        num_command_line_reads_(0) {}
+
+  virtual HRESULT GetProcessIds(std::vector<uint32>* process_ids) {
+    process_ids->clear();
+    for (std::map<uint32, ULONGLONG>::const_iterator it = processes_.begin();
+         it != processes_.end();
+         ++it) {
+      process_ids->push_back(it->first);
+    }
+    return S_OK;
+  }
+
+  virtual ULONGLONG GetStartTime(uint32 process_id) {
+    return processes_[process_id];
+  }
+
+  virtual HRESULT GetOwner(uint32 process_id, CString* owner_sid) {
+    ++num_owner_reads_;
+    owner_sid->Format(_T("S-1-5-%u"), process_id);
+    return S_OK;
+  }
+
+  virtual HRESULT GetCommandLine(uint32 process_id, CString* command_line) {
+    ++num_command_line_reads_;
+    if (fail_command_line_) {
+      return E_ACCESSDENIED;
+    }
+    command_line->Format(_T("process%u.exe /%I64u"),
+                         process_id, processes_[process_id]);
+    return S_OK;
+  }
+
+  // Maps the process ids to their start times.
+  std::map<uint32, ULONGLONG> processes_;
+  bool fail_command_line_;
+  int num_owner_reads_;
+  int num_command_line_reads_;
+};
+
+}  // namespace
+
+class ProcessIndexTest : public testing::Test {
+ protected:
+  ProcessIndexTest() : source_(new FakeProcessSource), index_(source_) {
+    source_->processes_[4] = 100;
+    source_->processes_[8] = 200;
+  }
+
+  bool IsIndexed(uint32 process_id) const {
+    return index_.entries_.find(process_id) != index_.entries_.end();
+  }
+
+  FakeProcessSource* source_;   // Owned by index_.
+  ProcessIndex index_;
+};
+
+TEST_F(ProcessIndexTest, CachesAttributes) {
+  std::vector<uint32> process_ids;
+  EXPECT_SUCCEEDED(index_.Refresh(&process_ids));
+  ASSERT_EQ(2, process_ids.size());
+
+  CString owner_sid;
+  CString command_line;
+  for (int i = 0; i != 2; ++i) {
+    EXPECT_SUCCEEDED(index_.GetOwner(4, &owner_sid));
+    EXPECT_STREQ(_T("S-1-5-4"), owner_sid);
+    EXPECT_SUCCEEDED(index_.GetCommandLine(4, &command_line));
+    EXPECT_STREQ(_T("process4.exe /100"), command_line);
+    EXPECT_SUCCEEDED(index_.Refresh(&process_ids));
+  }
+
+  EXPECT_EQ(1, source_->num_owner_reads_);
+  EXPECT_EQ(1, source_->num_command_line_reads_);
+}
+
+// A process that reuses the id of a process that exited is read again.
+TEST_F(ProcessIndexTest, ProcessIdReused) {
+  std::vector<uint32> process_ids;
+  EXPECT_SUCCEEDED(index_.Refresh(&process_ids));
+
+  CString command_line;
+  EXPECT_SUCCEEDED(index_.GetCommandLine(8, &command_line));
+  EXPECT_STREQ(_T("process8.exe /200"), command_line);
+
+  source_->processes_[8] = 300;
+  EXPECT_SUCCEEDED(index_.Refresh(&process_ids));
+  EXPECT_SUCCEEDED(index_.GetCommandLine(8, &command_line));
+  EXPECT_STREQ(_T("process8.exe /300"), command_line);
+  EXPECT_EQ(2, source_->num_command_line_reads_);
+}
+
+TEST_F(ProcessIndexTest, ProcessExited) {
+  std::vector<uint32> process_ids;
+  EXPECT_SUCCEEDED(index_.Refresh(&process_ids));
+
+  CString owner_sid;
+  EXPECT_SUCCEEDED(index_.GetOwner(4, &owner_sid));
+
+  source_->processes_.erase(4);
+  EXPECT_SUCCEEDED(index_.Refresh(&process_ids));
+  ASSERT_EQ(1, process_ids.size());
+  EXPECT_EQ(8, process_ids[0]);
+  EXPECT_FALSE(IsIndexed(4));
+  EXPECT_TRUE(IsIndexed(8));
+}
+
+TEST_F(ProcessIndexTest, FailuresNotCached) {
+  std::vector<uint32> process_ids;
+  EXPECT_SUCCEEDED(index_.Refresh(&process_ids));
+
+  CString command_line;
+  source_->fail_command_line_ = true;
+  EXPECT_EQ(E_ACCESSDENIED, index_.GetCommandLine(4, &command_line));
+
+  source_->fail_command_line_ = false;
+  EXPECT_SUCCEEDED(index_.GetCommandLine(4, &command_line));
+  EXPECT_STREQ(_T("process4.exe /100"), command_line);
+  EXPECT_EQ(2, source_->num_command_line_reads_);
+}
+
+// Without a start time, a process cannot be told apart from a later process
+// with the same id, so its attributes are not cached.
+TEST_F(ProcessIndexTest, NoStartTime) {
+  source_->processes_[12] = 0;
+  std::vector<uint32> process_ids;
+  EXPECT_SUCCEEDED(index_.Refresh(&process_ids));
+
+  CString owner_sid;
+  EXPECT_SUCCEEDED(index_.GetOwner(12, &owner_sid));
+  EXPECT_SUCCEEDED(index_.GetOwner(12, &owner_sid));
+  EXPECT_EQ(2, source_->num_owner_reads_);
+}
+
+}  // namespace omaha
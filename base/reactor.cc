@@ -16,7 +16,6 @@
 
 #include "omaha/base/reactor.h"
 
-#include <vector>
 #include "base/scoped_ptr.h"
 #include "omaha/base/debug.h"
 #include "omaha/base/error.h"
@@ -83,22 +82,19 @@ HRESULT Reactor::RegisterHandle(HANDLE handle,
   // callback and reenter the reactor on a different thread.
   // Acquire the critical section before registering the handle.
   ::EnterCriticalSection(&cs_);
-#if DEBUG
-  // The same handle should not be registered multiple times.
-  std::vector<RegistrationState*>::iterator it = handlers_.begin();
-  for (; it != handlers_.end(); ++it) {
-    ASSERT((*it)->handle != handle, (_T("[already registered %d]"), handle));
-  }
-#endif
-  bool res = !!::RegisterWaitForSingleObject(&state->wait_handle,
-                                             state->handle,
-                                             &Reactor::Callback,
-                                             state.get(),
-                                             INFINITE,
-                                             state->flags);
-  HRESULT hr = res ? S_OK : HRESULTFromLastError();
-  if (SUCCEEDED(hr)) {
-    handlers_.push_back(state.release());
+  HRESULT hr = S_OK;
+  if (handlers_.find(handle) != handlers_.end()) {
+    ASSERT(false, (_T("[already registered %d]"), handle));
+    hr = HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+  } else if (::RegisterWaitForSingleObject(&state->wait_handle,
+                                           state->handle,
+                                           &Reactor::Callback,
+                                           state.get(),
+                                           INFINITE,
+                                           state->flags)) {
+    handlers_[handle] = state.release();
+  } else {
+    hr = HRESULTFromLastError();
   }
   ::LeaveCriticalSection(&cs_);
 
@@ -114,12 +110,7 @@ HRESULT Reactor::RegisterHandle(HANDLE handle) {
 
 HRESULT Reactor::DoRegisterHandle(HANDLE handle) {
   ASSERT1(handle);
-  std::vector<RegistrationState*>::iterator it = handlers_.begin();
-  for (; it != handlers_.end(); ++it) {
-    if ((*it)->handle == handle) {
-      break;
-    }
-  }
+  HandlerMap::iterator it = handlers_.find(handle);
   if (it == handlers_.end()) {
     // The handle is not registered with the reactor anymore. Registering the
     // the handle again is not possible.
@@ -128,7 +119,7 @@ HRESULT Reactor::DoRegisterHandle(HANDLE handle) {
 
   // Unregister and register the handle again. Unregistering is an non blocking
   // call.
-  RegistrationState* state = *it;
+  RegistrationState* state = it->second;
   bool res = !!::UnregisterWaitEx(state->wait_handle, NULL);
   if (!res && ::GetLastError() != ERROR_IO_PENDING) {
     return HRESULTFromLastError();
@@ -189,13 +180,10 @@ void Reactor::DoCallback(RegistrationState* state) {
 Reactor::RegistrationState* Reactor::ReleaseHandlerState(HANDLE handle) {
   RegistrationState* registration_state = NULL;
   ::EnterCriticalSection(&cs_);
-  std::vector<RegistrationState*>::iterator it = handlers_.begin();
-  for (; it != handlers_.end(); ++it) {
-    if ((*it)->handle == handle) {
-      registration_state = *it;
-      handlers_.erase(it);
-      break;
-    }
+  HandlerMap::iterator it = handlers_.find(handle);
+  if (it != handlers_.end()) {
+    registration_state = it->second;
+    handlers_.erase(it);
   }
   ::LeaveCriticalSection(&cs_);
   return registration_state;
@@ -27,7 +27,7 @@
 #define OMAHA_COMMON_REACTOR_H__
 
 #include <windows.h>
-#include <vector>
+#include <map>
 #include "base/basictypes.h"
 
 namespace omaha {
@@ -43,7 +43,7 @@ class Reactor {
   HRESULT HandleEvents();
 
   // Registers an event handler for a handle. The reactor does not own the
-  // handle. Registering the same handle twice results in undefined behavior.
+  // handle. Registering the same handle twice fails.
   // The flags parameter can be one of the WT* thread pool values or 0 for
   // a reasonable default.
   HRESULT RegisterHandle(HANDLE handle,
@@ -81,8 +81,12 @@ class Reactor {
   // Releases the ownership of the registration state corresponding to a handle.
   RegistrationState* ReleaseHandlerState(HANDLE handle);
 
+  // Indexed by handle, since the lookups happen each time a handle is
+  // registered again, which is once per event dispatched.
+  typedef std::map<HANDLE, RegistrationState*> HandlerMap;
+
   CRITICAL_SECTION cs_;
-  std::vector<RegistrationState*> handlers_;
+  HandlerMap handlers_;
 
   DISALLOW_EVIL_CONSTRUCTORS(Reactor);
 };
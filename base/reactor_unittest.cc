@@ -15,6 +15,7 @@
 
 
 #include <stdlib.h>
+#include <vector>
 #include "base/scoped_ptr.h"
 #include "omaha/base/event_handler.h"
 #include "omaha/base/reactor.h"
@@ -133,4 +134,73 @@ TEST_F(ReactorTest, HandleEvents) {
   ASSERT_HRESULT_SUCCEEDED(reactor_.UnregisterHandle(get(event_done_)));
 }
 
+// Counts the events dispatched and signals an event after the last one.
+class CountingEventHandler : public EventHandler {
+ public:
+  CountingEventHandler(LONG num_expected, HANDLE event_done)
+      : cnt_(0), num_expected_(num_expected), event_done_(event_done) {}
+
+  virtual void HandleEvent(HANDLE h) {
+    EXPECT_TRUE(h);
+    if (::InterlockedIncrement(&cnt_) == num_expected_) {
+      EXPECT_TRUE(::SetEvent(event_done_));
+    }
+  }
+
+  LONG cnt() const { return cnt_; }
+
+ private:
+  volatile LONG cnt_;
+  const LONG num_expected_;
+  HANDLE event_done_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(CountingEventHandler);
+};
+
+// Registers many handles, signals all of them, and checks each handler is
+// called once.
+TEST(ReactorManyHandlesTest, HandleEvents) {
+  const int kNumHandles = 500;
+
+  scoped_event event_done(::CreateEvent(NULL, true, false, NULL));
+  ASSERT_TRUE(event_done);
+  CountingEventHandler handler(kNumHandles, get(event_done));
+
+  Reactor reactor;
+  std::vector<HANDLE> events;
+  for (int i = 0; i != kNumHandles; ++i) {
+    HANDLE event = ::CreateEvent(NULL, true, false, NULL);
+    ASSERT_TRUE(event);
+    events.push_back(event);
+    ASSERT_HRESULT_SUCCEEDED(reactor.RegisterHandle(event, &handler, 0));
+  }
+
+  for (int i = 0; i != kNumHandles; ++i) {
+    EXPECT_TRUE(::SetEvent(events[i]));
+  }
+  EXPECT_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(get(event_done), 10000));
+
+  for (int i = 0; i != kNumHandles; ++i) {
+    EXPECT_HRESULT_SUCCEEDED(reactor.UnregisterHandle(events[i]));
+    EXPECT_TRUE(::CloseHandle(events[i]));
+  }
+  EXPECT_EQ(kNumHandles, handler.cnt());
+}
+
+TEST(ReactorManyHandlesTest, RegisterTwice) {
+  scoped_event event(::CreateEvent(NULL, true, false, NULL));
+  ASSERT_TRUE(event);
+  CountingEventHandler handler(1, get(event));
+
+  Reactor reactor;
+  ASSERT_HRESULT_SUCCEEDED(reactor.RegisterHandle(get(event), &handler, 0));
+  {
+    ExpectAsserts expect_asserts;
+    EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS),
+              reactor.RegisterHandle(get(event), &handler, 0));
+  }
+  EXPECT_HRESULT_SUCCEEDED(reactor.UnregisterHandle(get(event)));
+  EXPECT_EQ(E_UNEXPECTED, reactor.UnregisterHandle(get(event)));
+}
+
 }  // namespace omaha
@@ -23,6 +23,7 @@
 #include "omaha/base/debug.h"
 #include "omaha/base/localization.h"
 #include "omaha/base/logging.h"
+#include "omaha/base/utf8.h"
 
 namespace omaha {
 
@@ -370,61 +371,34 @@ CString AnsiToWideString(const char *from, int length) {
 
 // Transform a unicode string into UTF8, as represented in an ASCII string
 CStringA WideToUtf8(const CString& w) {
-  // Add a cutoff. If it's all ascii, convert it directly
-  const TCHAR* input = static_cast<const TCHAR*>(w.GetString());
-  int input_len = w.GetLength(), i;
-  for (i = 0; i < input_len; ++i) {
-    if (input[i] > 127) {
-      break;
-    }
-  }
-
-  // If we made it to the end without breaking, then it's all ANSI, so do a quick convert
-  if (i == input_len) {
-    return WideToAnsiDirect(w);
-  }
-
-  // Figure out how long the string is
-  int req_bytes = ::WideCharToMultiByte(CP_UTF8, 0, w, -1, NULL, 0, NULL, NULL);
-
-  scoped_array<char> utf8_buffer(new char[req_bytes]);
-
-  int conv_bytes = ::WideCharToMultiByte(CP_UTF8, 0, w, -1, utf8_buffer.get(), req_bytes, NULL, NULL);
-  ASSERT1(req_bytes == conv_bytes);
-
-  // conv_bytes includes the null terminator, when we read this in, don't read the terminator
-  CStringA out(utf8_buffer.get(), conv_bytes - 1);
+  const TCHAR* input = w.GetString();
+  const size_t input_len = w.GetLength();
+  const size_t output_len = Utf16ToUtf8Length(input, input_len);
 
+  CStringA out;
+  char* buffer = out.GetBuffer(static_cast<int>(output_len));
+  VERIFY1(Utf16ToUtf8(input, input_len, buffer) == output_len);
+  out.ReleaseBuffer(static_cast<int>(output_len));
   return out;
 }
 
 CString Utf8ToWideChar(const char* utf8, uint32 num_bytes) {
   ASSERT1(utf8);
+
+  // Strip the byte order marker if there is one in the document.
+  const size_t bom_len = Utf8BomLength(utf8, num_bytes);
+  utf8 += bom_len;
+  num_bytes -= bom_len;
   if (num_bytes == 0) {
     return CString();
   }
 
-  uint32 number_of_wide_chars = ::MultiByteToWideChar(CP_UTF8, 0, utf8, num_bytes, NULL, 0);
-  number_of_wide_chars += 1;  // make room for NULL terminator
-
+  // Each byte decodes to at most one character.
   CString ret_string;
-  TCHAR* buffer = ret_string.GetBuffer(number_of_wide_chars);
-  DWORD number_of_characters_copied = ::MultiByteToWideChar(CP_UTF8, 0, utf8, num_bytes, buffer, number_of_wide_chars);
-  ASSERT1(number_of_characters_copied == number_of_wide_chars - 1);
-  buffer[number_of_wide_chars - 1] = _T('\0');  // ensure there is a NULL terminator
-  ret_string.ReleaseBuffer();
-
-  // Strip the byte order marker if there is one in the document.
-  if (ret_string[0] == kUnicodeBom) {
-    ret_string = ret_string.Right(ret_string.GetLength() - 1);
-  }
-
-  if (number_of_characters_copied > 0) {
-    return ret_string;
-  }
-
-  // Failure case
-  return CString();
+  TCHAR* buffer = ret_string.GetBuffer(num_bytes);
+  const size_t num_chars = Utf8ToUtf16(utf8, num_bytes, buffer, NULL);
+  ret_string.ReleaseBuffer(static_cast<int>(num_chars));
+  return ret_string;
 }
 
 CString Utf8BufferToWideChar(const std::vector<uint8>& buffer) {
@@ -754,7 +728,10 @@ CStringA WideToAnsiDirect(const CString & in) {
   CStringA out;
   unsigned char * out_buf = (unsigned char *)out.GetBufferSetLength(in_len);
 
-  for(int i = 0; i < in_len; ++i)
+  // The characters above U+007F, if any, are truncated to their low byte.
+  int i = static_cast<int>(
+      CopyUtf16AsciiPrefix(in_buf, in_len, reinterpret_cast<char*>(out_buf)));
+  for (; i < in_len; ++i)
     out_buf[i] = static_cast<unsigned char>(in_buf[i]);
 
   out.ReleaseBuffer(in_len);
@@ -0,0 +1,40 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/string_interner.h"
+#include "omaha/base/debug.h"
+
+namespace omaha {
+
+const CString& StringInterner::Intern(const CString& str) {
+  std::pair<std::set<CString>::iterator, bool> result = strings_.insert(str);
+  if (!result.second) {
+    ++num_hits_;
+  }
+  ASSERT1(*result.first == str);
+  return *result.first;
+}
+
+const CString& StringInterner::Intern(const TCHAR* str) {
+  ASSERT1(str);
+  return Intern(CString(str));
+}
+
+void StringInterner::Clear() {
+  strings_.clear();
+  num_hits_ = 0;
+}
+
+}  // namespace omaha
@@ -0,0 +1,59 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// StringInterner keeps one copy of each distinct string value. CString
+// shares the buffer of a string among its copies, so the strings returned by
+// Intern() for equal values, and all the copies made from them, reference a
+// single buffer instead of one buffer each. The buffers remain valid after the
+// interner is destroyed, as long as a copy of the string references them.
+//
+// StringInterner is not thread safe.
+
+#ifndef OMAHA_BASE_STRING_INTERNER_H_
+#define OMAHA_BASE_STRING_INTERNER_H_
+
+#include <atlstr.h>
+#include <set>
+#include "base/basictypes.h"
+
+namespace omaha {
+
+class StringInterner {
+ public:
+  StringInterner() : num_hits_(0) {}
+
+  // Returns the interned copy of the string. The reference is valid until the
+  // interner is destroyed or cleared.
+  const CString& Intern(const CString& str);
+  const CString& Intern(const TCHAR* str);
+
+  void Clear();
+
+  // The number of distinct strings interned.
+  size_t size() const { return strings_.size(); }
+
+  // The number of Intern() calls that returned an existing string.
+  int num_hits() const { return num_hits_; }
+
+ private:
+  std::set<CString> strings_;
+  int num_hits_;
+
+  DISALLOW_COPY_AND_ASSIGN(StringInterner);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_BASE_STRING_INTERNER_H_
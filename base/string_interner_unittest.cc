@@ -0,0 +1,71 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/string_interner.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+TEST(StringInternerTest, Intern) {
+  StringInterner interner;
+  EXPECT_EQ(0, interner.size());
+
+  const CString ok1(_T("ok"));
+  const CString ok2(_T("ok"));
+  EXPECT_NE(ok1.GetString(), ok2.GetString());
+
+  const CString& interned1 = interner.Intern(ok1);
+  const CString& interned2 = interner.Intern(ok2);
+  EXPECT_EQ(&interned1, &interned2);
+  EXPECT_STREQ(_T("ok"), interned1);
+  EXPECT_EQ(1, interner.size());
+  EXPECT_EQ(1, interner.num_hits());
+
+  EXPECT_STREQ(_T("noupdate"), interner.Intern(_T("noupdate")));
+  EXPECT_EQ(2, interner.size());
+  EXPECT_EQ(1, interner.num_hits());
+}
+
+TEST(StringInternerTest, Intern_IsCaseSensitive) {
+  StringInterner interner;
+  EXPECT_STREQ(_T("ok"), interner.Intern(_T("ok")));
+  EXPECT_STREQ(_T("OK"), interner.Intern(_T("OK")));
+  EXPECT_EQ(2, interner.size());
+  EXPECT_EQ(0, interner.num_hits());
+}
+
+TEST(StringInternerTest, Intern_Empty) {
+  StringInterner interner;
+  EXPECT_TRUE(interner.Intern(_T("")).IsEmpty());
+  EXPECT_TRUE(interner.Intern(CString()).IsEmpty());
+  EXPECT_EQ(1, interner.size());
+}
+
+// Copies of an interned string share its buffer, also after the interner has
+// been cleared.
+TEST(StringInternerTest, CopiesShareBuffer) {
+  StringInterner interner;
+  const CString copy1 = interner.Intern(CString(_T("http://dl.google.com/")));
+  const CString copy2 = interner.Intern(CString(_T("http://dl.google.com/")));
+  EXPECT_EQ(copy1.GetString(), copy2.GetString());
+
+  interner.Clear();
+  EXPECT_EQ(0, interner.size());
+  EXPECT_EQ(0, interner.num_hits());
+  EXPECT_STREQ(_T("http://dl.google.com/"), copy1);
+  EXPECT_EQ(copy1.GetString(), copy2.GetString());
+}
+
+}  // namespace omaha
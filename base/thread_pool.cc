@@ -15,37 +15,19 @@
 
 #include "omaha/base/thread_pool.h"
 
+#include <deque>
+#include <vector>
 #include "base/scoped_ptr.h"
 #include "omaha/base/debug.h"
 #include "omaha/base/error.h"
 #include "omaha/base/exception_barrier.h"
 #include "omaha/base/logging.h"
+#include "omaha/base/synchronized.h"
 
 namespace omaha {
 
 namespace {
 
-// Context keeps track the information necessary to execute a work item
-// inside a thread pool thread.
-class Context {
- public:
-  Context(ThreadPool* pool, UserWorkItem* work_item)
-      : pool_(pool),
-        work_item_(work_item) {
-    ASSERT1(pool);
-    ASSERT1(work_item);
-  }
-
-  ThreadPool*   pool() const { return pool_; }
-  UserWorkItem* work_item() const { return work_item_; }
-
- private:
-  ThreadPool*   pool_;
-  UserWorkItem* work_item_;
-
-  DISALLOW_EVIL_CONSTRUCTORS(Context);
-};
-
 // Returns true if delta time since 'baseline' is greater or equal than
 // 'milisecs'. Note: GetTickCount wraps around every ~48 days.
 bool TimeHasElapsed(DWORD baseline, DWORD milisecs) {
@@ -59,19 +41,382 @@ bool TimeHasElapsed(DWORD baseline, DWORD milisecs) {
 
 }   // namespace
 
+// Scheduler owns the queues and the worker threads. The pool and each worker
+// thread hold a reference to it.
+//
+// Lock order: lock_, then Worker::lock. The worker locks are otherwise never
+// held together.
+class ThreadPool::Scheduler {
+ public:
+  explicit Scheduler(int max_threads);
+
+  HRESULT Initialize();
+
+  void AddRef() { ::InterlockedIncrement(&ref_count_); }
+  void Release() {
+    if (::InterlockedDecrement(&ref_count_) == 0) {
+      delete this;
+    }
+  }
+
+  // Takes ownership of the work item on success.
+  HRESULT Add(UserWorkItem* work_item, Priority priority);
+
+  // Runs the items queued to the worker of the calling thread, if any, until
+  // the handle is signaled, and then waits for the handle.
+  void WaitForObject(HANDLE handle);
+
+  // Signals the work items that the pool is shutting down. The queued items
+  // still run.
+  void Shutdown() { VERIFY1(::SetEvent(get(shutdown_event_))); }
+
+  // Terminates the worker threads once they finish their current item. Waits
+  // for the threads to exit if 'wait' is true.
+  void Stop(bool wait);
+
+  LONG work_item_count() const { return work_item_count_; }
+
+ private:
+  struct Worker {
+    Worker(Scheduler* scheduler, int index)
+        : scheduler(scheduler),
+          index(index) {}
+
+    Scheduler* const scheduler;
+    const int index;
+
+    // Protects the queues.
+    LLock lock;
+
+    // The items queued by the work items this worker runs. The worker pops
+    // from the back and the other workers steal from the front.
+    std::deque<UserWorkItem*> queues[kNumPriorities];
+  };
+
+  ~Scheduler();
+
+  // Creates a worker thread if all the workers are busy and the pool is not
+  // full. Must be called with lock_ held.
+  HRESULT MaybeAddWorker();
+
+  void Run(Worker* worker);
+
+  // Returns the next item for the worker to run or NULL if there is none.
+  UserWorkItem* FindWork(Worker* worker);
+
+  // Returns the newest item of the highest priority from the queues of the
+  // worker or NULL if they are empty.
+  UserWorkItem* PopLocalWork(Worker* worker);
+
+  void Execute(UserWorkItem* work_item);
+
+  static DWORD WINAPI WorkerProc(void* param);
+
+  volatile LONG ref_count_;
+
+  const int max_threads_;
+
+  // Slot which points each worker thread to its Worker.
+  DWORD tls_index_;
+
+  // Protects injected_, threads_ and the creation of the workers.
+  LLock lock_;
+
+  std::deque<UserWorkItem*> injected_[kNumPriorities];
+
+  // Sized to max_threads_ upfront and never reallocated, so that the workers
+  // can steal from the first num_workers_ entries without holding lock_.
+  std::vector<Worker*> workers_;
+  volatile LONG num_workers_;
+
+  std::vector<HANDLE> threads_;
+
+  // Number of workers waiting for work.
+  volatile LONG num_idle_;
+
+  // Number of items queued and not yet started.
+  volatile LONG num_pending_;
+
+  // Number of items queued or running.
+  volatile LONG work_item_count_;
+
+  // Released once for each item queued.
+  scoped_handle work_available_;
 
-DWORD WINAPI ThreadPool::ThreadProc(void* param) {
+  // Given to the work items and set when the pool is shutting down.
+  scoped_event shutdown_event_;
+
+  // Set to terminate the worker threads.
+  scoped_event stop_event_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(Scheduler);
+};
+
+ThreadPool::Scheduler::Scheduler(int max_threads)
+    : ref_count_(1),
+      max_threads_(max_threads),
+      tls_index_(TLS_OUT_OF_INDEXES),
+      workers_(max_threads, NULL),
+      num_workers_(0),
+      num_idle_(0),
+      num_pending_(0),
+      work_item_count_(0) {
+  ASSERT1(max_threads > 0);
+}
+
+ThreadPool::Scheduler::~Scheduler() {
+  // The items still queued are the ones abandoned when the shutdown delay
+  // elapsed.
+  for (int priority = 0; priority != kNumPriorities; ++priority) {
+    for (size_t i = 0; i != injected_[priority].size(); ++i) {
+      delete injected_[priority][i];
+    }
+  }
+  for (int i = 0; i != num_workers_; ++i) {
+    Worker* worker = workers_[i];
+    for (int priority = 0; priority != kNumPriorities; ++priority) {
+      for (size_t j = 0; j != worker->queues[priority].size(); ++j) {
+        delete worker->queues[priority][j];
+      }
+    }
+    delete worker;
+  }
+  for (size_t i = 0; i != threads_.size(); ++i) {
+    VERIFY1(::CloseHandle(threads_[i]));
+  }
+  if (tls_index_ != TLS_OUT_OF_INDEXES) {
+    VERIFY1(::TlsFree(tls_index_));
+  }
+}
+
+HRESULT ThreadPool::Scheduler::Initialize() {
+  tls_index_ = ::TlsAlloc();
+  if (tls_index_ == TLS_OUT_OF_INDEXES) {
+    return HRESULTFromLastError();
+  }
+
+  reset(work_available_, ::CreateSemaphore(NULL, 0, LONG_MAX, NULL));
+  reset(shutdown_event_, ::CreateEvent(NULL, true, false, NULL));
+  reset(stop_event_, ::CreateEvent(NULL, true, false, NULL));
+  if (!work_available_ || !shutdown_event_ || !stop_event_) {
+    return HRESULTFromLastError();
+  }
+  return S_OK;
+}
+
+HRESULT ThreadPool::Scheduler::Add(UserWorkItem* work_item,
+                                   Priority priority) {
+  ASSERT1(work_item);
+  ASSERT1(priority >= 0 && priority < kNumPriorities);
+
+  work_item->set_shutdown_event(get(shutdown_event_));
+  ::InterlockedIncrement(&work_item_count_);
+  ::InterlockedIncrement(&num_pending_);
+
+  Worker* worker = static_cast<Worker*>(::TlsGetValue(tls_index_));
+  if (worker) {
+    ASSERT1(worker->scheduler == this);
+    __mutexScope(worker->lock);
+    worker->queues[priority].push_back(work_item);
+  }
+
+  __mutexBlock(lock_) {
+    if (!worker) {
+      injected_[priority].push_back(work_item);
+    }
+
+    HRESULT hr = MaybeAddWorker();
+    if (FAILED(hr) && num_workers_ == 0) {
+      // Nothing would run the item. The calling thread is not a worker, so
+      // the item is still at the back of the injection queue.
+      ASSERT1(!worker);
+      ASSERT1(injected_[priority].back() == work_item);
+      injected_[priority].pop_back();
+      ::InterlockedDecrement(&num_pending_);
+      ::InterlockedDecrement(&work_item_count_);
+      return hr;
+    }
+  }
+
+  VERIFY1(::ReleaseSemaphore(get(work_available_), 1, NULL));
+  return S_OK;
+}
+
+// The items in the queues of the worker can only be queued by the items the
+// worker runs, so once the queues are empty the remaining items the caller
+// waits for are run by the other workers.
+void ThreadPool::Scheduler::WaitForObject(HANDLE handle) {
+  ASSERT1(handle);
+
+  Worker* worker = static_cast<Worker*>(::TlsGetValue(tls_index_));
+  if (worker) {
+    ASSERT1(worker->scheduler == this);
+    while (::WaitForSingleObject(handle, 0) == WAIT_TIMEOUT) {
+      UserWorkItem* work_item = PopLocalWork(worker);
+      if (!work_item) {
+        break;
+      }
+      ::InterlockedDecrement(&num_pending_);
+      Execute(work_item);
+    }
+  }
+
+  VERIFY1(::WaitForSingleObject(handle, INFINITE) == WAIT_OBJECT_0);
+}
+
+HRESULT ThreadPool::Scheduler::MaybeAddWorker() {
+  if (num_workers_ == max_threads_) {
+    return S_OK;
+  }
+  if (num_workers_ > 0 && num_pending_ <= num_idle_) {
+    return S_OK;
+  }
+
+  scoped_ptr<Worker> worker(new Worker(this, num_workers_));
+  AddRef();
+  HANDLE thread = ::CreateThread(NULL,
+                                 0,
+                                 &Scheduler::WorkerProc,
+                                 worker.get(),
+                                 0,
+                                 NULL);
+  if (!thread) {
+    HRESULT hr = HRESULTFromLastError();
+    UTIL_LOG(LE, (_T("[CreateThread failed][0x%08x]"), hr));
+    Release();
+    return hr;
+  }
+
+  threads_.push_back(thread);
+  workers_[num_workers_] = worker.release();
+  ::InterlockedIncrement(&num_workers_);
+  UTIL_LOG(L4, (_T("[ThreadPool][added worker][%d]"), num_workers_));
+  return S_OK;
+}
+
+void ThreadPool::Scheduler::Stop(bool wait) {
+  VERIFY1(::SetEvent(get(stop_event_)));
+  if (!wait) {
+    return;
+  }
+
+  std::vector<HANDLE> threads;
+  __mutexBlock(lock_) {
+    threads = threads_;
+  }
+  for (size_t i = 0; i != threads.size(); ++i) {
+    VERIFY1(::WaitForSingleObject(threads[i], INFINITE) == WAIT_OBJECT_0);
+  }
+}
+
+DWORD WINAPI ThreadPool::Scheduler::WorkerProc(void* param) {
   ExceptionBarrier eb;
-  UTIL_LOG(L4, (_T("[ThreadPool::ThreadProc]")));
+  UTIL_LOG(L4, (_T("[ThreadPool::Scheduler::WorkerProc]")));
   ASSERT1(param);
-  Context* context = static_cast<Context*>(param);
-  context->pool()->ProcessWorkItem(context->work_item());
-  delete context;
+  Worker* worker = static_cast<Worker*>(param);
+  Scheduler* scheduler = worker->scheduler;
+  scheduler->Run(worker);
+  scheduler->Release();
   return 0;
 }
 
+void ThreadPool::Scheduler::Run(Worker* worker) {
+  VERIFY1(::TlsSetValue(tls_index_, worker));
+
+  HANDLE handles[] = { get(stop_event_), get(work_available_) };
+  for (;;) {
+    UserWorkItem* work_item = FindWork(worker);
+    if (work_item) {
+      ::InterlockedDecrement(&num_pending_);
+      Execute(work_item);
+      continue;
+    }
+
+    // The semaphore may be signaled for an item another worker already took,
+    // in which case the worker finds no work and waits again.
+    ::InterlockedIncrement(&num_idle_);
+    DWORD result = ::WaitForMultipleObjects(arraysize(handles),
+                                            handles,
+                                            false,
+                                            INFINITE);
+    ::InterlockedDecrement(&num_idle_);
+    if (result != WAIT_OBJECT_0 + 1) {
+      ASSERT1(result == WAIT_OBJECT_0);
+      break;
+    }
+  }
+
+  VERIFY1(::TlsSetValue(tls_index_, NULL));
+}
+
+UserWorkItem* ThreadPool::Scheduler::FindWork(Worker* worker) {
+  ASSERT1(worker);
+
+  for (int priority = 0; priority != kNumPriorities; ++priority) {
+    __mutexBlock(worker->lock) {
+      std::deque<UserWorkItem*>& queue = worker->queues[priority];
+      if (!queue.empty()) {
+        UserWorkItem* work_item = queue.back();
+        queue.pop_back();
+        return work_item;
+      }
+    }
+
+    __mutexBlock(lock_) {
+      std::deque<UserWorkItem*>& queue = injected_[priority];
+      if (!queue.empty()) {
+        UserWorkItem* work_item = queue.front();
+        queue.pop_front();
+        return work_item;
+      }
+    }
+
+    // Starts with the next worker so that the thieves spread over the victims.
+    const int num_workers = num_workers_;
+    for (int i = 1; i < num_workers; ++i) {
+      Worker* victim = workers_[(worker->index + i) % num_workers];
+      __mutexScope(victim->lock);
+      std::deque<UserWorkItem*>& queue = victim->queues[priority];
+      if (!queue.empty()) {
+        UserWorkItem* work_item = queue.front();
+        queue.pop_front();
+        return work_item;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+UserWorkItem* ThreadPool::Scheduler::PopLocalWork(Worker* worker) {
+  ASSERT1(worker);
+
+  __mutexScope(worker->lock);
+  for (int priority = 0; priority != kNumPriorities; ++priority) {
+    std::deque<UserWorkItem*>& queue = worker->queues[priority];
+    if (!queue.empty()) {
+      UserWorkItem* work_item = queue.back();
+      queue.pop_back();
+      return work_item;
+    }
+  }
+
+  return NULL;
+}
+
+void ThreadPool::Scheduler::Execute(UserWorkItem* work_item) {
+  ASSERT1(work_item);
+  if (work_item->IsCanceled()) {
+    UTIL_LOG(L4, (_T("[ThreadPool][work item canceled][0x%p]"), work_item));
+  } else {
+    work_item->Process();
+  }
+  delete work_item;
+  ::InterlockedDecrement(&work_item_count_);
+}
+
 ThreadPool::ThreadPool()
-    : work_item_count_(0),
+    : scheduler_(NULL),
       shutdown_delay_(0) {
   UTIL_LOG(L2, (_T("[ThreadPool::ThreadPool]")));
 }
@@ -79,51 +424,91 @@ ThreadPool::ThreadPool()
 ThreadPool::~ThreadPool() {
   UTIL_LOG(L2, (_T("[ThreadPool::~ThreadPool]")));
 
-  if (!shutdown_event_) {
+  if (!scheduler_) {
     return;
   }
 
   DWORD baseline_tick_count = ::GetTickCount();
-  if (::SetEvent(get(shutdown_event_))) {
-    while (work_item_count_ != 0) {
-      ::Sleep(1);
-      if (TimeHasElapsed(baseline_tick_count, shutdown_delay_)) {
-        UTIL_LOG(LE, (_T("[ThreadPool::~ThreadPool][timeout elapsed]")));
-        break;
-      }
+  bool is_timeout = false;
+  scheduler_->Shutdown();
+  while (scheduler_->work_item_count() != 0) {
+    ::Sleep(1);
+    if (TimeHasElapsed(baseline_tick_count, shutdown_delay_)) {
+      UTIL_LOG(LE, (_T("[ThreadPool::~ThreadPool][timeout elapsed]")));
+      is_timeout = true;
+      break;
     }
   }
+
+  // The workers that are still running an item keep the scheduler alive and
+  // exit when the item returns.
+  scheduler_->Stop(!is_timeout);
+  scheduler_->Release();
 }
 
 HRESULT ThreadPool::Initialize(int shutdown_delay) {
+  return Initialize(shutdown_delay, kDefaultMaxThreads);
+}
+
+HRESULT ThreadPool::Initialize(int shutdown_delay, int max_threads) {
+  ASSERT1(!scheduler_);
+  ASSERT1(max_threads > 0);
+
   shutdown_delay_ = shutdown_delay;
-  reset(shutdown_event_, ::CreateEvent(NULL, true, false, NULL));
-  return shutdown_event_ ? S_OK : HRESULTFromLastError();
+
+  Scheduler* scheduler = new Scheduler(max_threads);
+  HRESULT hr = scheduler->Initialize();
+  if (FAILED(hr)) {
+    scheduler->Release();
+    return hr;
+  }
+
+  scheduler_ = scheduler;
+  return S_OK;
 }
 
-void ThreadPool::ProcessWorkItem(UserWorkItem* work_item) {
-  ASSERT1(work_item);
-  work_item->Process();
-  delete work_item;
-  ::InterlockedDecrement(&work_item_count_);
+bool ThreadPool::HasWorkItems() const {
+  return scheduler_ && scheduler_->work_item_count() != 0;
 }
 
 HRESULT ThreadPool::QueueUserWorkItem(UserWorkItem* work_item, uint32 flags) {
-  UTIL_LOG(L4, (_T("[ThreadPool::QueueUserWorkItem]")));
+  UNREFERENCED_PARAMETER(flags);
+  return QueueUserWorkItem(work_item,
+                           PRIORITY_NORMAL,
+                           shared_ptr<CancellationToken>());
+}
+
+HRESULT ThreadPool::QueueUserWorkItem(
+    UserWorkItem* work_item,
+    Priority priority,
+    const shared_ptr<CancellationToken>& token) {
+  UTIL_LOG(L4, (_T("[ThreadPool::QueueUserWorkItem][%d]"), priority));
   ASSERT1(work_item);
 
-  scoped_ptr<Context> context(new Context(this, work_item));
-  work_item->set_shutdown_event(get(shutdown_event_));
-  ::InterlockedIncrement(&work_item_count_);
-  if (!::QueueUserWorkItem(&ThreadPool::ThreadProc, context.get(), flags)) {
-    ::InterlockedDecrement(&work_item_count_);
-    return HRESULTFromLastError();
+  if (!scheduler_) {
+    ASSERT(false, (_T("[ThreadPool is not initialized]")));
+    return E_UNEXPECTED;
   }
 
+  work_item->set_cancellation_token(token);
+
   // The thread pool has the ownership of the work item thereon.
-  context.release();
-  return S_OK;
+  return scheduler_->Add(work_item, priority);
 }
 
-}   // namespace omaha
+void ThreadPool::WaitForObject(HANDLE handle) {
+  ASSERT1(handle);
+
+  if (!scheduler_) {
+    VERIFY1(::WaitForSingleObject(handle, INFINITE) == WAIT_OBJECT_0);
+    return;
+  }
 
+  // The work items may outlive the pool when the shutdown delay elapses.
+  Scheduler* scheduler = scheduler_;
+  scheduler->AddRef();
+  scheduler->WaitForObject(handle);
+  scheduler->Release();
+}
+
+}   // namespace omaha
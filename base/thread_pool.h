@@ -13,15 +13,46 @@
 // limitations under the License.
 // ========================================================================
 
+// ThreadPool runs UserWorkItems on a bounded set of threads it owns. Each
+// worker thread has its own queues. The items queued by a work item go to the
+// queues of the thread running it and are taken in LIFO order, which favors
+// the items whose data is still in the cache. The items queued by other
+// threads go to a shared injection queue. Idle workers take from the shared
+// queue first and then steal the oldest items from the other workers.
+//
+// Items run in priority order: no item is started while an item with a higher
+// priority is waiting. Items queued with a CancellationToken are discarded
+// without running if the token is canceled before they start.
+//
+// A work item that waits for the items it queued must wait with
+// WaitForObject(). Otherwise, once every worker runs such an item, no thread
+// is left to run the queued items.
+
 #ifndef OMAHA_BASE_THREAD_POOL_H_
 #define OMAHA_BASE_THREAD_POOL_H_
 
 #include <windows.h>
 #include "base/basictypes.h"
 #include "omaha/base/scoped_any.h"
+#include "third_party/bar/shared_ptr.h"
 
 namespace omaha {
 
+// Shared by the code that queues work items and the work items themselves.
+// Cancellation is cooperative: the thread pool discards the items that have
+// not started, and the items that are running may poll IsCanceled().
+class CancellationToken {
+ public:
+  CancellationToken() : is_canceled_(0) {}
+
+  void Cancel() { ::InterlockedExchange(&is_canceled_, 1); }
+  bool IsCanceled() const { return is_canceled_ != 0; }
+
+ private:
+  volatile LONG is_canceled_;
+  DISALLOW_EVIL_CONSTRUCTORS(CancellationToken);
+};
+
 class UserWorkItem {
  public:
   UserWorkItem() : shutdown_event_(NULL) {}
@@ -35,6 +66,14 @@ class UserWorkItem {
     shutdown_event_ = shutdown_event;
   }
 
+  // Returns true if the item was queued with a token that has been canceled.
+  bool IsCanceled() const {
+    return cancellation_token_.get() && cancellation_token_->IsCanceled();
+  }
+  void set_cancellation_token(const shared_ptr<CancellationToken>& token) {
+    cancellation_token_ = token;
+  }
+
  private:
   // Executes the work item.
   virtual void DoProcess() = 0;
@@ -43,11 +82,24 @@ class UserWorkItem {
   // and shutdown correctly. This event is set when the thread pool is closing.
   // Do not close this event as is owned by the thread pool.
   HANDLE shutdown_event_;
+
+  // May be NULL if the item can't be canceled.
+  shared_ptr<CancellationToken> cancellation_token_;
+
   DISALLOW_EVIL_CONSTRUCTORS(UserWorkItem);
 };
 
 class ThreadPool {
  public:
+  enum Priority {
+    PRIORITY_HIGH = 0,
+    PRIORITY_NORMAL,
+    PRIORITY_LOW,
+  };
+  static const int kNumPriorities = PRIORITY_LOW + 1;
+
+  static const int kDefaultMaxThreads = 64;
+
   ThreadPool();
 
   // The destructor might block for 'shutdown_delay'.
@@ -55,25 +107,36 @@ class ThreadPool {
 
   HRESULT Initialize(int shutdown_delay);
 
+  // Runs at most 'max_threads' work items concurrently. Threads are created
+  // on demand, when the queued items outnumber the idle threads.
+  HRESULT Initialize(int shutdown_delay, int max_threads);
+
   // Returns true if any work items are still in progress.
-  bool HasWorkItems() const { return (0 != work_item_count_); }
+  bool HasWorkItems() const;
 
-  // Adds a work item to the queue. If the add fails the ownership of the
-  // work items remains with the caller.
+  // Adds a work item to the queue with normal priority. If the add fails the
+  // ownership of the work items remains with the caller. The flags are
+  // ignored and are kept for compatibility with the OS thread pool API, since
+  // every work item may now be long running.
   HRESULT QueueUserWorkItem(UserWorkItem* work_item, uint32 flags);
 
- private:
-  // Calls UserWorkItem::Process() in the context of the worker thread.
-  void ProcessWorkItem(UserWorkItem* work_item);
+  // Adds a work item to the queue. The token may be NULL. If the add fails the
+  // ownership of the work items remains with the caller.
+  HRESULT QueueUserWorkItem(UserWorkItem* work_item,
+                            Priority priority,
+                            const shared_ptr<CancellationToken>& token);
 
-  // This is the thread callback required by the underlying windows API.
-  static DWORD WINAPI ThreadProc(void* context);
+  // Waits for the handle to be signaled. When called by a work item, runs the
+  // items that were queued by the calling worker and have not started until
+  // the handle is signaled or no such item is left.
+  void WaitForObject(HANDLE handle);
 
-  // Approximate number of work items in the pool.
-  volatile LONG work_item_count_;
+ private:
+  class Scheduler;
 
-  // This event signals when the thread pool destructor is in progress.
-  scoped_event shutdown_event_;
+  // Ref counted, since the worker threads may outlive the pool when the
+  // shutdown delay elapses.
+  Scheduler* scheduler_;
 
   // How many milliseconds to wait for the work items to finish when
   // the thread pool is shutting down. The shutdown delay resolution is ~10ms.
@@ -85,4 +148,3 @@ class ThreadPool {
 }  // namespace omaha
 
 #endif  // OMAHA_BASE_THREAD_POOL_H_
-
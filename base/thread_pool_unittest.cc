@@ -13,8 +13,10 @@
 // limitations under the License.
 // ========================================================================
 
+#include <vector>
 #include "base/basictypes.h"
 #include "base/scoped_ptr.h"
+#include "omaha/base/synchronized.h"
 #include "omaha/base/thread_pool.h"
 #include "omaha/base/timer.h"
 #include "omaha/testing/unit_test.h"
@@ -88,6 +90,143 @@ HRESULT QueueMyJob3(ThreadPool* thread_pool) {
   return S_OK;
 }
 
+// Blocks the worker running it until the event is signaled.
+class BlockingJob : public UserWorkItem {
+ public:
+  explicit BlockingJob(HANDLE event) : event_(event) {}
+
+ private:
+  virtual void DoProcess() {
+    EXPECT_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(event_, INFINITE));
+  }
+
+  HANDLE event_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(BlockingJob);
+};
+
+// Appends its id to a list shared by the jobs.
+class RecordingJob : public UserWorkItem {
+ public:
+  RecordingJob(int id, std::vector<int>* ids, LLock* lock)
+      : id_(id), ids_(ids), lock_(lock) {}
+
+ private:
+  virtual void DoProcess() {
+    __mutexScope(*lock_);
+    ids_->push_back(id_);
+  }
+
+  int id_;
+  std::vector<int>* ids_;
+  LLock* lock_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(RecordingJob);
+};
+
+// Tracks the number of jobs running concurrently.
+class ConcurrencyJob : public UserWorkItem {
+ public:
+  ConcurrencyJob(volatile LONG* num_running, volatile LONG* max_running)
+      : num_running_(num_running), max_running_(max_running) {}
+
+ private:
+  virtual void DoProcess() {
+    LONG num_running = ::InterlockedIncrement(num_running_);
+    LONG max_running = *max_running_;
+    while (num_running > max_running &&
+           ::InterlockedCompareExchange(max_running_,
+                                        num_running,
+                                        max_running) != max_running) {
+      max_running = *max_running_;
+    }
+    ::Sleep(10);
+    ::InterlockedDecrement(num_running_);
+  }
+
+  volatile LONG* num_running_;
+  volatile LONG* max_running_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(ConcurrencyJob);
+};
+
+// Queues 'num_children' MyJob1 items from the worker thread.
+class ParentJob : public UserWorkItem {
+ public:
+  ParentJob(ThreadPool* thread_pool, int num_children)
+      : thread_pool_(thread_pool), num_children_(num_children) {}
+
+ private:
+  virtual void DoProcess() {
+    for (int i = 0; i != num_children_; ++i) {
+      EXPECT_HRESULT_SUCCEEDED(QueueMyJob1(thread_pool_));
+    }
+  }
+
+  ThreadPool* thread_pool_;
+  int num_children_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(ParentJob);
+};
+
+// Increments the global count by 1 and signals the event once the count of
+// the children left reaches zero.
+class ChildJob : public UserWorkItem {
+ public:
+  ChildJob(volatile LONG* num_left, HANDLE done_event)
+      : num_left_(num_left), done_event_(done_event) {}
+
+ private:
+  virtual void DoProcess() {
+    ::InterlockedExchangeAdd(&g_completed_count, 1);
+    if (::InterlockedDecrement(num_left_) == 0) {
+      EXPECT_TRUE(::SetEvent(done_event_));
+    }
+  }
+
+  volatile LONG* num_left_;
+  HANDLE done_event_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(ChildJob);
+};
+
+// Queues 'num_children' ChildJob items from the worker thread and waits for
+// them to complete.
+class WaitingParentJob : public UserWorkItem {
+ public:
+  WaitingParentJob(ThreadPool* thread_pool, int num_children)
+      : thread_pool_(thread_pool), num_children_(num_children) {}
+
+ private:
+  virtual void DoProcess() {
+    volatile LONG num_left = num_children_;
+    scoped_event done_event(::CreateEvent(NULL, true, false, NULL));
+    ASSERT_TRUE(done_event);
+
+    for (int i = 0; i != num_children_; ++i) {
+      EXPECT_HRESULT_SUCCEEDED(thread_pool_->QueueUserWorkItem(
+          new ChildJob(&num_left, get(done_event)), WT_EXECUTEDEFAULT));
+    }
+    thread_pool_->WaitForObject(get(done_event));
+    EXPECT_EQ(0, num_left);
+  }
+
+  ThreadPool* thread_pool_;
+  int num_children_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(WaitingParentJob);
+};
+
+bool WaitForWorkItems(const ThreadPool& thread_pool) {
+  const int kMaxWaitForJobsMs = 2000;
+  LowResTimer t(true);
+  while (thread_pool.HasWorkItems() &&
+         t.GetMilliseconds() < kMaxWaitForJobsMs) {
+    ::Sleep(10);
+  }
+  return !thread_pool.HasWorkItems();
+}
+
 }   // namespace
 
 // Creates several jobs to increment a global counter by different values and
@@ -114,5 +253,142 @@ TEST(ThreadPoolTest, ThreadPool) {
   EXPECT_EQ(g_completed_count, 6 * kNumJobsEachType);
 }
 
-}   // namespace omaha
+// Runs the jobs queued behind a blocked job on a single thread and checks they
+// ran in priority order and, within a priority, in the order they were queued.
+TEST(ThreadPoolTest, Priority) {
+  ThreadPool thread_pool;
+  ASSERT_HRESULT_SUCCEEDED(thread_pool.Initialize(0, 1));
+
+  scoped_event event(::CreateEvent(NULL, true, false, NULL));
+  ASSERT_TRUE(event);
+  ASSERT_HRESULT_SUCCEEDED(thread_pool.QueueUserWorkItem(
+      new BlockingJob(get(event)),
+      ThreadPool::PRIORITY_NORMAL,
+      shared_ptr<CancellationToken>()));
+
+  const ThreadPool::Priority kPriorities[] = {
+    ThreadPool::PRIORITY_LOW,
+    ThreadPool::PRIORITY_NORMAL,
+    ThreadPool::PRIORITY_HIGH,
+    ThreadPool::PRIORITY_NORMAL,
+    ThreadPool::PRIORITY_HIGH,
+  };
+  std::vector<int> ids;
+  LLock lock;
+  for (size_t i = 0; i != arraysize(kPriorities); ++i) {
+    ASSERT_HRESULT_SUCCEEDED(thread_pool.QueueUserWorkItem(
+        new RecordingJob(i, &ids, &lock),
+        kPriorities[i],
+        shared_ptr<CancellationToken>()));
+  }
+
+  EXPECT_TRUE(::SetEvent(get(event)));
+  EXPECT_TRUE(WaitForWorkItems(thread_pool));
+
+  const int kExpectedIds[] = {2, 4, 1, 3, 0};
+  ASSERT_EQ(arraysize(kExpectedIds), ids.size());
+  for (size_t i = 0; i != arraysize(kExpectedIds); ++i) {
+    EXPECT_EQ(kExpectedIds[i], ids[i]);
+  }
+}
+
+TEST(ThreadPoolTest, Cancel) {
+  ThreadPool thread_pool;
+  ASSERT_HRESULT_SUCCEEDED(thread_pool.Initialize(0, 1));
+
+  scoped_event event(::CreateEvent(NULL, true, false, NULL));
+  ASSERT_TRUE(event);
+  ASSERT_HRESULT_SUCCEEDED(thread_pool.QueueUserWorkItem(
+      new BlockingJob(get(event)),
+      ThreadPool::PRIORITY_NORMAL,
+      shared_ptr<CancellationToken>()));
+
+  shared_ptr<CancellationToken> token(new CancellationToken);
+  std::vector<int> ids;
+  LLock lock;
+  ASSERT_HRESULT_SUCCEEDED(thread_pool.QueueUserWorkItem(
+      new RecordingJob(1, &ids, &lock), ThreadPool::PRIORITY_NORMAL, token));
+  ASSERT_HRESULT_SUCCEEDED(thread_pool.QueueUserWorkItem(
+      new RecordingJob(2, &ids, &lock),
+      ThreadPool::PRIORITY_NORMAL,
+      shared_ptr<CancellationToken>()));
+  ASSERT_HRESULT_SUCCEEDED(thread_pool.QueueUserWorkItem(
+      new RecordingJob(3, &ids, &lock), ThreadPool::PRIORITY_NORMAL, token));
+
+  token->Cancel();
+  EXPECT_TRUE(::SetEvent(get(event)));
+  EXPECT_TRUE(WaitForWorkItems(thread_pool));
+
+  ASSERT_EQ(1, ids.size());
+  EXPECT_EQ(2, ids[0]);
+}
+
+TEST(ThreadPoolTest, MaxThreads) {
+  const int kMaxThreads = 3;
+  ThreadPool thread_pool;
+  ASSERT_HRESULT_SUCCEEDED(thread_pool.Initialize(0, kMaxThreads));
 
+  volatile LONG num_running = 0;
+  volatile LONG max_running = 0;
+  for (int i = 0; i != 30; ++i) {
+    ASSERT_HRESULT_SUCCEEDED(thread_pool.QueueUserWorkItem(
+        new ConcurrencyJob(&num_running, &max_running),
+        WT_EXECUTEDEFAULT));
+  }
+
+  EXPECT_TRUE(WaitForWorkItems(thread_pool));
+  EXPECT_EQ(0, num_running);
+  EXPECT_LE(max_running, kMaxThreads);
+  EXPECT_GE(max_running, 1);
+}
+
+// The jobs queued by a job go to the queue of its worker and the other
+// workers steal them.
+TEST(ThreadPoolTest, NestedWorkItems) {
+  const int kNumParents = 10;
+  const int kNumChildren = 50;
+
+  ThreadPool thread_pool;
+  ASSERT_HRESULT_SUCCEEDED(thread_pool.Initialize(0, 4));
+
+  LONG initial_count = g_completed_count;
+  for (int i = 0; i != kNumParents; ++i) {
+    ASSERT_HRESULT_SUCCEEDED(thread_pool.QueueUserWorkItem(
+        new ParentJob(&thread_pool, kNumChildren), WT_EXECUTEDEFAULT));
+  }
+
+  EXPECT_TRUE(WaitForWorkItems(thread_pool));
+  EXPECT_EQ(initial_count + kNumParents * kNumChildren, g_completed_count);
+}
+
+// Every worker runs a job that waits for the jobs it queued. The waiting jobs
+// run the jobs they queued since no worker is left to run them.
+TEST(ThreadPoolTest, NestedWorkItems_WaitAtMaxThreads) {
+  const int kMaxThreads = 4;
+  const int kNumParents = 3 * kMaxThreads;
+  const int kNumChildren = 20;
+
+  ThreadPool thread_pool;
+  ASSERT_HRESULT_SUCCEEDED(thread_pool.Initialize(0, kMaxThreads));
+
+  LONG initial_count = g_completed_count;
+  for (int i = 0; i != kNumParents; ++i) {
+    ASSERT_HRESULT_SUCCEEDED(thread_pool.QueueUserWorkItem(
+        new WaitingParentJob(&thread_pool, kNumChildren), WT_EXECUTEDEFAULT));
+  }
+
+  EXPECT_TRUE(WaitForWorkItems(thread_pool));
+  EXPECT_EQ(initial_count + kNumParents * kNumChildren, g_completed_count);
+}
+
+TEST(ThreadPoolTest, NotInitialized) {
+  ThreadPool thread_pool;
+  EXPECT_FALSE(thread_pool.HasWorkItems());
+
+  ExpectAsserts expect_asserts;
+  scoped_ptr<MyJob1> job(new MyJob1);
+  EXPECT_EQ(E_UNEXPECTED,
+            thread_pool.QueueUserWorkItem(job.get(), WT_EXECUTEDEFAULT));
+}
+
+}   // namespace omaha
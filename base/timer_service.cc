@@ -0,0 +1,184 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/timer_service.h"
+#include <algorithm>
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/exception_barrier.h"
+#include "omaha/base/logging.h"
+
+namespace omaha {
+
+namespace {
+
+// The service thread wakes up at least this often, which keeps the elapsed
+// time from missing a tick count wrap around.
+const DWORD kMaxWaitMs = 24 * 60 * 60 * 1000;   // 1 day.
+
+}  // namespace
+
+TimerService::TimerService()
+    : wheel_(0),
+      last_tick_count_(::GetTickCount()),
+      elapsed_ms_(0),
+      running_timer_(NULL),
+      thread_id_(0) {
+  UTIL_LOG(L3, (_T("[TimerService::TimerService]")));
+}
+
+TimerService::~TimerService() {
+  UTIL_LOG(L3, (_T("[TimerService::~TimerService]")));
+
+  if (thread_) {
+    ASSERT1(thread_id_ != ::GetCurrentThreadId());
+    VERIFY1(::SetEvent(get(stop_event_)));
+    VERIFY1(::WaitForSingleObject(get(thread_), INFINITE) == WAIT_OBJECT_0);
+  }
+}
+
+HRESULT TimerService::Initialize() {
+  reset(wake_event_, ::CreateEvent(NULL, false, false, NULL));
+  reset(stop_event_, ::CreateEvent(NULL, true, false, NULL));
+  if (!wake_event_ || !stop_event_) {
+    return HRESULTFromLastError();
+  }
+
+  reset(thread_, ::CreateThread(NULL,
+                                0,
+                                &TimerService::ThreadProc,
+                                this,
+                                0,
+                                &thread_id_));
+  if (!thread_) {
+    HRESULT hr = HRESULTFromLastError();
+    UTIL_LOG(LE, (_T("[TimerService][CreateThread failed][0x%08x]"), hr));
+    return hr;
+  }
+
+  return S_OK;
+}
+
+HRESULT TimerService::Start(Timer* timer, int due_time_ms, int slack_ms) {
+  ASSERT1(timer);
+  ASSERT1(timer->callback_);
+  ASSERT1(due_time_ms >= 0);
+  ASSERT1(slack_ms >= 0);
+  UTIL_LOG(L3, (_T("[TimerService::Start][0x%p][%d][%d]"),
+                timer, due_time_ms, slack_ms));
+
+  if (!thread_) {
+    return E_UNEXPECTED;
+  }
+
+  __mutexScope(lock_);
+  wheel_.Schedule(timer,
+                  GetElapsedMs() + std::max(due_time_ms, 0),
+                  std::max(slack_ms, 0));
+
+  // The service thread computes how long to sleep again. The wake up is not
+  // needed when the callback of the timer restarts the timer.
+  if (thread_id_ != ::GetCurrentThreadId()) {
+    VERIFY1(::SetEvent(get(wake_event_)));
+  }
+  return S_OK;
+}
+
+void TimerService::Stop(Timer* timer) {
+  ASSERT1(timer);
+  UTIL_LOG(L3, (_T("[TimerService::Stop][0x%p]"), timer));
+
+  bool is_running = false;
+  __mutexBlock(lock_) {
+    wheel_.Cancel(timer);
+    is_running = running_timer_ == timer;
+  }
+
+  // Waits for the callback of the timer to return.
+  if (is_running && thread_id_ != ::GetCurrentThreadId()) {
+    __mutexScope(callback_lock_);
+  }
+}
+
+DWORD WINAPI TimerService::ThreadProc(void* param) {
+  ExceptionBarrier eb;
+  ASSERT1(param);
+  static_cast<TimerService*>(param)->Run();
+  return 0;
+}
+
+void TimerService::Run() {
+  UTIL_LOG(L3, (_T("[TimerService::Run]")));
+
+  HANDLE handles[] = { get(stop_event_), get(wake_event_) };
+  for (;;) {
+    Timer* timer = NULL;
+    DWORD wait_ms = kMaxWaitMs;
+    __mutexBlock(lock_) {
+      const uint64 now_ms = GetElapsedMs();
+      wheel_.Advance(now_ms);
+      timer = static_cast<Timer*>(wheel_.PopExpired());
+      if (timer) {
+        // Taking the callback lock while holding lock_ makes Stop wait for
+        // the callback if Stop finds the timer running.
+        running_timer_ = timer;
+        VERIFY1(callback_lock_.Lock());
+      } else {
+        // The wheel expires every timer due by now_ms on Advance, so the next
+        // expiry is in the future. Waiting at least 1 ms keeps the thread from
+        // spinning until the tick count moves if it is not.
+        uint64 next_expiry_ms = 0;
+        if (wheel_.GetNextExpiry(&next_expiry_ms)) {
+          ASSERT1(next_expiry_ms > now_ms);
+          wait_ms = static_cast<DWORD>(
+              std::min<uint64>(std::max<uint64>(next_expiry_ms, now_ms + 1) -
+                                   now_ms,
+                               kMaxWaitMs));
+        }
+      }
+    }
+
+    if (timer) {
+      timer->callback_(timer);
+      __mutexBlock(lock_) {
+        running_timer_ = NULL;
+      }
+      VERIFY1(callback_lock_.Unlock());
+      continue;
+    }
+
+    DWORD result = ::WaitForMultipleObjects(arraysize(handles),
+                                            handles,
+                                            false,
+                                            wait_ms);
+    if (result == WAIT_OBJECT_0) {
+      break;
+    }
+    ASSERT1(result == WAIT_OBJECT_0 + 1 || result == WAIT_TIMEOUT);
+  }
+
+  UTIL_LOG(L3, (_T("[TimerService::Run exit]")));
+}
+
+uint64 TimerService::GetElapsedMs() {
+  const DWORD tick_count = ::GetTickCount();
+
+  // The unsigned subtraction handles the tick count wrapping around.
+  elapsed_ms_ += tick_count - last_tick_count_;
+  last_tick_count_ = tick_count;
+  return elapsed_ms_;
+}
+
+}  // namespace omaha
@@ -0,0 +1,106 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// TimerService runs one shot timers on a dedicated thread. The timers are kept
+// in a TimerWheel, so that any number of timers costs a single thread and a
+// single wait, and the timers that can tolerate some delay are coalesced to
+// wake up the machine less often.
+//
+// The callbacks run one at a time on the service thread and must be short. A
+// callback may start or stop any timer, including its own. As with QueueTimer,
+// never destroy a timer from its callback.
+
+#ifndef OMAHA_BASE_TIMER_SERVICE_H_
+#define OMAHA_BASE_TIMER_SERVICE_H_
+
+#include <windows.h>
+#include "base/basictypes.h"
+#include "omaha/base/scoped_any.h"
+#include "omaha/base/synchronized.h"
+#include "omaha/base/timer_wheel.h"
+
+namespace omaha {
+
+class TimerService {
+ public:
+  class Timer : public TimerWheel::Timer {
+   public:
+    typedef void (*Callback)(Timer* timer);
+
+    Timer(Callback callback, void* ctx) : callback_(callback), ctx_(ctx) {}
+
+    void* ctx() const { return ctx_; }
+
+   private:
+    friend class TimerService;
+
+    Callback callback_;
+    void* ctx_;
+
+    DISALLOW_EVIL_CONSTRUCTORS(Timer);
+  };
+
+  TimerService();
+
+  // Stops the service thread. The timers that did not fire are canceled.
+  ~TimerService();
+
+  HRESULT Initialize();
+
+  // Starts the timer, or restarts it if it is already started. The timer fires
+  // once, 'due_time_ms' from now or up to 'slack_ms' later.
+  HRESULT Start(Timer* timer, int due_time_ms, int slack_ms);
+
+  // Stops the timer. If its callback is running on another thread, waits for
+  // the callback to return, so the timer can be destroyed afterwards.
+  void Stop(Timer* timer);
+
+ private:
+  static DWORD WINAPI ThreadProc(void* param);
+  void Run();
+
+  // Returns the milliseconds since the service was created. Unlike the tick
+  // count, it does not wrap around as long as it is called at least once
+  // every 49 days. Must be called with lock_ held.
+  uint64 GetElapsedMs();
+
+  // Protects the members below, except callback_lock_.
+  LLock lock_;
+
+  // The time origin of the wheel is the creation of the service.
+  TimerWheel wheel_;
+
+  DWORD last_tick_count_;
+  uint64 elapsed_ms_;
+
+  // The timer whose callback is running, if any.
+  Timer* running_timer_;
+
+  // Held while a callback runs. Acquired after lock_.
+  LLock callback_lock_;
+
+  DWORD thread_id_;
+  scoped_handle thread_;
+
+  // Wakes up the service thread when a timer is started.
+  scoped_event wake_event_;
+  scoped_event stop_event_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(TimerService);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_BASE_TIMER_SERVICE_H_
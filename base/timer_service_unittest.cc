@@ -0,0 +1,111 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/scoped_any.h"
+#include "omaha/base/timer_service.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+void NoOpCallback(TimerService::Timer*) {}
+
+}  // namespace
+
+class TimerServiceTest : public testing::Test {
+ protected:
+  TimerServiceTest()
+      : timer1_(&TimerServiceTest::Callback, this),
+        timer2_(&TimerServiceTest::Callback, this),
+        cnt_(0),
+        max_cnt_(0) {}
+
+  virtual void SetUp() {
+    reset(ev_, ::CreateEvent(NULL, true, false, NULL));
+    ASSERT_TRUE(ev_);
+    ASSERT_HRESULT_SUCCEEDED(timer_service_.Initialize());
+  }
+
+  virtual void TearDown() {
+    timer_service_.Stop(&timer1_);
+    timer_service_.Stop(&timer2_);
+  }
+
+  // Restarts the timer until it fired max_cnt_ times, then signals ev_.
+  static void Callback(TimerService::Timer* timer);
+
+  TimerService::Timer timer1_;
+  TimerService::Timer timer2_;
+  TimerService timer_service_;
+  scoped_event ev_;
+  volatile LONG cnt_;
+  LONG max_cnt_;
+};
+
+void TimerServiceTest::Callback(TimerService::Timer* timer) {
+  ASSERT_TRUE(timer);
+  TimerServiceTest* test = static_cast<TimerServiceTest*>(timer->ctx());
+  if (::InterlockedIncrement(&test->cnt_) < test->max_cnt_) {
+    EXPECT_HRESULT_SUCCEEDED(test->timer_service_.Start(timer, 10, 0));
+  } else {
+    EXPECT_TRUE(::SetEvent(get(test->ev_)));
+  }
+}
+
+TEST_F(TimerServiceTest, Alarm) {
+  max_cnt_ = 1;
+  ASSERT_HRESULT_SUCCEEDED(timer_service_.Start(&timer1_, 10, 0));
+  EXPECT_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(get(ev_), 10000));
+  EXPECT_EQ(1, cnt_);
+  EXPECT_FALSE(timer1_.is_scheduled());
+}
+
+TEST_F(TimerServiceTest, RestartFromCallback) {
+  max_cnt_ = 5;
+  ASSERT_HRESULT_SUCCEEDED(timer_service_.Start(&timer1_, 0, 0));
+  EXPECT_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(get(ev_), 10000));
+  EXPECT_EQ(5, cnt_);
+}
+
+TEST_F(TimerServiceTest, Stop) {
+  max_cnt_ = 1;
+  ASSERT_HRESULT_SUCCEEDED(timer_service_.Start(&timer1_, 50, 0));
+  ASSERT_HRESULT_SUCCEEDED(timer_service_.Start(&timer2_, 100, 0));
+  timer_service_.Stop(&timer1_);
+  EXPECT_FALSE(timer1_.is_scheduled());
+
+  EXPECT_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(get(ev_), 10000));
+  ::Sleep(100);
+  EXPECT_EQ(1, cnt_);
+}
+
+// A timer started after a timer with a later due time wakes up the service.
+TEST_F(TimerServiceTest, EarlierTimer) {
+  max_cnt_ = 1;
+  ASSERT_HRESULT_SUCCEEDED(timer_service_.Start(&timer1_, 60 * 60 * 1000, 0));
+  ASSERT_HRESULT_SUCCEEDED(timer_service_.Start(&timer2_, 10, 0));
+  EXPECT_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(get(ev_), 10000));
+  EXPECT_EQ(1, cnt_);
+  EXPECT_TRUE(timer1_.is_scheduled());
+}
+
+TEST(TimerServiceNotInitializedTest, Start) {
+  TimerService timer_service;
+  TimerService::Timer timer(&NoOpCallback, NULL);
+  EXPECT_EQ(E_UNEXPECTED, timer_service.Start(&timer, 0, 0));
+}
+
+}  // namespace omaha
@@ -0,0 +1,277 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/timer_wheel.h"
+#include <algorithm>
+
+namespace omaha {
+
+TimerWheel::Timer::Timer()
+    : prev_(NULL),
+      next_(NULL),
+      expiry_ms_(0),
+      level_(kNotScheduled) {
+}
+
+TimerWheel::TimerWheel(uint64 now_ms)
+    : current_ms_(now_ms),
+      size_(0) {
+  for (int level = 0; level != kNumLevels; ++level) {
+    for (int slot = 0; slot != kNumSlots; ++slot) {
+      InitList(&slots_[level][slot]);
+    }
+    num_timers_[level] = 0;
+  }
+  InitList(&overdue_);
+  InitList(&expired_);
+}
+
+TimerWheel::~TimerWheel() {
+  // Leaves the timers that are still scheduled in a state that lets them be
+  // scheduled on another wheel.
+  for (int level = 0; level != kNumLevels; ++level) {
+    for (int slot = 0; slot != kNumSlots; ++slot) {
+      while (!IsListEmpty(&slots_[level][slot])) {
+        Cancel(slots_[level][slot].next_);
+      }
+    }
+  }
+  while (!IsListEmpty(&overdue_)) {
+    Cancel(overdue_.next_);
+  }
+  while (PopExpired()) {
+  }
+}
+
+void TimerWheel::Schedule(Timer* timer, uint64 expiry_ms, uint64 slack_ms) {
+  Cancel(timer);
+  timer->expiry_ms_ = Coalesce(expiry_ms, slack_ms);
+  ++size_;
+  Insert(timer);
+}
+
+bool TimerWheel::Cancel(Timer* timer) {
+  if (!timer->is_scheduled()) {
+    return false;
+  }
+
+  Unlink(timer);
+  if (timer->level_ >= 0) {
+    --num_timers_[timer->level_];
+  }
+  timer->level_ = kNotScheduled;
+  --size_;
+  return true;
+}
+
+void TimerWheel::Advance(uint64 now_ms) {
+  ExpireOverdue();
+
+  while (current_ms_ <= now_ms) {
+    int level = 0;
+    while (level != kNumLevels && !num_timers_[level]) {
+      ++level;
+    }
+    if (level == kNumLevels) {
+      current_ms_ = now_ms + 1;
+      return;
+    }
+
+    // With the lower levels empty, nothing happens until the next slot of
+    // the lowest non-empty level starts.
+    const uint64 span_mask = LevelSpan(level) - 1;
+    if (level && (current_ms_ & span_mask)) {
+      const uint64 next_slot_ms = (current_ms_ | span_mask) + 1;
+      if (next_slot_ms > now_ms) {
+        current_ms_ = now_ms + 1;
+        return;
+      }
+      current_ms_ = next_slot_ms;
+    }
+
+    Tick();
+  }
+}
+
+TimerWheel::Timer* TimerWheel::PopExpired() {
+  if (IsListEmpty(&expired_)) {
+    return NULL;
+  }
+
+  Timer* timer = expired_.next_;
+  Unlink(timer);
+  timer->level_ = kNotScheduled;
+  --size_;
+  return timer;
+}
+
+bool TimerWheel::GetNextExpiry(uint64* expiry_ms) const {
+  if (!size_) {
+    return false;
+  }
+
+  uint64 next_expiry_ms = kuint64max;
+  for (const Timer* timer = expired_.next_;
+       timer != &expired_;
+       timer = timer->next_) {
+    next_expiry_ms = std::min(next_expiry_ms, timer->expiry_ms_);
+  }
+  if (!IsListEmpty(&overdue_)) {
+    next_expiry_ms = std::min(next_expiry_ms, overdue_.next_->expiry_ms_);
+  }
+  for (int level = 0; level != kNumLevels; ++level) {
+    if (!num_timers_[level]) {
+      continue;
+    }
+    for (int slot = 0; slot != kNumSlots; ++slot) {
+      const Timer* head = &slots_[level][slot];
+      for (const Timer* timer = head->next_;
+           timer != head;
+           timer = timer->next_) {
+        next_expiry_ms = std::min(next_expiry_ms, timer->expiry_ms_);
+      }
+    }
+  }
+
+  *expiry_ms = next_expiry_ms;
+  return true;
+}
+
+uint64 TimerWheel::Coalesce(uint64 expiry_ms, uint64 slack_ms) {
+  if (!slack_ms) {
+    return expiry_ms;
+  }
+
+  uint64 granularity = 1;
+  while (granularity <= slack_ms / 2) {
+    granularity *= 2;
+  }
+
+  const uint64 rounded_ms = expiry_ms + granularity - 1;
+  if (rounded_ms < expiry_ms) {
+    return expiry_ms;
+  }
+  return rounded_ms - rounded_ms % granularity;
+}
+
+void TimerWheel::InitList(Timer* head) {
+  head->prev_ = head;
+  head->next_ = head;
+}
+
+void TimerWheel::PushBack(Timer* head, Timer* timer) {
+  timer->prev_ = head->prev_;
+  timer->next_ = head;
+  head->prev_->next_ = timer;
+  head->prev_ = timer;
+}
+
+void TimerWheel::Unlink(Timer* timer) {
+  timer->prev_->next_ = timer->next_;
+  timer->next_->prev_ = timer->prev_;
+  timer->prev_ = NULL;
+  timer->next_ = NULL;
+}
+
+void TimerWheel::Insert(Timer* timer) {
+  // The time before current_ms_ has been processed already, so the timers due
+  // then wait in overdue_, in order of expiry, for the next Advance.
+  if (timer->expiry_ms_ < current_ms_) {
+    Timer* next = &overdue_;
+    while (next->prev_ != &overdue_ &&
+           next->prev_->expiry_ms_ > timer->expiry_ms_) {
+      next = next->prev_;
+    }
+    timer->level_ = kOverdue;
+    PushBack(next, timer);
+    return;
+  }
+
+  uint64 expiry_ms = timer->expiry_ms_;
+  const uint64 delta_ms = expiry_ms - current_ms_;
+
+  int level = 0;
+  while (level != kNumLevels - 1 && delta_ms >= LevelSpan(level + 1)) {
+    ++level;
+  }
+
+  // Timers past the range of the wheel wait in the last slot and are
+  // reinserted when it is cascaded.
+  if (delta_ms >= LevelSpan(kNumLevels)) {
+    expiry_ms = current_ms_ + LevelSpan(kNumLevels) - 1;
+  }
+
+  const int slot = static_cast<int>(
+      (expiry_ms >> (kSlotBits * level)) & kSlotMask);
+  timer->level_ = level;
+  ++num_timers_[level];
+  PushBack(&slots_[level][slot], timer);
+}
+
+void TimerWheel::ExpireOverdue() {
+  while (!IsListEmpty(&overdue_)) {
+    Timer* timer = overdue_.next_;
+    Unlink(timer);
+    timer->level_ = kExpired;
+    PushBack(&expired_, timer);
+  }
+}
+
+void TimerWheel::Tick() {
+  for (int level = 1; level != kNumLevels; ++level) {
+    if (current_ms_ & (LevelSpan(level) - 1)) {
+      break;
+    }
+    Cascade(level,
+            static_cast<int>((current_ms_ >> (kSlotBits * level)) & kSlotMask));
+  }
+
+  Timer* head = &slots_[0][current_ms_ & kSlotMask];
+  while (!IsListEmpty(head)) {
+    Timer* timer = head->next_;
+    Unlink(timer);
+    --num_timers_[0];
+    timer->level_ = kExpired;
+    PushBack(&expired_, timer);
+  }
+
+  ++current_ms_;
+}
+
+void TimerWheel::Cascade(int level, int slot) {
+  Timer* head = &slots_[level][slot];
+  if (IsListEmpty(head)) {
+    return;
+  }
+
+  // Detaches the timers first, since a timer past the range of the wheel goes
+  // back to the same slot.
+  Timer cascaded;
+  InitList(&cascaded);
+  cascaded.prev_ = head->prev_;
+  cascaded.next_ = head->next_;
+  cascaded.prev_->next_ = &cascaded;
+  cascaded.next_->prev_ = &cascaded;
+  InitList(head);
+
+  while (!IsListEmpty(&cascaded)) {
+    Timer* timer = cascaded.next_;
+    Unlink(timer);
+    --num_timers_[level];
+    Insert(timer);
+  }
+}
+
+}  // namespace omaha
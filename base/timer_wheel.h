@@ -0,0 +1,158 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// TimerWheel is a hierarchical timing wheel, the data structure behind
+// TimerService. It keeps any number of one shot timers and finds the expired
+// ones as time advances. Scheduling and canceling a timer takes constant time,
+// and advancing time costs one step per expired timer plus one step per slot
+// boundary of the lowest level that holds timers.
+//
+// The wheel does not read any clock. The caller passes the current time to
+// Advance, in milliseconds since an arbitrary origin, which lets tests drive
+// the wheel in virtual time. This file only depends on the standard library so
+// that it can be built and tested on any platform. The wheel is not
+// thread-safe.
+
+#ifndef OMAHA_BASE_TIMER_WHEEL_H_
+#define OMAHA_BASE_TIMER_WHEEL_H_
+
+#include "base/basictypes.h"
+
+namespace omaha {
+
+class TimerWheel {
+ public:
+  // The caller owns the timers. A timer must be canceled or popped from the
+  // expired list before it is destroyed.
+  class Timer {
+   public:
+    Timer();
+
+    bool is_scheduled() const { return level_ != kNotScheduled; }
+
+    // The time the timer expires at, after coalescing.
+    uint64 expiry_ms() const { return expiry_ms_; }
+
+   private:
+    friend class TimerWheel;
+
+    // Doubly linked list node, which lets the timer be removed from its slot
+    // without a lookup.
+    Timer* prev_;
+    Timer* next_;
+
+    uint64 expiry_ms_;
+
+    // The level of the slot the timer is in, kOverdue, kExpired, or
+    // kNotScheduled.
+    int level_;
+
+    DISALLOW_COPY_AND_ASSIGN(Timer);
+  };
+
+  // Each level has kNumSlots slots. A slot at level n spans kNumSlots^n
+  // milliseconds, so the wheel covers 2^36 ms, or about two years. Timers past
+  // that are kept in the last slot and moved as time advances.
+  static const int kSlotBits = 6;
+  static const int kNumSlots = 1 << kSlotBits;
+  static const int kNumLevels = 6;
+
+  explicit TimerWheel(uint64 now_ms);
+  ~TimerWheel();
+
+  // Schedules the timer to expire at 'expiry_ms'. If the timer is already
+  // scheduled, it is rescheduled. To reduce the number of wake ups, the
+  // expiry may be delayed by up to 'slack_ms' to a multiple of the largest
+  // power of two not greater than 'slack_ms', so that timers with overlapping
+  // slack expire together.
+  void Schedule(Timer* timer, uint64 expiry_ms, uint64 slack_ms);
+
+  // Returns true if the timer was scheduled, false if it already expired or
+  // was never scheduled.
+  bool Cancel(Timer* timer);
+
+  // Moves the timers that expire at or before 'now_ms' to the expired list, in
+  // order of expiry. 'now_ms' must not go back in time.
+  void Advance(uint64 now_ms);
+
+  // Removes and returns the first timer on the expired list, or NULL if the
+  // list is empty.
+  Timer* PopExpired();
+
+  // Returns false if no timer is scheduled. Otherwise, returns the earliest
+  // expiry, which is in the past if there are expired timers. Takes time
+  // linear in the number of timers.
+  bool GetNextExpiry(uint64* expiry_ms) const;
+
+  // Returns the number of scheduled timers, including the expired ones.
+  size_t size() const { return size_; }
+
+  // Returns the first millisecond Advance has not processed yet.
+  uint64 current_ms() const { return current_ms_; }
+
+  static uint64 Coalesce(uint64 expiry_ms, uint64 slack_ms);
+
+ private:
+  static const int kExpired = -1;
+  static const int kNotScheduled = -2;
+  static const int kOverdue = -3;
+  static const int kSlotMask = kNumSlots - 1;
+
+  // The lists are circular and their head is a sentinel timer, so that
+  // linking and unlinking a timer never looks at the list it is in.
+  static void InitList(Timer* head);
+  static bool IsListEmpty(const Timer* head) { return head->next_ == head; }
+  // Links the timer before 'head', which is the back of the list when 'head'
+  // is the sentinel.
+  static void PushBack(Timer* head, Timer* timer);
+  static void Unlink(Timer* timer);
+
+  // Links the timer in the slot its expiry falls in, given current_ms_. A
+  // timer that expires before current_ms_ is linked in overdue_ instead.
+  void Insert(Timer* timer);
+
+  // Moves the overdue timers to the expired list.
+  void ExpireOverdue();
+
+  // Processes current_ms_: cascades the higher level slots that start at
+  // current_ms_ to the lower levels, then expires the timers in the level 0
+  // slot.
+  void Tick();
+
+  // Reinserts the timers in the slot.
+  void Cascade(int level, int slot);
+
+  static uint64 LevelSpan(int level) {
+    return static_cast<uint64>(1) << (kSlotBits * level);
+  }
+
+  uint64 current_ms_;
+  size_t size_;
+
+  Timer slots_[kNumLevels][kNumSlots];
+  int num_timers_[kNumLevels];
+
+  // The timers scheduled to expire before current_ms_, sorted by expiry. They
+  // expire on the next call to Advance.
+  Timer overdue_;
+
+  Timer expired_;
+
+  DISALLOW_COPY_AND_ASSIGN(TimerWheel);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_BASE_TIMER_WHEEL_H_
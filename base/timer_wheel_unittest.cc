@@ -0,0 +1,258 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+// This test only depends on gtest so that it can run on any platform.
+
+#include <vector>
+#include "base/scoped_ptr.h"
+#include "omaha/base/timer_wheel.h"
+#include "omaha/third_party/gtest/include/gtest/gtest.h"
+
+namespace omaha {
+
+namespace {
+
+typedef TimerWheel::Timer Timer;
+
+// Pops the expired timers and returns their indexes in 'timers'.
+std::vector<int> PopAll(TimerWheel* wheel, const Timer* timers) {
+  std::vector<int> indexes;
+  while (Timer* timer = wheel->PopExpired()) {
+    indexes.push_back(static_cast<int>(timer - timers));
+  }
+  return indexes;
+}
+
+}  // namespace
+
+TEST(TimerWheelTest, Empty) {
+  TimerWheel wheel(1000);
+  EXPECT_EQ(0, wheel.size());
+  EXPECT_EQ(1000, wheel.current_ms());
+
+  uint64 expiry_ms = 0;
+  EXPECT_FALSE(wheel.GetNextExpiry(&expiry_ms));
+  EXPECT_TRUE(wheel.PopExpired() == NULL);
+
+  // Advancing an empty wheel takes constant time.
+  wheel.Advance(kuint64max - 1);
+  EXPECT_EQ(kuint64max, wheel.current_ms());
+}
+
+TEST(TimerWheelTest, ExpiresInOrder) {
+  TimerWheel wheel(0);
+  Timer timers[4];
+  wheel.Schedule(&timers[0], 100000, 0);
+  wheel.Schedule(&timers[1], 10, 0);
+  wheel.Schedule(&timers[2], 5000, 0);
+  wheel.Schedule(&timers[3], 10, 0);
+  EXPECT_EQ(4, wheel.size());
+
+  uint64 expiry_ms = 0;
+  EXPECT_TRUE(wheel.GetNextExpiry(&expiry_ms));
+  EXPECT_EQ(10, expiry_ms);
+
+  wheel.Advance(9);
+  EXPECT_TRUE(PopAll(&wheel, timers).empty());
+
+  wheel.Advance(10);
+  std::vector<int> expired = PopAll(&wheel, timers);
+  ASSERT_EQ(2, expired.size());
+  EXPECT_EQ(1, expired[0]);
+  EXPECT_EQ(3, expired[1]);
+  EXPECT_FALSE(timers[1].is_scheduled());
+
+  wheel.Advance(99999);
+  expired = PopAll(&wheel, timers);
+  ASSERT_EQ(1, expired.size());
+  EXPECT_EQ(2, expired[0]);
+
+  EXPECT_TRUE(wheel.GetNextExpiry(&expiry_ms));
+  EXPECT_EQ(100000, expiry_ms);
+  wheel.Advance(100000);
+  expired = PopAll(&wheel, timers);
+  ASSERT_EQ(1, expired.size());
+  EXPECT_EQ(0, expired[0]);
+  EXPECT_EQ(0, wheel.size());
+}
+
+TEST(TimerWheelTest, Cancel) {
+  TimerWheel wheel(0);
+  Timer timers[2];
+  wheel.Schedule(&timers[0], 300, 0);
+  wheel.Schedule(&timers[1], 300, 0);
+
+  EXPECT_TRUE(wheel.Cancel(&timers[0]));
+  EXPECT_FALSE(wheel.Cancel(&timers[0]));
+  EXPECT_FALSE(timers[0].is_scheduled());
+  EXPECT_EQ(1, wheel.size());
+
+  wheel.Advance(1000);
+  std::vector<int> expired = PopAll(&wheel, timers);
+  ASSERT_EQ(1, expired.size());
+  EXPECT_EQ(1, expired[0]);
+}
+
+TEST(TimerWheelTest, CancelExpired) {
+  TimerWheel wheel(0);
+  Timer timer;
+  wheel.Schedule(&timer, 1, 0);
+  wheel.Advance(1);
+  EXPECT_EQ(1, wheel.size());
+  EXPECT_TRUE(wheel.Cancel(&timer));
+  EXPECT_TRUE(wheel.PopExpired() == NULL);
+  EXPECT_EQ(0, wheel.size());
+}
+
+TEST(TimerWheelTest, Reschedule) {
+  TimerWheel wheel(0);
+  Timer timer;
+  wheel.Schedule(&timer, 5000, 0);
+  wheel.Schedule(&timer, 20, 0);
+  EXPECT_EQ(1, wheel.size());
+
+  wheel.Advance(20);
+  EXPECT_EQ(&timer, wheel.PopExpired());
+  wheel.Advance(10000);
+  EXPECT_TRUE(wheel.PopExpired() == NULL);
+}
+
+TEST(TimerWheelTest, PastExpiry) {
+  TimerWheel wheel(1000);
+  Timer timer;
+  wheel.Schedule(&timer, 10, 0);
+  wheel.Advance(1000);
+  EXPECT_EQ(&timer, wheel.PopExpired());
+}
+
+// After Advance(now), the time up to now has been processed. Timers due by
+// now still expire on the next Advance to now, in order of expiry.
+TEST(TimerWheelTest, DueNowAfterAdvance) {
+  TimerWheel wheel(0);
+  wheel.Advance(1000);
+
+  Timer timers[3];
+  wheel.Schedule(&timers[0], 1000, 0);
+  wheel.Schedule(&timers[1], 500, 0);
+  wheel.Schedule(&timers[2], 1001, 0);
+  EXPECT_TRUE(wheel.PopExpired() == NULL);
+
+  uint64 expiry_ms = 0;
+  EXPECT_TRUE(wheel.GetNextExpiry(&expiry_ms));
+  EXPECT_EQ(500, expiry_ms);
+
+  wheel.Advance(1000);
+  std::vector<int> expired = PopAll(&wheel, timers);
+  ASSERT_EQ(2, expired.size());
+  EXPECT_EQ(1, expired[0]);
+  EXPECT_EQ(0, expired[1]);
+
+  wheel.Advance(1001);
+  expired = PopAll(&wheel, timers);
+  ASSERT_EQ(1, expired.size());
+  EXPECT_EQ(2, expired[0]);
+  EXPECT_EQ(0, wheel.size());
+}
+
+TEST(TimerWheelTest, CancelOverdue) {
+  TimerWheel wheel(0);
+  wheel.Advance(1000);
+
+  Timer timer;
+  wheel.Schedule(&timer, 0, 0);
+  EXPECT_TRUE(wheel.Cancel(&timer));
+  EXPECT_EQ(0, wheel.size());
+  wheel.Advance(1000);
+  EXPECT_TRUE(wheel.PopExpired() == NULL);
+}
+
+TEST(TimerWheelTest, BeyondRange) {
+  const uint64 kRangeMs = static_cast<uint64>(1) << 36;
+  TimerWheel wheel(12345);
+  Timer timer;
+  const uint64 expiry_ms = 12345 + 3 * kRangeMs + 17;
+  wheel.Schedule(&timer, expiry_ms, 0);
+
+  wheel.Advance(expiry_ms - 1);
+  EXPECT_TRUE(wheel.PopExpired() == NULL);
+  wheel.Advance(expiry_ms);
+  EXPECT_EQ(&timer, wheel.PopExpired());
+}
+
+TEST(TimerWheelTest, Coalesce) {
+  EXPECT_EQ(1001, TimerWheel::Coalesce(1001, 0));
+  EXPECT_EQ(1001, TimerWheel::Coalesce(1001, 1));
+  EXPECT_EQ(1024, TimerWheel::Coalesce(1001, 100));
+  EXPECT_EQ(1024, TimerWheel::Coalesce(1024, 100));
+  EXPECT_EQ(1088, TimerWheel::Coalesce(1025, 127));
+  EXPECT_EQ(kuint64max, TimerWheel::Coalesce(kuint64max, 1000));
+
+  // Timers with overlapping slack expire together.
+  TimerWheel wheel(0);
+  Timer timers[2];
+  wheel.Schedule(&timers[0], 1000, 100);
+  wheel.Schedule(&timers[1], 1020, 100);
+  EXPECT_EQ(timers[0].expiry_ms(), timers[1].expiry_ms());
+  EXPECT_LE(1020, timers[0].expiry_ms());
+  EXPECT_GE(1100, timers[0].expiry_ms());
+}
+
+// Schedules many timers with pseudo random expiries, advances in steps of
+// varying size, and checks each timer expires on time and once.
+TEST(TimerWheelTest, ManyTimers) {
+  const int kNumTimers = 5000;
+  const uint64 kStartMs = 987654321;
+
+  TimerWheel wheel(kStartMs);
+  scoped_array<Timer> timers(new Timer[kNumTimers]);
+  std::vector<uint64> expiries(kNumTimers);
+  std::vector<bool> fired(kNumTimers, false);
+
+  uint32 seed = 1;
+  for (int i = 0; i != kNumTimers; ++i) {
+    seed = seed * 1103515245 + 12345;
+    const int shift = static_cast<int>(seed >> 28) * 2;
+    expiries[i] = kStartMs + 1 + ((seed >> 4) & ((1 << shift) - 1));
+    wheel.Schedule(&timers[i], expiries[i], 0);
+  }
+
+  // Cancels every tenth timer.
+  for (int i = 0; i < kNumTimers; i += 10) {
+    EXPECT_TRUE(wheel.Cancel(&timers[i]));
+  }
+
+  uint64 now_ms = kStartMs;
+  uint64 step_ms = 1;
+  while (wheel.size()) {
+    const uint64 previous_ms = now_ms;
+    now_ms += step_ms;
+    step_ms = step_ms * 3 % 100003 + 1;
+    wheel.Advance(now_ms);
+    while (Timer* timer = wheel.PopExpired()) {
+      const int i = static_cast<int>(timer - timers.get());
+      EXPECT_NE(0, i % 10);
+      EXPECT_FALSE(fired[i]);
+      EXPECT_LE(expiries[i], now_ms);
+      EXPECT_GT(expiries[i], previous_ms);
+      fired[i] = true;
+    }
+  }
+
+  for (int i = 0; i != kNumTimers; ++i) {
+    EXPECT_EQ(i % 10 != 0, fired[i]);
+  }
+}
+
+}  // namespace omaha
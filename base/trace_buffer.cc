@@ -0,0 +1,149 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/trace_buffer.h"
+
+namespace omaha {
+
+namespace {
+
+void AppendUint64(uint64 value, std::string* out) {
+  char digits[20];
+  int num_digits = 0;
+  do {
+    digits[num_digits++] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value);
+
+  while (num_digits) {
+    out->push_back(digits[--num_digits]);
+  }
+}
+
+void AppendInt64(int64 value, std::string* out) {
+  if (value < 0) {
+    out->push_back('-');
+    // Negates in unsigned arithmetic so that kint64min does not overflow.
+    AppendUint64(0 - static_cast<uint64>(value), out);
+  } else {
+    AppendUint64(static_cast<uint64>(value), out);
+  }
+}
+
+void AppendJsonString(const char* value, std::string* out) {
+  static const char kHexDigits[] = "0123456789abcdef";
+
+  out->push_back('"');
+  for (const char* p = value ? value : ""; *p; ++p) {
+    const unsigned char c = static_cast<unsigned char>(*p);
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+      out->push_back(c);
+    } else if (c < 0x20) {
+      out->append("\\u00");
+      out->push_back(kHexDigits[c >> 4]);
+      out->push_back(kHexDigits[c & 0xf]);
+    } else {
+      out->push_back(c);
+    }
+  }
+  out->push_back('"');
+}
+
+}  // namespace
+
+TraceRingBuffer::TraceRingBuffer(size_t capacity)
+    : events_(capacity ? capacity : 1),
+      next_(0),
+      size_(0),
+      num_dropped_(0) {
+}
+
+void TraceRingBuffer::Add(const TraceEvent& event) {
+  events_[next_] = event;
+  next_ = (next_ + 1) % events_.size();
+  if (size_ < events_.size()) {
+    ++size_;
+  } else {
+    ++num_dropped_;
+  }
+}
+
+void TraceRingBuffer::CopyTo(std::vector<TraceEvent>* events) const {
+  const size_t first = (next_ + events_.size() - size_) % events_.size();
+  for (size_t i = 0; i != size_; ++i) {
+    events->push_back(events_[(first + i) % events_.size()]);
+  }
+}
+
+void TraceRingBuffer::Clear() {
+  next_ = 0;
+  size_ = 0;
+  num_dropped_ = 0;
+}
+
+uint64 TicksToMicroseconds(uint64 ticks, uint64 ticks_per_sec) {
+  const uint64 kMicrosecondsPerSecond = 1000000;
+  if (!ticks_per_sec) {
+    return 0;
+  }
+  return ticks / ticks_per_sec * kMicrosecondsPerSecond +
+         ticks % ticks_per_sec * kMicrosecondsPerSecond / ticks_per_sec;
+}
+
+void FormatChromeTrace(const std::vector<TraceEvent>& events,
+                       uint32 process_id,
+                       uint64 base_ticks,
+                       uint64 ticks_per_sec,
+                       std::string* json) {
+  json->append("{\"traceEvents\":[");
+  for (size_t i = 0; i != events.size(); ++i) {
+    const TraceEvent& event = events[i];
+
+    // Events recorded before the base or that end before they begin are
+    // clamped rather than dropped.
+    const uint64 begin_ticks = event.begin_ticks > base_ticks ?
+                               event.begin_ticks - base_ticks : 0;
+    const uint64 duration_ticks = event.end_ticks > event.begin_ticks ?
+                                  event.end_ticks - event.begin_ticks : 0;
+
+    if (i) {
+      json->push_back(',');
+    }
+    json->append("\n{\"name\":");
+    AppendJsonString(event.name, json);
+    json->append(",\"cat\":");
+    AppendJsonString(event.category, json);
+    json->append(",\"ph\":\"X\",\"ts\":");
+    AppendUint64(TicksToMicroseconds(begin_ticks, ticks_per_sec), json);
+    json->append(",\"dur\":");
+    AppendUint64(TicksToMicroseconds(duration_ticks, ticks_per_sec), json);
+    json->append(",\"pid\":");
+    AppendUint64(process_id, json);
+    json->append(",\"tid\":");
+    AppendUint64(event.thread_id, json);
+    if (event.arg_name) {
+      json->append(",\"args\":{");
+      AppendJsonString(event.arg_name, json);
+      json->push_back(':');
+      AppendInt64(event.arg_value, json);
+      json->push_back('}');
+    }
+    json->push_back('}');
+  }
+  json->append("\n],\"displayTimeUnit\":\"ms\"}\n");
+}
+
+}  // namespace omaha
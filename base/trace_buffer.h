@@ -0,0 +1,87 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// The platform independent part of span tracing: the fixed size buffer the
+// completed spans are recorded in and the export of the spans in the Chrome
+// trace event format, which can be loaded in chrome://tracing. This file only
+// depends on the standard library so that it can be built and tested on any
+// platform. See tracing.h for the recording API.
+
+#ifndef OMAHA_BASE_TRACE_BUFFER_H_
+#define OMAHA_BASE_TRACE_BUFFER_H_
+
+#include <string>
+#include <vector>
+#include "base/basictypes.h"
+
+namespace omaha {
+
+// A completed span. The strings are not copied and must outlive the buffer,
+// which is the case for string literals. The times are in ticks of a clock
+// with an arbitrary origin.
+struct TraceEvent {
+  const char* category;
+  const char* name;
+  const char* arg_name;     // NULL when the span has no argument.
+  int64 arg_value;
+  uint64 begin_ticks;
+  uint64 end_ticks;
+  uint32 thread_id;
+};
+
+// Keeps the most recent events up to a fixed capacity. Once the buffer is
+// full, each new event overwrites the oldest event. The buffer is not
+// thread-safe.
+class TraceRingBuffer {
+ public:
+  explicit TraceRingBuffer(size_t capacity);
+
+  void Add(const TraceEvent& event);
+
+  // Appends the events to the vector, oldest first.
+  void CopyTo(std::vector<TraceEvent>* events) const;
+
+  void Clear();
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return events_.size(); }
+
+  // Returns the number of events overwritten since the buffer was cleared.
+  uint64 num_dropped() const { return num_dropped_; }
+
+ private:
+  std::vector<TraceEvent> events_;
+  size_t next_;     // Where the next event goes.
+  size_t size_;
+  uint64 num_dropped_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceRingBuffer);
+};
+
+// Formats the events as a Chrome trace event JSON object of complete ("X")
+// events. The event times are converted to microseconds since base_ticks.
+void FormatChromeTrace(const std::vector<TraceEvent>& events,
+                       uint32 process_id,
+                       uint64 base_ticks,
+                       uint64 ticks_per_sec,
+                       std::string* json);
+
+// Converts a tick count to microseconds without overflowing for tick counts
+// that span days at GHz frequencies.
+uint64 TicksToMicroseconds(uint64 ticks, uint64 ticks_per_sec);
+
+}  // namespace omaha
+
+#endif  // OMAHA_BASE_TRACE_BUFFER_H_
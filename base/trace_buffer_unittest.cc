@@ -0,0 +1,136 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+// This test only depends on gtest so that it can run on any platform.
+
+#include <string>
+#include <vector>
+#include "omaha/base/trace_buffer.h"
+#include "omaha/third_party/gtest/include/gtest/gtest.h"
+
+namespace omaha {
+
+namespace {
+
+TraceEvent MakeEvent(const char* name, uint64 begin_ticks, uint64 end_ticks) {
+  TraceEvent event = {"test", name, NULL, 0, begin_ticks, end_ticks, 1};
+  return event;
+}
+
+}  // namespace
+
+TEST(TraceRingBufferTest, Empty) {
+  TraceRingBuffer buffer(4);
+  EXPECT_EQ(0, buffer.size());
+  EXPECT_EQ(4, buffer.capacity());
+  EXPECT_EQ(0, buffer.num_dropped());
+
+  std::vector<TraceEvent> events;
+  buffer.CopyTo(&events);
+  EXPECT_TRUE(events.empty());
+}
+
+TEST(TraceRingBufferTest, AddBelowCapacity) {
+  TraceRingBuffer buffer(4);
+  buffer.Add(MakeEvent("a", 1, 2));
+  buffer.Add(MakeEvent("b", 3, 4));
+  EXPECT_EQ(2, buffer.size());
+
+  std::vector<TraceEvent> events;
+  buffer.CopyTo(&events);
+  ASSERT_EQ(2, events.size());
+  EXPECT_STREQ("a", events[0].name);
+  EXPECT_STREQ("b", events[1].name);
+  EXPECT_EQ(0, buffer.num_dropped());
+}
+
+TEST(TraceRingBufferTest, Wraparound) {
+  TraceRingBuffer buffer(3);
+  const char* const kNames[] = {"a", "b", "c", "d", "e"};
+  for (int i = 0; i != arraysize(kNames); ++i) {
+    buffer.Add(MakeEvent(kNames[i], i, i + 1));
+  }
+  EXPECT_EQ(3, buffer.size());
+  EXPECT_EQ(2, buffer.num_dropped());
+
+  // The oldest events are overwritten and the order is preserved.
+  std::vector<TraceEvent> events;
+  buffer.CopyTo(&events);
+  ASSERT_EQ(3, events.size());
+  EXPECT_STREQ("c", events[0].name);
+  EXPECT_STREQ("d", events[1].name);
+  EXPECT_STREQ("e", events[2].name);
+
+  buffer.Clear();
+  EXPECT_EQ(0, buffer.size());
+  EXPECT_EQ(0, buffer.num_dropped());
+  events.clear();
+  buffer.CopyTo(&events);
+  EXPECT_TRUE(events.empty());
+}
+
+TEST(TraceRingBufferTest, ZeroCapacity) {
+  TraceRingBuffer buffer(0);
+  EXPECT_EQ(1, buffer.capacity());
+  buffer.Add(MakeEvent("a", 1, 2));
+  buffer.Add(MakeEvent("b", 3, 4));
+
+  std::vector<TraceEvent> events;
+  buffer.CopyTo(&events);
+  ASSERT_EQ(1, events.size());
+  EXPECT_STREQ("b", events[0].name);
+}
+
+TEST(TraceBufferTest, TicksToMicroseconds) {
+  EXPECT_EQ(0, TicksToMicroseconds(0, 1000));
+  EXPECT_EQ(1000, TicksToMicroseconds(1, 1000));
+  EXPECT_EQ(1500000, TicksToMicroseconds(1500, 1000));
+  EXPECT_EQ(0, TicksToMicroseconds(1500, 0));
+
+  // A week at 3 GHz overflows a naive ticks * 1000000 / frequency.
+  const uint64 kFrequency = 3000000000ULL;
+  const uint64 kWeekSec = 7 * 24 * 60 * 60;
+  EXPECT_EQ(kWeekSec * 1000000 + 1,
+            TicksToMicroseconds(kWeekSec * kFrequency + 3000, kFrequency));
+}
+
+TEST(TraceBufferTest, FormatChromeTrace_Empty) {
+  std::vector<TraceEvent> events;
+  std::string json;
+  FormatChromeTrace(events, 12, 0, 1000, &json);
+  EXPECT_STREQ("{\"traceEvents\":[\n],\"displayTimeUnit\":\"ms\"}\n",
+               json.c_str());
+}
+
+TEST(TraceBufferTest, FormatChromeTrace) {
+  std::vector<TraceEvent> events;
+  events.push_back(MakeEvent("a", 1010, 1030));
+
+  TraceEvent event = {"net", "quo\"te\\\n", "bytes", -5, 1005, 1000, 7};
+  events.push_back(event);
+
+  std::string json;
+  FormatChromeTrace(events, 12, 1000, 1000, &json);
+  EXPECT_STREQ(
+      "{\"traceEvents\":["
+      "\n{\"name\":\"a\",\"cat\":\"test\",\"ph\":\"X\","
+      "\"ts\":10000,\"dur\":20000,\"pid\":12,\"tid\":1},"
+      "\n{\"name\":\"quo\\\"te\\\\\\u000a\",\"cat\":\"net\",\"ph\":\"X\","
+      "\"ts\":5000,\"dur\":0,\"pid\":12,\"tid\":7,\"args\":{\"bytes\":-5}}"
+      "\n],\"displayTimeUnit\":\"ms\"}\n",
+      json.c_str());
+}
+
+}  // namespace omaha
@@ -0,0 +1,170 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/tracing.h"
+#include <string>
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/scoped_any.h"
+
+namespace omaha {
+
+volatile LONG Tracer::is_enabled_ = 0;
+size_t Tracer::events_per_thread_ = Tracer::kDefaultEventsPerThread;
+ULONGLONG Tracer::enable_ticks_ = 0;
+DWORD Tracer::tls_index_ = TLS_OUT_OF_INDEXES;
+std::vector<Tracer::ThreadBuffer*> Tracer::buffers_;
+LLock Tracer::lock_;
+
+void Tracer::Enable(size_t events_per_thread) {
+  __mutexScope(lock_);
+
+  if (tls_index_ == TLS_OUT_OF_INDEXES) {
+    tls_index_ = ::TlsAlloc();
+    if (tls_index_ == TLS_OUT_OF_INDEXES) {
+      UTIL_LOG(LE, (_T("[TlsAlloc failed][0x%08x]"), HRESULTFromLastError()));
+      return;
+    }
+  }
+
+  // The capacity applies to the buffers created from now on.
+  events_per_thread_ = events_per_thread;
+  if (!IsEnabled()) {
+    enable_ticks_ = HighresTimer::GetCurrentTicks();
+  }
+  ::InterlockedExchange(&is_enabled_, 1);
+}
+
+void Tracer::Disable() {
+  ::InterlockedExchange(&is_enabled_, 0);
+}
+
+void Tracer::AddEvent(const TraceEvent& event) {
+  ThreadBuffer* buffer = GetThreadBuffer();
+  if (!buffer) {
+    return;
+  }
+
+  __mutexScope(buffer->lock);
+  buffer->events.Add(event);
+}
+
+Tracer::ThreadBuffer* Tracer::GetThreadBuffer() {
+  if (tls_index_ == TLS_OUT_OF_INDEXES) {
+    return NULL;
+  }
+
+  ThreadBuffer* buffer = static_cast<ThreadBuffer*>(::TlsGetValue(tls_index_));
+  if (buffer) {
+    return buffer;
+  }
+
+  __mutexScope(lock_);
+  buffer = new ThreadBuffer(events_per_thread_);
+  if (!::TlsSetValue(tls_index_, buffer)) {
+    delete buffer;
+    return NULL;
+  }
+  buffers_.push_back(buffer);
+  return buffer;
+}
+
+void Tracer::GetEvents(std::vector<TraceEvent>* events) {
+  ASSERT1(events);
+
+  __mutexScope(lock_);
+  for (size_t i = 0; i != buffers_.size(); ++i) {
+    __mutexScope(buffers_[i]->lock);
+    buffers_[i]->events.CopyTo(events);
+  }
+}
+
+void Tracer::Clear() {
+  __mutexScope(lock_);
+  for (size_t i = 0; i != buffers_.size(); ++i) {
+    __mutexScope(buffers_[i]->lock);
+    buffers_[i]->events.Clear();
+  }
+}
+
+HRESULT Tracer::WriteChromeTrace(const CString& file_path) {
+  std::vector<TraceEvent> events;
+  GetEvents(&events);
+
+  // Formatting may take a while and is done without holding any lock.
+  std::string json;
+  FormatChromeTrace(events,
+                    ::GetCurrentProcessId(),
+                    enable_ticks_,
+                    HighresTimer::GetTimerFrequency(),
+                    &json);
+
+  scoped_hfile file(::CreateFile(file_path,
+                                 GENERIC_WRITE,
+                                 0,
+                                 NULL,
+                                 CREATE_ALWAYS,
+                                 FILE_ATTRIBUTE_NORMAL,
+                                 NULL));
+  if (!file) {
+    HRESULT hr = HRESULTFromLastError();
+    UTIL_LOG(LE, (_T("[CreateFile failed][%s][0x%08x]"), file_path, hr));
+    return hr;
+  }
+
+  DWORD bytes_written = 0;
+  if (!::WriteFile(get(file),
+                   json.data(),
+                   json.size(),
+                   &bytes_written,
+                   NULL)) {
+    HRESULT hr = HRESULTFromLastError();
+    UTIL_LOG(LE, (_T("[WriteFile failed][%s][0x%08x]"), file_path, hr));
+    return hr;
+  }
+  ASSERT1(bytes_written == json.size());
+
+  UTIL_LOG(L2, (_T("[Tracer::WriteChromeTrace][%s][%u events]"),
+                file_path, events.size()));
+  return S_OK;
+}
+
+ScopedTraceSpan::ScopedTraceSpan(const char* category, const char* name)
+    : is_enabled_(Tracer::IsEnabled()) {
+  if (!is_enabled_) {
+    return;
+  }
+
+  event_.category = category;
+  event_.name = name;
+  event_.arg_name = NULL;
+  event_.arg_value = 0;
+  event_.thread_id = ::GetCurrentThreadId();
+  event_.end_ticks = 0;
+  event_.begin_ticks = HighresTimer::GetCurrentTicks();
+}
+
+ScopedTraceSpan::~ScopedTraceSpan() {
+  if (!is_enabled_) {
+    return;
+  }
+
+  event_.end_ticks = HighresTimer::GetCurrentTicks();
+  Tracer::AddEvent(event_);
+}
+
+}  // namespace omaha
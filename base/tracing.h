@@ -0,0 +1,111 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// Lightweight span tracing. A span measures a scope with HighresTimer ticks
+// and is recorded, when tracing is enabled, in a ring buffer owned by the
+// calling thread. The spans of all threads can be written as a Chrome trace
+// event file and inspected in chrome://tracing.
+//
+//   void Worker::Foo() {
+//     ScopedTraceSpan span("worker", "Foo");
+//     ...
+//     span.set_arg("num_apps", num_apps);
+//   }
+//
+// The category, name, and argument name must be string literals. When tracing
+// is disabled, a span costs a check of a global flag.
+
+#ifndef OMAHA_BASE_TRACING_H_
+#define OMAHA_BASE_TRACING_H_
+
+#include <windows.h>
+#include <atlstr.h>
+#include <vector>
+#include "base/basictypes.h"
+#include "omaha/base/synchronized.h"
+#include "omaha/base/trace_buffer.h"
+
+namespace omaha {
+
+class Tracer {
+ public:
+  static const size_t kDefaultEventsPerThread = 4096;
+
+  // Starts recording spans. Each thread keeps up to events_per_thread spans.
+  static void Enable(size_t events_per_thread);
+
+  // Stops recording spans. The spans recorded so far are kept.
+  static void Disable();
+
+  static bool IsEnabled() { return is_enabled_ != 0; }
+
+  // Records the span in the buffer of the calling thread.
+  static void AddEvent(const TraceEvent& event);
+
+  // Writes the spans recorded by all threads to the file as Chrome trace
+  // event JSON.
+  static HRESULT WriteChromeTrace(const CString& file_path);
+
+  // Returns the spans recorded by all threads, grouped by thread.
+  static void GetEvents(std::vector<TraceEvent>* events);
+
+  // Discards the spans recorded by all threads.
+  static void Clear();
+
+ private:
+  struct ThreadBuffer {
+    explicit ThreadBuffer(size_t capacity) : events(capacity) {}
+
+    LLock lock;               // Contended only when the events are read.
+    TraceRingBuffer events;
+  };
+
+  static ThreadBuffer* GetThreadBuffer();
+
+  static volatile LONG is_enabled_;
+  static size_t events_per_thread_;
+  static ULONGLONG enable_ticks_;
+
+  // The buffers live until the process exits so that the spans of the
+  // threads that have exited can still be written out.
+  static DWORD tls_index_;
+  static std::vector<ThreadBuffer*> buffers_;
+  static LLock lock_;
+
+  DISALLOW_IMPLICIT_CONSTRUCTORS(Tracer);
+};
+
+// Records the time from construction to destruction as a span.
+class ScopedTraceSpan {
+ public:
+  ScopedTraceSpan(const char* category, const char* name);
+  ~ScopedTraceSpan();
+
+  // Attaches a value to the span, for instance a size or a result.
+  void set_arg(const char* arg_name, int64 arg_value) {
+    event_.arg_name = arg_name;
+    event_.arg_value = arg_value;
+  }
+
+ private:
+  TraceEvent event_;
+  bool is_enabled_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedTraceSpan);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_BASE_TRACING_H_
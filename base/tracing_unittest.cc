@@ -0,0 +1,145 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <string>
+#include <vector>
+#include "omaha/base/app_util.h"
+#include "omaha/base/file.h"
+#include "omaha/base/thread.h"
+#include "omaha/base/tracing.h"
+#include "omaha/base/utils.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+class SpanRunnable : public Runnable {
+ public:
+  SpanRunnable() {}
+  virtual void Run() {
+    ScopedTraceSpan span("test", "thread");
+  }
+};
+
+}  // namespace
+
+class TracerTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    Tracer::Disable();
+    Tracer::Clear();
+  }
+
+  virtual void TearDown() {
+    Tracer::Disable();
+    Tracer::Clear();
+  }
+};
+
+TEST_F(TracerTest, Disabled) {
+  {
+    ScopedTraceSpan span("test", "disabled");
+  }
+
+  std::vector<TraceEvent> events;
+  Tracer::GetEvents(&events);
+  EXPECT_TRUE(events.empty());
+}
+
+TEST_F(TracerTest, Span) {
+  Tracer::Enable(Tracer::kDefaultEventsPerThread);
+  {
+    ScopedTraceSpan outer("test", "outer");
+    {
+      ScopedTraceSpan inner("test", "inner");
+      inner.set_arg("value", 42);
+    }
+  }
+
+  std::vector<TraceEvent> events;
+  Tracer::GetEvents(&events);
+  ASSERT_EQ(2, events.size());
+
+  // The spans are recorded as they end.
+  EXPECT_STREQ("inner", events[0].name);
+  EXPECT_STREQ("test", events[0].category);
+  EXPECT_STREQ("value", events[0].arg_name);
+  EXPECT_EQ(42, events[0].arg_value);
+  EXPECT_EQ(::GetCurrentThreadId(), events[0].thread_id);
+
+  EXPECT_STREQ("outer", events[1].name);
+  EXPECT_EQ(NULL, events[1].arg_name);
+
+  EXPECT_LE(events[1].begin_ticks, events[0].begin_ticks);
+  EXPECT_LE(events[0].begin_ticks, events[0].end_ticks);
+  EXPECT_LE(events[0].end_ticks, events[1].end_ticks);
+}
+
+TEST_F(TracerTest, SpanStartedWhileDisabled) {
+  {
+    ScopedTraceSpan span("test", "span");
+    Tracer::Enable(Tracer::kDefaultEventsPerThread);
+  }
+
+  std::vector<TraceEvent> events;
+  Tracer::GetEvents(&events);
+  EXPECT_TRUE(events.empty());
+}
+
+TEST_F(TracerTest, MultipleThreads) {
+  Tracer::Enable(Tracer::kDefaultEventsPerThread);
+
+  SpanRunnable runnable;
+  Thread thread;
+  ASSERT_TRUE(thread.Start(&runnable));
+  ASSERT_TRUE(thread.WaitTillExit(INFINITE));
+
+  {
+    ScopedTraceSpan span("test", "main");
+  }
+
+  // The spans of the thread are kept after the thread exits.
+  std::vector<TraceEvent> events;
+  Tracer::GetEvents(&events);
+  ASSERT_EQ(2, events.size());
+  EXPECT_NE(events[0].thread_id, events[1].thread_id);
+}
+
+TEST_F(TracerTest, WriteChromeTrace) {
+  Tracer::Enable(Tracer::kDefaultEventsPerThread);
+  {
+    ScopedTraceSpan span("test", "write");
+  }
+
+  CString file_path;
+  EXPECT_TRUE(::GetTempFileName(app_util::GetTempDir(),
+                                _T("trc"),
+                                0,
+                                CStrBuf(file_path, MAX_PATH)));
+  EXPECT_SUCCEEDED(Tracer::WriteChromeTrace(file_path));
+
+  std::vector<byte> buffer;
+  EXPECT_SUCCEEDED(ReadEntireFile(file_path, 0, &buffer));
+  EXPECT_SUCCEEDED(File::Remove(file_path));
+
+  ASSERT_FALSE(buffer.empty());
+  std::string json(reinterpret_cast<const char*>(&buffer.front()),
+                   buffer.size());
+  EXPECT_EQ(0, json.find("{\"traceEvents\":["));
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"write\""));
+}
+
+}  // namespace omaha
@@ -0,0 +1,294 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/utf8.h"
+#include "omaha/base/debug.h"
+#include "omaha/base/static_assert.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#define OMAHA_HAS_SSE2_INTRINSICS 1
+#endif
+
+namespace omaha {
+
+namespace {
+
+STATIC_ASSERT(sizeof(wchar_t) == 2);
+
+// The x86 builds run on processors without SSE2, so the support is detected
+// at run time. Every x64 processor supports SSE2.
+#if defined(OMAHA_HAS_SSE2_INTRINSICS)
+#if defined(_M_X64)
+const bool kHasSse2 = true;
+#else
+const bool kHasSse2 =
+    ::IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE) != 0;
+#endif
+#endif
+
+bool IsHighSurrogate(wchar_t c) {
+  return c >= 0xD800 && c <= 0xDBFF;
+}
+
+bool IsLowSurrogate(wchar_t c) {
+  return c >= 0xDC00 && c <= 0xDFFF;
+}
+
+// The SSE2 helpers convert whole blocks of 16 ASCII characters and return the
+// number of characters converted. They stop at the first block that contains
+// a character that is not ASCII, which the caller converts one by one.
+#if defined(OMAHA_HAS_SSE2_INTRINSICS)
+
+size_t Utf8AsciiBlocksToUtf16(const char* utf8,
+                              size_t num_bytes,
+                              wchar_t* utf16) {
+  const __m128i zero = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 16 <= num_bytes; i += 16) {
+    const __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(utf8 + i));
+    if (_mm_movemask_epi8(bytes)) {
+      break;
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(utf16 + i),
+                     _mm_unpacklo_epi8(bytes, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(utf16 + i + 8),
+                     _mm_unpackhi_epi8(bytes, zero));
+  }
+  return i;
+}
+
+// When utf8 is NULL, only counts the characters.
+size_t Utf16AsciiBlocksToUtf8(const wchar_t* utf16,
+                              size_t num_chars,
+                              char* utf8) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i non_ascii_mask = _mm_set1_epi16(static_cast<int16>(0xFF80));
+  size_t i = 0;
+  for (; i + 16 <= num_chars; i += 16) {
+    const __m128i low =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(utf16 + i));
+    const __m128i high =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(utf16 + i + 8));
+    const __m128i non_ascii =
+        _mm_and_si128(_mm_or_si128(low, high), non_ascii_mask);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(non_ascii, zero)) != 0xFFFF) {
+      break;
+    }
+    if (utf8) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(utf8 + i),
+                       _mm_packus_epi16(low, high));
+    }
+  }
+  return i;
+}
+
+#endif  // OMAHA_HAS_SSE2_INTRINSICS
+
+}  // namespace
+
+size_t Utf8BomLength(const char* utf8, size_t num_bytes) {
+  ASSERT1(utf8 || !num_bytes);
+  if (num_bytes >= 3 &&
+      static_cast<uint8>(utf8[0]) == 0xEF &&
+      static_cast<uint8>(utf8[1]) == 0xBB &&
+      static_cast<uint8>(utf8[2]) == 0xBF) {
+    return 3;
+  }
+  return 0;
+}
+
+size_t Utf16ToUtf8Length(const wchar_t* utf16, size_t num_chars) {
+  ASSERT1(utf16 || !num_chars);
+
+  size_t i = 0;
+#if defined(OMAHA_HAS_SSE2_INTRINSICS)
+  if (kHasSse2) {
+    i = Utf16AsciiBlocksToUtf8(utf16, num_chars, NULL);
+  }
+#endif
+
+  size_t num_bytes = i;
+  while (i < num_chars) {
+    const wchar_t c = utf16[i++];
+    if (c < 0x80) {
+      num_bytes += 1;
+    } else if (c < 0x800) {
+      num_bytes += 2;
+    } else if (IsHighSurrogate(c) && i < num_chars &&
+               IsLowSurrogate(utf16[i])) {
+      num_bytes += 4;
+      ++i;
+    } else {
+      // Includes the unpaired surrogates, encoded as U+FFFD.
+      num_bytes += 3;
+    }
+  }
+  return num_bytes;
+}
+
+size_t Utf16ToUtf8(const wchar_t* utf16, size_t num_chars, char* utf8) {
+  ASSERT1(utf16 || !num_chars);
+  ASSERT1(utf8 || !num_chars);
+
+  size_t i = 0;
+#if defined(OMAHA_HAS_SSE2_INTRINSICS)
+  if (kHasSse2) {
+    i = Utf16AsciiBlocksToUtf8(utf16, num_chars, utf8);
+  }
+#endif
+
+  uint8* out = reinterpret_cast<uint8*>(utf8) + i;
+  while (i < num_chars) {
+    uint32 c = utf16[i++];
+    if (c < 0x80) {
+      *out++ = static_cast<uint8>(c);
+      continue;
+    }
+
+    if (c < 0x800) {
+      *out++ = static_cast<uint8>(0xC0 | (c >> 6));
+      *out++ = static_cast<uint8>(0x80 | (c & 0x3F));
+      continue;
+    }
+
+    if (IsHighSurrogate(static_cast<wchar_t>(c)) && i < num_chars &&
+        IsLowSurrogate(utf16[i])) {
+      c = 0x10000 + ((c - 0xD800) << 10) + (utf16[i++] - 0xDC00);
+      *out++ = static_cast<uint8>(0xF0 | (c >> 18));
+      *out++ = static_cast<uint8>(0x80 | ((c >> 12) & 0x3F));
+      *out++ = static_cast<uint8>(0x80 | ((c >> 6) & 0x3F));
+      *out++ = static_cast<uint8>(0x80 | (c & 0x3F));
+      continue;
+    }
+
+    if (IsHighSurrogate(static_cast<wchar_t>(c)) ||
+        IsLowSurrogate(static_cast<wchar_t>(c))) {
+      c = kReplacementCharacter;
+    }
+    *out++ = static_cast<uint8>(0xE0 | (c >> 12));
+    *out++ = static_cast<uint8>(0x80 | ((c >> 6) & 0x3F));
+    *out++ = static_cast<uint8>(0x80 | (c & 0x3F));
+  }
+  return out - reinterpret_cast<uint8*>(utf8);
+}
+
+size_t Utf8ToUtf16(const char* utf8,
+                   size_t num_bytes,
+                   wchar_t* utf16,
+                   bool* is_valid) {
+  ASSERT1(utf8 || !num_bytes);
+  ASSERT1(utf16 || !num_bytes);
+
+  const uint8* in = reinterpret_cast<const uint8*>(utf8);
+  wchar_t* out = utf16;
+  bool is_well_formed = true;
+
+  size_t i = 0;
+  while (i < num_bytes) {
+    uint32 c = in[i];
+    if (c < 0x80) {
+#if defined(OMAHA_HAS_SSE2_INTRINSICS)
+      if (kHasSse2) {
+        const size_t num_ascii =
+            Utf8AsciiBlocksToUtf16(utf8 + i, num_bytes - i, out);
+        i += num_ascii;
+        out += num_ascii;
+        if (num_ascii) {
+          continue;
+        }
+      }
+#endif
+      *out++ = static_cast<wchar_t>(c);
+      ++i;
+      continue;
+    }
+
+    // The range of the second byte depends on the lead byte, which excludes
+    // the overlong forms, the surrogates and the code points above U+10FFFF.
+    int num_trail_bytes = 0;
+    uint8 lower = 0x80;
+    uint8 upper = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF) {
+      num_trail_bytes = 1;
+      c &= 0x1F;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+      num_trail_bytes = 2;
+      lower = c == 0xE0 ? 0xA0 : 0x80;
+      upper = c == 0xED ? 0x9F : 0xBF;
+      c &= 0x0F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+      num_trail_bytes = 3;
+      lower = c == 0xF0 ? 0x90 : 0x80;
+      upper = c == 0xF4 ? 0x8F : 0xBF;
+      c &= 0x07;
+    }
+
+    size_t j = i + 1;
+    int k = 0;
+    for (; k < num_trail_bytes && j < num_bytes; ++k, ++j) {
+      const uint8 trail = in[j];
+      if (trail < lower || trail > upper) {
+        break;
+      }
+      c = (c << 6) | (trail & 0x3F);
+      lower = 0x80;
+      upper = 0xBF;
+    }
+
+    // An invalid lead byte, or a sequence that is cut short, is replaced. The
+    // byte that cut it short starts the next sequence.
+    if (!num_trail_bytes || k != num_trail_bytes) {
+      *out++ = kReplacementCharacter;
+      is_well_formed = false;
+      i = j;
+      continue;
+    }
+
+    i = j;
+    if (c < 0x10000) {
+      *out++ = static_cast<wchar_t>(c);
+    } else {
+      c -= 0x10000;
+      *out++ = static_cast<wchar_t>(0xD800 + (c >> 10));
+      *out++ = static_cast<wchar_t>(0xDC00 + (c & 0x3FF));
+    }
+  }
+
+  if (is_valid) {
+    *is_valid = is_well_formed;
+  }
+  return out - utf16;
+}
+
+size_t CopyUtf16AsciiPrefix(const wchar_t* utf16, size_t num_chars, char* out) {
+  ASSERT1(utf16 || !num_chars);
+  ASSERT1(out || !num_chars);
+
+  size_t i = 0;
+#if defined(OMAHA_HAS_SSE2_INTRINSICS)
+  if (kHasSse2) {
+    i = Utf16AsciiBlocksToUtf8(utf16, num_chars, out);
+  }
+#endif
+
+  for (; i < num_chars && utf16[i] < 0x80; ++i) {
+    out[i] = static_cast<char>(utf16[i]);
+  }
+  return i;
+}
+
+}  // namespace omaha
@@ -0,0 +1,66 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// Validating UTF-8 and UTF-16 transcoding without the Windows converters.
+//
+// The conversions make a single pass over the input and write into a buffer
+// provided by the caller, typically the buffer of a CString. Runs of ASCII
+// characters, which most of the strings exchanged with the server consist of,
+// are converted 16 characters at a time when the processor supports SSE2.
+//
+// Ill-formed input is not rejected. Each ill-formed sequence is replaced by
+// U+FFFD, the same as the Windows converters do when no flags are given:
+//   * UTF-8: each maximal subpart of an ill-formed sequence, as recommended by
+//     the Unicode Standard, chapter 3.9.
+//   * UTF-16: each unpaired surrogate.
+
+#ifndef OMAHA_BASE_UTF8_H_
+#define OMAHA_BASE_UTF8_H_
+
+#include <windows.h>
+#include "base/basictypes.h"
+
+namespace omaha {
+
+const wchar_t kReplacementCharacter = 0xFFFD;
+
+// Returns the length of the byte order mark the UTF-8 input starts with, that
+// is 3 if the input starts with EF BB BF and 0 otherwise.
+size_t Utf8BomLength(const char* utf8, size_t num_bytes);
+
+// Returns the number of bytes Utf16ToUtf8 writes for the input.
+size_t Utf16ToUtf8Length(const wchar_t* utf16, size_t num_chars);
+
+// Encodes the UTF-16 input as UTF-8. utf8 must have room for
+// Utf16ToUtf8Length(utf16, num_chars) bytes, which is at most 3 * num_chars.
+// Returns the number of bytes written. The output is not null-terminated.
+size_t Utf16ToUtf8(const wchar_t* utf16, size_t num_chars, char* utf8);
+
+// Decodes the UTF-8 input as UTF-16. utf16 must have room for num_bytes
+// characters, since each byte decodes to at most one character. Returns the
+// number of characters written. If is_valid is not NULL, it is set to false
+// if any ill-formed sequence was replaced. The output is not null-terminated.
+size_t Utf8ToUtf16(const char* utf8,
+                   size_t num_bytes,
+                   wchar_t* utf16,
+                   bool* is_valid);
+
+// Copies the leading ASCII characters of the UTF-16 input, stopping at the
+// first character above U+007F. Returns the number of characters copied.
+size_t CopyUtf16AsciiPrefix(const wchar_t* utf16, size_t num_chars, char* out);
+
+}  // namespace omaha
+
+#endif  // OMAHA_BASE_UTF8_H_
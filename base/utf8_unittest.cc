@@ -0,0 +1,156 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <string.h>
+#include "omaha/base/string.h"
+#include "omaha/base/utf8.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+CString Decode(const char* utf8, size_t num_bytes, bool* is_valid) {
+  CString utf16;
+  const size_t num_chars = Utf8ToUtf16(utf8,
+                                       num_bytes,
+                                       utf16.GetBuffer(num_bytes),
+                                       is_valid);
+  utf16.ReleaseBuffer(num_chars);
+  return utf16;
+}
+
+CString Decode(const char* utf8, bool* is_valid) {
+  return Decode(utf8, strlen(utf8), is_valid);
+}
+
+CStringA Encode(const wchar_t* utf16, size_t num_chars) {
+  const size_t num_bytes = Utf16ToUtf8Length(utf16, num_chars);
+  CStringA utf8;
+  EXPECT_EQ(num_bytes,
+            Utf16ToUtf8(utf16, num_chars, utf8.GetBuffer(num_bytes)));
+  utf8.ReleaseBuffer(num_bytes);
+  return utf8;
+}
+
+CStringA Encode(const wchar_t* utf16) {
+  return Encode(utf16, wcslen(utf16));
+}
+
+}  // namespace
+
+TEST(Utf8Test, Utf8BomLength) {
+  EXPECT_EQ(0, Utf8BomLength("", 0));
+  EXPECT_EQ(0, Utf8BomLength("\xEF\xBB", 2));
+  EXPECT_EQ(3, Utf8BomLength("\xEF\xBB\xBF", 3));
+  EXPECT_EQ(3, Utf8BomLength("\xEF\xBB\xBF" "abc", 6));
+  EXPECT_EQ(0, Utf8BomLength("abc\xEF\xBB\xBF", 6));
+}
+
+TEST(Utf8Test, Encode) {
+  EXPECT_STREQ("", Encode(L""));
+  EXPECT_STREQ("abc", Encode(L"abc"));
+  EXPECT_STREQ("\x7F\xC2\x80\xDF\xBF\xE0\xA0\x80\xEF\xBF\xBF",
+               Encode(L"\x007F\x0080\x07FF\x0800\xFFFF"));
+
+  // U+1F600 is encoded as a surrogate pair in UTF-16.
+  EXPECT_STREQ("\xF0\x9F\x98\x80", Encode(L"\xD83D\xDE00"));
+}
+
+TEST(Utf8Test, Encode_UnpairedSurrogates) {
+  EXPECT_STREQ("\xEF\xBF\xBD" "a", Encode(L"\xD83D" L"a"));
+  EXPECT_STREQ("a\xEF\xBF\xBD", Encode(L"a\xDE00"));
+  EXPECT_STREQ("\xEF\xBF\xBD\xF0\x9F\x98\x80", Encode(L"\xDE00\xD83D\xDE00"));
+  EXPECT_STREQ("\xEF\xBF\xBD", Encode(L"\xD83D"));
+}
+
+TEST(Utf8Test, Decode) {
+  bool is_valid = false;
+  EXPECT_STREQ(L"", Decode("", &is_valid));
+  EXPECT_TRUE(is_valid);
+
+  EXPECT_STREQ(L"abc", Decode("abc", &is_valid));
+  EXPECT_TRUE(is_valid);
+
+  EXPECT_STREQ(L"\x007F\x0080\x07FF\x0800\xFFFF\xD83D\xDE00",
+               Decode("\x7F\xC2\x80\xDF\xBF\xE0\xA0\x80\xEF\xBF\xBF"
+                      "\xF0\x9F\x98\x80",
+                      &is_valid));
+  EXPECT_TRUE(is_valid);
+
+  // The byte order mark is not stripped by the decoder.
+  EXPECT_STREQ(L"\xFEFF" L"a", Decode("\xEF\xBB\xBF" "a", &is_valid));
+  EXPECT_TRUE(is_valid);
+}
+
+// Each maximal subpart of an ill-formed sequence is replaced by one U+FFFD.
+TEST(Utf8Test, Decode_IllFormed) {
+  bool is_valid = true;
+
+  // Invalid lead and unexpected trail bytes.
+  EXPECT_STREQ(L"\xFFFD\xFFFD" L"a\xFFFD",
+               Decode("\xFF\x80" "a\xC1", &is_valid));
+  EXPECT_FALSE(is_valid);
+
+  // Overlong forms.
+  EXPECT_STREQ(L"\xFFFD\xFFFD", Decode("\xC0\xAF", &is_valid));
+  EXPECT_STREQ(L"\xFFFD\xFFFD\xFFFD", Decode("\xE0\x80\xAF", &is_valid));
+
+  // A surrogate and a code point above U+10FFFF.
+  EXPECT_STREQ(L"\xFFFD\xFFFD\xFFFD", Decode("\xED\xA0\x80", &is_valid));
+  EXPECT_STREQ(L"\xFFFD\xFFFD\xFFFD\xFFFD",
+               Decode("\xF4\x90\x80\x80", &is_valid));
+
+  // Truncated sequences, followed by a character or by the end of the input.
+  EXPECT_STREQ(L"\xFFFD" L"a", Decode("\xE2\x82" "a", &is_valid));
+  EXPECT_STREQ(L"a\xFFFD", Decode("a\xF0\x9F\x98", &is_valid));
+  EXPECT_FALSE(is_valid);
+}
+
+// The input is long enough to use the ASCII fast path, if available, with
+// characters that are not ASCII at the block boundaries and in the tail.
+TEST(Utf8Test, RoundTrip) {
+  CString expected;
+  for (int i = 0; i != 100; ++i) {
+    expected.AppendChar(i % 17 ? static_cast<TCHAR>(_T('a') + i % 26)
+                               : static_cast<TCHAR>(0x00E9 + i));
+  }
+  expected.Append(L"\xD83D\xDE00");
+
+  const CStringA utf8 = Encode(expected, expected.GetLength());
+  bool is_valid = false;
+  EXPECT_STREQ(expected, Decode(utf8, utf8.GetLength(), &is_valid));
+  EXPECT_TRUE(is_valid);
+
+  EXPECT_STREQ(utf8, WideToUtf8(expected));
+  EXPECT_STREQ(expected, Utf8ToWideChar(utf8, utf8.GetLength()));
+}
+
+TEST(Utf8Test, CopyUtf16AsciiPrefix) {
+  const CString input(_T("0123456789abcdefghijklmnopqrstuv\x00E9xyz"));
+  char output[64] = {0};
+  EXPECT_EQ(32, CopyUtf16AsciiPrefix(input, input.GetLength(), output));
+  EXPECT_STREQ("0123456789abcdefghijklmnopqrstuv", output);
+
+  EXPECT_EQ(0, CopyUtf16AsciiPrefix(_T("\x00E9"), 1, output));
+}
+
+TEST(Utf8Test, Utf8ToWideChar_StripsBom) {
+  EXPECT_STREQ(_T("abc"), Utf8ToWideChar("\xEF\xBB\xBF" "abc", 6));
+  EXPECT_STREQ(_T(""), Utf8ToWideChar("\xEF\xBB\xBF", 3));
+  EXPECT_STREQ(_T(""), Utf8ToWideChar("", 0));
+}
+
+}  // namespace omaha
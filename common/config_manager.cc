@@ -322,6 +322,36 @@ int ConfigManager::GetPackageCacheExpirationTimeDays() const {
   return static_cast<int>(cache_life_limit);
 }
 
+int ConfigManager::GetBackgroundDownloadBytesPerSec() const {
+  DWORD kMaxDownloadLimitKBytesPerSec = 1024 * 1024;   // 1 GB/s.
+
+  DWORD download_limit = 0;
+  if (FAILED(RegKey::GetValue(kRegKeyGoopdateGroupPolicy,
+                              kRegValueDownloadLimitKBytesPerSec,
+                              &download_limit)) ||
+      download_limit > kMaxDownloadLimitKBytesPerSec) {
+    download_limit = 0;
+  }
+
+  return static_cast<int>(download_limit * 1024);
+}
+
+int ConfigManager::GetMaxParallelInstalls() const {
+  DWORD kDefaultMaxParallelInstalls = 1;
+  DWORD kMaxMaxParallelInstalls = 16;
+
+  DWORD max_parallel_installs = 0;
+  if (FAILED(RegKey::GetValue(kRegKeyGoopdateGroupPolicy,
+                              kRegValueMaxParallelInstalls,
+                              &max_parallel_installs)) ||
+      max_parallel_installs > kMaxMaxParallelInstalls ||
+      max_parallel_installs == 0) {
+    max_parallel_installs = kDefaultMaxParallelInstalls;
+  }
+
+  return static_cast<int>(max_parallel_installs);
+}
+
 CString ConfigManager::GetMachineGoopdateInstallDirNoCreate() const {
   CString path;
   VERIFY1(SUCCEEDED(GetDir(CSIDL_PROGRAM_FILES,
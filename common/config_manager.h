@@ -96,6 +96,15 @@ class ConfigManager {
   // limit, it should be removed.
   int GetPackageCacheExpirationTimeDays() const;
 
+  // Gets the rate limit for background downloads in bytes per second, or zero
+  // if background downloads are not limited.
+  int GetBackgroundDownloadBytesPerSec() const;
+
+  // Gets how many installers of a bundle can run at the same time. A value of
+  // one, the default, installs the apps one after another. Parallel installs
+  // are enabled by policy.
+  int GetMaxParallelInstalls() const;
+
   // Creates download data dir:
   // %UserProfile%/Application Data/Google/Update/Download
   // This is the root of the package cache for the user.
@@ -1405,6 +1405,39 @@ TEST_F(ConfigManagerTest, GetPackageCacheExpirationTimeDays_Override_Valid) {
   EXPECT_EQ(60, cm_->GetPackageCacheExpirationTimeDays());
 }
 
+TEST_F(ConfigManagerTest, GetBackgroundDownloadBytesPerSec_Default) {
+  EXPECT_EQ(0, cm_->GetBackgroundDownloadBytesPerSec());
+}
+
+TEST_F(ConfigManagerTest, GetBackgroundDownloadBytesPerSec_Override_TooBig) {
+  EXPECT_SUCCEEDED(SetPolicy(kRegValueDownloadLimitKBytesPerSec, 0x7fffffff));
+  EXPECT_EQ(0, cm_->GetBackgroundDownloadBytesPerSec());
+}
+
+TEST_F(ConfigManagerTest, GetBackgroundDownloadBytesPerSec_Override_Valid) {
+  EXPECT_SUCCEEDED(SetPolicy(kRegValueDownloadLimitKBytesPerSec, 64));
+  EXPECT_EQ(64 * 1024, cm_->GetBackgroundDownloadBytesPerSec());
+}
+
+TEST_F(ConfigManagerTest, GetMaxParallelInstalls_Default) {
+  EXPECT_EQ(1, cm_->GetMaxParallelInstalls());
+}
+
+TEST_F(ConfigManagerTest, GetMaxParallelInstalls_Override_TooBig) {
+  EXPECT_SUCCEEDED(SetPolicy(kRegValueMaxParallelInstalls, 17));
+  EXPECT_EQ(1, cm_->GetMaxParallelInstalls());
+}
+
+TEST_F(ConfigManagerTest, GetMaxParallelInstalls_Override_Zero) {
+  EXPECT_SUCCEEDED(SetPolicy(kRegValueMaxParallelInstalls, 0));
+  EXPECT_EQ(1, cm_->GetMaxParallelInstalls());
+}
+
+TEST_F(ConfigManagerTest, GetMaxParallelInstalls_Override_Valid) {
+  EXPECT_SUCCEEDED(SetPolicy(kRegValueMaxParallelInstalls, 4));
+  EXPECT_EQ(4, cm_->GetMaxParallelInstalls());
+}
+
 TEST_F(ConfigManagerTest, LastCheckedTime) {
   DWORD time = 500;
   EXPECT_SUCCEEDED(cm_->SetLastCheckedTime(true, time));
@@ -190,6 +190,9 @@ const TCHAR* const kRegValueLastChecked           = _T("LastChecked");
 const TCHAR* const kRegValueOemInstallTimeSec     = _T("OemInstallTime");
 const TCHAR* const kRegValueCacheSizeLimitMBytes  = _T("PackageCacheSizeLimit");
 const TCHAR* const kRegValueCacheLifeLimitDays    = _T("PackageCacheLifeLimit");
+const TCHAR* const kRegValueDownloadLimitKBytesPerSec =
+    _T("BackgroundDownloadLimit");
+const TCHAR* const kRegValueMaxParallelInstalls   = _T("MaxParallelInstalls");
 const TCHAR* const kRegValueInstalledPath         = _T("path");
 const TCHAR* const kRegValueUserId                = _T("uid");
 const TCHAR* const kRegValueSelfUpdateExtraCode1  = _T("UpdateCode1");
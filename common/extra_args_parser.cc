@@ -48,12 +48,11 @@ HRESULT ConvertUtf8UrlEncodedString(const CString& encoded_string,
 }
 
 HRESULT Validate(const TCHAR* extra_args) {
-  CString extra_args_str(extra_args);
-  if (extra_args_str.IsEmpty()) {
+  if (!extra_args || !*extra_args) {
     return E_INVALIDARG;
   }
 
-  if (-1 != extra_args_str.FindOneOf(kDisallowedCharsInExtraArgs)) {
+  if (_tcspbrk(extra_args, kDisallowedCharsInExtraArgs)) {
     // A '/' was found in the "extra" arguments or "extra" arguments were
     // not specified before the next command.
     return E_INVALIDARG;
@@ -62,21 +61,82 @@ HRESULT Validate(const TCHAR* extra_args) {
   return S_OK;
 }
 
+bool IsSeparator(TCHAR c) {
+  return c && _tcschr(kExtraArgsSeparators, c);
+}
+
+// Finds the next name-value pair in a single pass over the string, starting at
+// *pos, and advances *pos past the pair. Separators before the pair are
+// skipped, the same as CString::Tokenize skips them. The name and the value
+// point into the string, which is not copied.
+//
+// Returns S_FALSE if there are no more pairs, and E_INVALIDARG if the token is
+// not a name-value pair, using the same rules as ParseNameValuePair.
+HRESULT GetNextNameValuePair(const TCHAR** pos,
+                             const TCHAR** name,
+                             int* name_length,
+                             const TCHAR** value,
+                             int* value_length) {
+  ASSERT1(pos && *pos);
+  ASSERT1(name);
+  ASSERT1(name_length);
+  ASSERT1(value);
+  ASSERT1(value_length);
+
+  const TCHAR* current = *pos;
+  while (IsSeparator(*current)) {
+    ++current;
+  }
+  if (!*current) {
+    *pos = current;
+    return S_FALSE;
+  }
+
+  const TCHAR* const token = current;
+  const TCHAR* name_value_separator = NULL;
+  int num_name_value_separators = 0;
+  for (; *current && !IsSeparator(*current); ++current) {
+    if (*current == kNameValueSeparatorChar) {
+      if (!name_value_separator) {
+        name_value_separator = current;
+      }
+      ++num_name_value_separators;
+    }
+  }
+  *pos = current;
+
+  if (num_name_value_separators != 1 ||       // Not a name-value pair.
+      name_value_separator == token ||        // No name was supplied.
+      name_value_separator + 1 == current) {  // No value was supplied.
+    return E_INVALIDARG;
+  }
+
+  *name = token;
+  *name_length = static_cast<int>(name_value_separator - token);
+  *value = name_value_separator + 1;
+  *value_length = static_cast<int>(current - *value);
+  return S_OK;
+}
+
+// Returns true if the name, which is not null-terminated, is expected_name,
+// ignoring the case.
+bool IsName(const TCHAR* name, int name_length, const TCHAR* expected_name) {
+  return _tcsnicmp(name, expected_name, name_length) == 0 &&
+         !expected_name[name_length];
+}
+
 // Handles tokens from the app arguments string.
-HRESULT HandleAppArgsToken(const CString& token,
+HRESULT HandleAppArgsToken(const TCHAR* name,
+                           int name_length,
+                           const CString& value,
                            CommandLineExtraArgs* args,
                            int* cur_app_args_index) {
+  ASSERT1(name);
   ASSERT1(args);
   ASSERT1(cur_app_args_index);
   ASSERT1(*cur_app_args_index < static_cast<int>(args->apps.size()));
 
-  CString name;
-  CString value;
-  if (!ParseNameValuePair(token, kNameValueSeparatorChar, &name, &value)) {
-    return E_INVALIDARG;
-  }
-
-  if (name.CompareNoCase(kExtraArgAppGuid) == 0) {
+  if (IsName(name, name_length, kExtraArgAppGuid)) {
     *cur_app_args_index = -1;
     for (size_t i = 0; i < args->apps.size(); ++i) {
       if (!value.CompareNoCase(GuidToString(args->apps[i].app_guid))) {
@@ -88,7 +148,7 @@ HRESULT HandleAppArgsToken(const CString& token,
     if (-1 == *cur_app_args_index) {
       return E_INVALIDARG;
     }
-  } else if (name.CompareNoCase(kExtraArgInstallerData) == 0) {
+  } else if (IsName(name, name_length, kExtraArgInstallerData)) {
     if (-1 == *cur_app_args_index) {
       return E_INVALIDARG;
     }
@@ -112,19 +172,27 @@ HRESULT ParseAppArgs(const TCHAR* app_args, CommandLineExtraArgs* args) {
   }
 
   int cur_app_args_index = -1;
-  int pos = 0;
-  CString input_str = app_args;
-  CString token = input_str.Tokenize(kExtraArgsSeparators, pos);
-  while (!token.IsEmpty()) {
-    hr = HandleAppArgsToken(token, args, &cur_app_args_index);
+  const TCHAR* pos = app_args;
+  const TCHAR* name = NULL;
+  const TCHAR* value = NULL;
+  int name_length = 0;
+  int value_length = 0;
+  while ((hr = GetNextNameValuePair(&pos,
+                                    &name,
+                                    &name_length,
+                                    &value,
+                                    &value_length)) == S_OK) {
+    hr = HandleAppArgsToken(name,
+                            name_length,
+                            CString(value, value_length),
+                            args,
+                            &cur_app_args_index);
     if (FAILED(hr)) {
       return hr;
     }
-
-    token = input_str.Tokenize(kExtraArgsSeparators, pos);
   }
 
-  return S_OK;
+  return FAILED(hr) ? hr : S_OK;
 }
 
 HRESULT StringToNeedsAdmin(const TCHAR* str, NeedsAdmin* value) {
@@ -177,18 +245,25 @@ HRESULT ExtraArgsParser::ParseExtraArgs(const TCHAR* extra_args,
   }
 
   first_app_ = true;
-  int pos = 0;
-  CString input_str(extra_args);
-  CString token = input_str.Tokenize(kExtraArgsSeparators, pos);
-  while (!token.IsEmpty()) {
-    CORE_LOG(L2, (_T("[ExtraArgsParser::Parse][token=%s]"), token));
-    hr = HandleToken(token, args);
+  const TCHAR* pos = extra_args;
+  const TCHAR* name = NULL;
+  const TCHAR* value = NULL;
+  int name_length = 0;
+  int value_length = 0;
+  while ((hr = GetNextNameValuePair(&pos,
+                                    &name,
+                                    &name_length,
+                                    &value,
+                                    &value_length)) == S_OK) {
+    CORE_LOG(L2, (_T("[ExtraArgsParser::Parse][token=%.*s]"),
+                  name_length + 1 + value_length, name));
+    hr = HandleToken(name, name_length, CString(value, value_length), args);
     if (FAILED(hr)) {
       return hr;
     }
-
-    // Continue parsing
-    token = input_str.Tokenize(kExtraArgsSeparators, pos);
+  }
+  if (FAILED(hr)) {
+    return hr;
   }
 
   // Save the arguments for the last application.
@@ -205,17 +280,16 @@ HRESULT ExtraArgsParser::ParseExtraArgs(const TCHAR* extra_args,
 }
 
 // Handles tokens from the extra arguments string.
-HRESULT ExtraArgsParser::HandleToken(const CString& token,
+HRESULT ExtraArgsParser::HandleToken(const TCHAR* name,
+                                     int name_length,
+                                     const CString& value,
                                      CommandLineExtraArgs* args) {
-  CString name;
-  CString value;
-  if (!ParseNameValuePair(token, kNameValueSeparatorChar, &name, &value)) {
-    return E_INVALIDARG;
-  }
+  ASSERT1(name);
+  ASSERT1(args);
 
   // The first set of args apply to all apps. They may occur at any point, but
   // only the last occurrence is recorded.
-  if (name.CompareNoCase(kExtraArgBundleName) == 0) {
+  if (IsName(name, name_length, kExtraArgBundleName)) {
     if (value.GetLength() > kMaxNameLength) {
       return E_INVALIDARG;
     }
@@ -224,61 +298,61 @@ HRESULT ExtraArgsParser::HandleToken(const CString& token,
     if (FAILED(hr)) {
       return hr;
     }
-  } else if (name.CompareNoCase(kExtraArgInstallationId) == 0) {
+  } else if (IsName(name, name_length, kExtraArgInstallationId)) {
     ASSERT1(!value.IsEmpty());
     if (FAILED(StringToGuidSafe(value, &args->installation_id))) {
       return E_INVALIDARG;
     }
-  } else if (name.CompareNoCase(kExtraArgBrandCode) == 0) {
+  } else if (IsName(name, name_length, kExtraArgBrandCode)) {
     if (value.GetLength() > kBrandIdLength) {
       return E_INVALIDARG;
     }
     args->brand_code = value;
-  } else if (name.CompareNoCase(kExtraArgClientId) == 0) {
+  } else if (IsName(name, name_length, kExtraArgClientId)) {
     args->client_id = value;
-  } else if (name.CompareNoCase(kExtraArgOmahaExperimentLabels) == 0) {
+  } else if (IsName(name, name_length, kExtraArgOmahaExperimentLabels)) {
     HRESULT hr = ConvertUtf8UrlEncodedString(value,
                                              &args->experiment_labels);
     if (FAILED(hr)) {
       return hr;
     }
-  } else if (name.CompareNoCase(kExtraArgReferralId) == 0) {
+  } else if (IsName(name, name_length, kExtraArgReferralId)) {
     args->referral_id = value;
-  } else if (name.CompareNoCase(kExtraArgBrowserType) == 0) {
+  } else if (IsName(name, name_length, kExtraArgBrowserType)) {
     BrowserType type = BROWSER_UNKNOWN;
     if (SUCCEEDED(goopdate_utils::ConvertStringToBrowserType(value, &type))) {
       args->browser_type = type;
     }
-  } else if (name.CompareNoCase(kExtraArgLanguage) == 0) {
+  } else if (IsName(name, name_length, kExtraArgLanguage)) {
     if (value.GetLength() > kLangMaxLength) {
       return E_INVALIDARG;
     }
     // Even if we don't support the language, we want to pass it to the
     // installer. Omaha will pick its language later. See http://b/1336966.
     args->language = value;
-  } else if (name.CompareNoCase(kExtraArgUsageStats) == 0) {
+  } else if (IsName(name, name_length, kExtraArgUsageStats)) {
     if (!String_StringToTristate(value, &args->usage_stats_enable)) {
       return E_INVALIDARG;
     }
-  } else if (name.CompareNoCase(kExtraArgRuntime) == 0) {
+  } else if (IsName(name, name_length, kExtraArgRuntime)) {
     if (!args->apps.empty() || cur_extra_app_args_.app_guid != GUID_NULL) {
       return E_INVALIDARG;
     }
     args->runtime_only = true;
 
   // The following args are per-app.
-  } else if (name.CompareNoCase(kExtraArgAdditionalParameters) == 0) {
+  } else if (IsName(name, name_length, kExtraArgAdditionalParameters)) {
     cur_extra_app_args_.ap = value;
-  } else if (name.CompareNoCase(kExtraArgTTToken) == 0) {
+  } else if (IsName(name, name_length, kExtraArgTTToken)) {
     cur_extra_app_args_.tt_token = value;
-  } else if (name.CompareNoCase(kExtraArgExperimentLabels) == 0) {
+  } else if (IsName(name, name_length, kExtraArgExperimentLabels)) {
     HRESULT hr = ConvertUtf8UrlEncodedString(
         value,
         &cur_extra_app_args_.experiment_labels);
     if (FAILED(hr)) {
       return hr;
     }
-  } else if (name.CompareNoCase(kExtraArgAppGuid) == 0) {
+  } else if (IsName(name, name_length, kExtraArgAppGuid)) {
     if (!first_app_) {
       // Save the arguments for the application we have been processing.
       args->apps.push_back(cur_extra_app_args_);
@@ -293,7 +367,7 @@ HRESULT ExtraArgsParser::HandleToken(const CString& token,
       return E_INVALIDARG;
     }
     first_app_ = false;
-  } else if (name.CompareNoCase(kExtraArgAppName) == 0) {
+  } else if (IsName(name, name_length, kExtraArgAppName)) {
     if (value.GetLength() > kMaxNameLength) {
       return E_INVALIDARG;
     }
@@ -302,11 +376,11 @@ HRESULT ExtraArgsParser::HandleToken(const CString& token,
     if (FAILED(hr)) {
       return hr;
     }
-  } else if (name.CompareNoCase(kExtraArgNeedsAdmin) == 0) {
+  } else if (IsName(name, name_length, kExtraArgNeedsAdmin)) {
     if (FAILED(StringToNeedsAdmin(value, &cur_extra_app_args_.needs_admin))) {
       return E_INVALIDARG;
     }
-  } else if (name.CompareNoCase(kExtraArgInstallDataIndex) == 0) {
+  } else if (IsName(name, name_length, kExtraArgInstallDataIndex)) {
     cur_extra_app_args_.install_data_index = value;
   } else {
     // Unrecognized token
@@ -43,8 +43,12 @@ class ExtraArgsParser {
   HRESULT ParseExtraArgs(const TCHAR* extra_args, CommandLineExtraArgs* args);
 
   // Performs validation against extra_args and if it's valid, stores the
-  // extra_args value into args->extra_args.
-  HRESULT HandleToken(const CString& token, CommandLineExtraArgs* args);
+  // extra_args value into args->extra_args. The name points into the string
+  // being parsed and is not null-terminated.
+  HRESULT HandleToken(const TCHAR* name,
+                      int name_length,
+                      const CString& value,
+                      CommandLineExtraArgs* args);
 
   CommandLineAppArgs cur_extra_app_args_;
   bool first_app_;
@@ -1660,4 +1660,61 @@ TEST(ExtraArgsParserTestMultipleEntries, ThreeApplications) {
   VerifyCommandLineExtraArgs(expected, args);
 }
 
+// The corpus covers the separators and the malformed name-value pairs that the
+// tokenizer must handle.
+TEST(ExtraArgsParserTest, Corpus) {
+  const struct {
+    const TCHAR* extra_args;
+    bool is_valid;
+  } kCorpus[] = {
+    { _T("appguid={8617EE50-F91C-4DC1-B937-0969EEF59B0B}"), true },
+    { _T("&&appguid={8617EE50-F91C-4DC1-B937-0969EEF59B0B}&&"), true },
+    { _T("APPGUID={8617EE50-F91C-4DC1-B937-0969EEF59B0B}&AppName=x"), true },
+    { _T(""), false },
+    { _T("="), false },
+    { _T("appguid"), false },
+    { _T("appguid="), false },
+    { _T("={8617EE50-F91C-4DC1-B937-0969EEF59B0B}"), false },
+    { _T("appguid=={8617EE50-F91C-4DC1-B937-0969EEF59B0B}"), false },
+    { _T("appguid={8617EE50-F91C-4DC1-B937-0969EEF59B0B}="), false },
+    { _T("appguid={8617EE50-F91C-4DC1-B937-0969EEF59B0B}&appname"), false },
+    { _T("appguid={8617EE50-F91C-4DC1-B937-0969EEF59B0B}&app=name=x"), false },
+    { _T("appguid={8617EE50-F91C-4DC1-B937-0969EEF59B0B}&appnam=x"), false },
+    { _T("appguid={8617EE50-F91C-4DC1-B937-0969EEF59B0B}&appnamex=x"), false },
+    { _T("appguid={8617EE50-F91C-4DC1-B937-0969EEF59B0B}&/install"), false },
+  };
+
+  for (int i = 0; i < arraysize(kCorpus); ++i) {
+    CommandLineExtraArgs args;
+    ExtraArgsParser parser;
+    EXPECT_EQ(kCorpus[i].is_valid,
+              SUCCEEDED(parser.Parse(kCorpus[i].extra_args, NULL, &args)))
+        << kCorpus[i].extra_args;
+  }
+}
+
+// Parses every prefix of the extra args. The prefixes that end with a
+// separator contain only complete name-value pairs and must be valid.
+TEST(ExtraArgsParserTest, Corpus_Truncated) {
+  const CString extra_args =
+      _T("appguid={8617EE50-F91C-4DC1-B937-0969EEF59B0B}&")
+      _T("appname=TestApp&needsadmin=true&lang=en&");
+
+  for (int i = 1; i <= extra_args.GetLength(); ++i) {
+    const CString prefix = extra_args.Left(i);
+
+    CommandLineExtraArgs args;
+    ExtraArgsParser parser;
+    const HRESULT hr = parser.Parse(prefix, NULL, &args);
+    if (prefix[i - 1] == _T('&')) {
+      EXPECT_SUCCEEDED(hr) << prefix;
+    }
+    if (SUCCEEDED(hr)) {
+      ASSERT_EQ(1, args.apps.size()) << prefix;
+      EXPECT_STREQ(_T("{8617EE50-F91C-4DC1-B937-0969EEF59B0B}"),
+                   GuidToString(args.apps[0].app_guid));
+    }
+  }
+}
+
 }  // namespace omaha
@@ -20,6 +20,7 @@
 #include "omaha/base/constants.h"
 #include "omaha/base/error.h"
 #include "omaha/base/string.h"
+#include "omaha/base/string_interner.h"
 #include "omaha/base/utils.h"
 #include "omaha/base/xml_utils.h"
 #include "omaha/common/config_manager.h"
@@ -165,13 +166,18 @@ CString ConvertProcessorArchitectureToString(DWORD arch) {
 // the template method design pattern.
 class ElementHandler {
  public:
-  ElementHandler() {}
+  ElementHandler() : string_interner_(NULL) {}
   virtual ~ElementHandler() {}
 
-  HRESULT Handle(IXMLDOMNode* node, response::Response* response) {
+  HRESULT Handle(IXMLDOMNode* node,
+                 StringInterner* string_interner,
+                 response::Response* response) {
     ASSERT1(node);
+    ASSERT1(string_interner);
     ASSERT1(response);
 
+    string_interner_ = string_interner;
+
     HRESULT hr = Validate(node);
     if (FAILED(hr)) {
       return hr;
@@ -185,6 +191,26 @@ class ElementHandler {
     return S_OK;
   }
 
+ protected:
+  // Reads an attribute whose values repeat across the apps of a response, such
+  // as status strings and urls. The values are interned so that the response
+  // and the copies made from it share one buffer for each distinct value.
+  HRESULT ReadInternedStringAttribute(IXMLDOMNode* node,
+                                      const TCHAR* attr_name,
+                                      CString* value) {
+    ASSERT1(value);
+    ASSERT1(string_interner_);
+
+    CString str;
+    HRESULT hr = ReadStringAttribute(node, attr_name, &str);
+    if (FAILED(hr)) {
+      return hr;
+    }
+
+    *value = string_interner_->Intern(str);
+    return S_OK;
+  }
+
  private:
   // Validates a node and returns S_OK in case of success.
   virtual HRESULT Validate(IXMLDOMNode* node) {
@@ -199,6 +225,8 @@ class ElementHandler {
     return S_OK;
   }
 
+  StringInterner* string_interner_;  // Not owned.
+
   DISALLOW_COPY_AND_ASSIGN(ElementHandler);
 };
 
@@ -239,7 +267,9 @@ class AppElementHandler : public ElementHandler {
       return hr;
     }
 
-    hr = ReadStringAttribute(node, xml::attribute::kStatus, &app.status);
+    hr = ReadInternedStringAttribute(node,
+                                     xml::attribute::kStatus,
+                                     &app.status);
     if (FAILED(hr)) {
       return hr;
     }
@@ -249,9 +279,9 @@ class AppElementHandler : public ElementHandler {
     // TODO(omaha3): If we adapt the server to send an empty string for these
     // attributes, we can remove these checks.
     if (HasAttribute(node, xml::attribute::kExperiments)) {
-      hr = ReadStringAttribute(node,
-                               xml::attribute::kExperiments,
-                               &app.experiments);
+      hr = ReadInternedStringAttribute(node,
+                                       xml::attribute::kExperiments,
+                                       &app.experiments);
       if (FAILED(hr)) {
         return hr;
       }
@@ -276,13 +306,13 @@ class UpdateCheckElementHandler : public ElementHandler {
                         xml::attribute::kTTToken,
                         &update_check.tt_token);
 
-    ReadStringAttribute(node,
-                        xml::attribute::kErrorUrl,
-                        &update_check.error_url);
+    ReadInternedStringAttribute(node,
+                                xml::attribute::kErrorUrl,
+                                &update_check.error_url);
 
-    return ReadStringAttribute(node,
-                               xml::attribute::kStatus,
-                               &update_check.status);
+    return ReadInternedStringAttribute(node,
+                                       xml::attribute::kStatus,
+                                       &update_check.status);
   }
 };
 
@@ -302,7 +332,9 @@ class UrlElementHandler : public ElementHandler {
  private:
   virtual HRESULT Parse(IXMLDOMNode* node, response::Response* response) {
     CString url;
-    HRESULT hr = ReadStringAttribute(node, xml::attribute::kCodebase, &url);
+    HRESULT hr = ReadInternedStringAttribute(node,
+                                             xml::attribute::kCodebase,
+                                             &url);
     if (FAILED(hr)) {
       return hr;
     }
@@ -412,16 +444,16 @@ class ActionElementHandler : public ElementHandler {
       return hr;
     }
 
-    ReadStringAttribute(node,
-                        xml::attribute::kRun,
-                        &install_action.program_to_run);
-    ReadStringAttribute(node,
-                        xml::attribute::kArguments,
-                        &install_action.program_arguments);
+    ReadInternedStringAttribute(node,
+                                xml::attribute::kRun,
+                                &install_action.program_to_run);
+    ReadInternedStringAttribute(node,
+                                xml::attribute::kArguments,
+                                &install_action.program_arguments);
 
-    ReadStringAttribute(node,
-                        xml::attribute::kSuccessUrl,
-                        &install_action.success_url);
+    ReadInternedStringAttribute(node,
+                                xml::attribute::kSuccessUrl,
+                                &install_action.success_url);
 
     ReadBooleanAttribute(node,
                          xml::attribute::kTerminateAllBrowsers,
@@ -453,9 +485,9 @@ class DataElementHandler : public ElementHandler {
     response->apps.back().data.push_back(response::Data());
     response::Data& data = response->apps.back().data.back();
 
-    HRESULT hr = ReadStringAttribute(node,
-                                     xml::attribute::kStatus,
-                                     &data.status);
+    HRESULT hr = ReadInternedStringAttribute(node,
+                                             xml::attribute::kStatus,
+                                             &data.status);
     if (FAILED(hr)) {
       return hr;
     }
@@ -495,7 +527,7 @@ class PingElementHandler : public ElementHandler {
  private:
   virtual HRESULT Parse(IXMLDOMNode* node, response::Response* response) {
     response::Ping& ping = response->apps.back().ping;
-    ReadStringAttribute(node, xml::attribute::kStatus, &ping.status);
+    ReadInternedStringAttribute(node, xml::attribute::kStatus, &ping.status);
     ASSERT1(ping.status == kResponseStatusOkValue);
     return S_OK;
   }
@@ -510,7 +542,7 @@ class EventElementHandler : public ElementHandler {
  private:
   virtual HRESULT Parse(IXMLDOMNode* node, response::Response* response) {
     response::Event event;
-    ReadStringAttribute(node, xml::attribute::kStatus, &event.status);
+    ReadInternedStringAttribute(node, xml::attribute::kStatus, &event.status);
     ASSERT1(event.status == kResponseStatusOkValue);
     response::App& app = response->apps.back();
     app.events.push_back(event);
@@ -1443,7 +1475,7 @@ HRESULT XmlParser::VisitElement(IXMLDOMNode* node) {
   ElementHandler* element_handler =
       element_handler_factory_.CreateObject(node_name.base);
   if (element_handler) {
-    return element_handler->Handle(node, response_);
+    return element_handler->Handle(node, &string_interner_, response_);
   } else {
     CORE_LOG(LW, (_T("[VisitElement: don't know how to handle %s:%s]"),
                   node_name.uri, node_name.base));
@@ -28,6 +28,7 @@
 #include <vector>
 #include "base/basictypes.h"
 #include "base/object_factory.h"
+#include "omaha/base/string_interner.h"
 #include "omaha/common/const_goopdate.h"
 #include "omaha/common/update_request.h"
 #include "omaha/common/update_response.h"
@@ -120,6 +121,9 @@ class XmlParser {
 
   ElementHandlerFactory element_handler_factory_;
 
+  // Interns the repeated values of the xml response being deserialized.
+  StringInterner string_interner_;
+
   DISALLOW_COPY_AND_ASSIGN(XmlParser);
 };
 
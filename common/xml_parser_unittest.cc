@@ -241,6 +241,31 @@ TEST_F(XmlParserTest, Parse) {
   }
 }
 
+// The values repeated across the apps of a response share one buffer.
+TEST_F(XmlParserTest, Parse_RepeatedValuesShareBuffer) {
+  CStringA buffer_string = "<?xml version=\"1.0\" encoding=\"UTF-8\"?><response protocol=\"3.0\"><app appid=\"{8A69D345-D564-463C-AFF1-A69D9E530F96}\" status=\"ok\"><updatecheck status=\"noupdate\"/><ping status=\"ok\"/></app><app appid=\"{430FD4D0-B729-4F61-AA34-91526481799D}\" status=\"ok\"><updatecheck status=\"noupdate\"/><ping status=\"ok\"/></app></response>";  // NOLINT
+  std::vector<uint8> buffer(buffer_string.GetLength());
+  memcpy(&buffer.front(), buffer_string, buffer.size());
+
+  scoped_ptr<UpdateResponse> update_response(UpdateResponse::Create());
+  EXPECT_HRESULT_SUCCEEDED(XmlParser::DeserializeResponse(
+      buffer,
+      update_response.get()));
+  const response::Response& xml_response(update_response->response());
+  ASSERT_EQ(2, xml_response.apps.size());
+
+  const response::App& app1(xml_response.apps[0]);
+  const response::App& app2(xml_response.apps[1]);
+  EXPECT_STREQ(_T("ok"), app1.status);
+  EXPECT_EQ(app1.status.GetString(), app2.status.GetString());
+  EXPECT_EQ(app1.status.GetString(), app1.ping.status.GetString());
+  EXPECT_EQ(app1.status.GetString(), app2.ping.status.GetString());
+  EXPECT_STREQ(_T("noupdate"), app1.update_check.status);
+  EXPECT_EQ(app1.update_check.status.GetString(),
+            app2.update_check.status.GetString());
+  EXPECT_STRNE(app1.appid, app2.appid);
+}
+
 // Parses a response for one application.
 TEST_F(XmlParserTest, Parse_InvalidDataStatusError) {
   CStringA buffer_string = "<?xml version=\"1.0\" encoding=\"UTF-8\"?><response protocol=\"3.0\"><app appid=\"{8A69D345-D564-463C-AFF1-A69D9E530F96}\" status=\"ok\"><updatecheck status=\"ok\"><urls><url codebase=\"http://cache.pack.google.com/edgedl/chrome/install/172.37/\"/></urls><manifest version=\"2.0.172.37\"><packages><package hash=\"NT/6ilbSjWgbVqHZ0rT1vTg1coE=\" name=\"chrome_installer.exe\" required=\"false\" size=\"9614320\"/></packages><actions><action arguments=\"--do-not-launch-chrome\" event=\"install\" needsadmin=\"false\" run=\"chrome_installer.exe\"/><action event=\"postinstall\" onsuccess=\"exitsilentlyonlaunchcmd\"/></actions></manifest></updatecheck><data index=\"verboselog\" name=\"install\" status=\"error-nodata\"/><ping status=\"ok\"/></app></response>";  // NOLINT
@@ -19,53 +19,42 @@
 #include "omaha/base/error.h"
 #include "omaha/base/highres_timer-win32.h"
 #include "omaha/base/logging.h"
-#include "omaha/base/queue_timer.h"
 #include "omaha/common/config_manager.h"
 #include "omaha/core/core.h"
 #include "omaha/core/core_metrics.h"
 
 namespace omaha {
 
+namespace {
+
+// The timers may fire up to 1/32 of their interval late, about 45 minutes for
+// a day.
+const int kSlackDivisor = 32;
+
+}  // namespace
+
 Scheduler::Scheduler(const Core& core)
-    : core_(core) {
+    : core_(core),
+      update_timer_(&Scheduler::TimerCallback, this),
+      code_red_timer_(&Scheduler::TimerCallback, this) {
   CORE_LOG(L1, (_T("[Scheduler::Scheduler]")));
 }
 
+// The destructor of the timer service waits for the callbacks to complete.
 Scheduler::~Scheduler() {
   CORE_LOG(L1, (_T("[Scheduler::~Scheduler]")));
-
-  if (update_timer_.get()) {
-    update_timer_.reset(NULL);
-  }
-
-  if (code_red_timer_.get()) {
-    code_red_timer_.reset(NULL);
-  }
-
-  if (timer_queue_) {
-    // The destructor blocks on deleting the timer queue and it waits for
-    // all timer callbacks to complete.
-    ::DeleteTimerQueueEx(timer_queue_, INVALID_HANDLE_VALUE);
-  }
 }
 
 HRESULT Scheduler::Initialize() {
   CORE_LOG(L1, (_T("[Scheduler::Initialize]")));
 
-  timer_queue_ = ::CreateTimerQueue();
-  if (!timer_queue_) {
-    return HRESULTFromLastError();
+  HRESULT hr = timer_service_.Initialize();
+  if (FAILED(hr)) {
+    return hr;
   }
 
   cr_debug_timer_.reset(new HighresTimer);
 
-  update_timer_.reset(new QueueTimer(timer_queue_,
-                                     &Scheduler::TimerCallback,
-                                     this));
-  code_red_timer_.reset(new QueueTimer(timer_queue_,
-                                       &Scheduler::TimerCallback,
-                                       this));
-
   ConfigManager* config_manager = ConfigManager::Instance();
   int cr_timer_interval_ms = config_manager->GetCodeRedTimerIntervalMs();
   VERIFY1(SUCCEEDED(ScheduleCodeRedTimer(cr_timer_interval_ms)));
@@ -76,7 +65,7 @@ HRESULT Scheduler::Initialize() {
   return S_OK;
 }
 
-void Scheduler::TimerCallback(QueueTimer* timer) {
+void Scheduler::TimerCallback(TimerService::Timer* timer) {
   ASSERT1(timer);
   Scheduler* scheduler = static_cast<Scheduler*>(timer->ctx());
   ASSERT1(scheduler);
@@ -86,13 +75,13 @@ void Scheduler::TimerCallback(QueueTimer* timer) {
 // First, do the useful work and then reschedule the timer. Otherwise, it is
 // possible that timer notifications overlap, and the timer can't be further
 // rescheduled: http://b/1228095
-void Scheduler::HandleCallback(QueueTimer* timer) {
+void Scheduler::HandleCallback(TimerService::Timer* timer) {
   ConfigManager* config_manager = ConfigManager::Instance();
-  if (update_timer_.get() == timer) {
+  if (&update_timer_ == timer) {
     core_.StartUpdateWorker();
     int au_timer_interval_ms = config_manager->GetAutoUpdateTimerIntervalMs();
     VERIFY1(SUCCEEDED(ScheduleUpdateTimer(au_timer_interval_ms)));
-  } else if (code_red_timer_.get() == timer) {
+  } else if (&code_red_timer_ == timer) {
     core_.StartCodeRed();
     int actual_time_ms = static_cast<int>(cr_debug_timer_->GetElapsedMs());
     metric_core_cr_actual_timer_interval_ms = actual_time_ms;
@@ -108,7 +97,9 @@ void Scheduler::HandleCallback(QueueTimer* timer) {
 }
 
 HRESULT Scheduler::ScheduleUpdateTimer(int interval_ms) {
-  HRESULT hr = update_timer_->Start(interval_ms, 0, WT_EXECUTEONLYONCE);
+  HRESULT hr = timer_service_.Start(&update_timer_,
+                                    interval_ms,
+                                    GetSlackMs(interval_ms));
   if (FAILED(hr)) {
     CORE_LOG(LE, (_T("[can't start update queue timer][0x%08x]"), hr));
   }
@@ -118,12 +109,18 @@ HRESULT Scheduler::ScheduleUpdateTimer(int interval_ms) {
 HRESULT Scheduler::ScheduleCodeRedTimer(int interval_ms) {
   metric_core_cr_expected_timer_interval_ms = interval_ms;
   cr_debug_timer_->Start();
-  HRESULT hr = code_red_timer_->Start(interval_ms, 0, WT_EXECUTEONLYONCE);
+  HRESULT hr = timer_service_.Start(&code_red_timer_,
+                                    interval_ms,
+                                    GetSlackMs(interval_ms));
   if (FAILED(hr)) {
     CORE_LOG(LE, (_T("[can't start Code Red queue timer][0x%08x]"), hr));
   }
   return hr;
 }
 
+int Scheduler::GetSlackMs(int interval_ms) {
+  return interval_ms / kSlackDivisor;
+}
+
 }  // namespace omaha
 
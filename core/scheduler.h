@@ -13,9 +13,6 @@
 // limitations under the License.
 // ========================================================================
 
-// TODO(omaha): consider using a waitable timer registered with the reactor. It
-// seems a lot less code than using the QueueTimer class.
-
 #ifndef OMAHA_CORE_SCHEDULER_H__
 #define OMAHA_CORE_SCHEDULER_H__
 
@@ -23,12 +20,12 @@
 #include <atlstr.h>
 #include "base/basictypes.h"
 #include "base/scoped_ptr.h"
+#include "omaha/base/timer_service.h"
 
 namespace omaha {
 
 class Core;
 class HighresTimer;
-class QueueTimer;
 
 class Scheduler {
  public:
@@ -39,21 +36,29 @@ class Scheduler {
   HRESULT Initialize();
 
  private:
-  static void TimerCallback(QueueTimer* timer);
-  void HandleCallback(QueueTimer* timer);
+  static void TimerCallback(TimerService::Timer* timer);
+  void HandleCallback(TimerService::Timer* timer);
   HRESULT ScheduleUpdateTimer(int interval_ms);
   HRESULT ScheduleCodeRedTimer(int interval_ms);
 
+  // Returns how late a timer with the interval may fire, so that the update
+  // and code red timers may fire together.
+  static int GetSlackMs(int interval_ms);
+
   const Core& core_;
-  HANDLE timer_queue_;
-  scoped_ptr<QueueTimer> update_timer_;
-  scoped_ptr<QueueTimer> code_red_timer_;
+
+  TimerService::Timer update_timer_;
+  TimerService::Timer code_red_timer_;
 
   // Measures the actual time interval between code red events for debugging
   // purposes. The timer is started when a code red alarm is set and then,
   // the value of the timer is read when the alarm goes off.
   scoped_ptr<HighresTimer> cr_debug_timer_;
 
+  // Declared last, so that its destructor waits for the callbacks to return
+  // and cancels the timers before the other members are destroyed.
+  TimerService timer_service_;
+
   DISALLOW_EVIL_CONSTRUCTORS(Scheduler);
 };
 
@@ -34,10 +34,12 @@
 namespace omaha {
 
 App::App(const GUID& app_guid, bool is_update, AppBundle* app_bundle)
-    : ModelObject(app_bundle->model()),
+    : ModelObject(app_bundle),
       app_bundle_(app_bundle),
       is_update_(is_update),
       has_update_available_(false),
+      is_download_pipelined_(false),
+      is_install_scheduled_(false),
       app_guid_(app_guid),
       iid_(GUID_NULL),
       install_time_diff_sec_(0),
@@ -58,8 +60,8 @@ App::App(const GUID& app_guid, bool is_update, AppBundle* app_bundle)
       num_bytes_downloaded_(0) {
   ASSERT1(!::IsEqualGUID(GUID_NULL, app_guid_));
 
-  current_version_.reset(new AppVersion(this));
-  next_version_.reset(new AppVersion(this));
+  current_version_.reset(new (arena()) AppVersion(this));
+  next_version_.reset(new (arena()) AppVersion(this));
 
   // TODO(omaha):  set the working_version_ correctly to indicate which
   // version of the app is modified: current version for components and
@@ -72,117 +74,117 @@ App::App(const GUID& app_guid, bool is_update, AppBundle* app_bundle)
 // Destruction of App objects happens within the scope of their parent,
 // which controls the locking.
 App::~App() {
-  ASSERT1(model()->IsLockedByCaller());
+  ASSERT1(IsLockedByCaller());
   working_version_ = NULL;
   app_bundle_ = NULL;
 }
 
 STDMETHODIMP App::get_appId(BSTR* app_id) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(app_id);
   *app_id = GuidToString(app_guid_).AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP App::get_language(BSTR* language) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(language);
   *language = language_.AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP App::put_language(BSTR language) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   language_ = language;
   return S_OK;
 }
 
 STDMETHODIMP App::get_ap(BSTR* ap) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(ap);
   *ap = ap_.AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP App::put_ap(BSTR ap) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ap_ = ap;
   return S_OK;
 }
 
 STDMETHODIMP App::get_pv(BSTR* pv) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(pv);
   *pv = pv_.AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP App::put_pv(BSTR pv) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   pv_ = pv;
   return S_OK;
 }
 
 STDMETHODIMP App::get_ttToken(BSTR* tt_token) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(tt_token);
   *tt_token = tt_token_.AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP App::put_ttToken(BSTR tt_token) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   tt_token_ = tt_token;
   return S_OK;
 }
 
 STDMETHODIMP App::get_iid(BSTR* iid) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(iid);
   *iid = GuidToString(iid_).AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP App::put_iid(BSTR iid) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return StringToGuidSafe(iid, &iid_);
 }
 
 STDMETHODIMP App::get_brandCode(BSTR* brand_code) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(brand_code);
   *brand_code = brand_code_.AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP App::put_brandCode(BSTR brand_code) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   brand_code_ = brand_code;
   return S_OK;
 }
 
 STDMETHODIMP App::get_clientId(BSTR* client_id) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(client_id);
   *client_id = client_id_.AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP App::put_clientId(BSTR client_id) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   client_id_ = client_id;
   return S_OK;
 }
 
 STDMETHODIMP App::get_labels(BSTR* labels) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(labels);
   *labels = GetExperimentLabels().AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP App::put_labels(BSTR labels) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ExperimentLabels decoded_labels;
   if (!decoded_labels.Deserialize(labels)) {
     return E_INVALIDARG;
@@ -192,60 +194,60 @@ STDMETHODIMP App::put_labels(BSTR labels) {
 }
 
 STDMETHODIMP App::get_referralId(BSTR* referral_id) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(referral_id);
   *referral_id = referral_id_.AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP App::put_referralId(BSTR referral_id) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   referral_id_ = referral_id;
   return S_OK;
 }
 
 STDMETHODIMP App::get_installTimeDiffSec(UINT* install_time_diff_sec) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(install_time_diff_sec);
   *install_time_diff_sec = install_time_diff_sec_;
   return S_OK;
 }
 
 STDMETHODIMP App::get_isEulaAccepted(VARIANT_BOOL* is_eula_accepted) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(is_eula_accepted);
   *is_eula_accepted = App::is_eula_accepted() ? VARIANT_TRUE : VARIANT_FALSE;
   return S_OK;
 }
 
 STDMETHODIMP App::put_isEulaAccepted(VARIANT_BOOL is_eula_accepted) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   is_eula_accepted_ = is_eula_accepted ? TRISTATE_TRUE : TRISTATE_FALSE;
   return S_OK;
 }
 
 STDMETHODIMP App::get_displayName(BSTR* display_name) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(display_name);
   *display_name = display_name_.AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP App::put_displayName(BSTR display_name) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   display_name_ = display_name;
   return S_OK;
 }
 
 STDMETHODIMP App::get_browserType(UINT* browser_type) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(browser_type);
   *browser_type = browser_type_;
   return S_OK;
 }
 
 STDMETHODIMP App::put_browserType(UINT browser_type) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   if (browser_type >= BROWSER_MAX) {
     return E_INVALIDARG;
   }
@@ -254,40 +256,40 @@ STDMETHODIMP App::put_browserType(UINT browser_type) {
 }
 
 STDMETHODIMP App::get_clientInstallData(BSTR* data) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(data);
   *data = client_install_data_.AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP App::put_clientInstallData(BSTR data) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   client_install_data_ = data;
   return S_OK;
 }
 
 STDMETHODIMP App::get_serverInstallDataIndex(BSTR* index) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(index);
   *index = server_install_data_index_.AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP App::put_serverInstallDataIndex(BSTR index) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   server_install_data_index_ = index;
   return S_OK;
 }
 
 STDMETHODIMP App::get_usageStatsEnable(UINT* usage_stats_enable) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(usage_stats_enable);
   *usage_stats_enable = usage_stats_enable_;
   return S_OK;
 }
 
 STDMETHODIMP App::put_usageStatsEnable(UINT usage_stats_enable) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   if (usage_stats_enable > TRISTATE_NONE) {
     return E_INVALIDARG;
   }
@@ -298,7 +300,7 @@ STDMETHODIMP App::put_usageStatsEnable(UINT usage_stats_enable) {
 // TODO(omaha3): Replace decisions based on state() with calls to AppState.
 // In this case, there should be a GetCurrentState() method on AppState.
 STDMETHODIMP App::get_currentState(IDispatch** current_state) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   CORE_LOG(L3, (_T("[App::get_currentState][0x%p]"), this));
   ASSERT1(current_state);
@@ -414,7 +416,7 @@ HRESULT App::GetDownloadProgress(uint64* bytes_downloaded,
                                  uint64* bytes_total,
                                  LONG* time_remaining_ms,
                                  uint64* next_retry_time) {
-  ASSERT1(model()->IsLockedByCaller());
+  ASSERT1(IsLockedByCaller());
 
   ASSERT1(bytes_downloaded);
   ASSERT1(bytes_total);
@@ -463,32 +465,32 @@ HRESULT App::GetDownloadProgress(uint64* bytes_downloaded,
 }
 
 AppBundle* App::app_bundle() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return app_bundle_;
 }
 
 const AppBundle* App::app_bundle() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return app_bundle_;
 }
 
 AppVersion* App::current_version() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return current_version_.get();
 }
 
 const AppVersion* App::current_version() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return current_version_.get();
 }
 
 AppVersion* App::next_version() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return next_version_.get();
 }
 
 const AppVersion* App::next_version() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return next_version_.get();
 }
 
@@ -497,63 +499,83 @@ CString App::app_guid_string() const {
 }
 
 GUID App::app_guid() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return app_guid_;
 }
 
 void App::set_app_guid(const GUID& app_guid) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   app_guid_ = app_guid;
 }
 
 CString App::language() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return language_;
 }
 
 bool App::is_eula_accepted() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return is_eula_accepted_ == TRISTATE_TRUE;
 }
 
 CString App::display_name() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return display_name_;
 }
 
 CurrentState App::state() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return app_state_->state();
 }
 
 bool App::is_update() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(current_version_->version().IsEmpty() != is_update_);
   return is_update_;
 }
 
 bool App::has_update_available() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return has_update_available_;
 }
 
 void App::set_has_update_available(bool has_update_available) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   has_update_available_ = has_update_available;
 }
 
+bool App::is_download_pipelined() const {
+  __mutexScope(lock());
+  return is_download_pipelined_;
+}
+
+void App::set_is_download_pipelined() {
+  __mutexScope(lock());
+  is_download_pipelined_ = true;
+}
+
+bool App::is_install_scheduled() const {
+  __mutexScope(lock());
+  return is_install_scheduled_;
+}
+
+void App::set_is_install_scheduled(bool is_install_scheduled) {
+  __mutexScope(lock());
+  is_install_scheduled_ = is_install_scheduled;
+}
+
 GUID App::iid() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return iid_;
 }
 
 CString App::client_id() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return client_id_;
 }
 
 CString App::GetExperimentLabels() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ExperimentLabels stored_labels;
   VERIFY1(SUCCEEDED(stored_labels.ReadFromRegistry(app_bundle_->is_machine(),
                                                    app_guid_string())));
@@ -561,123 +583,123 @@ CString App::GetExperimentLabels() const {
 }
 
 CString App::referral_id() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return referral_id_;
 }
 
 BrowserType App::browser_type() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return browser_type_;
 }
 
 Tristate App::usage_stats_enable() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return usage_stats_enable_;
 }
 
 CString App::client_install_data() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return client_install_data_;
 }
 
 CString App::server_install_data() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return server_install_data_;
 }
 
 void App::set_server_install_data(const CString& server_install_data) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   server_install_data_ = server_install_data;
 }
 
 CString App::brand_code() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return brand_code_;
 }
 
 // TODO(omaha): for better accuracy, compute the value when used.
 uint32 App::install_time_diff_sec() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return install_time_diff_sec_;
 }
 
 ActiveStates App::did_run() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return did_run_;
 }
 
 int App::days_since_last_active_ping() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return days_since_last_active_ping_;
 }
 
 void App::set_days_since_last_active_ping(int days) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   days_since_last_active_ping_ = days;
 }
 
 int App::days_since_last_roll_call() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return days_since_last_roll_call_;
 }
 
 void App::set_days_since_last_roll_call(int days) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   days_since_last_roll_call_ = days;
 }
 
 CString App::ap() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return ap_;
 }
 
 CString App::tt_token() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return tt_token_;
 }
 
 CString App::server_install_data_index() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return server_install_data_index_;
 }
 
 HRESULT App::error_code() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return error_context_.error_code;
 }
 
 ErrorContext App::error_context() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return error_context_;
 }
 
 int App::installer_result_code() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return installer_result_code_;
 }
 
 int App::installer_result_extra_code1() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return installer_result_extra_code1_;
 }
 
 const PingEventVector& App::ping_events() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return ping_events_;
 }
 
 AppVersion* App::working_version() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return working_version_;
 }
 
 const AppVersion* App::working_version() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return working_version_;
 }
 
 CString App::FetchAndResetLogText() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   CString event_log_text(event_log_text_);
   event_log_text_.Empty();
 
@@ -694,7 +716,7 @@ void App::LogTextAppendFormat(const TCHAR* format, ...) {
   SafeCStringFormatV(&log_string, format, arguments);
   va_end(arguments);
 
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   SafeCStringAppendFormat(&event_log_text_, _T("App=%s, Ver=%s, %s\n"),
                           app_guid_string().GetString(),
                           current_version()->version().GetString(),
@@ -702,13 +724,13 @@ void App::LogTextAppendFormat(const TCHAR* format, ...) {
 }
 
 void App::AddPingEvent(const PingEventPtr& ping_event) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ping_events_.push_back(ping_event);
   CORE_LOG(L3, (_T("[ping event added][%s]"), ping_event->ToString()));
 }
 
 HRESULT App::CheckGroupPolicy() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   bool is_auto_update = false;
 
@@ -729,7 +751,7 @@ HRESULT App::CheckGroupPolicy() const {
 }
 
 void App::SetDownloadStartTime() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(download_complete_time_ms_ == 0);
   ASSERT1(num_bytes_downloaded_ == 0);
 
@@ -737,12 +759,12 @@ void App::SetDownloadStartTime() {
 }
 
 void App::SetDownloadCompleteTime() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   download_complete_time_ms_ = GetCurrentMsTime();
 }
 
 void App::UpdateNumBytesDownloaded(uint64 num_bytes) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   CORE_LOG(L3, (_T("[RecordDownloadedBytes][new bytes downloaded: %llu]"),
                 num_bytes));
@@ -750,7 +772,7 @@ void App::UpdateNumBytesDownloaded(uint64 num_bytes) {
 }
 
 int App::GetDownloadTimeMs() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   if (download_complete_time_ms_ < download_start_time_ms_) {
     return 0;
@@ -760,12 +782,12 @@ int App::GetDownloadTimeMs() const {
 }
 
 uint64 App::num_bytes_downloaded() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return num_bytes_downloaded_;
 }
 
 uint64 App::GetPackagesTotalSize() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   uint64 total_size = 0;
   const size_t num_packages = working_version_->GetNumberOfPackages();
@@ -786,7 +808,7 @@ uint64 App::GetPackagesTotalSize() const {
 // Fail so that client developers realize quickly that something is wrong.
 // Otherwise, they might ship a client that installs apps that never update.
 void App::QueueUpdateCheck() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   ASSERT1(is_eula_accepted_ != TRISTATE_NONE);
   if (is_eula_accepted_ == TRISTATE_NONE) {
@@ -801,24 +823,24 @@ void App::QueueUpdateCheck() {
 
 void App::PreUpdateCheck(xml::UpdateRequest* update_request) {
   ASSERT1(update_request);
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   app_state_->PreUpdateCheck(this, update_request);
 }
 
 void App::PostUpdateCheck(HRESULT result,
                           xml::UpdateResponse* update_response) {
   ASSERT1(update_response);
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   app_state_->PostUpdateCheck(this, result, update_response);
 }
 
 void App::QueueDownload() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   app_state_->QueueDownload(this);
 }
 
 void App::QueueDownloadOrInstall() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   app_state_->QueueDownloadOrInstall(this);
 }
 
@@ -828,22 +850,22 @@ void App::Download(DownloadManagerInterface* download_manager) {
 }
 
 void App::Downloading() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   app_state_->Downloading(this);
 }
 
 void App::DownloadComplete() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   app_state_->DownloadComplete(this);
 }
 
 void App::MarkReadyToInstall() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   app_state_->MarkReadyToInstall(this);
 }
 
 void App::QueueInstall() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   app_state_->QueueInstall(this);
 }
 
@@ -853,34 +875,34 @@ void App::Install(InstallManagerInterface* install_manager) {
 }
 
 void App::Installing() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   app_state_->Installing(this);
 }
 
 void App::ReportInstallerComplete(const InstallerResultInfo& result_info) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   app_state_->ReportInstallerComplete(this,
                                       result_info);
 }
 
 void App::Pause() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return app_state_->Pause(this);
 }
 
 void App::Cancel() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return app_state_->Cancel(this);
 }
 
 void App::Error(const ErrorContext& error_context, const CString& message) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   app_state_->Error(this, error_context, message);
 }
 
 void App::ChangeState(fsm::AppState* app_state) {
   ASSERT1(app_state);
-  ASSERT1(model()->IsLockedByCaller());
+  ASSERT1(IsLockedByCaller());
   CurrentState existing_state = app_state_->state();
   app_state_.reset(app_state);
   PingEventPtr ping_event(
@@ -893,7 +915,7 @@ void App::ChangeState(fsm::AppState* app_state) {
 void App::SetError(const ErrorContext& error_context, const CString& message) {
   ASSERT1(FAILED(error_context.error_code));
   ASSERT1(!message.IsEmpty());
-  ASSERT1(model()->IsLockedByCaller());
+  ASSERT1(IsLockedByCaller());
 
   error_context_      = error_context;
   completion_message_ = message;
@@ -906,7 +928,7 @@ void App::SetError(const ErrorContext& error_context, const CString& message) {
 void App::SetNoUpdate(const ErrorContext& error_context,
                       const CString& message) {
   ASSERT1(!message.IsEmpty());
-  ASSERT1(model()->IsLockedByCaller());
+  ASSERT1(IsLockedByCaller());
 
   error_context_      = error_context;
   completion_message_ = message;
@@ -921,7 +943,7 @@ void App::SetNoUpdate(const ErrorContext& error_context,
 void App::SetInstallerResult(const InstallerResultInfo& result_info) {
   ASSERT1(result_info.type != INSTALLER_RESULT_UNKNOWN);
   ASSERT1(!result_info.text.IsEmpty());
-  ASSERT1(model()->IsLockedByCaller());
+  ASSERT1(IsLockedByCaller());
 
   completion_message_               = result_info.text;
   installer_result_code_            = result_info.code;
@@ -970,7 +992,7 @@ void App::SetInstallerResult(const InstallerResultInfo& result_info) {
 }
 
 CString App::GetInstallData() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   ASSERT1(state() >= STATE_UPDATE_AVAILABLE &&
           state() <= STATE_INSTALL_COMPLETE);
@@ -984,14 +1006,14 @@ CString App::GetInstallData() const {
 
 // IApp.
 STDMETHODIMP AppWrapper::get_currentVersion(IDispatch** current_version) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return AppVersionWrapper::Create(controlling_ptr(),
                                    wrapped_obj()->current_version(),
                                    current_version);
 }
 
 STDMETHODIMP AppWrapper::get_nextVersion(IDispatch** next_version) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return AppVersionWrapper::Create(controlling_ptr(),
                                    wrapped_obj()->next_version(),
                                    next_version);
@@ -999,167 +1021,167 @@ STDMETHODIMP AppWrapper::get_nextVersion(IDispatch** next_version) {
 
 // IApp.
 STDMETHODIMP AppWrapper::get_appId(BSTR* app_id) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_appId(app_id);
 }
 
 STDMETHODIMP AppWrapper::get_pv(BSTR* pv) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_pv(pv);
 }
 
 STDMETHODIMP AppWrapper::put_pv(BSTR pv) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_pv(pv);
 }
 
 STDMETHODIMP AppWrapper::get_language(BSTR* language) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_language(language);
 }
 
 STDMETHODIMP AppWrapper::put_language(BSTR language) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_language(language);
 }
 
 STDMETHODIMP AppWrapper::get_ap(BSTR* ap) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_ap(ap);
 }
 
 STDMETHODIMP AppWrapper::put_ap(BSTR ap) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_ap(ap);
 }
 
 STDMETHODIMP AppWrapper::get_ttToken(BSTR* tt_token) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_ttToken(tt_token);
 }
 
 STDMETHODIMP AppWrapper::put_ttToken(BSTR tt_token) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_ttToken(tt_token);
 }
 
 STDMETHODIMP AppWrapper::get_iid(BSTR* iid) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_iid(iid);
 }
 
 STDMETHODIMP AppWrapper::put_iid(BSTR iid) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_iid(iid);
 }
 
 STDMETHODIMP AppWrapper::get_brandCode(BSTR* brand_code) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_brandCode(brand_code);
 }
 
 STDMETHODIMP AppWrapper::put_brandCode(BSTR brand_code) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_brandCode(brand_code);
 }
 
 STDMETHODIMP AppWrapper::get_clientId(BSTR* client_id) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_clientId(client_id);
 }
 
 STDMETHODIMP AppWrapper::put_clientId(BSTR client_id) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_clientId(client_id);
 }
 
 STDMETHODIMP AppWrapper::get_labels(BSTR* labels) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_labels(labels);
 }
 
 STDMETHODIMP AppWrapper::put_labels(BSTR labels) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_labels(labels);
 }
 
 STDMETHODIMP AppWrapper::get_referralId(BSTR* referral_id) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_referralId(referral_id);
 }
 
 STDMETHODIMP AppWrapper::put_referralId(BSTR referral_id) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_referralId(referral_id);
 }
 
 STDMETHODIMP AppWrapper::get_installTimeDiffSec(UINT* install_time_diff_sec) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_installTimeDiffSec(install_time_diff_sec);
 }
 
 STDMETHODIMP AppWrapper::get_isEulaAccepted(VARIANT_BOOL* is_eula_accepted) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_isEulaAccepted(is_eula_accepted);
 }
 
 STDMETHODIMP AppWrapper::put_isEulaAccepted(VARIANT_BOOL is_eula_accepted) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_isEulaAccepted(is_eula_accepted);
 }
 
 STDMETHODIMP AppWrapper::get_displayName(BSTR* display_name) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_displayName(display_name);
 }
 
 STDMETHODIMP AppWrapper::put_displayName(BSTR display_name) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_displayName(display_name);
 }
 
 STDMETHODIMP AppWrapper::get_browserType(UINT* browser_type) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_browserType(browser_type);
 }
 
 STDMETHODIMP AppWrapper::put_browserType(UINT browser_type) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_browserType(browser_type);
 }
 
 STDMETHODIMP AppWrapper::get_clientInstallData(BSTR* data) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_clientInstallData(data);
 }
 
 STDMETHODIMP AppWrapper::put_clientInstallData(BSTR data) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_clientInstallData(data);
 }
 
 STDMETHODIMP AppWrapper::get_serverInstallDataIndex(BSTR* index) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_serverInstallDataIndex(index);
 }
 
 STDMETHODIMP AppWrapper::put_serverInstallDataIndex(BSTR index) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_serverInstallDataIndex(index);
 }
 
 STDMETHODIMP AppWrapper::get_usageStatsEnable(UINT* usage_stats_enable) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_usageStatsEnable(usage_stats_enable);
 }
 
 STDMETHODIMP AppWrapper::put_usageStatsEnable(UINT usage_stats_enable) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_usageStatsEnable(usage_stats_enable);
 }
 
 STDMETHODIMP AppWrapper::get_currentState(IDispatch** current_state_disp) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_currentState(current_state_disp);
 }
 
@@ -1170,7 +1192,7 @@ STDMETHODIMP AppWrapper::get_currentState(IDispatch** current_state_disp) {
 void SetAppStateForUnitTest(App* app, fsm::AppState* state) {
   ASSERT1(app);
   ASSERT1(state);
-  __mutexScope(app->model()->lock());
+  __mutexScope(app->lock());
   app->ChangeState(state);
 }
 
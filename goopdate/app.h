@@ -102,6 +102,16 @@ class App : public ModelObject {
   bool has_update_available() const;
   void set_has_update_available(bool has_update_available);
 
+  // True if the download of the app was queued by DownloadPipeline::Add()
+  // while the update check response was processed.
+  bool is_download_pipelined() const;
+  void set_is_download_pipelined();
+
+  // True while the app is installed by InstallScheduler, which holds the
+  // installer lock on behalf of the installer of the app.
+  bool is_install_scheduled() const;
+  void set_is_install_scheduled(bool is_install_scheduled);
+
   GUID iid() const;
 
   CString client_id() const;
@@ -343,6 +353,9 @@ class App : public ModelObject {
   // This can happen in both install and update cases.
   bool has_update_available_;
 
+  bool is_download_pipelined_;
+  bool is_install_scheduled_;
+
   GUID app_guid_;
   CString pv_;
 
@@ -29,8 +29,10 @@
 #include "omaha/common/web_services_client.h"
 #include "omaha/goopdate/app_bundle_state_init.h"
 #include "omaha/goopdate/app_manager.h"
+#include "omaha/goopdate/app_registry_snapshot.h"
 #include "omaha/goopdate/model.h"
 #include "omaha/goopdate/update_request_utils.h"
+#include "omaha/goopdate/worker_metrics.h"
 
 namespace omaha {
 
@@ -41,7 +43,9 @@ const TCHAR* const kDefaultInstallSource = _T("unknown");
 }  // namespace
 
 AppBundle::AppBundle(bool is_machine, Model* model)
-    : ModelObject(model),
+    : ModelObject(model, &lock_, &arena_),
+      lock_(_T("AppBundle")),
+      arena_(Arena::kDefaultBlockSize),
       install_source_(kDefaultInstallSource),
       is_machine_(is_machine),
       is_auto_update_(false),
@@ -50,6 +54,7 @@ AppBundle::AppBundle(bool is_machine, Model* model)
       user_work_item_(NULL),
       display_language_(lang::GetDefaultLanguage(is_machine)) {
   CORE_LOG(L3, (_T("[AppBundle::AppBundle][0x%p]"), this));
+  ASSERT1(model->IsLockedByCaller());
   app_bundle_state_.reset(new fsm::AppBundleStateInit);
 }
 
@@ -59,61 +64,78 @@ AppBundle::~AppBundle() {
   // Destruction of this object is not serialized. The lifetime of AppBundle
   // objects is controlled by the client and multiple objects can destruct at
   // the same time.
-  ASSERT1(!model()->IsLockedByCaller());
+  ASSERT1(!IsLockedByCaller());
 
   HRESULT hr = SendPingEvents();
   CORE_LOG(L3, (_T("[SendPingEvents returned 0x%x]"), hr));
 
-  __mutexScope(model()->lock());
-  for (size_t i = 0; i < apps_.size(); ++i) {
-    delete apps_[i];
-  }
+  __mutexBlock(lock()) {
+    for (size_t i = 0; i < apps_.size(); ++i) {
+      delete apps_[i];
+    }
+    for (size_t i = 0; i < uninstalled_apps_.size(); ++i) {
+      delete uninstalled_apps_[i];
+    }
 
-  // If the thread running this AppBundle does not exit before the
-  // NetworkConfigManager::DeleteInstance() happens in GoopdateImpl::Main, the
-  // update_check_client_ destructor will crash. Resetting here explicitly.
-  update_check_client_.reset();
+    metric_worker_bundle_objects_allocated += arena_.num_allocations();
+    metric_worker_bundle_arena_blocks += arena_.num_blocks();
+    metric_worker_bundle_arena_bytes.AddSample(arena_.bytes_reserved());
+
+    // If the thread running this AppBundle does not exit before the
+    // NetworkConfigManager::DeleteInstance() happens in GoopdateImpl::Main, the
+    // update_check_client_ destructor will crash. Resetting here explicitly.
+    update_check_client_.reset();
+
+    // Values modified in the snapshot are written back by the Worker. Anything
+    // left at this point belongs to an operation that did not complete.
+    if (registry_snapshot_.get()) {
+      VERIFY1(SUCCEEDED(AppManager::Instance()->FlushRegistrySnapshot(
+          registry_snapshot_.get())));
+      registry_snapshot_.reset();
+    }
+  }
 
   // Garbage-collect everything that has expired, including this object.
   // The model holds weak references to AppBundle objects. Those weak
   // references expire before the destructor for the object runs. Therefore, it
   // is not possible to associate this object with any of the weak references
-  // in the model. Those weak references must be garbage collected.
+  // in the model. Those weak references must be garbage collected. This takes
+  // the model lock, so it must be called after the bundle lock is released.
   model()->CleanupExpiredAppBundles();
 }
 
 ControllingPtr AppBundle::controlling_ptr() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return shared_from_this();
 }
 
 bool AppBundle::is_pending_non_blocking_call() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return user_work_item_ != NULL;
 }
 
 void AppBundle::set_user_work_item(UserWorkItem* user_work_item) {
   ASSERT(user_work_item, (_T("Use CompleteAsyncCall() instead.")));
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   user_work_item_ = user_work_item;
 }
 
 HANDLE AppBundle::impersonation_token() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return alt_impersonation_token_.GetHandle() ?
          alt_impersonation_token_.GetHandle() :
          impersonation_token_.GetHandle();
 }
 
 HANDLE AppBundle::primary_token() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return alt_primary_token_.GetHandle() ? alt_primary_token_.GetHandle() :
                                           primary_token_.GetHandle();
 }
 
 HRESULT AppBundle::CaptureCallerImpersonationToken() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   if (!is_machine_) {
     return S_OK;
@@ -133,7 +155,7 @@ HRESULT AppBundle::CaptureCallerImpersonationToken() {
 }
 
 HRESULT AppBundle::CaptureCallerPrimaryToken() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   if (!is_machine_) {
     return S_OK;
@@ -159,12 +181,12 @@ HRESULT AppBundle::CaptureCallerPrimaryToken() {
 }
 
 size_t AppBundle::GetNumberOfApps() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return apps_.size();
 }
 
 App* AppBundle::GetApp(size_t index) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   if (index >= GetNumberOfApps()) {
     ASSERT1(false);
@@ -177,7 +199,7 @@ App* AppBundle::GetApp(size_t index) {
 }
 
 CString AppBundle::FetchAndResetLogText() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   CString event_log_text;
   for (size_t i = 0; i < apps_.size(); ++i) {
@@ -199,7 +221,7 @@ HRESULT AppBundle::SendPingEvents() {
 
   Ping ping(is_machine_, session_id_, install_source_);
 
-  __mutexBlock(model()->lock()) {
+  __mutexBlock(lock()) {
     for (size_t i = 0; i != apps_.size(); ++i) {
       if (apps_[i]->is_eula_accepted()) {
         ping.BuildRequest(apps_[i], false);
@@ -224,73 +246,73 @@ HRESULT AppBundle::SendPingEvents() {
 // IAppBundle.
 STDMETHODIMP AppBundle::get_displayName(BSTR* display_name) {
   ASSERT1(display_name);
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   *display_name = display_name_.AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP AppBundle::put_displayName(BSTR display_name) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   display_name_ = display_name;
   return S_OK;
 }
 
 STDMETHODIMP AppBundle::get_installSource(BSTR* install_source) {
   ASSERT1(install_source);
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   *install_source = install_source_.AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP AppBundle::put_installSource(BSTR install_source) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   install_source_ = install_source;
   return S_OK;
 }
 
 STDMETHODIMP AppBundle::get_originURL(BSTR* origin_url) {
   ASSERT1(origin_url);
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   *origin_url = origin_url_.AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP AppBundle::put_originURL(BSTR origin_url) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   origin_url_ = origin_url;
   return S_OK;
 }
 
 STDMETHODIMP AppBundle::get_offlineDirectory(BSTR* offline_dir) {
   ASSERT1(offline_dir);
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   *offline_dir = offline_dir_.AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP AppBundle::put_offlineDirectory(BSTR offline_dir) {
   CORE_LOG(L3, (_T("[AppBundle::put_offlineDirectory][%s]"), offline_dir));
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   offline_dir_ = offline_dir;
   return S_OK;
 }
 
 STDMETHODIMP AppBundle::get_sessionId(BSTR* session_id) {
   ASSERT1(session_id);
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   *session_id = session_id_.AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP AppBundle::put_sessionId(BSTR session_id) {
   CORE_LOG(L3, (_T("[AppBundle::put_sessionId][%s]"), session_id));
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return app_bundle_state_->put_sessionId(this, session_id);
 }
 
 STDMETHODIMP AppBundle::get_priority(long* priority) {  // NOLINT
   ASSERT1(priority);
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   *priority = priority_;
   return S_OK;
 }
@@ -299,7 +321,7 @@ STDMETHODIMP AppBundle::put_priority(long priority) {  // NOLINT
   if ((priority < INSTALL_PRIORITY_LOW) || (priority > INSTALL_PRIORITY_HIGH)) {
     return E_INVALIDARG;
   }
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   priority_ = priority;
   return S_OK;
 }
@@ -310,7 +332,7 @@ STDMETHODIMP AppBundle::put_altTokens(ULONG_PTR impersonation_token,
   ASSERT1(impersonation_token);
   ASSERT1(primary_token);
   ASSERT1(caller_proc_id);
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   return app_bundle_state_->put_altTokens(this,
                                           impersonation_token,
@@ -321,26 +343,26 @@ STDMETHODIMP AppBundle::put_altTokens(ULONG_PTR impersonation_token,
 STDMETHODIMP AppBundle::put_parentHWND(ULONG_PTR hwnd) {
   CORE_LOG(L3, (_T("[AppBundle::put_parentHWND][0x%x]"), hwnd));
 
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   parent_hwnd_ = reinterpret_cast<HWND>(hwnd);
   update_check_client_->set_proxy_auth_config(GetProxyAuthConfig());
   return S_OK;
 }
 
 CString AppBundle::display_language() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return display_language_;
 }
 
 STDMETHODIMP AppBundle::get_displayLanguage(BSTR* language) {
   ASSERT1(language);
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   *language = display_language_.AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP AppBundle::put_displayLanguage(BSTR language) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   if (::SysStringLen(language) == 0) {
     return E_INVALIDARG;
   }
@@ -354,47 +376,47 @@ STDMETHODIMP AppBundle::put_displayLanguage(BSTR language) {
 }
 
 bool AppBundle::is_machine() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return is_machine_;
 }
 
 bool AppBundle::is_auto_update() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return is_auto_update_;
 }
 
 void AppBundle::set_is_auto_update(bool is_auto_update) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   is_auto_update_ = is_auto_update;
 }
 
 bool AppBundle::is_offline_install() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return !offline_dir_.IsEmpty();
 }
 
 const CString& AppBundle::offline_dir() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return offline_dir_;
 }
 
 const CString& AppBundle::session_id() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return session_id_;
 }
 
 int AppBundle::priority() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return priority_;
 }
 
 ProxyAuthConfig AppBundle::GetProxyAuthConfig() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return ProxyAuthConfig(parent_hwnd_, display_name_);
 }
 
 STDMETHODIMP AppBundle::initialize() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   // Ensure that clients that run as Local System were designed with alt tokens
   // in mind. The alt tokens might not always be a different user, but at least
@@ -417,7 +439,7 @@ STDMETHODIMP AppBundle::createApp(BSTR app_id, App** app) {
   ASSERT1(app_id);
   ASSERT1(app);
 
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   scoped_impersonation impersonate_user(impersonation_token());
   HRESULT hr = impersonate_user.result();
@@ -433,7 +455,7 @@ STDMETHODIMP AppBundle::createInstalledApp(BSTR app_id, App** app) {
   CORE_LOG(L1, (_T("[AppBundle::createInstalledApp][%s][0x%p]"), app_id, this));
   ASSERT1(app);
 
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
 
   scoped_impersonation impersonate_user(impersonation_token());
@@ -449,7 +471,7 @@ STDMETHODIMP AppBundle::createInstalledApp(BSTR app_id, App** app) {
 STDMETHODIMP AppBundle::createAllInstalledApps() {
   CORE_LOG(L1, (_T("[AppBundle::createAllInstalledApps][0x%p]"), this));
 
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   scoped_impersonation impersonate_user(impersonation_token());
   HRESULT hr = impersonate_user.result();
@@ -464,7 +486,7 @@ STDMETHODIMP AppBundle::createAllInstalledApps() {
 STDMETHODIMP AppBundle::get_Count(long* count) {  // NOLINT
   ASSERT1(count);
 
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   *count = apps_.size();
 
@@ -474,7 +496,7 @@ STDMETHODIMP AppBundle::get_Count(long* count) {  // NOLINT
 STDMETHODIMP AppBundle::get_Item(long index, App** app) {  // NOLINT
   ASSERT1(app);
 
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   if (index < 0 || static_cast<size_t>(index) >= apps_.size()) {
     return HRESULT_FROM_WIN32(ERROR_INVALID_INDEX);
@@ -485,15 +507,25 @@ STDMETHODIMP AppBundle::get_Item(long index, App** app) {  // NOLINT
 }
 
 WebServicesClientInterface* AppBundle::update_check_client() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(update_check_client_.get());
   return update_check_client_.get();
 }
 
+AppRegistrySnapshot* AppBundle::registry_snapshot() const {
+  __mutexScope(lock());
+  return registry_snapshot_.get();
+}
+
+void AppBundle::set_registry_snapshot(AppRegistrySnapshot* registry_snapshot) {
+  __mutexScope(lock());
+  registry_snapshot_.reset(registry_snapshot);
+}
+
 STDMETHODIMP AppBundle::checkForUpdate() {
   CORE_LOG(L1, (_T("[AppBundle::checkForUpdate][0x%p]"), this));
 
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   scoped_impersonation impersonate_user(impersonation_token());
   HRESULT hr = impersonate_user.result();
@@ -508,7 +540,7 @@ STDMETHODIMP AppBundle::checkForUpdate() {
 STDMETHODIMP AppBundle::download() {
   CORE_LOG(L1, (_T("[AppBundle::download][0x%p]"), this));
 
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   scoped_impersonation impersonate_user(impersonation_token());
   HRESULT hr = impersonate_user.result();
@@ -526,7 +558,7 @@ STDMETHODIMP AppBundle::download() {
 STDMETHODIMP AppBundle::install() {
   CORE_LOG(L1, (_T("[AppBundle::install][0x%p]"), this));
 
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   HRESULT hr = CaptureCallerPrimaryToken();
   if (FAILED(hr)) {
@@ -546,7 +578,7 @@ STDMETHODIMP AppBundle::install() {
 STDMETHODIMP AppBundle::updateAllApps() {
   CORE_LOG(L1, (_T("[AppBundle::updateAllApps][0x%p]"), this));
 
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   scoped_impersonation impersonate_user(impersonation_token());
   HRESULT hr = impersonate_user.result();
@@ -561,7 +593,7 @@ STDMETHODIMP AppBundle::updateAllApps() {
 STDMETHODIMP AppBundle::stop() {
   CORE_LOG(L1, (_T("[AppBundle::stop][0x%p]"), this));
 
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   return app_bundle_state_->Stop(this);
 }
@@ -569,7 +601,7 @@ STDMETHODIMP AppBundle::stop() {
 STDMETHODIMP AppBundle::pause() {
   CORE_LOG(L1, (_T("[AppBundle::pause][0x%p]"), this));
 
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   return app_bundle_state_->Pause(this);
 }
@@ -577,7 +609,7 @@ STDMETHODIMP AppBundle::pause() {
 STDMETHODIMP AppBundle::resume() {
   CORE_LOG(L1, (_T("[AppBundle::resume][0x%p]"), this));
 
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   return app_bundle_state_->Resume(this);
 }
@@ -586,7 +618,7 @@ STDMETHODIMP AppBundle::isBusy(VARIANT_BOOL* is_busy) {
   CORE_LOG(L3, (_T("[AppBundle::isBusy][0x%p]"), this));
   ASSERT1(is_busy);
 
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   *is_busy = IsBusy() ? VARIANT_TRUE : VARIANT_FALSE;
   return S_OK;
@@ -596,7 +628,7 @@ STDMETHODIMP AppBundle::downloadPackage(BSTR app_id, BSTR package_name) {
   CORE_LOG(L1, (_T("[AppBundle::downloadPackage][%s][%s]"),
       app_id, package_name));
 
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   scoped_impersonation impersonate_user(impersonation_token());
   HRESULT hr = impersonate_user.result();
@@ -625,7 +657,7 @@ HRESULT AppBundle::CreateUninstalledApp(const CString& app_id, App** app) {
                 app_id, this));
   ASSERT1(app);
 
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   GUID app_guid = {0};
   HRESULT hr = StringToGuidSafe(app_id, &app_guid);
@@ -634,7 +666,7 @@ HRESULT AppBundle::CreateUninstalledApp(const CString& app_id, App** app) {
     return hr;
   }
 
-  scoped_ptr<App> local_app(new App(app_guid, true, this));
+  scoped_ptr<App> local_app(new (arena()) App(app_guid, true, this));
 
   hr = AppManager::Instance()->ReadUninstalledAppPersistentData(
            local_app.get());
@@ -651,7 +683,7 @@ HRESULT AppBundle::CreateUninstalledApp(const CString& app_id, App** app) {
 }
 
 void AppBundle::CompleteAsyncCall() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   ASSERT1(is_pending_non_blocking_call());
 
@@ -661,7 +693,7 @@ void AppBundle::CompleteAsyncCall() {
 }
 
 bool AppBundle::IsBusy() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   const bool is_busy = app_bundle_state_->IsBusy();
   CORE_LOG(L3, (_T("[AppBundle::isBusy returned][0x%p][%u]"), this, is_busy));
   return is_busy;
@@ -669,7 +701,7 @@ bool AppBundle::IsBusy() const {
 
 void AppBundle::ChangeState(fsm::AppBundleState* app_bundle_state) {
   ASSERT1(app_bundle_state);
-  ASSERT1(model()->IsLockedByCaller());
+  ASSERT1(IsLockedByCaller());
 
   app_bundle_state_.reset(app_bundle_state);
 }
@@ -692,95 +724,95 @@ AppBundleWrapper::~AppBundleWrapper() {
 //
 
 STDMETHODIMP AppBundleWrapper::get_displayName(BSTR* display_name) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_displayName(display_name);
 }
 
 STDMETHODIMP AppBundleWrapper::put_displayName(BSTR display_name) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_displayName(display_name);
 }
 
 STDMETHODIMP AppBundleWrapper::get_installSource(BSTR* install_source) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_installSource(install_source);
 }
 
 STDMETHODIMP AppBundleWrapper::put_installSource(BSTR install_source) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_installSource(install_source);
 }
 
 STDMETHODIMP AppBundleWrapper::get_originURL(BSTR* origin_url) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_originURL(origin_url);
 }
 
 STDMETHODIMP AppBundleWrapper::put_originURL(BSTR origin_url) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_originURL(origin_url);
 }
 
 STDMETHODIMP AppBundleWrapper::get_offlineDirectory(BSTR* offline_dir) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_offlineDirectory(offline_dir);
 }
 
 STDMETHODIMP AppBundleWrapper::put_offlineDirectory(BSTR offline_dir) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_offlineDirectory(offline_dir);
 }
 
 STDMETHODIMP AppBundleWrapper::get_sessionId(BSTR* session_id) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_sessionId(session_id);
 }
 
 STDMETHODIMP AppBundleWrapper::put_sessionId(BSTR session_id) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_sessionId(session_id);
 }
 
 STDMETHODIMP AppBundleWrapper::get_priority(long* priority) {  // NOLINT
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_priority(priority);
 }
 
 STDMETHODIMP AppBundleWrapper::put_priority(long priority) {  // NOLINT
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_priority(priority);
 }
 
 STDMETHODIMP AppBundleWrapper::put_altTokens(ULONG_PTR impersonation_token,
                                              ULONG_PTR primary_token,
                                              DWORD caller_proc_id) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_altTokens(impersonation_token,
                                       primary_token,
                                       caller_proc_id);
 }
 
 STDMETHODIMP AppBundleWrapper::put_parentHWND(ULONG_PTR hwnd) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_parentHWND(hwnd);
 }
 
 STDMETHODIMP AppBundleWrapper::get_displayLanguage(BSTR* language) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_displayLanguage(language);
 }
 STDMETHODIMP AppBundleWrapper::put_displayLanguage(BSTR language) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->put_displayLanguage(language);
 }
 
 STDMETHODIMP AppBundleWrapper::initialize() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->initialize();
 }
 
 STDMETHODIMP AppBundleWrapper::createApp(BSTR app_id, IDispatch** app_disp) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   App* app = NULL;
   HRESULT hr = wrapped_obj()->createApp(app_id, &app);
@@ -793,7 +825,7 @@ STDMETHODIMP AppBundleWrapper::createApp(BSTR app_id, IDispatch** app_disp) {
 
 STDMETHODIMP AppBundleWrapper::createInstalledApp(BSTR appId,
                                                   IDispatch** app_disp) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   App* app = NULL;
   HRESULT hr = wrapped_obj()->createInstalledApp(appId, &app);
@@ -805,17 +837,17 @@ STDMETHODIMP AppBundleWrapper::createInstalledApp(BSTR appId,
 }
 
 STDMETHODIMP AppBundleWrapper::createAllInstalledApps() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->createAllInstalledApps();
 }
 
 STDMETHODIMP AppBundleWrapper::get_Count(long* count) {  // NOLINT
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_Count(count);
 }
 
 STDMETHODIMP AppBundleWrapper::get_Item(long index, IDispatch** app_disp) {  // NOLINT
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   App* app = NULL;
   HRESULT hr = wrapped_obj()->get_Item(index, &app);
@@ -827,12 +859,12 @@ STDMETHODIMP AppBundleWrapper::get_Item(long index, IDispatch** app_disp) {  //
 }
 
 STDMETHODIMP AppBundleWrapper::checkForUpdate() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->checkForUpdate();
 }
 
 STDMETHODIMP AppBundleWrapper::download() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->download();
 }
 
@@ -842,42 +874,42 @@ STDMETHODIMP AppBundleWrapper::install() {
     return E_ACCESSDENIED;
   }
 
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->install();
 }
 
 STDMETHODIMP AppBundleWrapper::updateAllApps() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->updateAllApps();
 }
 
 STDMETHODIMP AppBundleWrapper::stop() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->stop();
 }
 
 STDMETHODIMP AppBundleWrapper::pause() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->pause();
 }
 
 STDMETHODIMP AppBundleWrapper::resume() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->resume();
 }
 
 STDMETHODIMP AppBundleWrapper::isBusy(VARIANT_BOOL* is_busy) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->isBusy(is_busy);
 }
 
 STDMETHODIMP AppBundleWrapper::downloadPackage(BSTR app_id, BSTR package_name) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->downloadPackage(app_id, package_name);
 }
 
 STDMETHODIMP AppBundleWrapper::get_currentState(VARIANT* current_state) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_currentState(current_state);
 }
 
@@ -889,7 +921,7 @@ void SetAppBundleStateForUnitTest(AppBundle* app_bundle,
                                   fsm::AppBundleState* state) {
   ASSERT1(app_bundle);
   ASSERT1(state);
-  __mutexScope(app_bundle->model()->lock());
+  __mutexScope(app_bundle->lock());
   app_bundle->ChangeState(state);
 }
 
@@ -26,8 +26,10 @@
 #include "base/basictypes.h"
 #include "base/scoped_ptr.h"
 #include "goopdate/omaha3_idl.h"
+#include "omaha/base/arena.h"
 #include "omaha/base/constants.h"
 #include "omaha/base/debug.h"
+#include "omaha/base/lock_stats.h"
 #include "omaha/base/scoped_any.h"
 #include "omaha/goopdate/com_wrapper_creator.h"
 #include "omaha/goopdate/model_object.h"
@@ -41,6 +43,7 @@ namespace omaha {
 // such as Pause, Resume, Update, Install, etc...
 
 class App;
+class AppRegistrySnapshot;
 class Model;
 class WebServicesClientInterface;
 class UserWorkItem;
@@ -133,6 +136,13 @@ class AppBundle
 
   WebServicesClientInterface* update_check_client();
 
+  // Returns the registry snapshot loaded for this bundle or NULL if there is
+  // none. See AppManager::LoadRegistrySnapshot().
+  AppRegistrySnapshot* registry_snapshot() const;
+
+  // Takes ownership of the snapshot. Setting NULL releases the current one.
+  void set_registry_snapshot(AppRegistrySnapshot* registry_snapshot);
+
   bool is_machine() const;
 
   bool is_auto_update() const;
@@ -172,6 +182,14 @@ class AppBundle
 
   bool is_pending_non_blocking_call() const;
 
+  // Serializes access to the bundle and to the apps, app versions and packages
+  // in it. Returned by lock(). See model_object.h for the lock hierarchy.
+  InstrumentedLock<LLock> lock_;
+
+  // Allocates the apps, app versions and packages of the bundle. Returned by
+  // arena(). Destroyed after the objects allocated from it are deleted.
+  Arena arena_;
+
   CString display_name_;
   CString install_source_;
   CString origin_url_;
@@ -201,6 +219,10 @@ class AppBundle
 
   scoped_ptr<WebServicesClientInterface> update_check_client_;
 
+  // In-memory copy of the apps' registry state, used by bundles that operate
+  // on all installed apps to avoid reading the registry once per app value.
+  scoped_ptr<AppRegistrySnapshot> registry_snapshot_;
+
   // The apps in the bundle. Do not add to it directly; use AddApp() instead.
   std::vector<App*> apps_;
 
@@ -235,6 +257,7 @@ class AppBundle
 
   friend class AppBundleTest;
   friend class WorkerTest;
+  friend class WorkerLoadTest;
 
   DISALLOW_COPY_AND_ASSIGN(AppBundle);
 };
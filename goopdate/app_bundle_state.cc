@@ -110,7 +110,7 @@ bool AppBundleState::IsBusy() const {
 
 void AppBundleState::AddAppToBundle(AppBundle* app_bundle, App* app) {
   ASSERT1(app_bundle);
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
   app_bundle->apps_.push_back(app);
 }
 
@@ -124,7 +124,7 @@ HRESULT AppBundleState::DoDownloadPackage(AppBundle* app_bundle,
                                           const CString& package_name) {
   CORE_LOG(L3, (_T("[AppBundleState::DoDownloadPackage][0x%p]"), app_bundle));
   ASSERT1(app_bundle);
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
   ASSERT1(!IsPendingNonBlockingCall(app_bundle));
 
   GUID app_guid = {0};
@@ -173,7 +173,7 @@ HRESULT AppBundleState::DoDownloadPackage(AppBundle* app_bundle,
 void AppBundleState::ChangeState(AppBundle* app_bundle, AppBundleState* state) {
   ASSERT1(app_bundle);
   ASSERT1(state);
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
   CORE_LOG(L3, (_T("[AppBundleState::ChangeState][0x%p][from: %u][to: %u]"),
                 app_bundle, state_, state->state_));
 
@@ -186,7 +186,7 @@ HRESULT AppBundleState::HandleInvalidStateTransition(
   UNREFERENCED_PARAMETER(app_bundle);
   UNREFERENCED_PARAMETER(function_name);
   ASSERT1(app_bundle);
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
   CORE_LOG(LE, (_T("[Invalid state transition][%s called while in %u]"),
                 function_name, state_));
   return GOOPDATE_E_CALL_UNEXPECTED;
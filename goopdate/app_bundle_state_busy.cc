@@ -29,7 +29,7 @@ namespace fsm {
 HRESULT AppBundleStateBusy::Pause(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[AppBundleStateBusy::Pause][0x%p]"), app_bundle));
   ASSERT1(app_bundle);
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
   ASSERT1(IsPendingNonBlockingCall(app_bundle));
 
   HRESULT hr = app_bundle->model()->Pause(app_bundle);
@@ -45,7 +45,7 @@ HRESULT AppBundleStateBusy::Pause(AppBundle* app_bundle) {
 HRESULT AppBundleStateBusy::Stop(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[AppBundleStateBusy::Stop][0x%p]"), app_bundle));
   ASSERT1(app_bundle);
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
   ASSERT1(IsPendingNonBlockingCall(app_bundle));
 
   HRESULT hr = app_bundle->model()->Stop(app_bundle);
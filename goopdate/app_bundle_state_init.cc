@@ -37,7 +37,7 @@ HRESULT AppBundleStateInit::put_altTokens(AppBundle* app_bundle,
   ASSERT1(impersonation_token);
   ASSERT1(primary_token);
   ASSERT1(caller_proc_id);
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   scoped_handle caller_proc_handle(::OpenProcess(PROCESS_DUP_HANDLE,
                                                  false,
@@ -69,7 +69,7 @@ HRESULT AppBundleStateInit::put_sessionId(AppBundle* app_bundle,
                                           BSTR session_id) {
   CORE_LOG(L3, (_T("[AppBundleStateInit::put_sessionId][0x%p]"), app_bundle));
   ASSERT1(app_bundle);
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   if (!session_id) {
     return E_POINTER;
@@ -94,7 +94,7 @@ HRESULT AppBundleStateInit::put_sessionId(AppBundle* app_bundle,
 HRESULT AppBundleStateInit::Initialize(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[AppBundleStateInit::Initialize][0x%p]"), app_bundle));
   ASSERT1(app_bundle);
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   // Clients should have set these properties before calling this function.
   ASSERT1(!app_bundle->display_name_.IsEmpty());
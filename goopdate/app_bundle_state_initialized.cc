@@ -14,16 +14,17 @@
 // ========================================================================
 
 #include "omaha/goopdate/app_bundle_state_initialized.h"
+#include "base/scoped_ptr.h"
 #include "omaha/base/debug.h"
 #include "omaha/base/error.h"
 #include "omaha/base/logging.h"
-#include "omaha/common/app_registry_utils.h"
 #include "omaha/common/config_manager.h"
 #include "omaha/common/web_services_client.h"
 #include "omaha/goopdate/app_bundle_state_busy.h"
 #include "omaha/goopdate/app_bundle_state_paused.h"
 #include "omaha/goopdate/app_bundle_state_stopped.h"
 #include "omaha/goopdate/app_manager.h"
+#include "omaha/goopdate/app_registry_snapshot.h"
 #include "omaha/goopdate/model.h"
 
 namespace omaha {
@@ -33,7 +34,7 @@ namespace fsm {
 HRESULT AppBundleStateInitialized::Pause(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[AppBundleStateInitialized::Pause][0x%p]"), app_bundle));
   ASSERT1(app_bundle);
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   ChangeState(app_bundle, new AppBundleStatePaused);
   return S_OK;
@@ -42,7 +43,7 @@ HRESULT AppBundleStateInitialized::Pause(AppBundle* app_bundle) {
 HRESULT AppBundleStateInitialized::Stop(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[AppBundleStateInitialized::Stop][0x%p]"), app_bundle));
   ASSERT1(app_bundle);
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   ChangeState(app_bundle, new AppBundleStateStopped);
   return S_OK;
@@ -56,7 +57,7 @@ HRESULT AppBundleStateInitialized::CreateApp(AppBundle* app_bundle,
                 app_bundle));
   ASSERT1(app_bundle);
   ASSERT1(app);
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   // TODO(omaha): consider enabling this runtime test. Currently, there are
   // a few unit tests that break this assumption mostly during the setup of
@@ -80,7 +81,8 @@ HRESULT AppBundleStateInitialized::CreateApp(AppBundle* app_bundle,
     return hr;
   }
 
-  scoped_ptr<App> local_app(new App(app_guid, false, app_bundle));
+  scoped_ptr<App> local_app(
+      new (app_bundle->arena()) App(app_guid, false, app_bundle));
   hr = AddApp(app_bundle, local_app.get());
   if (FAILED(hr)) {
     return hr;
@@ -102,7 +104,7 @@ HRESULT AppBundleStateInitialized::CreateInstalledApp(AppBundle* app_bundle,
                                                       App** app) {
   CORE_LOG(L3, (_T("[AppBundleStateInitialized::CreateInstalledApp][0x%p]"),
                 app_bundle));
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   if (has_new_app_) {
     CORE_LOG(LE, (_T("[CreateInstalledApp][New app already in bundle]")));
@@ -133,7 +135,7 @@ HRESULT AppBundleStateInitialized::CreateAllInstalledApps(
     AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[AppBundleStateInitialized::CreateAllInstalledApps][0x%p]"),
                 app_bundle));
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   if (app_bundle->GetNumberOfApps() > 0) {
     CORE_LOG(LE, (_T("[CreateAllInstalledApps][Bundle already has apps]")));
@@ -151,18 +153,27 @@ HRESULT AppBundleStateInitialized::CreateAllInstalledApps(
     CORE_LOG(LW, (_T("[RunAllRegistrationUpdateHooks failed][0x%x]"), hr));
   }
 
-  AppIdVector registered_app_ids;
-  hr = app_manager.GetRegisteredApps(&registered_app_ids);
+  // Read the registry state of all apps at once. The bundle owns the snapshot,
+  // and AddInstalledApp() reads each app's persistent data from it.
+  scoped_ptr<AppRegistrySnapshot> registry_snapshot(new AppRegistrySnapshot);
+  hr = app_manager.LoadRegistrySnapshot(registry_snapshot.get());
   if (FAILED(hr)) {
-    CORE_LOG(LE, (_T("[GetRegisteredApps failed][0x%08x]"), hr));
+    CORE_LOG(LE, (_T("[LoadRegistrySnapshot failed][0x%08x]"), hr));
     return hr;
   }
 
+  AppIdVector registered_app_ids;
+  registry_snapshot->GetRegisteredApps(&registered_app_ids);
+
+  const AppRegistrySnapshot& snapshot = *registry_snapshot;
+  app_bundle->set_registry_snapshot(registry_snapshot.release());
+
   for (size_t i = 0; i != registered_app_ids.size(); ++i) {
     const CString& app_id = registered_app_ids[i];
 
-    ASSERT(RegKey::HasKey(app_registry_utils::GetAppClientStateKey(
-                              app_bundle->is_machine(), app_id)),
+    // The values of the apps that are not cached are read from the registry.
+    ASSERT(!snapshot.IsAppCached(app_id) ||
+           snapshot.HasKey(APP_HIVE_CLIENT_STATE, app_id),
            (_T("[Clients key without matching ClientState][%s]"), app_id));
 
     App* app = NULL;
@@ -182,7 +193,7 @@ HRESULT AppBundleStateInitialized::CheckForUpdate(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[AppBundleStateInitialized::CheckForUpdate][0x%p]"),
                 app_bundle));
   ASSERT1(app_bundle);
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
   ASSERT1(!IsPendingNonBlockingCall(app_bundle));
 
   if (app_bundle->GetNumberOfApps() == 0) {
@@ -206,7 +217,7 @@ HRESULT AppBundleStateInitialized::UpdateAllApps(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[AppBundleStateInitialized::UpdateAllApps][0x%p]"),
                 app_bundle));
   ASSERT1(app_bundle);
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
   ASSERT1(!IsPendingNonBlockingCall(app_bundle));
 
   if (app_bundle->GetNumberOfApps() != 0) {
@@ -239,7 +250,7 @@ HRESULT AppBundleStateInitialized::DownloadPackage(
   CORE_LOG(L3, (_T("[AppBundleStateInitialized::DownloadPackage][0x%p]"),
                 app_bundle));
   ASSERT1(app_bundle);
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   if (app_bundle->GetNumberOfApps() == 0 || has_new_app_) {
     CORE_LOG(LE, (_T("[DownloadPackage][No existing apps in bundle]")));
@@ -256,7 +267,7 @@ HRESULT AppBundleStateInitialized::AddInstalledApp(AppBundle* app_bundle,
                                                    App** app) {
   ASSERT1(app_bundle);
   ASSERT1(app);
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   GUID app_guid = {0};
   HRESULT hr = StringToGuidSafe(app_id, &app_guid);
@@ -265,7 +276,8 @@ HRESULT AppBundleStateInitialized::AddInstalledApp(AppBundle* app_bundle,
     return hr;
   }
 
-  scoped_ptr<App> local_app(new App(app_guid, true, app_bundle));
+  scoped_ptr<App> local_app(
+      new (app_bundle->arena()) App(app_guid, true, app_bundle));
 
   hr = AppManager::Instance()->ReadAppPersistentData(local_app.get());
   if (FAILED(hr)) {
@@ -287,7 +299,7 @@ HRESULT AppBundleStateInitialized::AddInstalledApp(AppBundle* app_bundle,
 HRESULT AppBundleStateInitialized::AddApp(AppBundle* app_bundle, App* app) {
   ASSERT1(app_bundle);
   ASSERT1(app);
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   for (size_t i = 0; i != app_bundle->GetNumberOfApps(); ++i) {
     App* existing_app = app_bundle->GetApp(i);
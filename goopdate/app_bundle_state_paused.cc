@@ -34,7 +34,7 @@ HRESULT AppBundleStatePaused::Pause(AppBundle* app_bundle) {
 HRESULT AppBundleStatePaused::Resume(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[AppBundleStatePaused::Resume][0x%p]"), app_bundle));
   ASSERT1(app_bundle);
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   HRESULT hr = app_bundle->model()->Resume(app_bundle);
   if (FAILED(hr)) {
@@ -54,7 +54,7 @@ HRESULT AppBundleStatePaused::CompleteAsyncCall(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[AppBundleStatePaused::CompleteAsyncCall][0x%p]"),
                 app_bundle));
   ASSERT1(app_bundle);
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
   ASSERT1(IsPendingNonBlockingCall(app_bundle));
   UNREFERENCED_PARAMETER(app_bundle);
   is_async_call_complete_ = true;
@@ -26,7 +26,7 @@ namespace fsm {
 HRESULT AppBundleStateReady::Download(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[AppBundleStateReady::Download][0x%p]"), app_bundle));
   ASSERT1(app_bundle);
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
   ASSERT1(!IsPendingNonBlockingCall(app_bundle));
 
   HRESULT hr = app_bundle->model()->Download(app_bundle);
@@ -42,7 +42,7 @@ HRESULT AppBundleStateReady::Download(AppBundle* app_bundle) {
 HRESULT AppBundleStateReady::Install(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[AppBundleStateReady::Install][0x%p]"), app_bundle));
   ASSERT1(app_bundle);
-  ASSERT1(app_bundle->model()->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
   ASSERT1(!IsPendingNonBlockingCall(app_bundle));
 
   HRESULT hr = app_bundle->model()->DownloadAndInstall(app_bundle);
@@ -554,6 +554,28 @@ TEST_F(AppBundleInitializedUserTest, createApp) {
   ValidateFreshInstallDefaultValues(*app0);
 }
 
+// The apps, their versions and their packages share the blocks of the bundle
+// arena.
+TEST_F(AppBundleInitializedUserTest, createApp_AllocatesFromBundleArena) {
+  App* app0 = NULL;
+  EXPECT_SUCCEEDED(app_bundle_->createApp(CComBSTR(kGuid1), &app0));
+  App* app1 = NULL;
+  EXPECT_SUCCEEDED(app_bundle_->createApp(CComBSTR(kGuid2), &app1));
+
+  __mutexScope(app_bundle_->lock());
+  const Arena& arena = *app_bundle_->arena();
+
+  // Each app and its current and next versions.
+  EXPECT_EQ(6, arena.num_allocations());
+  EXPECT_EQ(1, arena.num_blocks());
+
+  EXPECT_SUCCEEDED(app0->next_version()->AddPackage(_T("installer.exe"),
+                                                    1000,
+                                                    _T("hash")));
+  EXPECT_EQ(7, arena.num_allocations());
+  EXPECT_EQ(1, arena.num_blocks());
+}
+
 TEST_F(AppBundleInitializedUserTest, createApp_TwoApps) {
   App* app0_created = NULL;
   EXPECT_SUCCEEDED(app_bundle_->createApp(CComBSTR(kGuid1), &app0_created));
@@ -30,6 +30,7 @@
 #include "omaha/common/config_manager.h"
 #include "omaha/common/const_goopdate.h"
 #include "omaha/common/oem_install_utils.h"
+#include "omaha/goopdate/app_registry_snapshot.h"
 #include "omaha/goopdate/application_usage_data.h"
 #include "omaha/goopdate/model.h"
 #include "omaha/goopdate/server_resource.h"
@@ -98,8 +99,87 @@ HRESULT EnumerateSubKeys(const TCHAR* key_name, T* functor) {
   return S_OK;
 }
 
+// Same as app_registry_utils::ClearUpdateAvailableStats(), for the snapshot.
+void ClearUpdateAvailableStats(AppRegistrySnapshot* snapshot,
+                               const CString& app_id) {
+  ASSERT1(snapshot);
+  snapshot->DeleteValue(APP_HIVE_CLIENT_STATE,
+                        app_id,
+                        kRegValueUpdateAvailableCount);
+  snapshot->DeleteValue(APP_HIVE_CLIENT_STATE,
+                        app_id,
+                        kRegValueUpdateAvailableSince);
+}
+
+// Same as app_registry_utils::PersistSuccessfulUpdateCheck(), for the snapshot.
+void PersistSuccessfulUpdateCheck(AppRegistrySnapshot* snapshot,
+                                  const CString& app_id) {
+  ASSERT1(snapshot);
+  const DWORD now = Time64ToInt32(GetCurrent100NSTime());
+  snapshot->SetValue(APP_HIVE_CLIENT_STATE,
+                     app_id,
+                     kRegValueLastSuccessfulCheckSec,
+                     now);
+}
+
 }  // namespace
 
+// Provides the registry snapshot that the reads and writes for an app go
+// through. This is the snapshot owned by the app's bundle if it holds the app.
+// Otherwise, the app's keys are loaded into a local snapshot, which is written
+// back when this object goes out of scope. This object holds the lock of the
+// app's bundle and then the registry access lock for its lifetime, following
+// the hierarchy in model_object.h. The caller must not hold the registry access
+// lock when creating this object.
+class ScopedAppRegistrySnapshot {
+ public:
+  ScopedAppRegistrySnapshot(const AppManager& app_manager, const App& app)
+      : bundle_lock_(&app.lock()),
+        registry_access_lock_(&app_manager.registry_access_lock_),
+        app_manager_(app_manager),
+        snapshot_(NULL),
+        hr_(S_OK) {
+    const AppBundle* app_bundle = app.app_bundle();
+    AppRegistrySnapshot* bundle_snapshot =
+        app_bundle ? app_bundle->registry_snapshot() : NULL;
+    if (bundle_snapshot &&
+        bundle_snapshot->IsAppCached(app.app_guid_string())) {
+      snapshot_ = bundle_snapshot;
+      return;
+    }
+
+    local_snapshot_.reset(new AppRegistrySnapshot);
+    hr_ = local_snapshot_->LoadApp(app_manager_.registry_store_.get(),
+                                   app.app_guid_string());
+    snapshot_ = local_snapshot_.get();
+  }
+
+  ~ScopedAppRegistrySnapshot() {
+    if (local_snapshot_.get() && SUCCEEDED(hr_)) {
+      VERIFY1(SUCCEEDED(local_snapshot_->Flush(
+          app_manager_.registry_store_.get())));
+    }
+  }
+
+  // Returns the result of loading the local snapshot.
+  HRESULT hr() const { return hr_; }
+
+  AppRegistrySnapshot* get() const { return snapshot_; }
+
+ private:
+  // The locks are declared first so they are acquired before, and released
+  // after, the snapshot is loaded and written back.
+  AutoSync bundle_lock_;
+  AutoSync registry_access_lock_;
+
+  const AppManager& app_manager_;
+  AppRegistrySnapshot* snapshot_;
+  scoped_ptr<AppRegistrySnapshot> local_snapshot_;
+  HRESULT hr_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedAppRegistrySnapshot);
+};
+
 typedef bool (*AppPredictFunc)(const AppManager& app_manager,
                                const CString& app_id);
 
@@ -256,11 +336,77 @@ HRESULT AppManager::ReadAppVersionNoLock(bool is_machine, const GUID& app_guid,
   return S_OK;
 }
 
+RegistryStableStateLock::RegistryStableStateLock(const TCHAR* name)
+    : lock_(name),
+      num_installers_(0) {
+  reset(no_installers_event_, ::CreateEvent(NULL, true, true, NULL));
+  ASSERT1(valid(no_installers_event_));
+}
+
+bool RegistryStableStateLock::Lock() const {
+  return Lock(INFINITE);
+}
+
+bool RegistryStableStateLock::Lock(DWORD wait_ms) const {
+  if (lock_.GetOwner() == ::GetCurrentThreadId()) {
+    return lock_.Lock();
+  }
+
+  const DWORD start_ms = ::GetTickCount();
+  for (;;) {
+    DWORD remaining_ms = INFINITE;
+    if (wait_ms != INFINITE) {
+      const DWORD elapsed_ms = ::GetTickCount() - start_ms;
+      remaining_ms = elapsed_ms < wait_ms ? wait_ms - elapsed_ms : 0;
+    }
+    if (::WaitForSingleObject(get(no_installers_event_), remaining_ms) !=
+        WAIT_OBJECT_0) {
+      return false;
+    }
+    const bool is_locked = remaining_ms == INFINITE ? lock_.Lock() :
+                                                      lock_.Lock(remaining_ms);
+    if (!is_locked) {
+      return false;
+    }
+
+    // An installer may have started between the wait and the lock.
+    if (!num_installers_) {
+      return true;
+    }
+    VERIFY1(lock_.Unlock());
+  }
+}
+
+bool RegistryStableStateLock::Unlock() const {
+  return lock_.Unlock();
+}
+
+void RegistryStableStateLock::BeginInstaller() {
+  ASSERT1(lock_.GetOwner() == ::GetCurrentThreadId());
+  if (num_installers_++ == 0) {
+    VERIFY1(::ResetEvent(get(no_installers_event_)));
+  }
+}
+
+void RegistryStableStateLock::EndInstaller() {
+  __mutexScope(lock_);
+  ASSERT1(num_installers_ > 0);
+  if (--num_installers_ == 0) {
+    VERIFY1(::SetEvent(get(no_installers_event_)));
+  }
+}
+
 AppManager::AppManager(bool is_machine)
-    : is_machine_(is_machine) {
+    : is_machine_(is_machine),
+      registry_store_(new AppRegistryStore(is_machine)),
+      registry_access_lock_(_T("AppManager.RegistryAccess")),
+      registry_stable_state_lock_(_T("AppManager.RegistryStableState")) {
   CORE_LOG(L3, (_T("[AppManager::AppManager][is_machine=%d]"), is_machine));
 }
 
+AppManager::~AppManager() {
+}
+
 // App installers should use similar code to create a lock to acquire while
 // modifying Omaha registry.
 bool AppManager::InitializeRegistryLock() {
@@ -351,6 +497,39 @@ HRESULT AppManager::GetRegisteredApps(AppIdVector* app_ids) const {
       &func);
 }
 
+// Vulnerable to a race condition with installers. To prevent this, hold
+// GetRegistryStableStateLock() while loading the snapshot.
+HRESULT AppManager::LoadRegistrySnapshot(AppRegistrySnapshot* snapshot) const {
+  ASSERT1(snapshot);
+  CORE_LOG(L3, (_T("[AppManager::LoadRegistrySnapshot]")));
+
+  return snapshot->Load(registry_store_.get());
+}
+
+HRESULT AppManager::FlushRegistrySnapshot(AppRegistrySnapshot* snapshot) {
+  ASSERT1(snapshot);
+  CORE_LOG(L3, (_T("[AppManager::FlushRegistrySnapshot]")));
+
+  __mutexScope(registry_access_lock_);
+  return snapshot->Flush(registry_store_.get());
+}
+
+void AppManager::EvictFromRegistrySnapshot(const App& app) {
+  ASSERT1(app.IsLockedByCaller());
+
+  AppRegistrySnapshot* snapshot = app.app_bundle()->registry_snapshot();
+  if (!snapshot) {
+    return;
+  }
+
+  CORE_LOG(L3, (_T("[AppManager::EvictFromRegistrySnapshot][%s]"),
+                app.app_guid_string()));
+
+  __mutexScope(registry_access_lock_);
+  VERIFY1(SUCCEEDED(snapshot->Evict(registry_store_.get(),
+                                    app.app_guid_string())));
+}
+
 // Vulnerable to a race condition with installers. To prevent this, acquire
 // GetRegistryStableStateLock().
 HRESULT AppManager::GetUninstalledApps(AppIdVector* app_ids) const {
@@ -456,6 +635,43 @@ HRESULT AppManager::CreateClientStateKey(const GUID& app_guid,
   return S_OK;
 }
 
+// The ClientStateMedium value is copied to ClientState when it grants
+// acceptance, as app_registry_utils::IsAppEulaAccepted() does.
+bool AppManager::IsAppEulaAccepted(AppRegistrySnapshot* snapshot,
+                                   const CString& app_id) const {
+  ASSERT1(snapshot);
+
+  DWORD eula_accepted = 0;
+  if (FAILED(snapshot->GetValue(APP_HIVE_CLIENT_STATE,
+                                app_id,
+                                kRegValueEulaAccepted,
+                                &eula_accepted))) {
+    return true;
+  }
+  if (0 != eula_accepted) {
+    return true;
+  }
+
+  if (!is_machine_) {
+    return false;
+  }
+
+  eula_accepted = 0;
+  if (FAILED(snapshot->GetValue(APP_HIVE_CLIENT_STATE_MEDIUM,
+                                app_id,
+                                kRegValueEulaAccepted,
+                                &eula_accepted)) ||
+      0 == eula_accepted) {
+    return false;
+  }
+
+  snapshot->SetValue(APP_HIVE_CLIENT_STATE,
+                     app_id,
+                     kRegValueEulaAccepted,
+                     eula_accepted);
+  return true;
+}
+
 // Reads the following values from the registry:
 //  Clients key
 //    pv
@@ -482,33 +698,38 @@ HRESULT AppManager::CreateClientStateKey(const GUID& app_guid,
 // presence is checked for an uninstall
 // TODO(omaha3): We will need to get ClientState's pv when reporting uninstalls.
 // Note: If the application is uninstalled, the Clients key may not exist.
+// The values are read from the bundle's registry snapshot when it holds the
+// app. Otherwise, the app's keys are read once into a local snapshot.
 HRESULT AppManager::ReadAppPersistentData(App* app) {
   ASSERT1(app);
 
-  const GUID& app_guid = app->app_guid();
   const CString& app_guid_string = app->app_guid_string();
 
   CORE_LOG(L2, (_T("[AppManager::ReadAppPersistentData][%s]"),
                 app_guid_string));
 
-  ASSERT1(app->model()->IsLockedByCaller());
+  ASSERT1(app->IsLockedByCaller());
 
-  __mutexScope(registry_access_lock_);
+  // Holds the registry access lock for the rest of this function.
+  ScopedAppRegistrySnapshot scoped_snapshot(*this, *app);
+  HRESULT hr = scoped_snapshot.hr();
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[Failed to load app registry state][0x%08x]"), hr));
+    return hr;
+  }
+  AppRegistrySnapshot* snapshot = scoped_snapshot.get();
 
-  const bool is_eula_accepted =
-      app_registry_utils::IsAppEulaAccepted(is_machine_,
-                                            app_guid_string,
-                                            false);
+  const bool is_eula_accepted = IsAppEulaAccepted(snapshot, app_guid_string);
   app->is_eula_accepted_ = is_eula_accepted ? TRISTATE_TRUE : TRISTATE_FALSE;
 
-  bool client_key_exists = false;
-  RegKey client_key;
-  HRESULT hr = OpenClientKey(app_guid, &client_key);
-  if (SUCCEEDED(hr)) {
-    client_key_exists = true;
-
+  const bool client_key_exists = snapshot->HasKey(APP_HIVE_CLIENTS,
+                                                  app_guid_string);
+  if (client_key_exists) {
     CString version;
-    hr = client_key.GetValue(kRegValueProductVersion, &version);
+    hr = snapshot->GetValue(APP_HIVE_CLIENTS,
+                            app_guid_string,
+                            kRegValueProductVersion,
+                            &version);
     CORE_LOG(L3, (_T("[AppManager::ReadAppPersistentData]")
                   _T("[%s][version=%s]"), app_guid_string, version));
     if (FAILED(hr)) {
@@ -518,8 +739,14 @@ HRESULT AppManager::ReadAppPersistentData(App* app) {
     app->current_version()->set_version(version);
 
     // Language and name might not be written by installer, so ignore failures.
-    client_key.GetValue(kRegValueLanguage, &app->language_);
-    client_key.GetValue(kRegValueAppName, &app->display_name_);
+    snapshot->GetValue(APP_HIVE_CLIENTS,
+                       app_guid_string,
+                       kRegValueLanguage,
+                       &app->language_);
+    snapshot->GetValue(APP_HIVE_CLIENTS,
+                       app_guid_string,
+                       kRegValueAppName,
+                       &app->display_name_);
   }
 
   // Ensure there is a valid display name.
@@ -545,7 +772,8 @@ HRESULT AppManager::ReadAppPersistentData(App* app) {
   // The following do not rely on client_state_key, so check them before
   // possibly returning if OpenClientStateKey fails.
 
-  // Reads the did run value.
+  // Reads the did run value. The did run values are spread across user hives
+  // and are not part of the snapshot.
   ApplicationUsageData app_usage(is_machine_, vista_util::IsVistaOrLater());
   app_usage.ReadDidRun(app_guid_string);
 
@@ -557,9 +785,7 @@ HRESULT AppManager::ReadAppPersistentData(App* app) {
   // that the results when ClientState does not exist are desirable. See the
   // comments near that function and above set_days_since_last_active_ping call.
 
-  RegKey client_state_key;
-  hr = OpenClientStateKey(app_guid, KEY_READ, &client_state_key);
-  if (FAILED(hr)) {
+  if (!snapshot->HasKey(APP_HIVE_CLIENT_STATE, app_guid_string)) {
     // It is possible that the client state key has not yet been populated.
     // In this case just return the information that we have gathered thus far.
     // However if both keys do not exist, then we are doing something wrong.
@@ -567,54 +793,78 @@ HRESULT AppManager::ReadAppPersistentData(App* app) {
     if (client_key_exists) {
       return S_OK;
     } else {
-      return hr;
+      return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
     }
   }
 
   // Read language from ClientState key if it was not found in the Clients key.
   if (app->language().IsEmpty()) {
-    client_state_key.GetValue(kRegValueLanguage, &app->language_);
+    snapshot->GetValue(APP_HIVE_CLIENT_STATE,
+                       app_guid_string,
+                       kRegValueLanguage,
+                       &app->language_);
   }
 
-  client_state_key.GetValue(kRegValueAdditionalParams, &app->ap_);
-  client_state_key.GetValue(kRegValueTTToken, &app->tt_token_);
+  snapshot->GetValue(APP_HIVE_CLIENT_STATE,
+                     app_guid_string,
+                     kRegValueAdditionalParams,
+                     &app->ap_);
+  snapshot->GetValue(APP_HIVE_CLIENT_STATE,
+                     app_guid_string,
+                     kRegValueTTToken,
+                     &app->tt_token_);
 
   CString iid;
-  client_state_key.GetValue(kRegValueInstallationId, &iid);
+  snapshot->GetValue(APP_HIVE_CLIENT_STATE,
+                     app_guid_string,
+                     kRegValueInstallationId,
+                     &iid);
   GUID iid_guid;
   if (SUCCEEDED(StringToGuidSafe(iid, &iid_guid))) {
     app->iid_ = iid_guid;
   }
 
-  client_state_key.GetValue(kRegValueBrandCode, &app->brand_code_);
+  snapshot->GetValue(APP_HIVE_CLIENT_STATE,
+                     app_guid_string,
+                     kRegValueBrandCode,
+                     &app->brand_code_);
   ASSERT1(app->brand_code_.GetLength() <= kBrandIdLength);
-  client_state_key.GetValue(kRegValueClientId, &app->client_id_);
+  snapshot->GetValue(APP_HIVE_CLIENT_STATE,
+                     app_guid_string,
+                     kRegValueClientId,
+                     &app->client_id_);
 
   // We do not need the referral_id.
 
   DWORD last_active_ping_sec(0);
-  if (SUCCEEDED(client_state_key.GetValue(kRegValueActivePingDayStartSec,
-                                          &last_active_ping_sec))) {
+  if (SUCCEEDED(snapshot->GetValue(APP_HIVE_CLIENT_STATE,
+                                   app_guid_string,
+                                   kRegValueActivePingDayStartSec,
+                                   &last_active_ping_sec))) {
     int days_since_last_active_ping =
         GetNumberOfDaysSince(static_cast<int32>(last_active_ping_sec));
     app->set_days_since_last_active_ping(days_since_last_active_ping);
   }
 
   DWORD last_roll_call_sec(0);
-  if (SUCCEEDED(client_state_key.GetValue(kRegValueRollCallDayStartSec,
-                                          &last_roll_call_sec))) {
+  if (SUCCEEDED(snapshot->GetValue(APP_HIVE_CLIENT_STATE,
+                                   app_guid_string,
+                                   kRegValueRollCallDayStartSec,
+                                   &last_roll_call_sec))) {
     int days_since_last_roll_call =
         GetNumberOfDaysSince(static_cast<int32>(last_roll_call_sec));
     app->set_days_since_last_roll_call(days_since_last_roll_call);
   }
 
-  app->install_time_diff_sec_ = GetInstallTimeDiffSec(app_guid);
+  app->install_time_diff_sec_ = GetInstallTimeDiffSec(*snapshot,
+                                                      app_guid_string);
   // Generally GetInstallTimeDiffSec() shouldn't return kInitialInstallTimeDiff
   // here. The only exception is in the unexpected case when ClientState exists
   // without a pv.
   ASSERT1((app->install_time_diff_sec_ != kInitialInstallTimeDiff) ||
-          !RegKey::HasValue(GetClientStateKeyName(app_guid),
-                            kRegValueProductVersion));
+          !snapshot->HasValue(APP_HIVE_CLIENT_STATE,
+                              app_guid_string,
+                              kRegValueProductVersion));
 
   return S_OK;
 }
@@ -895,7 +1145,7 @@ HRESULT AppManager::ReadInstallerRegistrationValues(App* app) {
   CORE_LOG(L2, (_T("[AppManager::ReadInstallerRegistrationValues][%s]"),
                 app_guid_string));
 
-  ASSERT1(app->model()->IsLockedByCaller());
+  ASSERT1(app->IsLockedByCaller());
 
   __mutexScope(registry_access_lock_);
 
@@ -932,25 +1182,31 @@ void AppManager::PersistSuccessfulUpdateCheckResponse(
     bool is_update_available) {
   CORE_LOG(L2, (_T("[AppManager::PersistSuccessfulUpdateCheckResponse]")
                 _T("[%s][%d]"), app.app_guid_string(), is_update_available));
-  __mutexScope(registry_access_lock_);
 
-  VERIFY1(SUCCEEDED(SetTTToken(app)));
+  ScopedAppRegistrySnapshot scoped_snapshot(*this, app);
+  if (FAILED(scoped_snapshot.hr())) {
+    CORE_LOG(LE, (_T("[Failed to load app registry state][0x%08x]"),
+                  scoped_snapshot.hr()));
+    return;
+  }
+  AppRegistrySnapshot* snapshot = scoped_snapshot.get();
+  const CString& app_id = app.app_guid_string();
 
-  const CString client_state_key = GetClientStateKeyName(app.app_guid());
+  VERIFY1(SUCCEEDED(SetTTToken(snapshot, app)));
 
   if (is_update_available) {
     if (app.error_code() == GOOPDATE_E_APP_UPDATE_DISABLED_BY_POLICY) {
       // The error indicates is_update and updates are disabled by policy.
       ASSERT1(app.is_update());
-      app_registry_utils::ClearUpdateAvailableStats(client_state_key);
+      ClearUpdateAvailableStats(snapshot, app_id);
     } else if (app.is_update()) {
       // Only record an update available event for updates.
       // We have other mechanisms, including IID, to track install success.
-      UpdateUpdateAvailableStats(app.app_guid());
+      UpdateUpdateAvailableStats(snapshot, app_id);
     }
   } else {
-    app_registry_utils::ClearUpdateAvailableStats(client_state_key);
-    app_registry_utils::PersistSuccessfulUpdateCheck(client_state_key);
+    ClearUpdateAvailableStats(snapshot, app_id);
+    PersistSuccessfulUpdateCheck(snapshot, app_id);
   }
 }
 
@@ -1059,22 +1315,22 @@ HRESULT AppManager::SynchronizeClientState(const GUID& app_guid) {
 // that is used for the value from the tag exposes this value to the COM setter.
 // It would be nice to avoid that, possibly by only allowing that setter to work
 // in certain states.
-HRESULT AppManager::SetTTToken(const App& app) {
+HRESULT AppManager::SetTTToken(AppRegistrySnapshot* snapshot,
+                               const App& app) {
+  ASSERT1(snapshot);
   CORE_LOG(L3, (_T("[AppManager::SetTTToken][token=%s]"), app.tt_token()));
 
-  __mutexScope(registry_access_lock_);
-
-  RegKey client_state_key;
-  HRESULT hr = CreateClientStateKey(app.app_guid(), &client_state_key);
-  if (FAILED(hr)) {
-    return hr;
-  }
-
   if (app.tt_token().IsEmpty()) {
-    return client_state_key.DeleteValue(kRegValueTTToken);
+    snapshot->DeleteValue(APP_HIVE_CLIENT_STATE,
+                          app.app_guid_string(),
+                          kRegValueTTToken);
   } else {
-    return client_state_key.SetValue(kRegValueTTToken, app.tt_token());
+    snapshot->SetValue(APP_HIVE_CLIENT_STATE,
+                       app.app_guid_string(),
+                       kRegValueTTToken,
+                       app.tt_token());
   }
+  return S_OK;
 }
 
 void AppManager::ClearOemInstalled(const AppIdVector& app_ids) {
@@ -1100,33 +1356,35 @@ void AppManager::ClearOemInstalled(const AppIdVector& app_ids) {
   }
 }
 
-void AppManager::UpdateUpdateAvailableStats(const GUID& app_guid) {
-  __mutexScope(registry_access_lock_);
-
-  RegKey state_key;
-  HRESULT hr = CreateClientStateKey(app_guid, &state_key);
-  if (FAILED(hr)) {
-    ASSERT1(false);
-    return;
-  }
+void AppManager::UpdateUpdateAvailableStats(AppRegistrySnapshot* snapshot,
+                                            const CString& app_id) {
+  ASSERT1(snapshot);
 
   DWORD update_available_count(0);
-  hr = state_key.GetValue(kRegValueUpdateAvailableCount,
-                          &update_available_count);
+  HRESULT hr = snapshot->GetValue(APP_HIVE_CLIENT_STATE,
+                                  app_id,
+                                  kRegValueUpdateAvailableCount,
+                                  &update_available_count);
   if (FAILED(hr)) {
     update_available_count = 0;
   }
   ++update_available_count;
-  VERIFY1(SUCCEEDED(state_key.SetValue(kRegValueUpdateAvailableCount,
-                                       update_available_count)));
+  snapshot->SetValue(APP_HIVE_CLIENT_STATE,
+                     app_id,
+                     kRegValueUpdateAvailableCount,
+                     update_available_count);
 
   DWORD64 update_available_since_time(0);
-  hr = state_key.GetValue(kRegValueUpdateAvailableSince,
+  hr = snapshot->GetValue(APP_HIVE_CLIENT_STATE,
+                          app_id,
+                          kRegValueUpdateAvailableSince,
                           &update_available_since_time);
   if (FAILED(hr)) {
     // There is no existing value, so this must be the first update notice.
-    VERIFY1(SUCCEEDED(state_key.SetValue(kRegValueUpdateAvailableSince,
-                                         GetCurrent100NSTime())));
+    snapshot->SetValue(APP_HIVE_CLIENT_STATE,
+                       app_id,
+                       kRegValueUpdateAvailableSince,
+                       static_cast<DWORD64>(GetCurrent100NSTime()));
 
     // TODO(omaha): It would be nice to report the version that we were first
     // told to update to. This is available in UpdateResponse but we do not
@@ -1176,20 +1434,32 @@ void AppManager::ReadUpdateAvailableStats(
 }
 
 uint32 AppManager::GetInstallTimeDiffSec(const GUID& app_guid) const {
-  if (!IsAppRegistered(app_guid) && !IsAppUninstalled(app_guid)) {
+  const CString app_id = GuidToString(app_guid);
+
+  AppRegistrySnapshot snapshot;
+  if (FAILED(snapshot.LoadApp(registry_store_.get(), app_id))) {
+    return 0;
+  }
+
+  return GetInstallTimeDiffSec(snapshot, app_id);
+}
+
+uint32 AppManager::GetInstallTimeDiffSec(const AppRegistrySnapshot& snapshot,
+                                         const CString& app_id) const {
+  if (!snapshot.IsAppRegistered(app_id) && !snapshot.IsAppUninstalled(app_id)) {
     return kInitialInstallTimeDiff;
   }
 
-  RegKey client_state_key;
-  HRESULT hr = OpenClientStateKey(app_guid, KEY_READ, &client_state_key);
-  if (FAILED(hr)) {
+  if (!snapshot.HasKey(APP_HIVE_CLIENT_STATE, app_id)) {
     return 0;
   }
 
   DWORD install_time(0);
   DWORD install_time_diff_sec(0);
-  if (SUCCEEDED(client_state_key.GetValue(kRegValueInstallTimeSec,
-                                          &install_time))) {
+  if (SUCCEEDED(snapshot.GetValue(APP_HIVE_CLIENT_STATE,
+                                  app_id,
+                                  kRegValueInstallTimeSec,
+                                  &install_time))) {
     const uint32 now = Time64ToInt32(GetCurrent100NSTime());
     if (0 != install_time && now >= install_time) {
       install_time_diff_sec = now - install_time;
@@ -1211,8 +1481,7 @@ uint32 AppManager::GetInstallTimeDiffSec(const GUID& app_guid) const {
 // 3) The app is Omaha. Always delete Installation ID if it is present
 //    because DidRun does not apply.
 HRESULT AppManager::ClearInstallationId(const App& app) {
-  ASSERT1(app.model()->IsLockedByCaller());
-  __mutexScope(registry_access_lock_);
+  ASSERT1(app.IsLockedByCaller());
 
   if (::IsEqualGUID(app.iid(), GUID_NULL)) {
     return S_OK;
@@ -1223,13 +1492,15 @@ HRESULT AppManager::ClearInstallationId(const App& app) {
       (::IsEqualGUID(kGoopdateGuid, app.app_guid()))) {
     CORE_LOG(L1, (_T("[Deleting iid for app][%s]"), app.app_guid_string()));
 
-    RegKey client_state_key;
-    HRESULT hr = CreateClientStateKey(app.app_guid(), &client_state_key);
+    ScopedAppRegistrySnapshot scoped_snapshot(*this, app);
+    HRESULT hr = scoped_snapshot.hr();
     if (FAILED(hr)) {
       return hr;
     }
 
-    return client_state_key.DeleteValue(kRegValueInstallationId);
+    scoped_snapshot.get()->DeleteValue(APP_HIVE_CLIENT_STATE,
+                                       app.app_guid_string(),
+                                       kRegValueInstallationId);
   }
 
   return S_OK;
@@ -1239,30 +1510,33 @@ void AppManager::SetLastPingDayStartTime(const App& app,
                                          int elapsed_seconds_since_day_start) {
   ASSERT1(elapsed_seconds_since_day_start >= 0);
   ASSERT1(elapsed_seconds_since_day_start < kMaxTimeSinceMidnightSec);
-  ASSERT1(app.model()->IsLockedByCaller());
-
-  __mutexScope(registry_access_lock_);
+  ASSERT1(app.IsLockedByCaller());
 
   int now = Time64ToInt32(GetCurrent100NSTime());
 
-  RegKey client_state_key;
-  if (FAILED(CreateClientStateKey(app.app_guid(), &client_state_key))) {
+  ScopedAppRegistrySnapshot scoped_snapshot(*this, app);
+  if (FAILED(scoped_snapshot.hr())) {
     return;
   }
+  AppRegistrySnapshot* snapshot = scoped_snapshot.get();
 
   bool did_send_active_ping = (app.did_run() == ACTIVE_RUN &&
                                app.days_since_last_active_ping() != 0);
   if (did_send_active_ping) {
-    VERIFY1(SUCCEEDED(client_state_key.SetValue(
+    snapshot->SetValue(
+        APP_HIVE_CLIENT_STATE,
+        app.app_guid_string(),
         kRegValueActivePingDayStartSec,
-        static_cast<DWORD>(now - elapsed_seconds_since_day_start))));
+        static_cast<DWORD>(now - elapsed_seconds_since_day_start));
   }
 
   bool did_send_roll_call = (app.days_since_last_roll_call() != 0);
   if (did_send_roll_call) {
-    VERIFY1(SUCCEEDED(client_state_key.SetValue(
+    snapshot->SetValue(
+        APP_HIVE_CLIENT_STATE,
+        app.app_guid_string(),
         kRegValueRollCallDayStartSec,
-        static_cast<DWORD>(now - elapsed_seconds_since_day_start))));
+        static_cast<DWORD>(now - elapsed_seconds_since_day_start));
   }
 }
 
@@ -1273,7 +1547,7 @@ void AppManager::SetLastPingDayStartTime(const App& app,
 HRESULT AppManager::PersistUpdateCheckSuccessfullySent(
     const App& app,
     int elapsed_seconds_since_day_start) {
-  ASSERT1(app.model()->IsLockedByCaller());
+  ASSERT1(app.IsLockedByCaller());
 
   ApplicationUsageData app_usage(app.app_bundle()->is_machine(),
                                  vista_util::IsVistaOrLater());
@@ -20,18 +20,60 @@
 #include <atlstr.h>
 #include <vector>
 #include "base/basictypes.h"
+#include "base/scoped_ptr.h"
+#include "omaha/base/lock_stats.h"
+#include "omaha/base/scoped_any.h"
 #include "omaha/base/synchronized.h"
 
 namespace omaha {
 
 class App;
+class AppRegistrySnapshot;
+class AppRegistryStoreInterface;
 class RegKey;
 
 typedef std::vector<CString> AppIdVector;
 
+// Ensures the registry is in a stable state while several installers of the
+// process may be running at the same time. Lock() waits until no installer
+// started with BeginInstaller() is running, unless the calling thread already
+// holds the lock. The installs use install_lock() instead, which does not wait
+// for the other installers, to update the registry before and after running
+// their installer.
+class RegistryStableStateLock : public Lockable {
+ public:
+  explicit RegistryStableStateLock(const TCHAR* name);
+  virtual ~RegistryStableStateLock() {}
+
+  virtual bool Lock() const;
+  virtual bool Lock(DWORD wait_ms) const;
+  virtual bool Unlock() const;
+
+  // Returns the thread id of the owner or 0 if the lock is not owned.
+  DWORD GetOwner() const { return lock_.GetOwner(); }
+
+  Lockable& install_lock() { return lock_; }
+
+  // Marks the start and the end of the execution of an installer. The caller
+  // must hold the lock when calling BeginInstaller().
+  void BeginInstaller();
+  void EndInstaller();
+
+ private:
+  InstrumentedLock<LLock> lock_;
+
+  // The number of installers running. Protected by lock_.
+  int num_installers_;
+
+  // Manual reset event that is signaled when num_installers_ is zero.
+  scoped_event no_installers_event_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(RegistryStableStateLock);
+};
+
 // Manages the persistence of application state in the registry.
 // All functions that operate on model objects assume the call is protected by
-// the model lock.
+// the lock of the bundle the objects belong to.
 // All public functions hold a registry access lock for the duration of registry
 // accesses in that function. Unless otherwise noted, read operations may return
 // inconsistent/unstable state in some cases. Examples include:
@@ -75,6 +117,22 @@ class AppManager {
   // Adds all registered products to bundle.
   HRESULT GetRegisteredApps(AppIdVector* app_ids) const;
 
+  // Loads the Clients, ClientState, and ClientStateMedium keys of all apps
+  // into the snapshot with one enumeration of each hive. Once the snapshot is
+  // owned by a bundle, the per-app reads and update check writes for the apps
+  // in that bundle are served from memory until FlushRegistrySnapshot() is
+  // called. Vulnerable to the same race conditions as GetRegisteredApps().
+  HRESULT LoadRegistrySnapshot(AppRegistrySnapshot* snapshot) const;
+
+  // Writes the values modified in the snapshot back to the registry in one
+  // pass.
+  HRESULT FlushRegistrySnapshot(AppRegistrySnapshot* snapshot);
+
+  // Writes the app's modified values and stops serving the app from the
+  // bundle's snapshot. Must be called before anything other than AppManager,
+  // such as the app installer, modifies the app's keys.
+  void EvictFromRegistrySnapshot(const App& app);
+
   // Adds all uninstalled products to bundle.
   HRESULT GetUninstalledApps(AppIdVector* app_ids) const;
 
@@ -166,10 +224,21 @@ class AppManager {
   // state (i.e. no app is being installed). Acquire this lock before calling
   // read functions if you require a consistent/stable snapshot of the system
   // (for example, to determine whether Omaha should install). Because this
-  // lock is held throughout app install, the Lock() call could block for
+  // lock waits for the apps being installed, the Lock() call could block for
   // seconds or more.
   Lockable& GetRegistryStableStateLock() { return registry_stable_state_lock_; }
 
+  // Returns the lock held by an app install while it updates the registry.
+  // Unlike GetRegistryStableStateLock(), the lock may be acquired while the
+  // installers of other apps are running. The install calls BeginInstaller()
+  // with the lock held, releases the lock while its installer runs, and calls
+  // EndInstaller() when the installer exits.
+  Lockable& GetRegistryInstallLock() {
+    return registry_stable_state_lock_.install_lock();
+  }
+  void BeginInstaller() { registry_stable_state_lock_.BeginInstaller(); }
+  void EndInstaller() { registry_stable_state_lock_.EndInstaller(); }
+
   // Gets the time since InstallTime was written. Returns 0 if InstallTime
   // could not be read. This could occur if the app is not already installed or
   // there is no valid install time in the registry, which can occur for apps
@@ -188,7 +257,7 @@ class AppManager {
 
  private:
   explicit AppManager(bool is_machine);
-  ~AppManager() {}
+  ~AppManager();
 
   bool InitializeRegistryLock();
 
@@ -205,12 +274,21 @@ class AppManager {
   // Creates the app's ClientState key.
   HRESULT CreateClientStateKey(const GUID& app_guid, RegKey* client_state_key);
 
+  // Same as app_registry_utils::IsAppEulaAccepted() with
+  // require_explicit_acceptance set to false, for the snapshot.
+  bool IsAppEulaAccepted(AppRegistrySnapshot* snapshot,
+                         const CString& app_id) const;
+
+  uint32 GetInstallTimeDiffSec(const AppRegistrySnapshot& snapshot,
+                               const CString& app_id) const;
+
   // Write the TT Token with what the server returned.
-  HRESULT SetTTToken(const App& app);
+  HRESULT SetTTToken(AppRegistrySnapshot* snapshot, const App& app);
 
   // Stores information about the update available event for the app.
   // Call each time an update is available.
-  void UpdateUpdateAvailableStats(const GUID& app_guid);
+  void UpdateUpdateAvailableStats(AppRegistrySnapshot* snapshot,
+                                  const CString& app_id);
 
   HRESULT ClearInstallationId(const App& app);
 
@@ -225,6 +303,9 @@ class AppManager {
 
   const bool is_machine_;
 
+  // Provides access to the app keys for AppRegistrySnapshot.
+  scoped_ptr<AppRegistryStoreInterface> registry_store_;
+
   // Locks.
   // If it is going to be acquired, registry_stable_state_lock_ should always be
   // acquired before registry_access_lock_.
@@ -233,17 +314,18 @@ class AppManager {
 
   // Ensures that each function's access is on a stable snapshot of the
   // registry, excluding values modified by the installer.
-  GLock registry_access_lock_;
+  InstrumentedLock<GLock> registry_access_lock_;
 
   // Ensures the registry is in a stable state (i.e. all apps are fully
   // installed and no installer is running that might be modifying the
   // registry.) Uninstalls are still an issue unless the app uninstaller informs
   // Omaha that it is uninstalling the app.
-  LLock registry_stable_state_lock_;
+  RegistryStableStateLock registry_stable_state_lock_;
 
   static AppManager* instance_;
 
   friend class RunRegistrationUpdateHooksFunc;
+  friend class ScopedAppRegistrySnapshot;
   friend class AppManagerTestBase;
 
   DISALLOW_COPY_AND_ASSIGN(AppManager);
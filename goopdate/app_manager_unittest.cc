@@ -30,6 +30,7 @@
 #include "omaha/common/config_manager.h"
 #include "omaha/common/const_goopdate.h"
 #include "omaha/goopdate/app_manager.h"
+#include "omaha/goopdate/app_registry_snapshot.h"
 #include "omaha/goopdate/app_unittest_base.h"
 #include "omaha/setup/setup_google_update.h"
 #include "omaha/testing/unit_test.h"
@@ -349,7 +350,12 @@ class AppManagerTestBase : public AppTestBaseWithRegistryOverride {
   static void UpdateUpdateAvailableStats(const GUID& app_guid,
                                          AppManager* app_manager) {
     ASSERT1(app_manager);
-    app_manager->UpdateUpdateAvailableStats(app_guid);
+    const CString app_id = GuidToString(app_guid);
+    AppRegistrySnapshot snapshot;
+    ASSERT_SUCCEEDED(snapshot.LoadApp(app_manager->registry_store_.get(),
+                                      app_id));
+    app_manager->UpdateUpdateAvailableStats(&snapshot, app_id);
+    ASSERT_SUCCEEDED(app_manager->FlushRegistrySnapshot(&snapshot));
   }
 
   CString GetClientKeyName(const GUID& app_guid) const {
@@ -486,7 +492,7 @@ class AppManagerTestBase : public AppTestBaseWithRegistryOverride {
 
     __mutexScope(AppManager::Instance()->GetRegistryStableStateLock());
 
-    __mutexBlock(app_->model()->lock()) {
+    __mutexBlock(app_->lock()) {
       EXPECT_SUCCEEDED(app_manager_->ReadAppPersistentData(app_));
 
       // We only want to make sure the timestamps in the registry are updated
@@ -566,7 +572,7 @@ class AppManagerTestBase : public AppTestBaseWithRegistryOverride {
 
     __mutexScope(AppManager::Instance()->GetRegistryStableStateLock());
 
-    __mutexBlock(app_->model()->lock()) {
+    __mutexBlock(app_->lock()) {
       EXPECT_SUCCEEDED(app_manager_->ReadAppPersistentData(app_));
 
       // We only want to make sure the timestamps in the registry are updated
@@ -627,7 +633,7 @@ class AppManagerTestBase : public AppTestBaseWithRegistryOverride {
 
     __mutexScope(AppManager::Instance()->GetRegistryStableStateLock());
 
-    __mutexBlock(app_->model()->lock()) {
+    __mutexBlock(app_->lock()) {
       EXPECT_SUCCEEDED(app_manager_->ReadAppPersistentData(app_));
 
       // We only want to make sure the timestamps in the registry are updated
@@ -690,13 +696,13 @@ class AppManagerTestBase : public AppTestBaseWithRegistryOverride {
     EXPECT_SUCCEEDED(app_bundle_->createApp(CComBSTR(app_id), &app));
     ASSERT_TRUE(app);
 
-    __mutexBlock(app_->model()->lock()) {
+    __mutexBlock(app_->lock()) {
       EXPECT_SUCCEEDED(app_manager_->ReadAppPersistentData(app));
     }
 
     EXPECT_TRUE(app->referral_id_.IsEmpty());
 
-    __mutexBlock(app_->model()->lock()) {
+    __mutexBlock(app_->lock()) {
       EXPECT_SUCCEEDED(app_manager_->SynchronizeClientState(app->app_guid()));
     }
 
@@ -1388,19 +1394,19 @@ TEST_F(AppManagerUserTest,
 }
 
 TEST_F(AppManagerReadAppPersistentDataMachineTest, NoApp) {
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   EXPECT_FAILED(app_manager_->ReadAppPersistentData(app_));
 }
 
 // For new app, the install_time_diff_sec_ should be -1 day.
 TEST_F(AppManagerMachineTest, ReadAppInstallTimeDiff_NewApp) {
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   app_manager_->ReadAppInstallTimeDiff(app_);
   EXPECT_EQ(kInitialInstallTimeDiff, app_->install_time_diff_sec());
 }
 
 TEST_F(AppManagerUserTest, ReadAppInstallTimeDiff_NewApp) {
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   app_manager_->ReadAppInstallTimeDiff(app_);
   EXPECT_EQ(kInitialInstallTimeDiff, app_->install_time_diff_sec());
 }
@@ -1412,7 +1418,7 @@ TEST_F(AppManagerMachineTest, ReadAppInstallTimeDiff_RegisteredApp) {
   PopulateExpectedApp1(new_app);
   CreateAppRegistryState(*new_app, is_machine_, _T("1.0.0.0"), true);
 
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   app_manager_->ReadAppInstallTimeDiff(app_);
   EXPECT_EQ(0, app_->install_time_diff_sec());
 }
@@ -1427,7 +1433,7 @@ TEST_F(AppManagerUserTest, ReadAppInstallTimeDiff_OverInstall) {
   SetAppInstallTimeDiffSec(over_install_app, kInstallTimeDiffSec);
   CreateAppRegistryState(*over_install_app, is_machine_, _T("1.1.1.1"), true);
 
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   app_manager_->ReadAppInstallTimeDiff(app_);
   EXPECT_GE(app_->install_time_diff_sec(), kInstallTimeDiffSec);
   EXPECT_LE(app_->install_time_diff_sec(), kInstallTimeDiffSec + 1);
@@ -1442,7 +1448,7 @@ TEST_F(AppManagerMachineTest, ReadAppInstallTimeDiff_UninstalledApp) {
   SetAppInstallTimeDiffSec(uninstalled_app, kInstallTimeDiffSec);
   CreateAppRegistryState(*uninstalled_app, is_machine_, _T("1.1.0.0"), false);
 
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   app_manager_->ReadAppInstallTimeDiff(app_);
   EXPECT_GE(app_->install_time_diff_sec(), kInstallTimeDiffSec);
   EXPECT_LE(app_->install_time_diff_sec(), kInstallTimeDiffSec + 1);
@@ -1457,7 +1463,7 @@ TEST_F(AppManagerUserTest, ReadAppInstallTimeDiff_UninstalledAppWithoutPv) {
   SetAppInstallTimeDiffSec(uninstalled_app, kInstallTimeDiffSec);
   CreateAppRegistryState(*uninstalled_app, is_machine_, _T(""), false);
 
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   app_manager_->ReadAppInstallTimeDiff(app_);
   EXPECT_EQ(kInitialInstallTimeDiff, app_->install_time_diff_sec());
 }
@@ -1510,7 +1516,7 @@ TEST_F(AppManagerReadAppPersistentDataUserTest, AppExists) {
   PopulateExpectedApp1(expected_app);
   CreateAppRegistryState(*expected_app, is_machine_, _T("1.0.0.0"), true);
 
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   EXPECT_SUCCEEDED(app_manager_->ReadAppPersistentData(app_));
 
   EXPECT_SUCCEEDED(expected_app->put_isEulaAccepted(VARIANT_TRUE));
@@ -1522,7 +1528,7 @@ TEST_F(AppManagerReadAppPersistentDataMachineTest, AppExists) {
   PopulateExpectedApp1(expected_app);
   CreateAppRegistryState(*expected_app, is_machine_, _T("1.0.0.0"), true);
 
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   EXPECT_SUCCEEDED(app_manager_->ReadAppPersistentData(app_));
 
   EXPECT_SUCCEEDED(expected_app->put_isEulaAccepted(VARIANT_TRUE));
@@ -1535,7 +1541,7 @@ TEST_F(AppManagerReadAppPersistentDataUserTest, AppExists_NoDisplayName) {
   SetDisplayName(_T(""), expected_app);
   CreateAppRegistryState(*expected_app, is_machine_, _T("1.0.0.0"), true);
 
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   EXPECT_SUCCEEDED(app_manager_->ReadAppPersistentData(app_));
 
   SetDisplayName(kDefaultAppName, expected_app);
@@ -1552,7 +1558,7 @@ TEST_F(AppManagerReadAppPersistentDataUserTest, AppExists_EmptyDisplayName) {
                                     kRegValueAppName,
                                     _T("")));
 
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   EXPECT_SUCCEEDED(app_manager_->ReadAppPersistentData(app_));
 
   SetDisplayName(kDefaultAppName, expected_app);
@@ -1573,7 +1579,7 @@ TEST_F(AppManagerReadAppPersistentDataUserTest, EulaNotAccepted) {
                                     static_cast<DWORD>(0)));
   EXPECT_SUCCEEDED(expected_app->put_isEulaAccepted(VARIANT_FALSE));
 
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   EXPECT_SUCCEEDED(app_manager_->ReadAppPersistentData(app_));
 
   ValidateExpectedValues(*expected_app, *app_);
@@ -1589,7 +1595,7 @@ TEST_F(AppManagerReadAppPersistentDataUserTest, EulaAccepted) {
                                     static_cast<DWORD>(1)));
   EXPECT_SUCCEEDED(expected_app->put_isEulaAccepted(VARIANT_TRUE));
 
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   EXPECT_SUCCEEDED(app_manager_->ReadAppPersistentData(app_));
 
   ValidateExpectedValues(*expected_app, *app_);
@@ -1605,7 +1611,7 @@ TEST_F(AppManagerReadAppPersistentDataMachineTest, EulaNotAccepted) {
                                     static_cast<DWORD>(0)));
   EXPECT_SUCCEEDED(expected_app->put_isEulaAccepted(VARIANT_FALSE));
 
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   EXPECT_SUCCEEDED(app_manager_->ReadAppPersistentData(app_));
 
   ValidateExpectedValues(*expected_app, *app_);
@@ -1621,7 +1627,7 @@ TEST_F(AppManagerReadAppPersistentDataMachineTest, EulaAccepted) {
                                     static_cast<DWORD>(1)));
   EXPECT_SUCCEEDED(expected_app->put_isEulaAccepted(VARIANT_TRUE));
 
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   EXPECT_SUCCEEDED(app_manager_->ReadAppPersistentData(app_));
 
   ValidateExpectedValues(*expected_app, *app_);
@@ -1640,7 +1646,7 @@ TEST_F(AppManagerReadAppPersistentDataUserTest, TwoApps) {
   PopulateExpectedApp1(expected_app2);
   CreateAppRegistryState(*expected_app2, is_machine_, _T("1.0.0.0"), true);
 
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
 
   EXPECT_SUCCEEDED(app_manager_->ReadAppPersistentData(app_));
   EXPECT_SUCCEEDED(expected_app1->put_isEulaAccepted(VARIANT_TRUE));
@@ -1661,7 +1667,7 @@ TEST_F(AppManagerReadAppPersistentDataUserTest, NoClientState) {
 
   EXPECT_FALSE(IsClientStateKeyPresent(*app_));
 
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   EXPECT_SUCCEEDED(app_manager_->ReadAppPersistentData(app_));
 
   EXPECT_SUCCEEDED(expected_app->put_isEulaAccepted(VARIANT_TRUE));
@@ -1675,7 +1681,7 @@ TEST_F(AppManagerReadAppPersistentDataUserTest,
   PopulateExpectedUninstalledApp(_T("1.1.0.0"), expected_app);
   CreateAppRegistryState(*expected_app, is_machine_, _T("1.1.0.0"), false);
 
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   EXPECT_SUCCEEDED(app_manager_->ReadUninstalledAppPersistentData(app_));
 
   SetDisplayName(kDefaultAppName, expected_app);
@@ -1705,7 +1711,7 @@ TEST_F(AppManagerReadAppPersistentDataMachineTest,
   EXPECT_SUCCEEDED(expected_app->put_isEulaAccepted(VARIANT_TRUE));
   CreateAppRegistryState(*expected_app, is_machine_, _T("1.1.0.0"), false);
 
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   EXPECT_SUCCEEDED(app_manager_->ReadUninstalledAppPersistentData(app_));
 
   SetDisplayName(kDefaultAppName, expected_app);
@@ -1734,7 +1740,7 @@ TEST_F(AppManagerReadAppPersistentDataUserTest,
   EXPECT_SUCCEEDED(expected_app->put_isEulaAccepted(VARIANT_FALSE));
   CreateAppRegistryState(*expected_app, is_machine_, _T("1.1.0.0"), false);
 
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   EXPECT_SUCCEEDED(app_manager_->ReadUninstalledAppPersistentData(app_));
 
   SetDisplayName(kDefaultAppName, expected_app);
@@ -1757,7 +1763,7 @@ TEST_F(AppManagerReadAppPersistentDataUserTest,
   // necessary.
   app_manager_->ReadAppInstallTimeDiff(expected_app);
 
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   EXPECT_SUCCEEDED(app_manager_->ReadAppPersistentData(app_));
 
   SetDisplayName(kDefaultAppName, expected_app);
@@ -1777,7 +1783,7 @@ TEST_F(AppManagerReadAppPersistentDataMachineTest,
   // necessary.
   app_manager_->ReadAppInstallTimeDiff(expected_app);
 
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   EXPECT_SUCCEEDED(app_manager_->ReadAppPersistentData(app_));
 
   SetDisplayName(kDefaultAppName, expected_app);
@@ -1800,7 +1806,7 @@ TEST_F(AppManagerReadAppPersistentDataUserTest,
                                      kRegValueProductVersion,
                                      _T("")));
 
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   EXPECT_SUCCEEDED(app_manager_->ReadAppPersistentData(app_));
 
   SetDisplayName(kDefaultAppName, expected_app);
@@ -1810,7 +1816,7 @@ TEST_F(AppManagerReadAppPersistentDataUserTest,
 
 TEST_F(AppManagerUserTest,
        ReadInstallerRegistrationValues_FailsWhenClientsKeyAbsent) {
-  __mutexBlock(app_->model()->lock()) {
+  __mutexBlock(app_->lock()) {
     EXPECT_EQ(GOOPDATEINSTALL_E_INSTALLER_DID_NOT_WRITE_CLIENTS_KEY,
               app_manager_->ReadInstallerRegistrationValues(app_));
   }
@@ -1826,7 +1832,7 @@ TEST_F(AppManagerUserTest,
        ReadInstallerRegistrationValues_FailsWhenVersionValueAbsent) {
   ASSERT_SUCCEEDED(RegKey::CreateKey(kGuid1ClientsKeyPathUser));
 
-  __mutexBlock(app_->model()->lock()) {
+  __mutexBlock(app_->lock()) {
     EXPECT_EQ(GOOPDATEINSTALL_E_INSTALLER_DID_NOT_WRITE_CLIENTS_KEY,
               app_manager_->ReadInstallerRegistrationValues(app_));
   }
@@ -1844,7 +1850,7 @@ TEST_F(AppManagerUserTest,
                                     kRegValueProductVersion,
                                     _T("")));
 
-  __mutexBlock(app_->model()->lock()) {
+  __mutexBlock(app_->lock()) {
     EXPECT_EQ(GOOPDATEINSTALL_E_INSTALLER_DID_NOT_WRITE_CLIENTS_KEY,
               app_manager_->ReadInstallerRegistrationValues(app_));
   }
@@ -1862,7 +1868,7 @@ TEST_F(AppManagerUserTest,
                                     kRegValueProductVersion,
                                     _T("0.9.68.4")));
 
-  __mutexBlock(app_->model()->lock()) {
+  __mutexBlock(app_->lock()) {
     EXPECT_SUCCEEDED(app_manager_->ReadInstallerRegistrationValues(app_));
   }
 
@@ -1879,7 +1885,7 @@ TEST_F(AppManagerUserTest,
                                     kRegValueLanguage,
                                     _T("zh-TW")));
 
-  __mutexBlock(app_->model()->lock()) {
+  __mutexBlock(app_->lock()) {
     EXPECT_SUCCEEDED(app_manager_->ReadInstallerRegistrationValues(app_));
   }
 
@@ -1896,7 +1902,7 @@ TEST_F(AppManagerMachineTest,
                                     kRegValueLanguage,
                                     _T("zh-TW")));
 
-  __mutexBlock(app_->model()->lock()) {
+  __mutexBlock(app_->lock()) {
     EXPECT_SUCCEEDED(app_manager_->ReadInstallerRegistrationValues(app_));
   }
 
@@ -2545,7 +2551,7 @@ TEST_F(AppManagerMachineTest, AppLockContention) {
   hold_lock.WaitForLockToBeAcquired();
 
   HighresTimer lock_metrics_timer;
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND),
             app_manager_->ReadAppPersistentData(app_));
 
@@ -2564,7 +2570,7 @@ TEST_F(AppManagerUserTest, AppLockContention) {
   hold_lock.WaitForLockToBeAcquired();
 
   HighresTimer lock_metrics_timer;
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND),
             app_manager_->ReadAppPersistentData(app_));
 
@@ -2581,7 +2587,7 @@ TEST_F(AppManagerMachineTest, AppLock_MachineAndUser) {
   __mutexScope(app_manager_user_lock);
 
   HighresTimer lock_metrics_timer;
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND),
             app_manager_->ReadAppPersistentData(app_));
 
@@ -2629,4 +2635,102 @@ TEST_F(AppManagerMachineTest, ReadAppVersionNoLock_RegisteredApp) {
   EXPECT_SUCCEEDED(RegKey::DeleteKey(kGuid1ClientsKeyPathMachine));
 }
 
+// Ends an installer on the stable state lock after a delay.
+class EndInstallerAfterDelay : public Runnable {
+ public:
+  EndInstallerAfterDelay(RegistryStableStateLock* lock, int delay_ms)
+      : lock_(lock),
+        delay_ms_(delay_ms) {}
+
+  virtual void Run() {
+    ::Sleep(delay_ms_);
+    lock_->EndInstaller();
+  }
+
+ private:
+  RegistryStableStateLock* lock_;
+  const int delay_ms_;
+
+  DISALLOW_IMPLICIT_CONSTRUCTORS(EndInstallerAfterDelay);
+};
+
+TEST(RegistryStableStateLockTest, Lock_NoInstallers) {
+  RegistryStableStateLock lock(_T("RegistryStableStateLockTest"));
+  EXPECT_EQ(0, lock.GetOwner());
+
+  EXPECT_TRUE(lock.Lock(0));
+  EXPECT_EQ(::GetCurrentThreadId(), lock.GetOwner());
+  EXPECT_TRUE(lock.Unlock());
+  EXPECT_EQ(0, lock.GetOwner());
+}
+
+TEST(RegistryStableStateLockTest, Lock_WaitsForRunningInstallers) {
+  RegistryStableStateLock lock(_T("RegistryStableStateLockTest"));
+
+  ASSERT_TRUE(lock.Lock());
+  lock.BeginInstaller();
+  lock.BeginInstaller();
+  EXPECT_TRUE(lock.Unlock());
+
+  // The lock is free, but installers are running.
+  EXPECT_FALSE(lock.Lock(100));
+  EXPECT_EQ(0, lock.GetOwner());
+
+  lock.EndInstaller();
+  EXPECT_FALSE(lock.Lock(100));
+
+  lock.EndInstaller();
+  EXPECT_TRUE(lock.Lock(100));
+  EXPECT_TRUE(lock.Unlock());
+}
+
+TEST(RegistryStableStateLockTest, Lock_SucceedsWhenInstallerEnds) {
+  RegistryStableStateLock lock(_T("RegistryStableStateLockTest"));
+
+  ASSERT_TRUE(lock.Lock());
+  lock.BeginInstaller();
+  EXPECT_TRUE(lock.Unlock());
+
+  EndInstallerAfterDelay end_installer(&lock, 200);
+  Thread thread;
+  ASSERT_TRUE(thread.Start(&end_installer));
+
+  HighresTimer timer;
+  EXPECT_TRUE(lock.Lock());
+  EXPECT_LE(150, timer.GetElapsedMs());
+  EXPECT_TRUE(lock.Unlock());
+
+  EXPECT_TRUE(thread.WaitTillExit(1000));
+}
+
+TEST(RegistryStableStateLockTest, Lock_ReentrantWhileInstallerRuns) {
+  RegistryStableStateLock lock(_T("RegistryStableStateLockTest"));
+
+  ASSERT_TRUE(lock.Lock());
+  lock.BeginInstaller();
+
+  // The owner does not wait for the installer it started.
+  EXPECT_TRUE(lock.Lock(0));
+  EXPECT_TRUE(lock.Unlock());
+  EXPECT_TRUE(lock.Unlock());
+
+  lock.EndInstaller();
+}
+
+TEST(RegistryStableStateLockTest, InstallLock_DoesNotWaitForInstallers) {
+  RegistryStableStateLock lock(_T("RegistryStableStateLockTest"));
+
+  ASSERT_TRUE(lock.Lock());
+  lock.BeginInstaller();
+  EXPECT_TRUE(lock.Unlock());
+
+  EXPECT_TRUE(lock.install_lock().Lock());
+  EXPECT_EQ(::GetCurrentThreadId(), lock.GetOwner());
+  EXPECT_TRUE(lock.install_lock().Unlock());
+
+  lock.EndInstaller();
+  EXPECT_TRUE(lock.Lock(0));
+  EXPECT_TRUE(lock.Unlock());
+}
+
 }  // namespace omaha
@@ -0,0 +1,592 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/goopdate/app_registry_snapshot.h"
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/reg_key.h"
+#include "omaha/base/utils.h"
+#include "omaha/common/app_registry_utils.h"
+#include "omaha/common/config_manager.h"
+#include "omaha/common/const_goopdate.h"
+
+namespace omaha {
+
+namespace {
+
+const HRESULT kValueNotFound = HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+const HRESULT kValueTypeMismatch = HRESULT_FROM_WIN32(ERROR_DATATYPE_MISMATCH);
+
+}  // namespace
+
+CString AppRegistryStore::GetHiveKeyName(AppRegistryHive hive) const {
+  const ConfigManager& cm = *ConfigManager::Instance();
+  switch (hive) {
+    case APP_HIVE_CLIENTS:
+      return cm.registry_clients(is_machine_);
+    case APP_HIVE_CLIENT_STATE:
+      return cm.registry_client_state(is_machine_);
+    case APP_HIVE_CLIENT_STATE_MEDIUM:
+      return is_machine_ ? cm.machine_registry_client_state_medium() : _T("");
+    default:
+      ASSERT1(false);
+      return _T("");
+  }
+}
+
+HRESULT AppRegistryStore::GetAppIds(AppRegistryHive hive,
+                                    std::vector<CString>* app_ids) {
+  ASSERT1(app_ids);
+  app_ids->clear();
+
+  const CString hive_key_name = GetHiveKeyName(hive);
+  if (hive_key_name.IsEmpty()) {
+    return kValueNotFound;
+  }
+
+  RegKey hive_key;
+  HRESULT hr = hive_key.Open(hive_key_name, KEY_READ);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  const int num_sub_keys = hive_key.GetSubkeyCount();
+  for (int i = 0; i < num_sub_keys; ++i) {
+    CString sub_key_name;
+    if (SUCCEEDED(hive_key.GetSubkeyNameAt(i, &sub_key_name))) {
+      app_ids->push_back(sub_key_name);
+    }
+  }
+
+  return S_OK;
+}
+
+// Values of unsupported types are skipped. They are never modified through the
+// snapshot, so they are left untouched by WriteAppValues().
+HRESULT AppRegistryStore::ReadAppValues(AppRegistryHive hive,
+                                        const CString& app_id,
+                                        AppRegistryValueMap* values) {
+  ASSERT1(values);
+  values->clear();
+
+  const CString hive_key_name = GetHiveKeyName(hive);
+  if (hive_key_name.IsEmpty()) {
+    return kValueNotFound;
+  }
+
+  RegKey app_key;
+  HRESULT hr = app_key.Open(AppendRegKeyPath(hive_key_name, app_id), KEY_READ);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  const int num_values = app_key.GetValueCount();
+  for (int i = 0; i < num_values; ++i) {
+    CString value_name;
+    DWORD type = REG_NONE;
+    if (FAILED(app_key.GetValueNameAt(i, &value_name, &type))) {
+      continue;
+    }
+
+    switch (type) {
+      case REG_SZ:
+      case REG_EXPAND_SZ: {
+        CString value;
+        if (SUCCEEDED(app_key.GetValue(value_name, &value))) {
+          (*values)[value_name] = AppRegistryValue(value);
+        }
+        break;
+      }
+      case REG_DWORD: {
+        DWORD value = 0;
+        if (SUCCEEDED(app_key.GetValue(value_name, &value))) {
+          (*values)[value_name] = AppRegistryValue(value);
+        }
+        break;
+      }
+      case REG_QWORD: {
+        DWORD64 value = 0;
+        if (SUCCEEDED(app_key.GetValue(value_name, &value))) {
+          (*values)[value_name] = AppRegistryValue(value);
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  return S_OK;
+}
+
+// Creating a machine app's ClientState key also creates its ClientStateMedium
+// key, as AppManager::CreateClientStateKey() does.
+HRESULT AppRegistryStore::WriteAppValues(
+    AppRegistryHive hive,
+    const CString& app_id,
+    const AppRegistryValueMap& values,
+    const std::vector<CString>& deleted_names) {
+  const CString hive_key_name = GetHiveKeyName(hive);
+  if (hive_key_name.IsEmpty()) {
+    return kValueNotFound;
+  }
+  const CString app_key_name = AppendRegKeyPath(hive_key_name, app_id);
+
+  RegKey app_key;
+  HRESULT hr = S_OK;
+  if (values.empty()) {
+    hr = app_key.Open(app_key_name, KEY_SET_VALUE);
+    if (hr == kValueNotFound) {
+      // Nothing to delete.
+      return S_OK;
+    }
+  } else {
+    hr = app_key.Create(app_key_name);
+  }
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[AppRegistryStore][failed to open key][%s][0x%08x]"),
+                  app_key_name, hr));
+    return hr;
+  }
+
+  if (hive == APP_HIVE_CLIENT_STATE &&
+      is_machine_ &&
+      !values.empty() &&
+      app_id.CompareNoCase(kGoogleUpdateAppId) != 0) {
+    VERIFY1(SUCCEEDED(RegKey::CreateKey(
+        app_registry_utils::GetAppClientStateMediumKey(is_machine_, app_id))));
+  }
+
+  HRESULT result = S_OK;
+  for (AppRegistryValueMap::const_iterator it = values.begin();
+       it != values.end();
+       ++it) {
+    const AppRegistryValue& value = it->second;
+    switch (value.type) {
+      case REG_SZ:
+        hr = app_key.SetValue(it->first, value.str);
+        break;
+      case REG_DWORD:
+        hr = app_key.SetValue(it->first, static_cast<DWORD>(value.number));
+        break;
+      case REG_QWORD:
+        hr = app_key.SetValue(it->first, value.number);
+        break;
+      default:
+        ASSERT1(false);
+        hr = E_UNEXPECTED;
+        break;
+    }
+    if (FAILED(hr)) {
+      CORE_LOG(LW, (_T("[AppRegistryStore][SetValue failed][%s][%s][0x%08x]"),
+                    app_key_name, it->first, hr));
+      result = hr;
+    }
+  }
+
+  for (size_t i = 0; i != deleted_names.size(); ++i) {
+    hr = app_key.DeleteValue(deleted_names[i]);
+    if (FAILED(hr)) {
+      CORE_LOG(LW, (_T("[AppRegistryStore][DeleteValue failed][%s][%s][0x%08x]"),
+                    app_key_name, deleted_names[i], hr));
+      result = hr;
+    }
+  }
+
+  return result;
+}
+
+AppRegistrySnapshot::AppRegistrySnapshot() : is_complete_(false) {
+}
+
+AppRegistrySnapshot::~AppRegistrySnapshot() {
+  ASSERT(!IsDirty(), (_T("[AppRegistrySnapshot has unflushed values]")));
+}
+
+void AppRegistrySnapshot::Clear() {
+  apps_.clear();
+  index_.clear();
+  is_complete_ = false;
+}
+
+AppRegistrySnapshot::AppRecord* AppRegistrySnapshot::GetOrAddApp(
+    const CString& app_id) {
+  AppIndex::const_iterator it = index_.find(app_id);
+  if (it != index_.end()) {
+    return &apps_[it->second];
+  }
+
+  index_[app_id] = apps_.size();
+  apps_.push_back(AppRecord());
+  AppRecord* app = &apps_.back();
+  app->app_id = app_id;
+  return app;
+}
+
+const AppRegistrySnapshot::AppRecord* AppRegistrySnapshot::FindApp(
+    const CString& app_id) const {
+  AppIndex::const_iterator it = index_.find(app_id);
+  return it == index_.end() ? NULL : &apps_[it->second];
+}
+
+HRESULT AppRegistrySnapshot::LoadKey(AppRegistryStoreInterface* store,
+                                     AppRegistryHive hive,
+                                     AppRecord* app) {
+  ASSERT1(store);
+  ASSERT1(app);
+
+  KeyRecord& key = app->keys[hive];
+  key.dirty_names.clear();
+  HRESULT hr = store->ReadAppValues(hive, app->app_id, &key.values);
+  key.exists = SUCCEEDED(hr);
+  if (FAILED(hr)) {
+    key.values.clear();
+    return hr == kValueNotFound ? S_OK : hr;
+  }
+  return S_OK;
+}
+
+HRESULT AppRegistrySnapshot::Load(AppRegistryStoreInterface* store) {
+  ASSERT1(store);
+  CORE_LOG(L3, (_T("[AppRegistrySnapshot::Load]")));
+
+  Clear();
+
+  bool is_hive_unreadable = false;
+  for (int i = 0; i != APP_HIVE_COUNT; ++i) {
+    const AppRegistryHive hive = static_cast<AppRegistryHive>(i);
+
+    std::vector<CString> app_ids;
+    HRESULT hr = store->GetAppIds(hive, &app_ids);
+    if (FAILED(hr)) {
+      // Only the Clients key is required to exist. Omaha itself is always
+      // registered, so failing to enumerate it is a real error.
+      if (hive == APP_HIVE_CLIENTS) {
+        CORE_LOG(LE, (_T("[GetAppIds failed for Clients][0x%08x]"), hr));
+        Clear();
+        return hr;
+      }
+
+      // The other hives may not exist. Any other error leaves the keys of the
+      // hive unknown, so no app can be served from the snapshot.
+      if (hr != kValueNotFound) {
+        CORE_LOG(LW, (_T("[GetAppIds failed][%d][0x%08x]"), hive, hr));
+        is_hive_unreadable = true;
+      }
+      continue;
+    }
+
+    for (size_t j = 0; j != app_ids.size(); ++j) {
+      // The app is cached when it is first seen. A failure to load any of its
+      // keys clears the flag, which the later hives must not set again.
+      const bool is_new_app = index_.find(app_ids[j]) == index_.end();
+      AppRecord* app = GetOrAddApp(app_ids[j]);
+      if (is_new_app) {
+        app->is_cached = true;
+      }
+      if (hive == APP_HIVE_CLIENTS) {
+        app->is_listed_in_clients = true;
+      }
+      hr = LoadKey(store, hive, app);
+      if (FAILED(hr)) {
+        // The app is read from the registry if its keys can't be cached.
+        CORE_LOG(LW, (_T("[LoadKey failed][%s][%d][0x%08x]"),
+                      app_ids[j], hive, hr));
+        app->is_cached = false;
+      }
+    }
+  }
+
+  if (is_hive_unreadable) {
+    for (size_t i = 0; i != apps_.size(); ++i) {
+      apps_[i].is_cached = false;
+    }
+  } else {
+    is_complete_ = true;
+  }
+
+  CORE_LOG(L3, (_T("[AppRegistrySnapshot::Load][%u apps]"), apps_.size()));
+  return S_OK;
+}
+
+HRESULT AppRegistrySnapshot::LoadApp(AppRegistryStoreInterface* store,
+                                     const CString& app_id) {
+  ASSERT1(store);
+  ASSERT1(!IsDirty());
+
+  Clear();
+
+  AppRecord* app = GetOrAddApp(app_id);
+  for (int i = 0; i != APP_HIVE_COUNT; ++i) {
+    HRESULT hr = LoadKey(store, static_cast<AppRegistryHive>(i), app);
+    if (FAILED(hr)) {
+      return hr;
+    }
+  }
+  app->is_cached = true;
+  return S_OK;
+}
+
+HRESULT AppRegistrySnapshot::FlushApp(AppRegistryStoreInterface* store,
+                                      AppRecord* app) {
+  ASSERT1(store);
+  ASSERT1(app);
+
+  HRESULT result = S_OK;
+  for (int i = 0; i != APP_HIVE_COUNT; ++i) {
+    KeyRecord& key = app->keys[i];
+    if (key.dirty_names.empty()) {
+      continue;
+    }
+
+    AppRegistryValueMap values;
+    std::vector<CString> deleted_names;
+    for (ValueNameSet::const_iterator it = key.dirty_names.begin();
+         it != key.dirty_names.end();
+         ++it) {
+      AppRegistryValueMap::const_iterator value = key.values.find(*it);
+      if (value != key.values.end()) {
+        values[value->first] = value->second;
+      } else {
+        deleted_names.push_back(*it);
+      }
+    }
+
+    HRESULT hr = store->WriteAppValues(static_cast<AppRegistryHive>(i),
+                                       app->app_id,
+                                       values,
+                                       deleted_names);
+    if (FAILED(hr)) {
+      CORE_LOG(LE, (_T("[WriteAppValues failed][%s][%d][0x%08x]"),
+                    app->app_id, i, hr));
+      result = hr;
+    }
+
+    // The values are not retried. This matches the direct registry writes,
+    // which only VERIFY the result.
+    key.dirty_names.clear();
+  }
+
+  return result;
+}
+
+HRESULT AppRegistrySnapshot::Flush(AppRegistryStoreInterface* store) {
+  ASSERT1(store);
+
+  HRESULT result = S_OK;
+  for (size_t i = 0; i != apps_.size(); ++i) {
+    HRESULT hr = FlushApp(store, &apps_[i]);
+    if (FAILED(hr)) {
+      result = hr;
+    }
+  }
+  return result;
+}
+
+HRESULT AppRegistrySnapshot::Evict(AppRegistryStoreInterface* store,
+                                   const CString& app_id) {
+  ASSERT1(store);
+
+  AppIndex::const_iterator it = index_.find(app_id);
+  if (it == index_.end()) {
+    // Keep track of the eviction so that the app is not reported as absent.
+    AppRecord* app = GetOrAddApp(app_id);
+    app->is_cached = false;
+    return S_OK;
+  }
+
+  AppRecord* app = &apps_[it->second];
+  HRESULT hr = FlushApp(store, app);
+
+  app->is_cached = false;
+  for (int i = 0; i != APP_HIVE_COUNT; ++i) {
+    app->keys[i] = KeyRecord();
+  }
+  return hr;
+}
+
+bool AppRegistrySnapshot::IsAppCached(const CString& app_id) const {
+  const AppRecord* app = FindApp(app_id);
+  return app ? app->is_cached : is_complete_;
+}
+
+bool AppRegistrySnapshot::HasKey(AppRegistryHive hive,
+                                 const CString& app_id) const {
+  ASSERT1(IsAppCached(app_id));
+  const AppRecord* app = FindApp(app_id);
+  return app && app->keys[hive].exists;
+}
+
+bool AppRegistrySnapshot::IsAppRegistered(const CString& app_id) const {
+  return HasKey(APP_HIVE_CLIENTS, app_id);
+}
+
+bool AppRegistrySnapshot::IsAppUninstalled(const CString& app_id) const {
+  return !IsAppRegistered(app_id) &&
+         HasValue(APP_HIVE_CLIENT_STATE, app_id, kRegValueProductVersion);
+}
+
+void AppRegistrySnapshot::GetRegisteredApps(
+    std::vector<CString>* app_ids) const {
+  ASSERT1(app_ids);
+  for (size_t i = 0; i != apps_.size(); ++i) {
+    const AppRecord& app = apps_[i];
+    if (app.is_listed_in_clients) {
+      app_ids->push_back(app.app_id);
+    }
+  }
+}
+
+const AppRegistryValue* AppRegistrySnapshot::FindValue(
+    AppRegistryHive hive,
+    const CString& app_id,
+    const TCHAR* value_name) const {
+  ASSERT1(value_name);
+  ASSERT1(IsAppCached(app_id));
+
+  const AppRecord* app = FindApp(app_id);
+  if (!app) {
+    return NULL;
+  }
+
+  const AppRegistryValueMap& values = app->keys[hive].values;
+  AppRegistryValueMap::const_iterator it = values.find(value_name);
+  return it == values.end() ? NULL : &it->second;
+}
+
+HRESULT AppRegistrySnapshot::GetValue(AppRegistryHive hive,
+                                      const CString& app_id,
+                                      const TCHAR* value_name,
+                                      CString* value) const {
+  ASSERT1(value);
+  const AppRegistryValue* reg_value = FindValue(hive, app_id, value_name);
+  if (!reg_value) {
+    return kValueNotFound;
+  }
+  if (reg_value->type != REG_SZ) {
+    return kValueTypeMismatch;
+  }
+  *value = reg_value->str;
+  return S_OK;
+}
+
+HRESULT AppRegistrySnapshot::GetValue(AppRegistryHive hive,
+                                      const CString& app_id,
+                                      const TCHAR* value_name,
+                                      DWORD* value) const {
+  ASSERT1(value);
+  const AppRegistryValue* reg_value = FindValue(hive, app_id, value_name);
+  if (!reg_value) {
+    return kValueNotFound;
+  }
+  if (reg_value->type != REG_DWORD) {
+    return kValueTypeMismatch;
+  }
+  *value = static_cast<DWORD>(reg_value->number);
+  return S_OK;
+}
+
+HRESULT AppRegistrySnapshot::GetValue(AppRegistryHive hive,
+                                      const CString& app_id,
+                                      const TCHAR* value_name,
+                                      DWORD64* value) const {
+  ASSERT1(value);
+  const AppRegistryValue* reg_value = FindValue(hive, app_id, value_name);
+  if (!reg_value) {
+    return kValueNotFound;
+  }
+  if (reg_value->type != REG_QWORD) {
+    return kValueTypeMismatch;
+  }
+  *value = reg_value->number;
+  return S_OK;
+}
+
+bool AppRegistrySnapshot::HasValue(AppRegistryHive hive,
+                                   const CString& app_id,
+                                   const TCHAR* value_name) const {
+  return FindValue(hive, app_id, value_name) != NULL;
+}
+
+void AppRegistrySnapshot::SetValueInternal(AppRegistryHive hive,
+                                           const CString& app_id,
+                                           const TCHAR* value_name,
+                                           const AppRegistryValue& value) {
+  ASSERT1(value_name);
+  ASSERT1(IsAppCached(app_id));
+
+  AppRecord* app = GetOrAddApp(app_id);
+  app->is_cached = true;
+
+  KeyRecord& key = app->keys[hive];
+  key.exists = true;
+  key.values[value_name] = value;
+  key.dirty_names.insert(value_name);
+}
+
+void AppRegistrySnapshot::SetValue(AppRegistryHive hive,
+                                   const CString& app_id,
+                                   const TCHAR* value_name,
+                                   const CString& value) {
+  SetValueInternal(hive, app_id, value_name, AppRegistryValue(value));
+}
+
+void AppRegistrySnapshot::SetValue(AppRegistryHive hive,
+                                   const CString& app_id,
+                                   const TCHAR* value_name,
+                                   DWORD value) {
+  SetValueInternal(hive, app_id, value_name, AppRegistryValue(value));
+}
+
+void AppRegistrySnapshot::SetValue(AppRegistryHive hive,
+                                   const CString& app_id,
+                                   const TCHAR* value_name,
+                                   DWORD64 value) {
+  SetValueInternal(hive, app_id, value_name, AppRegistryValue(value));
+}
+
+// Deleting a value from a key that does not exist does not create the key.
+void AppRegistrySnapshot::DeleteValue(AppRegistryHive hive,
+                                      const CString& app_id,
+                                      const TCHAR* value_name) {
+  ASSERT1(value_name);
+  ASSERT1(IsAppCached(app_id));
+
+  AppIndex::const_iterator it = index_.find(app_id);
+  if (it == index_.end()) {
+    return;
+  }
+
+  KeyRecord& key = apps_[it->second].keys[hive];
+  if (!key.exists) {
+    return;
+  }
+  key.values.erase(value_name);
+  key.dirty_names.insert(value_name);
+}
+
+bool AppRegistrySnapshot::IsDirty() const {
+  for (size_t i = 0; i != apps_.size(); ++i) {
+    for (int j = 0; j != APP_HIVE_COUNT; ++j) {
+      if (!apps_[i].keys[j].dirty_names.empty()) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+}  // namespace omaha
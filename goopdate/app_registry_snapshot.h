@@ -0,0 +1,263 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+// AppRegistrySnapshot is an in-memory copy of the Clients, ClientState, and
+// ClientStateMedium keys of the registered apps. It is loaded with a single
+// enumeration of each hive, serves the per-app reads AppManager does while a
+// bundle is being processed, and writes the modified values back in one pass.
+//
+// The snapshot does not access the registry directly. It goes through an
+// AppRegistryStoreInterface, which allows it to be tested against an in-memory
+// store.
+
+#ifndef OMAHA_GOOPDATE_APP_REGISTRY_SNAPSHOT_H_
+#define OMAHA_GOOPDATE_APP_REGISTRY_SNAPSHOT_H_
+
+#include <windows.h>
+#include <atlstr.h>
+#include <map>
+#include <set>
+#include <vector>
+#include "base/basictypes.h"
+
+namespace omaha {
+
+// The per-app keys Omaha persists application state in.
+enum AppRegistryHive {
+  APP_HIVE_CLIENTS = 0,
+  APP_HIVE_CLIENT_STATE,
+  APP_HIVE_CLIENT_STATE_MEDIUM,
+  APP_HIVE_COUNT,
+};
+
+// Registry key and value names are case-insensitive.
+struct AppRegistryNameLess {
+  bool operator()(const CString& a, const CString& b) const {
+    return a.CompareNoCase(b) < 0;
+  }
+};
+
+// A registry value held in memory. Only the string, DWORD and QWORD types are
+// supported, which are the only types Omaha reads or writes for apps.
+struct AppRegistryValue {
+  AppRegistryValue() : type(REG_NONE), number(0) {}
+  explicit AppRegistryValue(const CString& value)
+      : type(REG_SZ), str(value), number(0) {}
+  explicit AppRegistryValue(DWORD value) : type(REG_DWORD), number(value) {}
+  explicit AppRegistryValue(DWORD64 value) : type(REG_QWORD), number(value) {}
+
+  DWORD type;
+  CString str;
+  DWORD64 number;
+};
+
+typedef std::map<CString, AppRegistryValue, AppRegistryNameLess>
+    AppRegistryValueMap;
+
+// Abstracts the storage of the per-app keys.
+class AppRegistryStoreInterface {
+ public:
+  virtual ~AppRegistryStoreInterface() {}
+
+  // Returns the names of the app subkeys in the hive.
+  virtual HRESULT GetAppIds(AppRegistryHive hive,
+                            std::vector<CString>* app_ids) = 0;
+
+  // Reads all supported values in the app's key. Returns
+  // HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND) if the key does not exist.
+  virtual HRESULT ReadAppValues(AppRegistryHive hive,
+                                const CString& app_id,
+                                AppRegistryValueMap* values) = 0;
+
+  // Sets the values and deletes the values named in deleted_names in the app's
+  // key. Creates the key if there is any value to set.
+  virtual HRESULT WriteAppValues(AppRegistryHive hive,
+                                 const CString& app_id,
+                                 const AppRegistryValueMap& values,
+                                 const std::vector<CString>& deleted_names) = 0;
+};
+
+// Implements AppRegistryStoreInterface on top of the Windows registry.
+class AppRegistryStore : public AppRegistryStoreInterface {
+ public:
+  explicit AppRegistryStore(bool is_machine) : is_machine_(is_machine) {}
+  virtual ~AppRegistryStore() {}
+
+  virtual HRESULT GetAppIds(AppRegistryHive hive,
+                            std::vector<CString>* app_ids);
+  virtual HRESULT ReadAppValues(AppRegistryHive hive,
+                                const CString& app_id,
+                                AppRegistryValueMap* values);
+  virtual HRESULT WriteAppValues(AppRegistryHive hive,
+                                 const CString& app_id,
+                                 const AppRegistryValueMap& values,
+                                 const std::vector<CString>& deleted_names);
+
+ private:
+  // Returns the name of the hive key or an empty string if the hive does not
+  // exist for this type of install.
+  CString GetHiveKeyName(AppRegistryHive hive) const;
+
+  const bool is_machine_;
+
+  DISALLOW_COPY_AND_ASSIGN(AppRegistryStore);
+};
+
+// Not thread safe. The owner of the snapshot is responsible for serializing
+// access to it, typically by holding the bundle lock.
+class AppRegistrySnapshot {
+ public:
+  AppRegistrySnapshot();
+  ~AppRegistrySnapshot();
+
+  // Enumerates all hives in the store once and caches the values of all apps.
+  // Discards any previously loaded state, including modified values.
+  HRESULT Load(AppRegistryStoreInterface* store);
+
+  // Caches the values of a single app. Other apps are not considered cached.
+  HRESULT LoadApp(AppRegistryStoreInterface* store, const CString& app_id);
+
+  // Writes all modified values back to the store, one write per modified key.
+  HRESULT Flush(AppRegistryStoreInterface* store);
+
+  // Writes the modified values of the app, then stops serving the app from
+  // memory. Call before something other than the snapshot modifies the app's
+  // keys, such as an installer.
+  HRESULT Evict(AppRegistryStoreInterface* store, const CString& app_id);
+
+  // Returns true if reads and writes for the app can be served by the snapshot.
+  bool IsAppCached(const CString& app_id) const;
+
+  // Returns true if the app's key in the hive exists.
+  bool HasKey(AppRegistryHive hive, const CString& app_id) const;
+
+  // An app is registered if its Clients key exists.
+  bool IsAppRegistered(const CString& app_id) const;
+
+  // An app is uninstalled if its Clients key does not exist but its
+  // ClientState key has a pv value. See AppManager::IsAppUninstalled().
+  bool IsAppUninstalled(const CString& app_id) const;
+
+  // Returns the apps found under the Clients key by Load(), in enumeration
+  // order, including the apps that are not cached. The values of those apps
+  // must be read from the registry.
+  void GetRegisteredApps(std::vector<CString>* app_ids) const;
+
+  // Getters return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND) if the value does
+  // not exist and HRESULT_FROM_WIN32(ERROR_DATATYPE_MISMATCH) if it has a
+  // different type.
+  HRESULT GetValue(AppRegistryHive hive,
+                   const CString& app_id,
+                   const TCHAR* value_name,
+                   CString* value) const;
+  HRESULT GetValue(AppRegistryHive hive,
+                   const CString& app_id,
+                   const TCHAR* value_name,
+                   DWORD* value) const;
+  HRESULT GetValue(AppRegistryHive hive,
+                   const CString& app_id,
+                   const TCHAR* value_name,
+                   DWORD64* value) const;
+  bool HasValue(AppRegistryHive hive,
+                const CString& app_id,
+                const TCHAR* value_name) const;
+
+  // Setters create the key in memory if it does not exist and mark the value
+  // as modified. The app must be cached.
+  void SetValue(AppRegistryHive hive,
+                const CString& app_id,
+                const TCHAR* value_name,
+                const CString& value);
+  void SetValue(AppRegistryHive hive,
+                const CString& app_id,
+                const TCHAR* value_name,
+                DWORD value);
+  void SetValue(AppRegistryHive hive,
+                const CString& app_id,
+                const TCHAR* value_name,
+                DWORD64 value);
+  void DeleteValue(AppRegistryHive hive,
+                   const CString& app_id,
+                   const TCHAR* value_name);
+
+  // Returns true if there are modified values that have not been flushed.
+  bool IsDirty() const;
+
+  size_t num_apps() const { return apps_.size(); }
+
+ private:
+  typedef std::set<CString, AppRegistryNameLess> ValueNameSet;
+
+  struct KeyRecord {
+    KeyRecord() : exists(false) {}
+
+    bool exists;
+    AppRegistryValueMap values;
+
+    // Names of values that were set or deleted since the last flush. A name in
+    // this set that is not in values has been deleted.
+    ValueNameSet dirty_names;
+  };
+
+  struct AppRecord {
+    AppRecord() : is_cached(false), is_listed_in_clients(false) {}
+
+    CString app_id;
+    bool is_cached;
+
+    // True if Load() found the app under the Clients key, even if the values
+    // of the app could not be read.
+    bool is_listed_in_clients;
+    KeyRecord keys[APP_HIVE_COUNT];
+  };
+
+  typedef std::map<CString, size_t, AppRegistryNameLess> AppIndex;
+
+  void Clear();
+
+  // Returns the record for the app, adding an empty one if there is none.
+  AppRecord* GetOrAddApp(const CString& app_id);
+
+  const AppRecord* FindApp(const CString& app_id) const;
+  const AppRegistryValue* FindValue(AppRegistryHive hive,
+                                    const CString& app_id,
+                                    const TCHAR* value_name) const;
+
+  HRESULT LoadKey(AppRegistryStoreInterface* store,
+                  AppRegistryHive hive,
+                  AppRecord* app);
+
+  void SetValueInternal(AppRegistryHive hive,
+                        const CString& app_id,
+                        const TCHAR* value_name,
+                        const AppRegistryValue& value);
+
+  HRESULT FlushApp(AppRegistryStoreInterface* store, AppRecord* app);
+
+  // Records are kept in the order the apps were first enumerated. The index
+  // maps app ids to positions in apps_.
+  std::vector<AppRecord> apps_;
+  AppIndex index_;
+
+  // True if all apps in the store have been loaded, in which case an app that
+  // is not in the index does not exist.
+  bool is_complete_;
+
+  DISALLOW_COPY_AND_ASSIGN(AppRegistrySnapshot);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_GOOPDATE_APP_REGISTRY_SNAPSHOT_H_
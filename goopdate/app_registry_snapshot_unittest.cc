@@ -0,0 +1,441 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <map>
+#include <vector>
+#include "omaha/common/const_goopdate.h"
+#include "omaha/goopdate/app_registry_snapshot.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+const TCHAR* const kAppId1 = _T("{21CD0965-0B0E-47cf-B421-2D191C16C0E2}");
+const TCHAR* const kAppId2 = _T("{A979ACBD-1F55-4b12-A35F-4DBCA5A7CCB8}");
+const TCHAR* const kAppId3 = _T("{661045C5-4429-4140-BC48-8CEA241D1DEF}");
+
+// Stores the app keys in memory and counts the store accesses.
+class FakeAppRegistryStore : public AppRegistryStoreInterface {
+ public:
+  FakeAppRegistryStore()
+      : read_error_hive_(APP_HIVE_COUNT),
+        num_get_app_ids_calls_(0),
+        num_read_calls_(0),
+        num_write_calls_(0) {
+    for (int i = 0; i != APP_HIVE_COUNT; ++i) {
+      get_app_ids_errors_[i] = S_OK;
+    }
+  }
+
+  virtual HRESULT GetAppIds(AppRegistryHive hive,
+                            std::vector<CString>* app_ids) {
+    ++num_get_app_ids_calls_;
+    app_ids->clear();
+    if (FAILED(get_app_ids_errors_[hive])) {
+      return get_app_ids_errors_[hive];
+    }
+    const KeyMap& keys = hives_[hive];
+    for (KeyMap::const_iterator it = keys.begin(); it != keys.end(); ++it) {
+      app_ids->push_back(it->first);
+    }
+    return S_OK;
+  }
+
+  virtual HRESULT ReadAppValues(AppRegistryHive hive,
+                                const CString& app_id,
+                                AppRegistryValueMap* values) {
+    ++num_read_calls_;
+    if (hive == read_error_hive_ && app_id == read_error_app_id_) {
+      return E_ACCESSDENIED;
+    }
+    KeyMap::const_iterator it = hives_[hive].find(app_id);
+    if (it == hives_[hive].end()) {
+      return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    }
+    *values = it->second;
+    return S_OK;
+  }
+
+  virtual HRESULT WriteAppValues(AppRegistryHive hive,
+                                 const CString& app_id,
+                                 const AppRegistryValueMap& values,
+                                 const std::vector<CString>& deleted_names) {
+    ++num_write_calls_;
+    KeyMap& keys = hives_[hive];
+    if (values.empty() && keys.find(app_id) == keys.end()) {
+      return S_OK;
+    }
+    AppRegistryValueMap& key = keys[app_id];
+    for (AppRegistryValueMap::const_iterator it = values.begin();
+         it != values.end();
+         ++it) {
+      key[it->first] = it->second;
+    }
+    for (size_t i = 0; i != deleted_names.size(); ++i) {
+      key.erase(deleted_names[i]);
+    }
+    return S_OK;
+  }
+
+  void CreateKey(AppRegistryHive hive, const CString& app_id) {
+    hives_[hive][app_id];
+  }
+
+  void SetValue(AppRegistryHive hive,
+                const CString& app_id,
+                const CString& name,
+                const AppRegistryValue& value) {
+    hives_[hive][app_id][name] = value;
+  }
+
+  // Fails the enumeration of the hive.
+  void SetGetAppIdsError(AppRegistryHive hive, HRESULT hr) {
+    get_app_ids_errors_[hive] = hr;
+  }
+
+  // Fails the reads of the key of the app in the hive.
+  void SetReadError(AppRegistryHive hive, const CString& app_id) {
+    read_error_hive_ = hive;
+    read_error_app_id_ = app_id;
+  }
+
+  bool HasKey(AppRegistryHive hive, const CString& app_id) {
+    return hives_[hive].find(app_id) != hives_[hive].end();
+  }
+
+  const AppRegistryValue* GetValue(AppRegistryHive hive,
+                                   const CString& app_id,
+                                   const CString& name) {
+    KeyMap::const_iterator key = hives_[hive].find(app_id);
+    if (key == hives_[hive].end()) {
+      return NULL;
+    }
+    AppRegistryValueMap::const_iterator value = key->second.find(name);
+    return value == key->second.end() ? NULL : &value->second;
+  }
+
+  int num_get_app_ids_calls() const { return num_get_app_ids_calls_; }
+  int num_read_calls() const { return num_read_calls_; }
+  int num_write_calls() const { return num_write_calls_; }
+
+ private:
+  typedef std::map<CString, AppRegistryValueMap, AppRegistryNameLess> KeyMap;
+
+  KeyMap hives_[APP_HIVE_COUNT];
+  HRESULT get_app_ids_errors_[APP_HIVE_COUNT];
+  AppRegistryHive read_error_hive_;
+  CString read_error_app_id_;
+  int num_get_app_ids_calls_;
+  int num_read_calls_;
+  int num_write_calls_;
+};
+
+}  // namespace
+
+class AppRegistrySnapshotTest : public testing::Test {
+ protected:
+  // App1 is registered, App2 is uninstalled, and App3 only has ClientState
+  // without a pv.
+  virtual void SetUp() {
+    store_.SetValue(APP_HIVE_CLIENTS, kAppId1, kRegValueProductVersion,
+                    AppRegistryValue(CString(_T("1.2.3.4"))));
+    store_.SetValue(APP_HIVE_CLIENTS, kAppId1, kRegValueAppName,
+                    AppRegistryValue(CString(_T("App1"))));
+    store_.SetValue(APP_HIVE_CLIENT_STATE, kAppId1, kRegValueProductVersion,
+                    AppRegistryValue(CString(_T("1.2.3.4"))));
+    store_.SetValue(APP_HIVE_CLIENT_STATE, kAppId1, kRegValueInstallTimeSec,
+                    AppRegistryValue(static_cast<DWORD>(12345)));
+    store_.SetValue(APP_HIVE_CLIENT_STATE, kAppId1,
+                    kRegValueUpdateAvailableSince,
+                    AppRegistryValue(static_cast<DWORD64>(9876543210)));
+
+    store_.SetValue(APP_HIVE_CLIENT_STATE, kAppId2, kRegValueProductVersion,
+                    AppRegistryValue(CString(_T("2.0.0.0"))));
+
+    store_.CreateKey(APP_HIVE_CLIENT_STATE, kAppId3);
+  }
+
+  FakeAppRegistryStore store_;
+};
+
+TEST_F(AppRegistrySnapshotTest, Load) {
+  AppRegistrySnapshot snapshot;
+  EXPECT_SUCCEEDED(snapshot.Load(&store_));
+
+  EXPECT_EQ(APP_HIVE_COUNT, store_.num_get_app_ids_calls());
+  EXPECT_EQ(3, snapshot.num_apps());
+
+  EXPECT_TRUE(snapshot.IsAppCached(kAppId1));
+  EXPECT_TRUE(snapshot.IsAppRegistered(kAppId1));
+  EXPECT_FALSE(snapshot.IsAppUninstalled(kAppId1));
+
+  EXPECT_FALSE(snapshot.IsAppRegistered(kAppId2));
+  EXPECT_TRUE(snapshot.IsAppUninstalled(kAppId2));
+
+  EXPECT_FALSE(snapshot.IsAppRegistered(kAppId3));
+  EXPECT_FALSE(snapshot.IsAppUninstalled(kAppId3));
+  EXPECT_TRUE(snapshot.HasKey(APP_HIVE_CLIENT_STATE, kAppId3));
+  EXPECT_FALSE(snapshot.HasKey(APP_HIVE_CLIENT_STATE_MEDIUM, kAppId3));
+
+  std::vector<CString> registered_apps;
+  snapshot.GetRegisteredApps(&registered_apps);
+  ASSERT_EQ(1, registered_apps.size());
+  EXPECT_STREQ(kAppId1, registered_apps[0]);
+
+  EXPECT_FALSE(snapshot.IsDirty());
+}
+
+// Apps that do not exist in the store are known not to exist.
+TEST_F(AppRegistrySnapshotTest, Load_AppNotInStore) {
+  const CString kAppId(_T("{D9F05AEA-BEDA-4f91-B216-BE45DAE330CB}"));
+
+  AppRegistrySnapshot snapshot;
+  EXPECT_SUCCEEDED(snapshot.Load(&store_));
+
+  EXPECT_TRUE(snapshot.IsAppCached(kAppId));
+  EXPECT_FALSE(snapshot.IsAppRegistered(kAppId));
+  EXPECT_FALSE(snapshot.HasKey(APP_HIVE_CLIENT_STATE, kAppId));
+
+  CString version;
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND),
+            snapshot.GetValue(APP_HIVE_CLIENTS,
+                              kAppId,
+                              kRegValueProductVersion,
+                              &version));
+}
+
+// A key that fails to load keeps the app out of the cache even when the keys
+// of the later hives load.
+TEST_F(AppRegistrySnapshotTest, Load_KeyReadFails) {
+  store_.SetReadError(APP_HIVE_CLIENTS, kAppId1);
+
+  AppRegistrySnapshot snapshot;
+  EXPECT_SUCCEEDED(snapshot.Load(&store_));
+
+  EXPECT_EQ(3, snapshot.num_apps());
+  EXPECT_FALSE(snapshot.IsAppCached(kAppId1));
+  EXPECT_TRUE(snapshot.IsAppCached(kAppId2));
+  EXPECT_TRUE(snapshot.IsAppCached(kAppId3));
+
+  // The app is still listed, so that it is updated from the registry values.
+  std::vector<CString> registered_apps;
+  snapshot.GetRegisteredApps(&registered_apps);
+  ASSERT_EQ(1, registered_apps.size());
+  EXPECT_STREQ(kAppId1, registered_apps[0]);
+}
+
+// A hive that does not exist is known to have no keys.
+TEST_F(AppRegistrySnapshotTest, Load_HiveNotFound) {
+  store_.SetGetAppIdsError(APP_HIVE_CLIENT_STATE_MEDIUM,
+                           HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND));
+
+  AppRegistrySnapshot snapshot;
+  EXPECT_SUCCEEDED(snapshot.Load(&store_));
+
+  EXPECT_TRUE(snapshot.IsAppCached(kAppId1));
+  EXPECT_FALSE(snapshot.HasKey(APP_HIVE_CLIENT_STATE_MEDIUM, kAppId1));
+
+  const CString kAppId(_T("{D9F05AEA-BEDA-4f91-B216-BE45DAE330CB}"));
+  EXPECT_TRUE(snapshot.IsAppCached(kAppId));
+}
+
+// The apps are read from the registry if a hive cannot be enumerated.
+TEST_F(AppRegistrySnapshotTest, Load_HiveReadFails) {
+  store_.SetGetAppIdsError(APP_HIVE_CLIENT_STATE_MEDIUM, E_ACCESSDENIED);
+
+  AppRegistrySnapshot snapshot;
+  EXPECT_SUCCEEDED(snapshot.Load(&store_));
+
+  EXPECT_EQ(3, snapshot.num_apps());
+  EXPECT_FALSE(snapshot.IsAppCached(kAppId1));
+  EXPECT_FALSE(snapshot.IsAppCached(kAppId2));
+  EXPECT_FALSE(snapshot.IsAppCached(kAppId3));
+
+  const CString kAppId(_T("{D9F05AEA-BEDA-4f91-B216-BE45DAE330CB}"));
+  EXPECT_FALSE(snapshot.IsAppCached(kAppId));
+
+  std::vector<CString> registered_apps;
+  snapshot.GetRegisteredApps(&registered_apps);
+  ASSERT_EQ(1, registered_apps.size());
+  EXPECT_STREQ(kAppId1, registered_apps[0]);
+}
+
+TEST_F(AppRegistrySnapshotTest, GetValue) {
+  AppRegistrySnapshot snapshot;
+  EXPECT_SUCCEEDED(snapshot.Load(&store_));
+  const int num_reads = store_.num_read_calls();
+
+  CString name;
+  EXPECT_SUCCEEDED(snapshot.GetValue(APP_HIVE_CLIENTS,
+                                     kAppId1,
+                                     kRegValueAppName,
+                                     &name));
+  EXPECT_STREQ(_T("App1"), name);
+
+  // Value and app id lookups are case-insensitive.
+  CString lower_case_app_id(kAppId1);
+  lower_case_app_id.MakeLower();
+  CString version;
+  EXPECT_SUCCEEDED(snapshot.GetValue(APP_HIVE_CLIENTS,
+                                     lower_case_app_id,
+                                     _T("PV"),
+                                     &version));
+  EXPECT_STREQ(_T("1.2.3.4"), version);
+
+  DWORD install_time(0);
+  EXPECT_SUCCEEDED(snapshot.GetValue(APP_HIVE_CLIENT_STATE,
+                                     kAppId1,
+                                     kRegValueInstallTimeSec,
+                                     &install_time));
+  EXPECT_EQ(12345, install_time);
+
+  DWORD64 since(0);
+  EXPECT_SUCCEEDED(snapshot.GetValue(APP_HIVE_CLIENT_STATE,
+                                     kAppId1,
+                                     kRegValueUpdateAvailableSince,
+                                     &since));
+  EXPECT_EQ(9876543210, since);
+
+  DWORD dword_value(0);
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_DATATYPE_MISMATCH),
+            snapshot.GetValue(APP_HIVE_CLIENT_STATE,
+                              kAppId1,
+                              kRegValueUpdateAvailableSince,
+                              &dword_value));
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND),
+            snapshot.GetValue(APP_HIVE_CLIENT_STATE,
+                              kAppId1,
+                              kRegValueTTToken,
+                              &name));
+
+  // Reads are served from memory.
+  EXPECT_EQ(num_reads, store_.num_read_calls());
+}
+
+TEST_F(AppRegistrySnapshotTest, Flush_WritesModifiedKeysOnce) {
+  AppRegistrySnapshot snapshot;
+  EXPECT_SUCCEEDED(snapshot.Load(&store_));
+
+  snapshot.SetValue(APP_HIVE_CLIENT_STATE, kAppId1, kRegValueTTToken,
+                    CString(_T("token")));
+  snapshot.SetValue(APP_HIVE_CLIENT_STATE, kAppId1,
+                    kRegValueUpdateAvailableCount, static_cast<DWORD>(3));
+  snapshot.DeleteValue(APP_HIVE_CLIENT_STATE, kAppId1,
+                       kRegValueUpdateAvailableSince);
+  snapshot.SetValue(APP_HIVE_CLIENT_STATE, kAppId2,
+                    kRegValueLastSuccessfulCheckSec, static_cast<DWORD>(1));
+  EXPECT_TRUE(snapshot.IsDirty());
+
+  // The store is not modified until the snapshot is flushed.
+  EXPECT_EQ(0, store_.num_write_calls());
+  EXPECT_FALSE(store_.GetValue(APP_HIVE_CLIENT_STATE, kAppId1,
+                               kRegValueTTToken));
+
+  EXPECT_SUCCEEDED(snapshot.Flush(&store_));
+  EXPECT_FALSE(snapshot.IsDirty());
+  EXPECT_EQ(2, store_.num_write_calls());
+
+  const AppRegistryValue* value =
+      store_.GetValue(APP_HIVE_CLIENT_STATE, kAppId1, kRegValueTTToken);
+  ASSERT_TRUE(value);
+  EXPECT_STREQ(_T("token"), value->str);
+  value = store_.GetValue(APP_HIVE_CLIENT_STATE, kAppId1,
+                          kRegValueUpdateAvailableCount);
+  ASSERT_TRUE(value);
+  EXPECT_EQ(REG_DWORD, value->type);
+  EXPECT_EQ(3, value->number);
+  EXPECT_FALSE(store_.GetValue(APP_HIVE_CLIENT_STATE, kAppId1,
+                               kRegValueUpdateAvailableSince));
+  EXPECT_TRUE(store_.GetValue(APP_HIVE_CLIENT_STATE, kAppId2,
+                              kRegValueLastSuccessfulCheckSec));
+
+  // Nothing is written when nothing changed.
+  EXPECT_SUCCEEDED(snapshot.Flush(&store_));
+  EXPECT_EQ(2, store_.num_write_calls());
+}
+
+TEST_F(AppRegistrySnapshotTest, SetValue_CreatesKey) {
+  AppRegistrySnapshot snapshot;
+  EXPECT_SUCCEEDED(snapshot.Load(&store_));
+
+  EXPECT_FALSE(snapshot.HasKey(APP_HIVE_CLIENT_STATE_MEDIUM, kAppId1));
+  snapshot.SetValue(APP_HIVE_CLIENT_STATE_MEDIUM, kAppId1,
+                    kRegValueEulaAccepted, static_cast<DWORD>(1));
+  EXPECT_TRUE(snapshot.HasKey(APP_HIVE_CLIENT_STATE_MEDIUM, kAppId1));
+
+  EXPECT_SUCCEEDED(snapshot.Flush(&store_));
+  EXPECT_TRUE(store_.HasKey(APP_HIVE_CLIENT_STATE_MEDIUM, kAppId1));
+}
+
+TEST_F(AppRegistrySnapshotTest, DeleteValue_DoesNotCreateKey) {
+  AppRegistrySnapshot snapshot;
+  EXPECT_SUCCEEDED(snapshot.Load(&store_));
+
+  snapshot.DeleteValue(APP_HIVE_CLIENT_STATE, kAppId1, kRegValueTTToken);
+  snapshot.DeleteValue(APP_HIVE_CLIENT_STATE_MEDIUM, kAppId1,
+                       kRegValueEulaAccepted);
+  EXPECT_FALSE(snapshot.HasKey(APP_HIVE_CLIENT_STATE_MEDIUM, kAppId1));
+
+  EXPECT_SUCCEEDED(snapshot.Flush(&store_));
+  EXPECT_FALSE(store_.HasKey(APP_HIVE_CLIENT_STATE_MEDIUM, kAppId1));
+}
+
+TEST_F(AppRegistrySnapshotTest, LoadApp) {
+  AppRegistrySnapshot snapshot;
+  EXPECT_SUCCEEDED(snapshot.LoadApp(&store_, kAppId2));
+
+  EXPECT_EQ(0, store_.num_get_app_ids_calls());
+  EXPECT_EQ(APP_HIVE_COUNT, store_.num_read_calls());
+
+  EXPECT_TRUE(snapshot.IsAppCached(kAppId2));
+  EXPECT_TRUE(snapshot.IsAppUninstalled(kAppId2));
+  EXPECT_FALSE(snapshot.IsAppCached(kAppId1));
+
+  // Loading an app that does not exist succeeds.
+  EXPECT_SUCCEEDED(snapshot.LoadApp(&store_,
+                                    _T("{D9F05AEA-BEDA-4f91-B216-BE45DAE330CB}")));
+}
+
+TEST_F(AppRegistrySnapshotTest, Evict) {
+  AppRegistrySnapshot snapshot;
+  EXPECT_SUCCEEDED(snapshot.Load(&store_));
+
+  snapshot.SetValue(APP_HIVE_CLIENT_STATE, kAppId1, kRegValueTTToken,
+                    CString(_T("token")));
+  EXPECT_SUCCEEDED(snapshot.Evict(&store_, kAppId1));
+
+  // The modified values are written and the app is no longer served.
+  EXPECT_EQ(1, store_.num_write_calls());
+  EXPECT_TRUE(store_.GetValue(APP_HIVE_CLIENT_STATE, kAppId1,
+                              kRegValueTTToken));
+  EXPECT_FALSE(snapshot.IsAppCached(kAppId1));
+  EXPECT_TRUE(snapshot.IsAppCached(kAppId2));
+  EXPECT_FALSE(snapshot.IsDirty());
+
+  // The app is still listed, and its values are read from the registry.
+  std::vector<CString> registered_apps;
+  snapshot.GetRegisteredApps(&registered_apps);
+  ASSERT_EQ(1, registered_apps.size());
+  EXPECT_STREQ(kAppId1, registered_apps[0]);
+
+  // Evicting an app that was never enumerated also stops serving it.
+  const CString kNewAppId(_T("{D9F05AEA-BEDA-4f91-B216-BE45DAE330CB}"));
+  EXPECT_TRUE(snapshot.IsAppCached(kNewAppId));
+  EXPECT_SUCCEEDED(snapshot.Evict(&store_, kNewAppId));
+  EXPECT_FALSE(snapshot.IsAppCached(kNewAppId));
+}
+
+}  // namespace omaha
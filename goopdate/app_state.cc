@@ -63,7 +63,7 @@ void AppState::Download(App* app, DownloadManagerInterface* download_manager) {
   UNREFERENCED_PARAMETER(download_manager);
   // Must acquire the lock here because app does not acquire it before calling
   // this method.
-  __mutexScope(app->model()->lock());
+  __mutexScope(app->lock());
   HandleInvalidStateTransition(app, _T(__FUNCTION__));
 }
 
@@ -88,7 +88,7 @@ void AppState::Install(App* app, InstallManagerInterface* install_manager) {
   UNREFERENCED_PARAMETER(install_manager);
   // Must acquire the lock here because app does not acquire it before calling
   // this method.
-  __mutexScope(app->model()->lock());
+  __mutexScope(app->lock());
   HandleInvalidStateTransition(app, _T(__FUNCTION__));
 }
 
@@ -110,7 +110,7 @@ void AppState::Pause(App* app) {
 // those states and decide what should happen. Consider Worker::StopAsync().
 void AppState::Cancel(App* app) {
   ASSERT1(app);
-  ASSERT1(app->model()->IsLockedByCaller());
+  ASSERT1(app->IsLockedByCaller());
   CORE_LOG(L3, (_T("[AppState::Cancel][0x%p]"), app));
 
   const HRESULT hr = GOOPDATE_E_CANCELLED;
@@ -126,7 +126,7 @@ void AppState::Error(App* app,
                      const ErrorContext& error_context,
                      const CString& message) {
   ASSERT1(app);
-  ASSERT1(app->model()->IsLockedByCaller());
+  ASSERT1(app->IsLockedByCaller());
   CORE_LOG(LE, (_T("[AppState::Error][0x%p][0x%08x][%s]"),
       app, error_context.error_code, message));
 
@@ -137,7 +137,7 @@ void AppState::Error(App* app,
 void AppState::ChangeState(App* app, AppState* app_state) {
   ASSERT1(app);
   ASSERT1(app_state);
-  ASSERT1(app->model()->IsLockedByCaller());
+  ASSERT1(app->IsLockedByCaller());
   CORE_LOG(L3, (_T("[AppState::ChangeState][0x%p][%d]"),
                 app, app_state->state()));
 
@@ -158,7 +158,7 @@ void AppState::HandleInvalidStateTransition(App* app,
 }
 
 PingEvent::Results AppState::GetCompletionResult(const App& app) {
-  ASSERT1(app.model()->IsLockedByCaller());
+  ASSERT1(app.IsLockedByCaller());
   return app.completion_result_;
 }
 
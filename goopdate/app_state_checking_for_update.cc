@@ -80,7 +80,7 @@ void AppStateCheckingForUpdate::PostUpdateCheck(
   ASSERT1(app);
   ASSERT1(update_response);
 
-  ASSERT1(app->model()->IsLockedByCaller());
+  ASSERT1(app->IsLockedByCaller());
 
   update_response_ = update_response;
 
@@ -43,7 +43,7 @@ void AppStateWaitingToCheckForUpdate::PreUpdateCheck(
   ASSERT1(app);
   ASSERT1(update_request);
 
-  ASSERT1(app->model()->IsLockedByCaller());
+  ASSERT1(app->IsLockedByCaller());
 
   const CString& current_version(app->current_version()->version());
   if (!current_version.IsEmpty()) {
@@ -47,6 +47,19 @@ const PingEvent* AppStateWaitingToDownload::CreatePingEvent(
   return new PingEvent(event_type, GetCompletionResult(*app), error_code, 0);
 }
 
+// The download may have been queued by a DownloadPipeline when the update
+// check response was processed, in which case the app is already waiting to
+// download. Any other app must not be queued twice.
+void AppStateWaitingToDownload::QueueDownloadOrInstall(App* app) {
+  CORE_LOG(L3, (_T("[AppStateWaitingToDownload::QueueDownloadOrInstall][%p]"),
+                app));
+  ASSERT1(app);
+
+  if (!app->is_download_pipelined()) {
+    AppState::QueueDownloadOrInstall(app);
+  }
+}
+
 void AppStateWaitingToDownload::Download(
     App* app,
     DownloadManagerInterface* download_manager) {
@@ -31,6 +31,7 @@ class AppStateWaitingToDownload : public AppState {
   virtual const PingEvent* CreatePingEvent(App* app,
                                            CurrentState previous_state) const;
 
+  virtual void QueueDownloadOrInstall(App* app);
   virtual void Download(App* app, DownloadManagerInterface* download_manager);
   virtual void Downloading(App* app);
   virtual void DownloadComplete(App* app);
@@ -25,14 +25,14 @@
 namespace omaha {
 
 AppVersion::AppVersion(App* app)
-    : ModelObject(app->model()),
+    : ModelObject(app),
       app_(app) {
 }
 
 // Destruction of App objects happens within the scope of their parent,
 // which controls the locking.
 AppVersion::~AppVersion() {
-  ASSERT1(model()->IsLockedByCaller());
+  ASSERT1(IsLockedByCaller());
 
   for (size_t i = 0; i < packages_.size(); ++i) {
     delete packages_[i];
@@ -40,22 +40,22 @@ AppVersion::~AppVersion() {
 }
 
 CString AppVersion::version() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return version_;
 }
 
 void AppVersion::set_version(const CString& version) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   version_ = version;
 }
 
 App* AppVersion::app() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return app_;
 }
 
 const App* AppVersion::app() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return app_;
 }
 
@@ -67,33 +67,33 @@ const App* AppVersion::app() const {
 // InstallManager tests and other tests that need a manifest. This could
 // probably be solved through mocking too.
 const xml::InstallManifest* AppVersion::install_manifest() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return install_manifest_.get();
 }
 
 void AppVersion::set_install_manifest(xml::InstallManifest* install_manifest) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(install_manifest);
   install_manifest_.reset(install_manifest);
 }
 
 size_t AppVersion::GetNumberOfPackages() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return packages_.size();
 }
 
 HRESULT AppVersion::AddPackage(const CString& filename,
                                uint32 size,
                                const CString& hash) {
-  __mutexScope(model()->lock());
-  Package* package = new Package(this);
+  __mutexScope(lock());
+  Package* package = new (arena()) Package(this);
   package->SetFileInfo(filename, size, hash);
   packages_.push_back(package);
   return S_OK;
 }
 
 Package* AppVersion::GetPackage(size_t index) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   if (index >= GetNumberOfPackages()) {
     ASSERT1(false);
@@ -104,7 +104,7 @@ Package* AppVersion::GetPackage(size_t index) {
 }
 
 const Package* AppVersion::GetPackage(size_t index) const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   if (index >= GetNumberOfPackages()) {
     ASSERT1(false);
@@ -115,13 +115,13 @@ const Package* AppVersion::GetPackage(size_t index) const {
 }
 
 const std::vector<CString>& AppVersion::download_base_urls() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(!download_base_urls_.empty());
   return download_base_urls_;
 }
 
 HRESULT AppVersion::AddDownloadBaseUrl(const CString& base_url) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(!base_url.IsEmpty());
   download_base_urls_.push_back(base_url);
   return S_OK;
@@ -129,21 +129,21 @@ HRESULT AppVersion::AddDownloadBaseUrl(const CString& base_url) {
 
 // IAppVersion.
 STDMETHODIMP AppVersion::get_version(BSTR* version) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(version);
   *version = version_.AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP AppVersion::get_packageCount(long* count) {  // NOLINT
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   *count = GetNumberOfPackages();
   return S_OK;
 }
 
 STDMETHODIMP AppVersion::get_package(long index, Package** package) {  // NOLINT
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   if (index < 0 || static_cast<size_t>(index) >= GetNumberOfPackages()) {
     return HRESULT_FROM_WIN32(ERROR_INVALID_INDEX);
@@ -154,18 +154,18 @@ STDMETHODIMP AppVersion::get_package(long index, Package** package) {  // NOLINT
 }
 
 STDMETHODIMP AppVersionWrapper::get_version(BSTR* version) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_version(version);
 }
 
 STDMETHODIMP AppVersionWrapper::get_packageCount(long* count) {  // NOLINT
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_packageCount(count);
 }
 
 STDMETHODIMP AppVersionWrapper::get_package(long index,  // NOLINT
                                             IDispatch** package) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   Package* p = NULL;
   HRESULT hr = wrapped_obj()->get_package(index, &p);
@@ -37,7 +37,7 @@ typedef shared_ptr<AppBundle> ControllingPtr;
 // Generalizes the creation of COM wrappers for a given class T.
 // It requires:
 //   * The wrapper class TWrapper derives from ComWrapper
-//   * The wrapped class T provides access to model instance
+//   * The wrapped class T provides access to model instance and bundle lock
 template <typename TWrapper, typename T>
 class ComWrapper : public CComObjectRootEx<CComObjectThreadModel> {
  public:
@@ -47,7 +47,7 @@ class ComWrapper : public CComObjectRootEx<CComObjectThreadModel> {
     ASSERT1(t);
     ASSERT1(t_wrapper);
 
-    ASSERT1(IsModelLockedByCaller(t->model()));
+    ASSERT1(t->IsLockedByCaller());
 
     scoped_ptr<TComObject> t_com_object;
     HRESULT hr = TComObject::CreateInstance(address(t_com_object));
@@ -82,8 +82,13 @@ class ComWrapper : public CComObjectRootEx<CComObjectThreadModel> {
     return omaha::interlocked_exchange_pointer(&model_, model_);
   }
 
+  // Returns the lock of the bundle the wrapped object belongs to.
+  const Lockable& lock() {
+    return wrapped_obj()->lock();
+  }
+
   const ControllingPtr& controlling_ptr() const {
-    ASSERT1(IsModelLockedByCaller(wrapped_obj_->model()));
+    ASSERT1(wrapped_obj_->IsLockedByCaller());
     return controlling_ptr_;
   }
 
@@ -54,6 +54,7 @@
 #include "omaha/common/event_logger.h"
 #include "omaha/common/goopdate_utils.h"
 #include "omaha/common/stats_uploader.h"
+#include "omaha/goopdate/crash_upload_queue.h"
 #include "omaha/goopdate/goopdate_metrics.h"
 #include "third_party/breakpad/src/client/windows/common/ipc_protocol.h"
 #include "third_party/breakpad/src/client/windows/crash_generation/client_info.h"
@@ -78,6 +79,7 @@ const ACCESS_MASK kPipeAccessMask = FILE_READ_ATTRIBUTES  |
 CString Crash::module_filename_;
 CString Crash::crash_dir_;
 CString Crash::checkpoint_file_;
+CString Crash::queue_dir_;
 CString Crash::version_postfix_  = kCrashVersionPostfixString;
 CString Crash::crash_report_url_ = kUrlCrashReport;
 int Crash::max_reports_per_day_  = kCrashReportMaxReportsPerDay;
@@ -110,6 +112,13 @@ HRESULT Crash::Initialize(bool is_machine) {
     return GOOPDATE_E_PATH_APPEND_FAILED;
   }
 
+  // The crashes waiting to be uploaded are kept in a subdirectory, which is
+  // created when the first crash is queued.
+  queue_dir_ = ConcatenatePath(crash_dir_, _T("Queue"));
+  if (queue_dir_.IsEmpty()) {
+    return GOOPDATE_E_PATH_APPEND_FAILED;
+  }
+
   return S_OK;
 }
 
@@ -413,7 +422,10 @@ HRESULT Crash::DoSendCrashReport(bool can_upload,
 
   HRESULT hr = S_OK;
   if (can_upload) {
-    hr = UploadCrash(is_out_of_process, crash_filename, parameters, report_id);
+    hr = QueueAndUploadCrash(is_out_of_process,
+                             crash_filename,
+                             parameters,
+                             report_id);
   } else {
     CORE_LOG(L2, (_T("[crash uploads are not allowed]")));
   }
@@ -421,6 +433,36 @@ HRESULT Crash::DoSendCrashReport(bool can_upload,
   return hr;
 }
 
+// The report id is only returned when the crash is uploaded directly. Queued
+// crashes are reported in the event log as they are uploaded.
+HRESULT Crash::QueueAndUploadCrash(bool is_out_of_process,
+                                   const CString& crash_filename,
+                                   const ParameterMap& parameters,
+                                   CString* report_id) {
+  ASSERT1(report_id);
+  report_id->Empty();
+
+  ASSERT1(!queue_dir_.IsEmpty());
+  CrashUploadQueue queue(queue_dir_, is_machine_);
+  HRESULT hr = queue.Initialize();
+  if (SUCCEEDED(hr)) {
+    hr = queue.Add(is_out_of_process, crash_filename, parameters);
+  }
+  if (hr == GOOPDATE_E_CRASH_QUEUE_FULL) {
+    CORE_LOG(LW, (_T("[crash upload queue is full, crash discarded]")));
+    return hr;
+  }
+  if (FAILED(hr)) {
+    CORE_LOG(LW, (_T("[failed to queue the crash][0x%08x]"), hr));
+    return UploadCrash(is_out_of_process,
+                       crash_filename,
+                       parameters,
+                       report_id);
+  }
+
+  return queue.Upload(&Crash::UploadCrash);
+}
+
 HRESULT Crash::UploadCrash(bool is_out_of_process,
                            const CString& crash_filename,
                            const ParameterMap& parameters,
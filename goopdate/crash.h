@@ -190,6 +190,14 @@ class Crash {
   // Updates the crash metrics after uploading the crash.
   static void UpdateCrashUploadMetrics(bool is_out_of_process, HRESULT hr);
 
+  // Adds the crash to the crash upload queue and uploads the queued crashes,
+  // unless another process is already uploading them. Uploads the crash
+  // directly if it cannot be queued.
+  static HRESULT QueueAndUploadCrash(bool is_out_of_process,
+                                     const CString& crash_filename,
+                                     const ParameterMap& parameters,
+                                     CString* report_id);
+
   // Uploads the crash, logs the result of the crash upload, and updates
   // the crash metrics.
   static HRESULT UploadCrash(bool is_out_of_process,
@@ -254,6 +262,7 @@ class Crash {
   static CString module_filename_;
   static CString Crash::crash_dir_;
   static CString Crash::checkpoint_file_;
+  static CString Crash::queue_dir_;
   static CString version_postfix_;
 
   static CString crash_report_url_;
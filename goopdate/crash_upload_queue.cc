@@ -0,0 +1,780 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/goopdate/crash_upload_queue.h"
+#include <dbghelp.h>
+#include <algorithm>
+#include "omaha/base/const_object_names.h"
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/file.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/path.h"
+#include "omaha/base/scoped_any.h"
+#include "omaha/base/signatures.h"
+#include "omaha/base/string.h"
+#include "omaha/base/time.h"
+#include "omaha/base/utils.h"
+#include "omaha/common/goopdate_utils.h"
+#include "omaha/goopdate/goopdate_metrics.h"
+#include "third_party/lzma/v4_65/files/C/LzmaLib.h"
+
+namespace omaha {
+
+namespace {
+
+const TCHAR kEntryGroup[]      = _T("Entry");
+const TCHAR kParametersGroup[] = _T("Parameters");
+
+const TCHAR kOutOfProcessKey[] = _T("OutOfProcess");
+const TCHAR kCountKey[]        = _T("Count");
+const TCHAR kTimeKey[]         = _T("Time");
+const TCHAR kUploadedKey[]     = _T("Uploaded");
+
+const TCHAR kEntryExtension[]  = _T(".ini");
+const TCHAR kDumpExtension[]   = _T(".lz");
+
+// The compressed minidump starts with the LZMA properties followed by the
+// uncompressed size as a little endian uint64.
+const size_t kCompressedHeaderSize = LZMA_PROPS_SIZE + sizeof(uint64);
+
+// Reads the streams of a minidump held in memory.
+class MinidumpStreams {
+ public:
+  explicit MinidumpStreams(const std::vector<uint8>& minidump)
+      : minidump_(minidump), read_dump_stream_(NULL) {}
+
+  HRESULT Initialize() {
+    if (minidump_.empty()) {
+      return E_INVALIDARG;
+    }
+
+    // Dynamically link with the dbghelp to avoid runtime resource bloat.
+    reset(dbghelp_, ::LoadLibrary(_T("dbghelp.dll")));
+    if (!dbghelp_) {
+      return HRESULTFromLastError();
+    }
+    read_dump_stream_ = reinterpret_cast<MiniDumpReadDumpStreamFun>(
+        ::GetProcAddress(get(dbghelp_), "MiniDumpReadDumpStream"));
+    if (!read_dump_stream_) {
+      return HRESULTFromLastError();
+    }
+    return S_OK;
+  }
+
+  // Returns the stream or NULL if the minidump does not contain the stream or
+  // the stream is smaller than min_size.
+  const void* ReadStream(ULONG stream_number, ULONG min_size) const {
+    ASSERT1(read_dump_stream_);
+    MINIDUMP_DIRECTORY directory = {0};
+    void* stream = NULL;
+    ULONG stream_size = 0;
+    if (!(*read_dump_stream_)(const_cast<uint8*>(&minidump_.front()),
+                              stream_number,
+                              &directory,
+                              &stream,
+                              &stream_size) ||
+        !stream ||
+        stream_size < min_size) {
+      return NULL;
+    }
+    return stream;
+  }
+
+  // Returns the data at the rva or NULL if the data is not in the minidump.
+  const void* GetData(RVA rva, ULONG64 size) const {
+    if (rva > minidump_.size() || size > minidump_.size() - rva) {
+      return NULL;
+    }
+    return &minidump_[rva];
+  }
+
+  // Returns true if the array that starts inside a stream fits in the minidump.
+  bool Contains(const void* data, ULONG64 size) const {
+    const uint8* begin = &minidump_.front();
+    const uint8* p = static_cast<const uint8*>(data);
+    return p >= begin &&
+           static_cast<size_t>(p - begin) <= minidump_.size() &&
+           size <= minidump_.size() - (p - begin);
+  }
+
+ private:
+  typedef BOOL (WINAPI *MiniDumpReadDumpStreamFun)(void* base_of_dump,
+                                                   ULONG stream_number,
+                                                   MINIDUMP_DIRECTORY* dir,
+                                                   void** stream_pointer,
+                                                   ULONG* stream_size);
+
+  const std::vector<uint8>& minidump_;
+  scoped_library dbghelp_;
+  MiniDumpReadDumpStreamFun read_dump_stream_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(MinidumpStreams);
+};
+
+struct Module {
+  ULONG64 base;
+  ULONG64 size;
+  CString name;
+};
+
+// Returns the module name and the offset of the address in the module. The
+// offset does not depend on where the module was loaded.
+CString FormatAddress(const std::vector<Module>& modules, ULONG64 address) {
+  for (size_t i = 0; i != modules.size(); ++i) {
+    if (address >= modules[i].base &&
+        address - modules[i].base < modules[i].size) {
+      CString location;
+      location.Format(_T("%s+0x%I64x"),
+                      modules[i].name, address - modules[i].base);
+      return location;
+    }
+  }
+  return _T("?");
+}
+
+bool IsInModule(const std::vector<Module>& modules, ULONG64 address) {
+  return FormatAddress(modules, address) != _T("?");
+}
+
+void ReadModules(const MinidumpStreams& streams,
+                 std::vector<Module>* modules) {
+  ASSERT1(modules);
+  modules->clear();
+
+  const MINIDUMP_MODULE_LIST* module_list =
+      static_cast<const MINIDUMP_MODULE_LIST*>(
+          streams.ReadStream(ModuleListStream, sizeof(ULONG32)));
+  if (!module_list) {
+    return;
+  }
+
+  const ULONG32 num_modules = module_list->NumberOfModules;
+  if (!streams.Contains(
+          module_list->Modules,
+          static_cast<ULONG64>(num_modules) * sizeof(MINIDUMP_MODULE))) {
+    return;
+  }
+
+  for (ULONG32 i = 0; i != num_modules; ++i) {
+    const MINIDUMP_MODULE& raw_module = module_list->Modules[i];
+    const MINIDUMP_STRING* raw_name = static_cast<const MINIDUMP_STRING*>(
+        streams.GetData(raw_module.ModuleNameRva, sizeof(ULONG32)));
+    if (!raw_name ||
+        !streams.GetData(raw_module.ModuleNameRva,
+                         sizeof(ULONG32) + raw_name->Length)) {
+      continue;
+    }
+
+    Module module;
+    module.base = raw_module.BaseOfImage;
+    module.size = raw_module.SizeOfImage;
+    module.name = CString(raw_name->Buffer, raw_name->Length / sizeof(WCHAR));
+    module.name = GetFileFromPath(module.name);
+    module.name.MakeLower();
+    modules->push_back(module);
+  }
+}
+
+// Scans the stack of the thread for the values that point inside a module,
+// which are likely return addresses. The stack captured in the minidump starts
+// at the stack pointer of the thread.
+void ScanStack(const MinidumpStreams& streams,
+               const std::vector<Module>& modules,
+               ULONG32 thread_id,
+               std::vector<CString>* frames) {
+  ASSERT1(frames);
+
+  const MINIDUMP_THREAD_LIST* thread_list =
+      static_cast<const MINIDUMP_THREAD_LIST*>(
+          streams.ReadStream(ThreadListStream, sizeof(ULONG32)));
+  if (!thread_list) {
+    return;
+  }
+
+  size_t pointer_size = sizeof(uint32);
+  const MINIDUMP_SYSTEM_INFO* system_info =
+      static_cast<const MINIDUMP_SYSTEM_INFO*>(
+          streams.ReadStream(SystemInfoStream, sizeof(MINIDUMP_SYSTEM_INFO)));
+  if (system_info &&
+      system_info->ProcessorArchitecture == PROCESSOR_ARCHITECTURE_AMD64) {
+    pointer_size = sizeof(uint64);
+  }
+
+  const ULONG32 num_threads = thread_list->NumberOfThreads;
+  if (!streams.Contains(
+          thread_list->Threads,
+          static_cast<ULONG64>(num_threads) * sizeof(MINIDUMP_THREAD))) {
+    return;
+  }
+
+  for (ULONG32 i = 0; i != num_threads; ++i) {
+    const MINIDUMP_THREAD& thread = thread_list->Threads[i];
+    if (thread.ThreadId != thread_id) {
+      continue;
+    }
+
+    const MINIDUMP_LOCATION_DESCRIPTOR& memory = thread.Stack.Memory;
+    const uint8* stack = static_cast<const uint8*>(
+        streams.GetData(memory.Rva, memory.DataSize));
+    if (!stack) {
+      return;
+    }
+
+    for (size_t offset = 0;
+         offset + pointer_size <= memory.DataSize &&
+         static_cast<int>(frames->size()) < CrashUploadQueue::kMaxStackFrames;
+         offset += pointer_size) {
+      ULONG64 value = 0;
+      memcpy(&value, stack + offset, pointer_size);
+      if (IsInModule(modules, value)) {
+        frames->push_back(FormatAddress(modules, value));
+      }
+    }
+    return;
+  }
+}
+
+HRESULT HashString(const CString& str, CString* hash) {
+  ASSERT1(hash);
+
+  const uint8* data = reinterpret_cast<const uint8*>(str.GetString());
+  std::vector<uint8> buffer(data, data + str.GetLength() * sizeof(TCHAR));
+  std::vector<uint8> digest;
+  CryptoHash crypto_hash;
+  HRESULT hr = crypto_hash.Compute(buffer, &digest);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  *hash = BytesToHex(digest);
+  return S_OK;
+}
+
+bool IsOlderThan(uint64 time, uint64 now, int age_sec) {
+  return now > time && now - time > age_sec * kSecsTo100ns;
+}
+
+}  // namespace
+
+CrashUploadQueue::CrashUploadQueue(const CString& queue_dir, bool is_machine)
+    : queue_dir_(queue_dir),
+      is_machine_(is_machine) {
+  ASSERT1(!queue_dir_.IsEmpty());
+}
+
+HRESULT CrashUploadQueue::Initialize() {
+  NamedObjectAttributes lock_attr;
+  GetNamedObjectAttributes(kCrashUploadQueueLock, is_machine_, &lock_attr);
+  if (!queue_lock_.InitializeWithSecAttr(lock_attr.name, &lock_attr.sa)) {
+    return HRESULTFromLastError();
+  }
+
+  NamedObjectAttributes upload_lock_attr;
+  GetNamedObjectAttributes(kCrashUploadQueueUploaderLock,
+                           is_machine_,
+                           &upload_lock_attr);
+  if (!upload_lock_.InitializeWithSecAttr(upload_lock_attr.name,
+                                          &upload_lock_attr.sa)) {
+    return HRESULTFromLastError();
+  }
+
+  // The directory inherits the security of the crash directory.
+  return CreateDir(queue_dir_, NULL);
+}
+
+HRESULT CrashUploadQueue::Add(bool is_out_of_process,
+                              const CString& crash_filename,
+                              const ParameterMap& parameters) {
+  CORE_LOG(L3, (_T("[CrashUploadQueue::Add][%s]"), crash_filename));
+
+  std::vector<uint8> minidump;
+  HRESULT hr = ReadEntireFileShareMode(crash_filename,
+                                       kMaxCrashFileSize,
+                                       FILE_SHARE_READ,
+                                       &minidump);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  // A minidump without a signature is only collapsed with identical copies.
+  CString signature;
+  hr = GetCrashSignature(minidump, &signature);
+  if (FAILED(hr)) {
+    CORE_LOG(LW, (_T("[GetCrashSignature failed][0x%08x]"), hr));
+    std::vector<uint8> digest;
+    CryptoHash crypto_hash;
+    hr = crypto_hash.Compute(minidump, &digest);
+    if (FAILED(hr)) {
+      return hr;
+    }
+    signature = _T("dump=") + BytesToHex(digest);
+  }
+  CORE_LOG(L3, (_T("[crash signature][%s]"), signature));
+
+  const CString key = GetKey(parameters, signature);
+  if (key.IsEmpty()) {
+    return E_FAIL;
+  }
+
+  const uint64 now = GetCurrent100NSTime();
+
+  __mutexScope(queue_lock_);
+
+  Entry entry;
+  if (SUCCEEDED(ReadEntry(key, &entry))) {
+    if (!entry.is_uploaded) {
+      ++entry.count;
+      ++metric_crashes_deduplicated;
+      VERIFY1(SUCCEEDED(WriteEntry(entry)));
+      return S_FALSE;
+    }
+    if (!IsOlderThan(entry.time, now, kDuplicateWindowSec)) {
+      ++metric_crashes_deduplicated;
+      return S_FALSE;
+    }
+  }
+
+  std::vector<Entry> pending_entries;
+  VERIFY1(SUCCEEDED(GetPendingEntries(&pending_entries)));
+  if (static_cast<int>(pending_entries.size()) >= kMaxQueuedCrashes) {
+    ++metric_crashes_queue_full;
+    return GOOPDATE_E_CRASH_QUEUE_FULL;
+  }
+
+  std::vector<uint8> compressed;
+  hr = Compress(minidump, &compressed);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  hr = WriteEntireFile(GetDumpFilename(key), compressed);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  CORE_LOG(L3, (_T("[crash queued][%s][%u bytes][%u compressed]"),
+                key, minidump.size(), compressed.size()));
+
+  entry = Entry();
+  entry.key = key;
+  entry.is_out_of_process = is_out_of_process;
+  entry.count = 1;
+  entry.time = now;
+  entry.parameters = parameters;
+
+  // The entry file is rewritten from scratch since the parameters of an
+  // expired entry may differ.
+  ::DeleteFile(GetEntryFilename(key));
+  hr = WriteEntry(entry);
+  if (FAILED(hr)) {
+    DeleteEntry(key);
+    return hr;
+  }
+
+  ++metric_crashes_queued;
+  return S_OK;
+}
+
+HRESULT CrashUploadQueue::Upload(UploadCrashFun upload_crash) {
+  ASSERT1(upload_crash);
+
+  if (!upload_lock_.Lock(0)) {
+    CORE_LOG(L3, (_T("[another process uploads the crashes]")));
+    return S_FALSE;
+  }
+
+  HRESULT result = S_OK;
+  int num_uploads = 0;
+  for (;;) {
+    std::vector<Entry> pending_entries;
+    __mutexBlock(queue_lock_) {
+      VERIFY1(SUCCEEDED(GetPendingEntries(&pending_entries)));
+
+      // The upload lock is released with the queue lock held. A process that
+      // adds a crash after this point acquires the upload lock and uploads its
+      // crash. Otherwise, the crash is seen by the loop above.
+      if (pending_entries.empty() || num_uploads >= kMaxUploadsPerCall) {
+        VERIFY1(upload_lock_.Unlock());
+        return result;
+      }
+    }
+
+    for (size_t i = 0;
+         i != pending_entries.size() && num_uploads < kMaxUploadsPerCall;
+         ++i) {
+      ++num_uploads;
+      HRESULT hr = S_OK;
+      const bool should_continue = UploadEntry(upload_crash,
+                                               pending_entries[i],
+                                               &hr);
+      if (FAILED(hr) && SUCCEEDED(result)) {
+        result = hr;
+      }
+
+      // The remaining crashes are uploaded when the next crash is reported.
+      if (!should_continue) {
+        VERIFY1(upload_lock_.Unlock());
+        return result;
+      }
+    }
+  }
+}
+
+int CrashUploadQueue::GetNumPendingCrashes() {
+  __mutexScope(queue_lock_);
+  std::vector<Entry> pending_entries;
+  VERIFY1(SUCCEEDED(GetPendingEntries(&pending_entries)));
+  return static_cast<int>(pending_entries.size());
+}
+
+bool CrashUploadQueue::UploadEntry(UploadCrashFun upload_crash,
+                                   const Entry& entry,
+                                   HRESULT* hr) {
+  ASSERT1(upload_crash);
+  ASSERT1(hr);
+
+  const CString crash_filename = ConcatenatePath(queue_dir_,
+                                                 entry.key + _T(".dmp"));
+  if (crash_filename.IsEmpty()) {
+    *hr = GOOPDATE_E_PATH_APPEND_FAILED;
+    return false;
+  }
+
+  std::vector<uint8> compressed;
+  std::vector<uint8> minidump;
+  __mutexBlock(queue_lock_) {
+    *hr = ReadEntireFile(GetDumpFilename(entry.key), 0, &compressed);
+  }
+  if (SUCCEEDED(*hr)) {
+    *hr = Decompress(compressed, &minidump);
+  }
+  if (SUCCEEDED(*hr)) {
+    *hr = WriteEntireFile(crash_filename, minidump);
+  }
+  if (FAILED(*hr)) {
+    // The entry cannot be uploaded. Discard it and continue with the others.
+    CORE_LOG(LE, (_T("[failed to restore the crash][%s][0x%08x]"),
+                  entry.key, *hr));
+    __mutexScope(queue_lock_);
+    DeleteEntry(entry.key);
+    return true;
+  }
+
+  ParameterMap parameters(entry.parameters);
+  if (entry.count > 1) {
+    parameters[_T("dup_count")] =
+        String_Int64ToString(entry.count - 1, 10).GetString();
+  }
+
+  CString report_id;
+  *hr = (*upload_crash)(entry.is_out_of_process,
+                        crash_filename,
+                        parameters,
+                        &report_id);
+  ::DeleteFile(crash_filename);
+
+  if (FAILED(*hr) &&
+      *hr != GOOPDATE_E_CRASH_REJECTED &&
+      *hr != GOOPDATE_E_CRASH_THROTTLED) {
+    return false;
+  }
+
+  // The entry is kept without the minidump to recognize the duplicates of the
+  // crash for a while.
+  __mutexScope(queue_lock_);
+  Entry uploaded_entry;
+  if (FAILED(ReadEntry(entry.key, &uploaded_entry))) {
+    uploaded_entry = entry;
+  }
+  uploaded_entry.is_uploaded = true;
+
+  // Duplicates may have been added while the crash was uploaded. Only the
+  // crashes reported with the upload are removed from the count; the others
+  // are only counted in the metrics, like the duplicates added after it.
+  uploaded_entry.count = std::max(0, uploaded_entry.count - entry.count);
+  uploaded_entry.time = GetCurrent100NSTime();
+  VERIFY1(SUCCEEDED(WriteEntry(uploaded_entry)));
+  ::DeleteFile(GetDumpFilename(entry.key));
+  return true;
+}
+
+HRESULT CrashUploadQueue::ReadEntry(const CString& key, Entry* entry) const {
+  ASSERT1(entry);
+
+  const CString filename = GetEntryFilename(key);
+  std::map<CString, CString> values;
+  HRESULT hr = goopdate_utils::ReadNameValuePairsFromFile(filename,
+                                                          kEntryGroup,
+                                                          &values);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  if (values.find(kTimeKey) == values.end()) {
+    return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+  }
+
+  std::map<CString, CString> parameters;
+  hr = goopdate_utils::ReadNameValuePairsFromFile(filename,
+                                                  kParametersGroup,
+                                                  &parameters);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  *entry = Entry();
+  entry->key = key;
+  entry->is_out_of_process = values[kOutOfProcessKey] == _T("1");
+  entry->count = String_StringToInt(values[kCountKey]);
+  entry->time = static_cast<uint64>(String_StringToInt64(values[kTimeKey]));
+  entry->is_uploaded = values[kUploadedKey] == _T("1");
+  std::map<CString, CString>::const_iterator it = parameters.begin();
+  for (; it != parameters.end(); ++it) {
+    entry->parameters[it->first.GetString()] = it->second.GetString();
+  }
+  return S_OK;
+}
+
+HRESULT CrashUploadQueue::WriteEntry(const Entry& entry) const {
+  const CString filename = GetEntryFilename(entry.key);
+
+  std::map<CString, CString> parameters;
+  ParameterMap::const_iterator it = entry.parameters.begin();
+  for (; it != entry.parameters.end(); ++it) {
+    parameters[it->first.c_str()] = it->second.c_str();
+  }
+  HRESULT hr = goopdate_utils::WriteNameValuePairsToFile(filename,
+                                                         kParametersGroup,
+                                                         parameters);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  // The time is written last since an entry without a time is invalid.
+  std::map<CString, CString> values;
+  values[kOutOfProcessKey] = entry.is_out_of_process ? _T("1") : _T("0");
+  values[kCountKey] = String_Int64ToString(entry.count, 10);
+  values[kUploadedKey] = entry.is_uploaded ? _T("1") : _T("0");
+  hr = goopdate_utils::WriteNameValuePairsToFile(filename,
+                                                 kEntryGroup,
+                                                 values);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  return ::WritePrivateProfileString(
+      kEntryGroup,
+      kTimeKey,
+      String_Int64ToString(static_cast<int64>(entry.time), 10),
+      filename) ? S_OK : HRESULTFromLastError();
+}
+
+void CrashUploadQueue::DeleteEntry(const CString& key) const {
+  ::DeleteFile(GetDumpFilename(key));
+  ::DeleteFile(GetEntryFilename(key));
+}
+
+HRESULT CrashUploadQueue::GetPendingEntries(
+    std::vector<Entry>* pending_entries) const {
+  ASSERT1(pending_entries);
+  pending_entries->clear();
+
+  CString wildcard(_T("*"));
+  wildcard += kEntryExtension;
+  std::vector<CString> entry_files;
+  HRESULT hr = File::GetWildcards(queue_dir_, wildcard, &entry_files);
+  if (hr == HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND)) {
+    return S_OK;
+  }
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  const uint64 now = GetCurrent100NSTime();
+  for (size_t i = 0; i != entry_files.size(); ++i) {
+    CString key = GetFileFromPath(entry_files[i]);
+    key.Truncate(key.GetLength() - arraysize(kEntryExtension) + 1);
+
+    Entry entry;
+    if (FAILED(ReadEntry(key, &entry))) {
+      DeleteEntry(key);
+      continue;
+    }
+
+    if (entry.is_uploaded) {
+      if (IsOlderThan(entry.time, now, kDuplicateWindowSec)) {
+        DeleteEntry(key);
+      }
+      continue;
+    }
+
+    if (IsOlderThan(entry.time, now, kMaxPendingAgeSec) ||
+        !File::Exists(GetDumpFilename(key))) {
+      CORE_LOG(LW, (_T("[discarding queued crash][%s]"), key));
+      DeleteEntry(key);
+      continue;
+    }
+
+    pending_entries->push_back(entry);
+  }
+
+  // Uploads the oldest crashes first.
+  std::stable_sort(pending_entries->begin(),
+                   pending_entries->end(),
+                   &CrashUploadQueue::IsQueuedBefore);
+
+  return S_OK;
+}
+
+bool CrashUploadQueue::IsQueuedBefore(const Entry& entry1,
+                                      const Entry& entry2) {
+  return entry1.time < entry2.time;
+}
+
+CString CrashUploadQueue::GetEntryFilename(const CString& key) const {
+  return ConcatenatePath(queue_dir_, key + kEntryExtension);
+}
+
+CString CrashUploadQueue::GetDumpFilename(const CString& key) const {
+  return ConcatenatePath(queue_dir_, key + kDumpExtension);
+}
+
+CString CrashUploadQueue::GetKey(const ParameterMap& parameters,
+                                 const CString& signature) {
+  ParameterMap::const_iterator prod = parameters.find(_T("prod"));
+  ParameterMap::const_iterator ver = parameters.find(_T("ver"));
+
+  CString str;
+  str.Format(_T("%s|%s|%s"),
+             prod != parameters.end() ? prod->second.c_str() : _T(""),
+             ver != parameters.end() ? ver->second.c_str() : _T(""),
+             signature);
+
+  CString key;
+  if (FAILED(HashString(str, &key))) {
+    return CString();
+  }
+  return key;
+}
+
+HRESULT CrashUploadQueue::GetCrashSignature(const std::vector<uint8>& minidump,
+                                            CString* signature) {
+  ASSERT1(signature);
+
+  MinidumpStreams streams(minidump);
+  HRESULT hr = streams.Initialize();
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  const MINIDUMP_EXCEPTION_STREAM* exception_stream =
+      static_cast<const MINIDUMP_EXCEPTION_STREAM*>(
+          streams.ReadStream(ExceptionStream,
+                             sizeof(MINIDUMP_EXCEPTION_STREAM)));
+  if (!exception_stream) {
+    return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+  }
+
+  std::vector<Module> modules;
+  ReadModules(streams, &modules);
+
+  const MINIDUMP_EXCEPTION& exception = exception_stream->ExceptionRecord;
+  signature->Format(_T("%08x|%s"),
+                    exception.ExceptionCode,
+                    FormatAddress(modules, exception.ExceptionAddress));
+
+  std::vector<CString> frames;
+  ScanStack(streams, modules, exception_stream->ThreadId, &frames);
+  for (size_t i = 0; i != frames.size(); ++i) {
+    signature->AppendFormat(_T("|%s"), frames[i]);
+  }
+
+  return S_OK;
+}
+
+HRESULT CrashUploadQueue::Compress(const std::vector<uint8>& buffer,
+                                   std::vector<uint8>* compressed) {
+  ASSERT1(compressed);
+
+  if (buffer.empty()) {
+    return E_INVALIDARG;
+  }
+
+  // The worst case expansion of LZMA is small. This bound is the one
+  // recommended by LzmaLib.h.
+  compressed->resize(kCompressedHeaderSize +
+                     buffer.size() + buffer.size() / 3 + 128);
+
+  size_t compressed_size = compressed->size() - kCompressedHeaderSize;
+  size_t props_size = LZMA_PROPS_SIZE;
+  const int kLevel = 5;
+  const unsigned int kDictionarySize = 1 << 22;   // 4 MB.
+  int res = LzmaCompress(&(*compressed)[kCompressedHeaderSize],
+                         &compressed_size,
+                         &buffer.front(),
+                         buffer.size(),
+                         &compressed->front(),
+                         &props_size,
+                         kLevel,
+                         kDictionarySize,
+                         -1,    // lc.
+                         -1,    // lp.
+                         -1,    // pb.
+                         -1,    // fb.
+                         1);    // numThreads.
+  if (res != SZ_OK || props_size != LZMA_PROPS_SIZE) {
+    CORE_LOG(LE, (_T("[LzmaCompress failed][%d]"), res));
+    return E_FAIL;
+  }
+
+  uint64 size = buffer.size();
+  for (size_t i = 0; i != sizeof(size); ++i) {
+    (*compressed)[LZMA_PROPS_SIZE + i] = static_cast<uint8>(size >> (8 * i));
+  }
+  compressed->resize(kCompressedHeaderSize + compressed_size);
+  return S_OK;
+}
+
+HRESULT CrashUploadQueue::Decompress(const std::vector<uint8>& compressed,
+                                     std::vector<uint8>* buffer) {
+  ASSERT1(buffer);
+
+  if (compressed.size() <= kCompressedHeaderSize) {
+    return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+  }
+
+  uint64 size = 0;
+  for (size_t i = 0; i != sizeof(size); ++i) {
+    size |= static_cast<uint64>(compressed[LZMA_PROPS_SIZE + i]) << (8 * i);
+  }
+  if (size == 0 || size > kMaxCrashFileSize) {
+    return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+  }
+
+  buffer->resize(static_cast<size_t>(size));
+  size_t buffer_size = buffer->size();
+  size_t compressed_size = compressed.size() - kCompressedHeaderSize;
+  int res = LzmaUncompress(&buffer->front(),
+                           &buffer_size,
+                           &compressed[kCompressedHeaderSize],
+                           &compressed_size,
+                           &compressed.front(),
+                           LZMA_PROPS_SIZE);
+  if (res != SZ_OK || buffer_size != buffer->size()) {
+    CORE_LOG(LE, (_T("[LzmaUncompress failed][%d]"), res));
+    buffer->clear();
+    return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+  }
+  return S_OK;
+}
+
+}  // namespace omaha
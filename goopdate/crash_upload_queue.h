@@ -0,0 +1,147 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+// CrashUploadQueue holds the crashes waiting to be uploaded in a directory
+// shared by all the crash reporting processes of a user or of the machine.
+//
+// Each crash is identified by a signature computed from its minidump: the
+// exception code, the module and offset where the exception occurred, and the
+// first few return addresses found on the stack of the faulting thread. A crash
+// with the same product, version, and signature as a queued crash only
+// increments the counter of the queued crash, which is reported along with the
+// upload as the "dup_count" parameter. A crash with the same signature as a
+// crash uploaded during the last kDuplicateWindowSec is only counted in the
+// metrics. The minidumps are stored compressed with LZMA until they are
+// uploaded.
+//
+// Only one process drains the queue at a time. The other processes add their
+// crash to the queue and return, which turns a crash storm into a few batches
+// of unique uploads.
+
+#ifndef OMAHA_GOOPDATE_CRASH_UPLOAD_QUEUE_H_
+#define OMAHA_GOOPDATE_CRASH_UPLOAD_QUEUE_H_
+
+#include <windows.h>
+#include <atlstr.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "base/basictypes.h"
+#include "omaha/base/synchronized.h"
+
+namespace omaha {
+
+class CrashUploadQueue {
+ public:
+  typedef std::map<std::wstring, std::wstring> ParameterMap;
+
+  // Uploads one crash. Returns GOOPDATE_E_CRASH_REJECTED or
+  // GOOPDATE_E_CRASH_THROTTLED if the server does not accept the crash, and
+  // any other error if the upload can be retried later.
+  typedef HRESULT (*UploadCrashFun)(bool is_out_of_process,
+                                    const CString& crash_filename,
+                                    const ParameterMap& parameters,
+                                    CString* report_id);
+
+  CrashUploadQueue(const CString& queue_dir, bool is_machine);
+
+  // Creates the queue directory if it does not exist.
+  HRESULT Initialize();
+
+  // Adds a copy of the crash to the queue. Returns S_FALSE if the crash is a
+  // duplicate of a queued or recently uploaded crash, in which case only the
+  // duplicate counter is updated. The caller still owns the crash file.
+  HRESULT Add(bool is_out_of_process,
+              const CString& crash_filename,
+              const ParameterMap& parameters);
+
+  // Uploads the queued crashes, oldest first, until the queue is empty, the
+  // server cannot be contacted, or kMaxUploadsPerCall crashes are uploaded.
+  // Returns S_FALSE without uploading anything if another process is already
+  // draining the queue. Otherwise, returns the first upload error or S_OK.
+  HRESULT Upload(UploadCrashFun upload_crash);
+
+  // Returns the number of crashes waiting to be uploaded.
+  int GetNumPendingCrashes();
+
+  // Computes the signature of the minidump in the buffer.
+  static HRESULT GetCrashSignature(const std::vector<uint8>& minidump,
+                                   CString* signature);
+
+  static HRESULT Compress(const std::vector<uint8>& buffer,
+                          std::vector<uint8>* compressed);
+  static HRESULT Decompress(const std::vector<uint8>& compressed,
+                            std::vector<uint8>* buffer);
+
+  // Bounds the disk space used by the queue during a crash storm.
+  static const int kMaxQueuedCrashes = 16;
+  static const int kMaxUploadsPerCall = 32;
+  static const int kDuplicateWindowSec = 24 * 60 * 60;   // 1 day.
+  static const int kMaxPendingAgeSec = 7 * 24 * 60 * 60;  // 7 days.
+  static const int kMaxStackFrames = 4;
+  static const uint32 kMaxCrashFileSize = 64 * 1024 * 1024;
+
+ private:
+  struct Entry {
+    Entry() : is_out_of_process(false), count(0), time(0), is_uploaded(false) {}
+
+    CString key;
+    bool is_out_of_process;
+    int count;            // Crashes collapsed into the entry, not reported.
+    uint64 time;          // Time queued, or time uploaded if is_uploaded.
+    bool is_uploaded;
+    ParameterMap parameters;
+  };
+
+  // The key identifies the entry files in the queue directory. Must be called
+  // with queue_lock_ held.
+  HRESULT ReadEntry(const CString& key, Entry* entry) const;
+  HRESULT WriteEntry(const Entry& entry) const;
+  void DeleteEntry(const CString& key) const;
+
+  // Reads all entries, deletes the expired ones, and returns the pending ones
+  // sorted by time. Must be called with queue_lock_ held.
+  HRESULT GetPendingEntries(std::vector<Entry>* pending_entries) const;
+
+  // Uploads one entry and records the result in the queue. Returns true if
+  // the next entry should be uploaded.
+  bool UploadEntry(UploadCrashFun upload_crash,
+                   const Entry& entry,
+                   HRESULT* hr);
+
+  static bool IsQueuedBefore(const Entry& entry1, const Entry& entry2);
+
+  CString GetEntryFilename(const CString& key) const;
+  CString GetDumpFilename(const CString& key) const;
+
+  static CString GetKey(const ParameterMap& parameters,
+                        const CString& signature);
+
+  const CString queue_dir_;
+  const bool is_machine_;
+
+  // Serializes the changes to the queue directory across processes.
+  GLock queue_lock_;
+
+  // Held by the process draining the queue.
+  GLock upload_lock_;
+
+  friend class CrashUploadQueueTest;
+  DISALLOW_EVIL_CONSTRUCTORS(CrashUploadQueue);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_GOOPDATE_CRASH_UPLOAD_QUEUE_H_
@@ -0,0 +1,238 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <vector>
+#include "base/scoped_ptr.h"
+#include "omaha/base/app_util.h"
+#include "omaha/base/error.h"
+#include "omaha/base/file.h"
+#include "omaha/base/path.h"
+#include "omaha/base/string.h"
+#include "omaha/base/utils.h"
+#include "omaha/goopdate/crash_upload_queue.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+const TCHAR kMiniDumpFilename[] = _T("minidump.dmp");
+
+}  // namespace
+
+class CrashUploadQueueTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    crash_filename_ = ConcatenatePath(
+        ConcatenatePath(app_util::GetModuleDirectory(NULL),
+                        _T("unittest_support")),
+        kMiniDumpFilename);
+    ASSERT_SUCCEEDED(ReadEntireFile(crash_filename_, 0, &minidump_));
+
+    queue_dir_ = ConcatenatePath(app_util::GetTempDir(),
+                                 _T("CrashUploadQueueTest"));
+    DeleteDirectory(queue_dir_);
+    queue_.reset(new CrashUploadQueue(queue_dir_, false));
+    ASSERT_SUCCEEDED(queue_->Initialize());
+
+    parameters_[_T("prod")] = _T("Update2");
+    parameters_[_T("ver")]  = _T("1.3.0.0");
+
+    upload_result_ = S_OK;
+    add_on_upload_ = NULL;
+    uploaded_minidumps_.clear();
+    uploaded_parameters_.clear();
+  }
+
+  virtual void TearDown() {
+    queue_.reset();
+    EXPECT_SUCCEEDED(DeleteDirectory(queue_dir_));
+  }
+
+  static HRESULT UploadCrash(bool is_out_of_process,
+                             const CString& crash_filename,
+                             const CrashUploadQueue::ParameterMap& parameters,
+                             CString* report_id) {
+    UNREFERENCED_PARAMETER(is_out_of_process);
+    EXPECT_TRUE(report_id);
+
+    std::vector<uint8> minidump;
+    EXPECT_SUCCEEDED(ReadEntireFile(crash_filename, 0, &minidump));
+    uploaded_minidumps_.push_back(minidump);
+    uploaded_parameters_.push_back(parameters);
+
+    // Adds a duplicate of the crash while it is uploaded.
+    if (add_on_upload_) {
+      EXPECT_EQ(S_FALSE, add_on_upload_->queue_->Add(
+          false, add_on_upload_->crash_filename_, add_on_upload_->parameters_));
+    }
+    return upload_result_;
+  }
+
+  // Reads the queue entry of the test crash.
+  void ReadEntry(CrashUploadQueue::Entry* entry) {
+    CString signature;
+    ASSERT_SUCCEEDED(CrashUploadQueue::GetCrashSignature(minidump_,
+                                                         &signature));
+    const CString key = CrashUploadQueue::GetKey(parameters_, signature);
+    __mutexScope(queue_->queue_lock_);
+    ASSERT_SUCCEEDED(queue_->ReadEntry(key, entry));
+  }
+
+  CString crash_filename_;
+  std::vector<uint8> minidump_;
+  CString queue_dir_;
+  scoped_ptr<CrashUploadQueue> queue_;
+  CrashUploadQueue::ParameterMap parameters_;
+
+  static HRESULT upload_result_;
+  static CrashUploadQueueTest* add_on_upload_;
+  static std::vector<std::vector<uint8> > uploaded_minidumps_;
+  static std::vector<CrashUploadQueue::ParameterMap> uploaded_parameters_;
+};
+
+HRESULT CrashUploadQueueTest::upload_result_ = S_OK;
+CrashUploadQueueTest* CrashUploadQueueTest::add_on_upload_ = NULL;
+std::vector<std::vector<uint8> > CrashUploadQueueTest::uploaded_minidumps_;
+std::vector<CrashUploadQueue::ParameterMap>
+    CrashUploadQueueTest::uploaded_parameters_;
+
+TEST_F(CrashUploadQueueTest, CompressDecompress) {
+  std::vector<uint8> compressed;
+  ASSERT_SUCCEEDED(CrashUploadQueue::Compress(minidump_, &compressed));
+  EXPECT_LT(compressed.size(), minidump_.size());
+
+  std::vector<uint8> decompressed;
+  ASSERT_SUCCEEDED(CrashUploadQueue::Decompress(compressed, &decompressed));
+  EXPECT_TRUE(minidump_ == decompressed);
+
+  compressed.resize(compressed.size() / 2);
+  EXPECT_FAILED(CrashUploadQueue::Decompress(compressed, &decompressed));
+
+  EXPECT_EQ(E_INVALIDARG,
+            CrashUploadQueue::Compress(std::vector<uint8>(), &compressed));
+}
+
+// The test minidump has an access violation at 0x12345670.
+TEST_F(CrashUploadQueueTest, GetCrashSignature) {
+  CString signature;
+  ASSERT_SUCCEEDED(CrashUploadQueue::GetCrashSignature(minidump_,
+                                                       &signature));
+  EXPECT_EQ(0, signature.Find(_T("c0000005|")));
+
+  CString signature2;
+  ASSERT_SUCCEEDED(CrashUploadQueue::GetCrashSignature(minidump_,
+                                                       &signature2));
+  EXPECT_STREQ(signature, signature2);
+
+  std::vector<uint8> not_a_minidump(minidump_.size(), 0);
+  EXPECT_FAILED(CrashUploadQueue::GetCrashSignature(not_a_minidump,
+                                                    &signature));
+}
+
+TEST_F(CrashUploadQueueTest, AddDuplicates) {
+  EXPECT_EQ(S_OK, queue_->Add(false, crash_filename_, parameters_));
+  EXPECT_EQ(S_FALSE, queue_->Add(false, crash_filename_, parameters_));
+  EXPECT_EQ(S_FALSE, queue_->Add(false, crash_filename_, parameters_));
+  EXPECT_EQ(1, queue_->GetNumPendingCrashes());
+
+  // The same crash in another product is a different crash.
+  CrashUploadQueue::ParameterMap other_parameters(parameters_);
+  other_parameters[_T("prod")] = _T("OtherProduct");
+  EXPECT_EQ(S_OK, queue_->Add(true, crash_filename_, other_parameters));
+  EXPECT_EQ(2, queue_->GetNumPendingCrashes());
+
+  // The caller still owns the crash.
+  EXPECT_TRUE(File::Exists(crash_filename_));
+}
+
+TEST_F(CrashUploadQueueTest, Upload) {
+  EXPECT_EQ(S_OK, queue_->Add(false, crash_filename_, parameters_));
+  EXPECT_EQ(S_FALSE, queue_->Add(false, crash_filename_, parameters_));
+
+  EXPECT_EQ(S_OK, queue_->Upload(&UploadCrash));
+  ASSERT_EQ(1, uploaded_minidumps_.size());
+  EXPECT_TRUE(minidump_ == uploaded_minidumps_[0]);
+  EXPECT_STREQ(_T("Update2"), uploaded_parameters_[0][_T("prod")].c_str());
+  EXPECT_STREQ(_T("1"), uploaded_parameters_[0][_T("dup_count")].c_str());
+  EXPECT_EQ(0, queue_->GetNumPendingCrashes());
+
+  // The duplicates of a recently uploaded crash are not uploaded.
+  EXPECT_EQ(S_FALSE, queue_->Add(false, crash_filename_, parameters_));
+  EXPECT_EQ(0, queue_->GetNumPendingCrashes());
+  EXPECT_EQ(S_OK, queue_->Upload(&UploadCrash));
+  EXPECT_EQ(1, uploaded_minidumps_.size());
+}
+
+// The duplicates added during the upload are not cleared by the upload.
+TEST_F(CrashUploadQueueTest, Upload_DuplicateAddedDuringUpload) {
+  EXPECT_EQ(S_OK, queue_->Add(false, crash_filename_, parameters_));
+  EXPECT_EQ(S_FALSE, queue_->Add(false, crash_filename_, parameters_));
+
+  add_on_upload_ = this;
+  EXPECT_EQ(S_OK, queue_->Upload(&UploadCrash));
+  add_on_upload_ = NULL;
+  ASSERT_EQ(1, uploaded_parameters_.size());
+  EXPECT_STREQ(_T("1"), uploaded_parameters_[0][_T("dup_count")].c_str());
+
+  CrashUploadQueue::Entry entry;
+  ReadEntry(&entry);
+  EXPECT_TRUE(entry.is_uploaded);
+  EXPECT_EQ(1, entry.count);
+  EXPECT_EQ(0, queue_->GetNumPendingCrashes());
+}
+
+TEST_F(CrashUploadQueueTest, Upload_Failed) {
+  EXPECT_EQ(S_OK, queue_->Add(false, crash_filename_, parameters_));
+
+  upload_result_ = E_FAIL;
+  EXPECT_EQ(E_FAIL, queue_->Upload(&UploadCrash));
+  EXPECT_EQ(1, uploaded_minidumps_.size());
+  EXPECT_EQ(1, queue_->GetNumPendingCrashes());
+
+  upload_result_ = S_OK;
+  EXPECT_EQ(S_OK, queue_->Upload(&UploadCrash));
+  EXPECT_EQ(2, uploaded_minidumps_.size());
+  EXPECT_EQ(0, queue_->GetNumPendingCrashes());
+}
+
+TEST_F(CrashUploadQueueTest, Upload_Rejected) {
+  EXPECT_EQ(S_OK, queue_->Add(false, crash_filename_, parameters_));
+
+  upload_result_ = GOOPDATE_E_CRASH_REJECTED;
+  EXPECT_EQ(GOOPDATE_E_CRASH_REJECTED, queue_->Upload(&UploadCrash));
+  EXPECT_EQ(0, queue_->GetNumPendingCrashes());
+  EXPECT_EQ(S_FALSE, queue_->Add(false, crash_filename_, parameters_));
+}
+
+TEST_F(CrashUploadQueueTest, QueueFull) {
+  CrashUploadQueue::ParameterMap parameters(parameters_);
+  for (int i = 0; i != CrashUploadQueue::kMaxQueuedCrashes; ++i) {
+    parameters[_T("ver")] = String_Int64ToString(i, 10).GetString();
+    EXPECT_EQ(S_OK, queue_->Add(false, crash_filename_, parameters));
+  }
+
+  parameters[_T("ver")] = _T("full");
+  EXPECT_EQ(GOOPDATE_E_CRASH_QUEUE_FULL,
+            queue_->Add(false, crash_filename_, parameters));
+  EXPECT_EQ(CrashUploadQueue::kMaxQueuedCrashes,
+            queue_->GetNumPendingCrashes());
+
+  EXPECT_EQ(S_OK, queue_->Upload(&UploadCrash));
+  EXPECT_EQ(CrashUploadQueue::kMaxQueuedCrashes, uploaded_minidumps_.size());
+  EXPECT_EQ(0, queue_->GetNumPendingCrashes());
+}
+
+}  // namespace omaha
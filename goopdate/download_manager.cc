@@ -27,12 +27,14 @@
 #include "omaha/base/debug.h"
 #include "omaha/base/error.h"
 #include "omaha/base/file.h"
+#include "omaha/base/highres_timer-win32.h"
 #include "omaha/base/logging.h"
 #include "omaha/base/path.h"
 #include "omaha/base/scoped_impersonation.h"
 #include "omaha/base/safe_format.h"
 #include "omaha/base/string.h"
 #include "omaha/base/synchronized.h"
+#include "omaha/base/tracing.h"
 #include "omaha/base/user_rights.h"
 #include "omaha/base/utils.h"
 #include "omaha/common/config_manager.h"
@@ -237,6 +239,7 @@ HRESULT DownloadManager::DownloadApp(App* app) {
 
   app->Downloading();
 
+  HighresTimer download_timer;
   CString message;
   hr = S_OK;
 
@@ -264,6 +267,8 @@ HRESULT DownloadManager::DownloadApp(App* app) {
 
   if (SUCCEEDED(hr)) {
     ++metric_worker_download_succeeded;
+    metric_worker_download_succeeded_ms.AddSample(
+        download_timer.GetElapsedMs());
   }
 
   VERIFY1(SUCCEEDED(DeleteStateForApp(app)));
@@ -326,6 +331,9 @@ HRESULT DownloadManager::DoDownloadPackage(Package* package, State* state) {
   ASSERT1(package);
   ASSERT1(state);
 
+  ScopedTraceSpan span("download", "DownloadPackage");
+  span.set_arg("expected_size", static_cast<int64>(package->expected_size()));
+
   App* app = package->app_version()->app();
   const CString app_id(app->app_guid_string());
   const CString version(package->app_version()->version());
@@ -399,7 +407,7 @@ HRESULT DownloadManager::DoDownloadPackage(Package* package, State* state) {
       // Downloading a file is a blocking call. It assumes the model is not
       // locked by the calling thread, otherwise other threads won't be able to
       // to access the model until the file download is complete.
-      ASSERT1(!package->model()->IsLockedByCaller());
+      ASSERT1(!package->IsLockedByCaller());
 
       hr = network_request->DownloadFile(url, unique_filename_path);
       if (FAILED(hr)) {
@@ -558,6 +566,7 @@ HRESULT DownloadManager::CreateStateForApp(App* app, State** state) {
   const bool use_background_priority =
                   (app->app_bundle()->priority() < INSTALL_PRIORITY_HIGH);
   network_request->set_low_priority(use_background_priority);
+  network_request->set_throttle_priority(app->app_bundle()->priority());
 
   network_request->set_proxy_auth_config(
       app->app_bundle()->GetProxyAuthConfig());
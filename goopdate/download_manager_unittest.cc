@@ -101,7 +101,7 @@ class DownloadManagerTest : public AppTestBase {
 
   static HRESULT LoadBundleFromXml(AppBundle* app_bundle,
                                    const CStringA& buffer_string) {
-    __mutexScope(app_bundle->model()->lock());
+    __mutexScope(app_bundle->lock());
 
     std::vector<uint8> buffer(buffer_string.GetLength());
     memcpy(&buffer.front(), buffer_string, buffer.size());
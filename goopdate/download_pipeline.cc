@@ -0,0 +1,176 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/goopdate/download_pipeline.h"
+#include <algorithm>
+#include "base/scoped_ptr.h"
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/scoped_impersonation.h"
+#include "omaha/base/thread_pool_callback.h"
+#include "omaha/goopdate/goopdate.h"
+#include "omaha/goopdate/model.h"
+
+namespace omaha {
+
+DownloadPipeline::DownloadPipeline(DownloadManagerInterface* download_manager,
+                                   HANDLE impersonation_token)
+    : download_manager_(download_manager),
+      impersonation_token_(impersonation_token),
+      current_app_(NULL),
+      is_downloading_(false) {
+  ASSERT1(download_manager);
+  reset(idle_event_, ::CreateEvent(NULL, true, true, NULL));
+  ASSERT1(valid(idle_event_));
+  reset(app_done_event_, ::CreateEvent(NULL, true, true, NULL));
+  ASSERT1(valid(app_done_event_));
+}
+
+DownloadPipeline::~DownloadPipeline() {
+  Wait();
+}
+
+HRESULT DownloadPipeline::Add(App* app) {
+  ASSERT1(app);
+  ASSERT1(app->state() == STATE_UPDATE_AVAILABLE);
+
+  CORE_LOG(L3, (_T("[DownloadPipeline::Add][0x%p]"), app));
+
+  app->QueueDownload();
+  if (app->state() != STATE_WAITING_TO_DOWNLOAD) {
+    return E_UNEXPECTED;
+  }
+  app->set_is_download_pipelined();
+
+  if (!valid(idle_event_) || !valid(app_done_event_)) {
+    return E_HANDLE;
+  }
+
+  __mutexScope(lock_);
+
+  pending_apps_.push_back(app);
+  if (is_downloading_) {
+    return S_OK;
+  }
+
+  typedef ThreadPoolCallBack0<DownloadPipeline> Callback;
+  scoped_ptr<Callback> callback(
+      new Callback(this, &DownloadPipeline::DownloadApps));
+
+  VERIFY1(::ResetEvent(get(idle_event_)));
+  is_downloading_ = true;
+
+  HRESULT hr = Goopdate::Instance().QueueUserWorkItem(callback.get(),
+                                                      WT_EXECUTELONGFUNCTION);
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[QueueUserWorkItem failed][0x%08x]"), hr));
+    pending_apps_.pop_back();
+    SetIdle();
+    return hr;
+  }
+
+  callback.release();
+  return S_OK;
+}
+
+void DownloadPipeline::WaitForApp(const App* app) {
+  ASSERT1(app);
+
+  if (!valid(app_done_event_)) {
+    return;
+  }
+
+  for (;;) {
+    __mutexBlock(lock_) {
+      if (!IsDownloadPending(app)) {
+        return;
+      }
+
+      // The event is set with the lock held, after the app leaves the
+      // pipeline, so resetting it here does not lose that signal.
+      VERIFY1(::ResetEvent(get(app_done_event_)));
+    }
+
+    Goopdate::Instance().WaitForObject(get(app_done_event_));
+  }
+}
+
+void DownloadPipeline::Wait() {
+  if (!valid(idle_event_)) {
+    return;
+  }
+
+  Goopdate::Instance().WaitForObject(get(idle_event_));
+
+  // The event is signaled with the lock held. Acquiring the lock ensures the
+  // work item no longer uses this object, which may be destroyed on return.
+  __mutexScope(lock_);
+  ASSERT1(!is_downloading_);
+  ASSERT1(pending_apps_.empty());
+}
+
+void DownloadPipeline::DownloadApps() {
+  CORE_LOG(L3, (_T("[DownloadPipeline::DownloadApps]")));
+
+  scoped_impersonation impersonate_user(impersonation_token_);
+  HRESULT hr = impersonate_user.result();
+  if (FAILED(hr)) {
+    // The apps remain in Waiting To Download and are downloaded by the caller.
+    CORE_LOG(LE, (_T("[Impersonation failed][0x%08x]"), hr));
+    __mutexScope(lock_);
+    pending_apps_.clear();
+    SetIdle();
+    return;
+  }
+
+  for (;;) {
+    App* app = NULL;
+    __mutexBlock(lock_) {
+      if (pending_apps_.empty()) {
+        SetIdle();
+        return;
+      }
+      app = pending_apps_.front();
+      pending_apps_.pop_front();
+      current_app_ = app;
+    }
+
+    // This is a blocking call on the network.
+    app->Download(download_manager_);
+
+    ASSERT1(app->state() == STATE_READY_TO_INSTALL ||
+            app->state() == STATE_ERROR);
+
+    __mutexBlock(lock_) {
+      current_app_ = NULL;
+      VERIFY1(::SetEvent(get(app_done_event_)));
+    }
+  }
+}
+
+void DownloadPipeline::SetIdle() {
+  is_downloading_ = false;
+  VERIFY1(::SetEvent(get(app_done_event_)));
+  VERIFY1(::SetEvent(get(idle_event_)));
+}
+
+bool DownloadPipeline::IsDownloadPending(const App* app) const {
+  return app == current_app_ ||
+         std::find(pending_apps_.begin(), pending_apps_.end(), app) !=
+             pending_apps_.end();
+}
+
+}  // namespace omaha
@@ -0,0 +1,104 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+// DownloadPipeline downloads apps on a thread pool thread while the caller
+// continues to process the update check response for the remaining apps of the
+// bundle. Apps are downloaded one at a time, in the order they are added, the
+// same as Worker downloads them when the download is not pipelined. The caller
+// can install each app as soon as its own download completes.
+
+#ifndef OMAHA_GOOPDATE_DOWNLOAD_PIPELINE_H_
+#define OMAHA_GOOPDATE_DOWNLOAD_PIPELINE_H_
+
+#include <windows.h>
+#include <deque>
+#include "base/basictypes.h"
+#include "omaha/base/scoped_any.h"
+#include "omaha/base/synchronized.h"
+
+namespace omaha {
+
+class App;
+class DownloadManagerInterface;
+
+class DownloadPipeline {
+ public:
+  // The impersonation token is not owned and must remain valid until Wait()
+  // returns. It may be NULL.
+  DownloadPipeline(DownloadManagerInterface* download_manager,
+                   HANDLE impersonation_token);
+
+  // Waits for the downloads in progress to complete.
+  ~DownloadPipeline();
+
+  // Moves the app to Waiting To Download, marks it as pipelined, and queues its
+  // download. The app must be in the Update Available state. If the download
+  // cannot be queued, the app is left in Waiting To Download and the caller
+  // downloads it as usual.
+  //
+  // The caller must not use the app until WaitForApp() or Wait() returns.
+  HRESULT Add(App* app);
+
+  // Blocks until the download of the app is no longer pending or in progress.
+  // Returns immediately for apps that were not added. The app is then in the
+  // same states as after Wait().
+  void WaitForApp(const App* app);
+
+  // Blocks until all the apps added have been downloaded. When it returns, each
+  // app is in Ready To Install or Error, or in Waiting To Download if the
+  // download could not be started.
+  void Wait();
+
+ private:
+  // Runs on a thread pool thread and downloads the queued apps until the queue
+  // is empty.
+  void DownloadApps();
+
+  // Marks the pipeline as not downloading and signals idle_event_. Must be
+  // called with lock_ held.
+  void SetIdle();
+
+  // Returns true if the app is waiting for a download or being downloaded.
+  // Must be called with lock_ held.
+  bool IsDownloadPending(const App* app) const;
+
+  DownloadManagerInterface* download_manager_;  // Not owned.
+  HANDLE impersonation_token_;                  // Not owned.
+
+  LLock lock_;
+
+  // The apps waiting for a download. Protected by lock_.
+  std::deque<App*> pending_apps_;
+
+  // The app being downloaded or NULL. Protected by lock_.
+  App* current_app_;
+
+  // True while a thread pool work item is draining pending_apps_. Protected by
+  // lock_.
+  bool is_downloading_;
+
+  // Manual reset event that is signaled when no work item is running.
+  scoped_event idle_event_;
+
+  // Manual reset event that is signaled each time an app leaves the pipeline.
+  // WaitForApp() resets it with lock_ held before it waits.
+  scoped_event app_done_event_;
+
+  DISALLOW_COPY_AND_ASSIGN(DownloadPipeline);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_GOOPDATE_DOWNLOAD_PIPELINE_H_
@@ -146,6 +146,9 @@ class ATL_NO_VTABLE Update3COMClass
       return HRESULT_FROM_WIN32(ERROR_INVALID_INDEX);
     }
     shared_ptr<AppBundle> app_bundle(model()->GetAppBundle(index));
+
+    // The bundle lock is below the model lock in the lock hierarchy.
+    __mutexScope(app_bundle->lock());
     return AppBundleWrapper::Create(app_bundle->controlling_ptr(),
                                     app_bundle.get(),
                                     app_bundle_wrapper);
@@ -159,6 +162,8 @@ class ATL_NO_VTABLE Update3COMClass
     __mutexScope(model()->lock());
 
     shared_ptr<AppBundle> app_bundle(model()->CreateAppBundle(T::is_machine()));
+
+    __mutexScope(app_bundle->lock());
     return AppBundleWrapper::Create(app_bundle->controlling_ptr(),
                                     app_bundle.get(),
                                     app_bundle_wrapper);
@@ -53,15 +53,20 @@
 #include "omaha/base/debug.h"
 #include "omaha/base/error.h"
 #include "omaha/base/file.h"
+#include "omaha/base/lock_stats.h"
 #include "omaha/base/logging.h"
 #include "omaha/base/module_utils.h"
 #include "omaha/base/omaha_version.h"
+#include "omaha/base/path.h"
 #include "omaha/base/proc_utils.h"
+#include "omaha/base/process_index.h"
 #include "omaha/base/reg_key.h"
 #include "omaha/base/safe_format.h"
 #include "omaha/base/scoped_any.h"
 #include "omaha/base/scoped_ptr_address.h"
+#include "omaha/base/synchronized.h"
 #include "omaha/base/system_info.h"
+#include "omaha/base/tracing.h"
 #include "omaha/base/utils.h"
 #include "omaha/base/vistautil.h"
 #include "omaha/client/client_utils.h"
@@ -89,6 +94,7 @@
 #include "omaha/goopdate/goopdate_internal.h"
 #include "omaha/goopdate/goopdate_metrics.h"
 #include "omaha/goopdate/resource_manager.h"
+#include "omaha/goopdate/startup_profiler.h"
 #include "omaha/net/net_diags.h"
 #include "omaha/service/service_main.h"
 #include "omaha/setup/setup_service.h"
@@ -171,6 +177,31 @@ bool CheckRegisteredVersion(const CString& version,
 }
 #endif
 
+// Aggregates the samples of all the instrumented locks in the metrics. The
+// per-lock statistics are logged when the process exits.
+class LockMetricsObserver : public LockStatsObserver {
+ public:
+  LockMetricsObserver() {}
+
+  virtual void OnLockReleased(const TCHAR* name,
+                              int64 wait_us,
+                              int64 hold_us) {
+    UNREFERENCED_PARAMETER(name);
+    if (wait_us > 0) {
+      ++metric_lock_contended_acquires;
+    }
+    metric_lock_wait_us.AddSample(wait_us);
+    metric_lock_hold_us.AddSample(hold_us);
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(LockMetricsObserver);
+};
+
+// Lives until the process exits, since a lock released after the statistics
+// are disabled may still notify it.
+LockMetricsObserver lock_metrics_observer;
+
 }  // namespace
 
 namespace detail {
@@ -183,6 +214,10 @@ class GoopdateImpl {
   HRESULT Main(HINSTANCE instance, const TCHAR* cmd_line, int cmd_show);
 
   HRESULT QueueUserWorkItem(UserWorkItem* work_item, uint32 flags);
+  HRESULT QueueUserWorkItem(UserWorkItem* work_item,
+                            ThreadPool::Priority priority);
+
+  void WaitForObject(HANDLE handle);
 
   void Stop();
 
@@ -261,6 +296,15 @@ class GoopdateImpl {
 
   static HRESULT CaptureOSMetrics();
 
+  // Starts tracing if a trace directory is configured.
+  void StartTracing();
+
+  // Starts recording lock statistics if they are enabled in the registry.
+  void StartLockStats();
+
+  // Measures the startup. Declared first to be constructed first.
+  StartupProfiler startup_profiler_;
+
   HINSTANCE module_instance_;  // Current module instance.
   CString cmd_line_;           // Command line, as provided by the OS.
   int cmd_show_;
@@ -275,10 +319,14 @@ class GoopdateImpl {
   // True if Omaha has been uninstalled by the Worker.
   bool has_uninstalled_;
 
-  // Language identifier for the current user locale.
-  CString user_default_language_id_;
-
+  // The thread pool is created when the first work item is queued, since
+  // most modes do not use it. Protected by thread_pool_lock_.
   scoped_ptr<ThreadPool>      thread_pool_;
+  bool is_stopped_;
+  LLock thread_pool_lock_;
+
+  // The file the trace is written to on exit, if tracing is enabled.
+  CString trace_file_path_;
 
   Goopdate* goopdate_;
 
@@ -290,11 +338,14 @@ GoopdateImpl::GoopdateImpl(Goopdate* goopdate, bool is_local_system)
       cmd_show_(0),
       is_local_system_(is_local_system),
       has_uninstalled_(false),
+      is_stopped_(false),
       goopdate_(goopdate) {
   ASSERT1(goopdate);
 
   ++metric_goopdate_constructor;
 
+  startup_profiler_.StartPhase("crash_handler");
+
   // The command line needs to be parsed to accurately determine if the current
   // process is a machine process or not. Take an upfront guess before that.
   is_machine_ = vista_util::IsUserAdmin() &&
@@ -307,6 +358,13 @@ GoopdateImpl::GoopdateImpl(Goopdate* goopdate, bool is_local_system)
   // Install the exception handler.
   VERIFY1(SUCCEEDED(Crash::InstallCrashHandler(is_machine_)));
 
+  // Tracing starts once the crash handler is installed, so that the crash
+  // handler reports a crash while starting it.
+  StartTracing();
+  StartLockStats();
+
+  startup_profiler_.StartPhase("metrics");
+
   // Hints network configure manager how to create its singleton.
   NetworkConfigManager::set_is_machine(is_machine_);
 
@@ -323,12 +381,7 @@ GoopdateImpl::GoopdateImpl(Goopdate* goopdate, bool is_local_system)
     omaha::g_crash_specific_error = static_cast<HRESULT>(crash_specific_error);
   }
 
-  static const int kThreadPoolShutdownDelayMs = 60000;
-  thread_pool_.reset(new ThreadPool);
-  HRESULT hr = thread_pool_->Initialize(kThreadPoolShutdownDelayMs);
-  if (FAILED(hr)) {
-    CORE_LOG(LE, (_T("[thread_pool_->Initialize failed][0x%08x]"), hr));
-  }
+  startup_profiler_.EndPhase();
 }
 
 GoopdateImpl::~GoopdateImpl() {
@@ -338,6 +391,18 @@ GoopdateImpl::~GoopdateImpl() {
 
   Stop();
 
+  if (!trace_file_path_.IsEmpty()) {
+    Tracer::Disable();
+    VERIFY1(SUCCEEDED(Tracer::WriteChromeTrace(trace_file_path_)));
+  }
+
+  if (LockStats::IsEnabled()) {
+    LockStats::Disable();
+    CString lock_stats;
+    LockStats::Dump(&lock_stats);
+    CORE_LOG(L2, (_T("[lock statistics]\r\n%s"), lock_stats));
+  }
+
   // Bug 994348 does not repro anymore.
   // If the assert fires, clean up the key, and fix the code if we have unit
   // tests or application code that create the key.
@@ -360,17 +425,66 @@ GoopdateImpl::~GoopdateImpl() {
 }
 
 HRESULT GoopdateImpl::QueueUserWorkItem(UserWorkItem* work_item, uint32 flags) {
-  CORE_LOG(L3, (_T("[GoopdateImpl::QueueUserWorkItem]")));
+  UNREFERENCED_PARAMETER(flags);
+  return QueueUserWorkItem(work_item, ThreadPool::PRIORITY_NORMAL);
+}
+
+HRESULT GoopdateImpl::QueueUserWorkItem(UserWorkItem* work_item,
+                                        ThreadPool::Priority priority) {
+  CORE_LOG(L3, (_T("[GoopdateImpl::QueueUserWorkItem][%d]"), priority));
   ASSERT1(work_item);
 
-  ASSERT1(thread_pool_.get());
+  __mutexScope(thread_pool_lock_);
+
+  if (!thread_pool_.get()) {
+    if (is_stopped_) {
+      return E_UNEXPECTED;
+    }
+
+    static const int kThreadPoolShutdownDelayMs = 60000;
+    scoped_ptr<ThreadPool> thread_pool(new ThreadPool);
+    HRESULT hr = thread_pool->Initialize(kThreadPoolShutdownDelayMs);
+    if (FAILED(hr)) {
+      CORE_LOG(LE, (_T("[thread_pool->Initialize failed][0x%08x]"), hr));
+      return hr;
+    }
+    thread_pool_.swap(thread_pool);
+  }
+
+  return thread_pool_->QueueUserWorkItem(work_item,
+                                         priority,
+                                         shared_ptr<CancellationToken>());
+}
+
+void GoopdateImpl::WaitForObject(HANDLE handle) {
+  ASSERT1(handle);
 
-  return thread_pool_->QueueUserWorkItem(work_item, flags);
+  // The callers are work items, which the thread pool destructor waits for.
+  // Once Stop() is called, the callers wait without running the items they
+  // queued, up to the shutdown delay of the thread pool.
+  ThreadPool* thread_pool = NULL;
+  __mutexBlock(thread_pool_lock_) {
+    thread_pool = thread_pool_.get();
+  }
+
+  if (!thread_pool) {
+    VERIFY1(::WaitForSingleObject(handle, INFINITE) == WAIT_OBJECT_0);
+    return;
+  }
+  thread_pool->WaitForObject(handle);
 }
 
 void GoopdateImpl::Stop() {
-  // The thread pool destructor waits for any remaining jobs to complete.
-  thread_pool_.reset();
+  scoped_ptr<ThreadPool> thread_pool;
+  __mutexBlock(thread_pool_lock_) {
+    is_stopped_ = true;
+    thread_pool.swap(thread_pool_);
+  }
+
+  // The thread pool destructor waits for any remaining jobs to complete. The
+  // lock is not held since the jobs may call QueueUserWorkItem() meanwhile,
+  // which fails from now on.
+  thread_pool.reset();
 }
 
 // Assumes the resources are loaded and members are initialized.
@@ -458,6 +572,9 @@ HRESULT GoopdateImpl::Main(HINSTANCE instance,
 
   Worker::DeleteInstance();
 
+  // Frees the process attributes cached by the process searches of this run.
+  ProcessIndex::DeleteInstance();
+
   // Uninitializing the network configuration must happen after reporting the
   // metrics. The call succeeds even if the network has not been initialized
   // due to errors up the execution path.
@@ -509,6 +626,8 @@ HRESULT GoopdateImpl::DoMain(HINSTANCE instance,
   cmd_line_ = cmd_line;
   cmd_show_ = cmd_show;
 
+  startup_profiler_.StartPhase("os_metrics");
+
   // The system terminates the process without displaying a retry dialog box
   // for the user. GoogleUpdate has no user state to be saved, therefore
   // prompting the user for input is meaningless.
@@ -516,6 +635,8 @@ HRESULT GoopdateImpl::DoMain(HINSTANCE instance,
 
   VERIFY1(SUCCEEDED(CaptureOSMetrics()));
 
+  startup_profiler_.StartPhase("version");
+
   InitializeVersionFromModule(module_instance_);
   this_version_ = GetVersionString();
 
@@ -533,6 +654,8 @@ HRESULT GoopdateImpl::DoMain(HINSTANCE instance,
                 vista_util::IsUserNonElevatedAdmin(),
                 ConfigManager::Instance()->GetTestSource()));
 
+  startup_profiler_.StartPhase("parse_command_line");
+
   HRESULT parse_hr = omaha::ParseCommandLine(cmd_line_, &args_);
   if (FAILED(parse_hr)) {
     CORE_LOG(LE, (_T("[Parse cmd line failed][0x%08x]"), parse_hr));
@@ -551,7 +674,10 @@ HRESULT GoopdateImpl::DoMain(HINSTANCE instance,
     args_.is_silent_set = !args_.install_source.IsEmpty();
   }
 
+  startup_profiler_.StartPhase("initialize");
+
   HRESULT hr = InitializeGoopdateAndLoadResources();
+  startup_profiler_.EndPhase();
   if (FAILED(hr)) {
     CORE_LOG(LE,
              (_T("[InitializeGoopdateAndLoadResources failed][0x%08x]"), hr));
@@ -578,6 +704,11 @@ HRESULT GoopdateImpl::DoMain(HINSTANCE instance,
                 ConfigManager::Instance()->CanUseNetwork(is_machine_),
                 ConfigManager::Instance()->CanCollectStats(is_machine_)));
 
+  const int startup_ms = startup_profiler_.GetTotalMs();
+  metric_goopdate_startup_ms.AddSample(startup_ms);
+  OPT_LOG(L2, (_T("[startup][%d ms]%s"),
+               startup_ms, startup_profiler_.ToString()));
+
   bool has_ui_been_displayed = false;
 
   if (!is_machine_ && vista_util::IsElevatedWithUACMaybeOn()) {
@@ -651,6 +782,8 @@ HRESULT GoopdateImpl::InitializeGoopdateAndLoadResources() {
     return GOOPDATE_E_SHUTDOWN_SIGNALED;
   }
 
+  startup_profiler_.StartPhase("load_resources");
+
   HRESULT hr = LoadResourceDllIfNecessary(args_.mode, module_directory);
   if (FAILED(hr)) {
     CORE_LOG(LE, (_T("[LoadResourceDllIfNecessary failed][0x%08x]"), hr));
@@ -667,8 +800,6 @@ HRESULT GoopdateImpl::ExecuteMode(bool* has_ui_been_displayed) {
   // Save the mode on the stack for post-mortem debugging purposes.
   volatile CommandLineMode mode = args_.mode;
 
-  user_default_language_id_ = lang::GetDefaultLanguage(is_local_system_);
-
   ASSERT1(CheckRegisteredVersion(GetVersionString(), is_machine_, mode));
 
 #pragma warning(push)
@@ -857,7 +988,7 @@ HRESULT GoopdateImpl::HandleReportCrash() {
     hr = Crash::Report(can_upload_in_process,
                        args_.crash_filename,
                        args_.custom_info_filename,
-                       user_default_language_id_);
+                       lang::GetDefaultLanguage(is_local_system_));
   }
   __except(EXCEPTION_EXECUTE_HANDLER) {
     hr = E_FAIL;
@@ -1350,6 +1481,41 @@ HRESULT GoopdateImpl::CaptureOSMetrics() {
   return hr;
 }
 
+void GoopdateImpl::StartTracing() {
+  CString trace_directory;
+  if (FAILED(RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
+                              kRegValueTraceDirectory,
+                              &trace_directory)) ||
+      trace_directory.IsEmpty()) {
+    return;
+  }
+
+  CString file_name;
+  file_name.Format(_T("trace_%u_%u.json"),
+                   ::GetCurrentProcessId(),
+                   ::GetTickCount());
+  trace_file_path_ = ConcatenatePath(trace_directory, file_name);
+  if (trace_file_path_.IsEmpty()) {
+    return;
+  }
+
+  CORE_LOG(L2, (_T("[tracing enabled][%s]"), trace_file_path_));
+  Tracer::Enable(Tracer::kDefaultEventsPerThread);
+}
+
+void GoopdateImpl::StartLockStats() {
+  DWORD is_enabled = 0;
+  if (FAILED(RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
+                              kRegValueLockStats,
+                              &is_enabled)) ||
+      !is_enabled) {
+    return;
+  }
+
+  CORE_LOG(L2, (_T("[lock statistics enabled]")));
+  LockStats::Enable(&lock_metrics_observer);
+}
+
 }  // namespace detail
 
 namespace internal {
@@ -1607,6 +1773,15 @@ HRESULT Goopdate::QueueUserWorkItem(UserWorkItem* work_item, uint32 flags) {
   return impl_->QueueUserWorkItem(work_item, flags);
 }
 
+HRESULT Goopdate::QueueUserWorkItem(UserWorkItem* work_item,
+                                    ThreadPool::Priority priority) {
+  return impl_->QueueUserWorkItem(work_item, priority);
+}
+
+void Goopdate::WaitForObject(HANDLE handle) {
+  impl_->WaitForObject(handle);
+}
+
 void Goopdate::Stop() {
   return impl_->Stop();
 }
@@ -47,6 +47,13 @@ class Goopdate {
   HRESULT Main(HINSTANCE instance, const TCHAR* cmd_line, int cmd_show);
 
   HRESULT QueueUserWorkItem(UserWorkItem* work_item, uint32 flags);
+  HRESULT QueueUserWorkItem(UserWorkItem* work_item,
+                            ThreadPool::Priority priority);
+
+  // Waits for the handle to be signaled. A work item that waits for the work
+  // items it queued must use this, which runs them on the calling thread if
+  // no other thread has started them.
+  void WaitForObject(HANDLE handle);
 
   void Stop();
 
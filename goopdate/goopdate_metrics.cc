@@ -39,6 +39,10 @@ DEFINE_METRIC_count(oop_crashes_createcustominfofile_failed);
 DEFINE_METRIC_count(oop_crashes_startsenderwithcommandline_failed);
 DEFINE_METRIC_count(oop_crash_start_sender);
 
+DEFINE_METRIC_count(crashes_queued);
+DEFINE_METRIC_count(crashes_deduplicated);
+DEFINE_METRIC_count(crashes_queue_full);
+
 DEFINE_METRIC_count(goopdate_handle_report_crash);
 
 DEFINE_METRIC_count(crash_start_server_total);
@@ -56,4 +60,10 @@ DEFINE_METRIC_count(goopdate_constructor);
 DEFINE_METRIC_count(goopdate_destructor);
 DEFINE_METRIC_count(goopdate_main);
 
+DEFINE_METRIC_histogram(goopdate_startup_ms);
+
+DEFINE_METRIC_count(lock_contended_acquires);
+DEFINE_METRIC_histogram(lock_wait_us);
+DEFINE_METRIC_histogram(lock_hold_us);
+
 }  // namespace omaha
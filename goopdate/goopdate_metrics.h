@@ -54,6 +54,13 @@ DECLARE_METRIC_count(oop_crashes_createcustominfofile_failed);
 DECLARE_METRIC_count(oop_crashes_startsenderwithcommandline_failed);
 DECLARE_METRIC_count(oop_crash_start_sender);
 
+// Crash upload queue metrics, for both in process and out of process crashes.
+// A crash is queued, collapsed into a duplicate, or discarded because the
+// queue is full.
+DECLARE_METRIC_count(crashes_queued);
+DECLARE_METRIC_count(crashes_deduplicated);
+DECLARE_METRIC_count(crashes_queue_full);
+
 // Increments every time GoopdateImpl::HandleReportCrash is called.
 DECLARE_METRIC_count(goopdate_handle_report_crash);
 
@@ -82,6 +89,15 @@ DECLARE_METRIC_count(goopdate_constructor);
 DECLARE_METRIC_count(goopdate_destructor);
 DECLARE_METRIC_count(goopdate_main);
 
+// Time from the construction of GoopdateImpl until the mode starts executing.
+DECLARE_METRIC_histogram(goopdate_startup_ms);
+
+// Lock contention, aggregated over the instrumented locks. Only recorded when
+// the lock statistics are enabled in the registry.
+DECLARE_METRIC_count(lock_contended_acquires);
+DECLARE_METRIC_histogram(lock_wait_us);
+DECLARE_METRIC_histogram(lock_hold_us);
+
 }  // namespace omaha
 
 #endif  // OMAHA_GOOPDATE_GOOPDATE_METRICS_H_
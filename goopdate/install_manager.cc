@@ -15,6 +15,7 @@
 
 #include "omaha/goopdate/install_manager.h"
 #include <vector>
+#include "omaha/base/const_object_names.h"
 #include "omaha/base/debug.h"
 #include "omaha/base/error.h"
 #include "omaha/base/logging.h"
@@ -22,6 +23,7 @@
 #include "omaha/base/safe_format.h"
 #include "omaha/base/scope_guard.h"
 #include "omaha/base/synchronized.h"
+#include "omaha/base/tracing.h"
 #include "omaha/base/utils.h"
 #include "omaha/common/config_manager.h"
 #include "omaha/common/const_cmd_line.h"
@@ -60,9 +62,7 @@ bool GetInstallActionForEvent(
 
 }  // namespace
 
-InstallManager::InstallManager(const Lockable* model_lock, bool is_machine)
-    : model_lock_(model_lock),
-      is_machine_(is_machine) {
+InstallManager::InstallManager(bool is_machine) : is_machine_(is_machine) {
   CORE_LOG(L3, (_T("[InstallManager::InstallManager][%d]"), is_machine_));
 
   install_working_dir_ =
@@ -82,11 +82,17 @@ InstallManager::~InstallManager() {
 }
 
 HRESULT InstallManager::Initialize() {
-  return installer_wrapper_->Initialize();
+  NamedObjectAttributes lock_attr;
+  GetNamedObjectAttributes(kInstallManagerSerializer, is_machine_, &lock_attr);
+  if (!installer_lock_.InitializeWithSecAttr(lock_attr.name, &lock_attr.sa)) {
+    OPT_LOG(LEVEL_ERROR, (_T("[Could not init Install Manager lock]")));
+    return GOOPDATEINSTALL_E_FAILED_INIT_INSTALLER_LOCK;
+  }
+
+  return S_OK;
 }
 
 CString InstallManager::install_working_dir() const {
-  __mutexScope(model_lock_);
   return install_working_dir_;
 }
 
@@ -96,6 +102,8 @@ void InstallManager::InstallApp(App* app,  const CString& dir) {
   CORE_LOG(L3, (_T("[InstallManager::InstallApp][0x%p]"), app));
   ASSERT1(app);
 
+  ScopedTraceSpan span("install", "InstallApp");
+
   const ConfigManager& cm = *ConfigManager::Instance();
   // TODO(omaha): Since we don't currently have is_manual, check the least
   // restrictive case of true. It would be nice if we had is_manual. We'll see.
@@ -105,12 +113,10 @@ void InstallManager::InstallApp(App* app,  const CString& dir) {
          app->is_install() && app->app_bundle()->is_offline_install(),
          (_T("update/online install of app for which EULA is not accepted.")));
 
-  // TODO(omaha3): This needs to be set/passed per app/bundle.
   const int priority = app->app_bundle()->priority();
   const int num_tries = (priority < INSTALL_PRIORITY_HIGH) ?
                              kNumMsiAlreadyRunningSilentMaxTries :
                              kNumMsiAlreadyRunningInteractiveMaxTries;
-  installer_wrapper_->set_num_tries_when_msi_busy(num_tries);
 
   AppVersion* next_version = app->next_version();
   ASSERT1(app->app_bundle()->is_machine() == is_machine_);
@@ -119,11 +125,17 @@ void InstallManager::InstallApp(App* app,  const CString& dir) {
 
   HANDLE primary_token(app->app_bundle()->primary_token());
 
+  // InstallScheduler holds the installer lock while its installers run, and
+  // runs the MSI installers one at a time.
+  Lockable* installer_lock =
+      app->is_install_scheduled() ? NULL : &installer_lock_;
+
   HRESULT hr = InstallApp(is_machine_,
                           primary_token,
                           current_version_string,
-                          *model_lock_,
                           installer_wrapper_.get(),
+                          installer_lock,
+                          num_tries,
                           app,
                           dir);
   if (FAILED(hr)) {
@@ -131,15 +143,25 @@ void InstallManager::InstallApp(App* app,  const CString& dir) {
   }
 
   app->LogTextAppendFormat(_T("Install result=0x%08x"), hr);
+  span.set_arg("hr", hr);
 
   ASSERT1(FAILED(hr) == (app->state() == STATE_ERROR));
 }
 
+void InstallManager::LockInstallers() {
+  VERIFY1(installer_lock_.Lock());
+}
+
+void InstallManager::UnlockInstallers() {
+  VERIFY1(installer_lock_.Unlock());
+}
+
 HRESULT InstallManager::InstallApp(bool is_machine,
                                    HANDLE user_token,
                                    const CString& existing_version,
-                                   const Lockable& model_lock,
                                    InstallerWrapper* installer_wrapper,
+                                   Lockable* installer_lock,
+                                   int num_tries_when_msi_busy,
                                    App* app,
                                    const CString& dir) {
   UNREFERENCED_PARAMETER(is_machine);
@@ -157,8 +179,15 @@ HRESULT InstallManager::InstallApp(bool is_machine,
   CString installer_data;
   CString expected_version;
 
+  // The installers of other apps may run at the same time as this one. The
+  // registry install lock is only held while Omaha updates the registry, and
+  // BeginInstaller() and EndInstaller() mark the registry as unstable while
+  // the installer runs.
   AppManager& app_manager = *AppManager::Instance();
-  __mutexScope(app_manager.GetRegistryStableStateLock());
+  const Lockable& registry_install_lock = app_manager.GetRegistryInstallLock();
+  VERIFY1(registry_install_lock.Lock());
+  ScopeGuard registry_install_lock_guard =
+      MakeObjGuard(registry_install_lock, &Lockable::Unlock);
 
   // TODO(omaha): If this does not get much simpler, extract method.
   AppVersion& next_version = *(app->next_version());
@@ -167,9 +196,13 @@ HRESULT InstallManager::InstallApp(bool is_machine,
   CString language = app->app_bundle()->display_language();
 
   // TODO(omaha): review the need for locking below.
-  __mutexBlock(model_lock) {
+  __mutexBlock(app->lock()) {
     app->Installing();
 
+    // The installer modifies the app's registry keys, so stop serving them
+    // from the bundle's registry snapshot.
+    app_manager.EvictFromRegistrySnapshot(*app);
+
     app_guid = app->app_guid();
 
     // The first package is always the Package Manager for the app.
@@ -221,7 +254,7 @@ HRESULT InstallManager::InstallApp(bool is_machine,
     // for version compatibility). Should we protect this case as well?
     // Is it safest to use the installer lock for this? What is the performance
     // impact. If we do use the installer lock, it would need to be acquired
-    // here instead of in the InstallerWrapper::InstallApp path.
+    // here instead of around InstallerWrapper::InstallApp.
     if (!is_update) {
       HRESULT hr = app_manager.WritePreInstallData(*app);
       if (FAILED(hr)) {
@@ -241,21 +274,37 @@ HRESULT InstallManager::InstallApp(bool is_machine,
                manifest_arguments,
                installer_data));
 
+  app_manager.BeginInstaller();
+  registry_install_lock_guard.Dismiss();
+  VERIFY1(registry_install_lock.Unlock());
+
   InstallerResultInfo result_info;
 
+  // Acquire the global lock here. This will ensure that we are the only
+  // installer running of the multiple goopdates.
+  if (installer_lock) {
+    VERIFY1(installer_lock->Lock());
+  }
   HRESULT hr = installer_wrapper->InstallApp(user_token,
                                              app_guid,
                                              installer_path,
                                              manifest_arguments,
                                              installer_data,
                                              language,
+                                             num_tries_when_msi_busy,
                                              &result_info);
+  if (installer_lock) {
+    VERIFY1(installer_lock->Unlock());
+  }
 
   OPT_LOG(L1, (_T("[InstallApp returned][0x%x][%s][type:%d][code: %d][%s][%s]"),
                hr, GuidToString(app_guid), result_info.type, result_info.code,
                result_info.text, result_info.post_install_launch_command_line));
 
-  __mutexScope(model_lock);
+  __mutexScope(registry_install_lock);
+  app_manager.EndInstaller();
+
+  __mutexScope(app->lock());
 
   if (SUCCEEDED(hr)) {
     ASSERT1(result_info.type == INSTALLER_RESULT_SUCCESS);
@@ -23,6 +23,7 @@
 #include <atlstr.h>
 #include "base/basictypes.h"
 #include "base/scoped_ptr.h"
+#include "omaha/base/synchronized.h"
 #include "omaha/base/thread_pool.h"
 
 namespace omaha {
@@ -40,11 +41,13 @@ class InstallManagerInterface {
   virtual CString install_working_dir() const = 0;
   virtual HRESULT Initialize() = 0;
   virtual void InstallApp(App* app, const CString& dir) = 0;
+  virtual void LockInstallers() = 0;
+  virtual void UnlockInstallers() = 0;
 };
 
 class InstallManager : public InstallManagerInterface {
  public:
-  InstallManager(const Lockable* model_lock, bool is_machine_);
+  explicit InstallManager(bool is_machine_);
   virtual ~InstallManager();
 
   // Returns the base directory where the InstallManager expects application
@@ -54,23 +57,30 @@ class InstallManager : public InstallManagerInterface {
   virtual HRESULT Initialize();
 
   // Installs an application. Expects the application packages to be present
-  // in the specified directory.
+  // in the specified directory. The installer runs once no other installer
+  // runs in the goopdate instances, unless the install is scheduled by
+  // InstallScheduler, which holds the installer lock for its installs.
   virtual void InstallApp(App* app, const CString& dir);
 
+  // Acquires and releases the installer lock on behalf of the calling thread.
+  virtual void LockInstallers();
+  virtual void UnlockInstallers();
+
  private:
   // TODO(omaha): Rename to avoid overload.
+  // The installer runs with installer_lock held, unless it is NULL.
   static HRESULT InstallApp(bool is_machine,
                             HANDLE user_token,
                             const CString& existing_version,
-                            const Lockable& model_lock,
                             InstallerWrapper* installer_wrapper,
+                            Lockable* installer_lock,
+                            int num_tries_when_msi_busy,
                             App* app,
                             const CString& dir);
   static void PopulateSuccessfulInstallResultInfo(
       const App* app,
       InstallerResultInfo* result_info);
 
-  const Lockable* model_lock_;
   const bool is_machine_;
 
   // Base path where verified application packages are copied before install.
@@ -78,6 +88,12 @@ class InstallManager : public InstallManagerInterface {
 
   scoped_ptr<InstallerWrapper> installer_wrapper_;
 
+  // Ensures that a single installer is run by us at a time.
+  // Not sure if we can run installers in different sessions without
+  // interference. In that case we can use a local lock instead of a
+  // global lock.
+  GLock installer_lock_;
+
   friend class InstallManagerInstallAppTest;
 
   DISALLOW_COPY_AND_ASSIGN(InstallManager);
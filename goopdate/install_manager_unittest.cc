@@ -106,7 +106,7 @@ extern const TCHAR kError1619MessagePrefix[];
 extern const int kError1619MessagePrefixLength;
 void VerifyStringIsMsiPackageOpenFailedString(const CString& str);
 void UninstallTestMsi(const CString& installer_path);
-void AdjustMsiTries(InstallerWrapper* installer_wrapper);
+int GetNumMsiTries();
 
 // TODO(omaha3): Test the rest of InstallManager.
 class InstallManagerTest : public testing::Test {
@@ -117,7 +117,8 @@ class InstallManagerTest : public testing::Test {
 class InstallManagerInstallAppTest : public AppTestBaseWithRegistryOverride {
  protected:
   explicit InstallManagerInstallAppTest(bool is_machine)
-      : AppTestBaseWithRegistryOverride(is_machine, false) {}
+      : AppTestBaseWithRegistryOverride(is_machine, false),
+        num_msi_tries_(1) {}
 
   static void SetUpTestCase() {
     CString system_path;
@@ -142,7 +143,6 @@ class InstallManagerInstallAppTest : public AppTestBaseWithRegistryOverride {
     AppTestBaseWithRegistryOverride::SetUp();
 
     installer_wrapper_.reset(new InstallerWrapper(is_machine_));
-    EXPECT_SUCCEEDED(installer_wrapper_->Initialize());
 
     ASSERT_SUCCEEDED(app_bundle_->createApp(CComBSTR(kAppId), &app_));
 
@@ -156,8 +156,9 @@ class InstallManagerInstallAppTest : public AppTestBaseWithRegistryOverride {
     return InstallManager::InstallApp(is_machine_,
                                       NULL,
                                       existing_version,
-                                      app->model()->lock(),
                                       installer_wrapper_.get(),
+                                      NULL,  // Installer lock.
+                                      num_msi_tries_,
                                       app,
                                       dir);
   }
@@ -236,6 +237,10 @@ class InstallManagerInstallAppTest : public AppTestBaseWithRegistryOverride {
 
   scoped_ptr<InstallerWrapper> installer_wrapper_;
 
+  // The number of tries the installs made by InstallApp() make when an MSI
+  // install is already running.
+  int num_msi_tries_;
+
   App* app_;
 
   static CPath cmd_exe_dir_;
@@ -578,7 +583,7 @@ TEST_F(InstallManagerInstallAppMachineTest, InstallApp_MsiInstallerSucceeds) {
   // installer.
   RestoreRegistryHives();
 
-  AdjustMsiTries(installer_wrapper_.get());
+  num_msi_tries_ = GetNumMsiTries();
 
   CString installer_dir(app_util::GetCurrentModuleDirectory());
 
@@ -658,7 +663,7 @@ TEST_F(InstallManagerInstallAppMachineTest,
   // installer.
   RestoreRegistryHives();
 
-  AdjustMsiTries(installer_wrapper_.get());
+  num_msi_tries_ = GetNumMsiTries();
 
   CString installer_dir(app_util::GetCurrentModuleDirectory());
 
@@ -850,7 +855,7 @@ TEST_F(InstallManagerInstallAppUserTest,
   msi_path.Append(_T("foo.msi"));
   const CString log_path = msi_path + _T(".log");
 
-  AdjustMsiTries(installer_wrapper_.get());
+  num_msi_tries_ = GetNumMsiTries();
 
   ASSERT_SUCCEEDED(File::Remove(log_path));
   ASSERT_FALSE(File::Exists(log_path));
@@ -0,0 +1,224 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/goopdate/install_scheduler.h"
+#include "base/scoped_ptr.h"
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/thread_pool_callback.h"
+#include "omaha/common/const_goopdate.h"
+#include "omaha/goopdate/goopdate.h"
+#include "omaha/goopdate/installer_wrapper.h"
+#include "omaha/goopdate/model.h"
+
+namespace omaha {
+
+namespace {
+
+bool IsMsiApp(App* app) {
+  ASSERT1(app);
+  AppVersion* next_version = app->next_version();
+  if (!next_version || !next_version->GetNumberOfPackages()) {
+    return false;
+  }
+  const Package* package = next_version->GetPackage(0);
+  return package && InstallerWrapper::IsMsiInstaller(package->filename());
+}
+
+}  // namespace
+
+InstallScheduler::InstallScheduler(InstallManagerInterface* install_manager,
+                                   int max_parallel_installs)
+    : install_manager_(install_manager),
+      max_parallel_installs_(max_parallel_installs),
+      num_running_(0),
+      is_stopped_(false),
+      is_installer_lock_held_(false),
+      last_msi_job_(-1),
+      last_new_install_job_(-1),
+      last_barrier_job_(-1) {
+  ASSERT1(install_manager);
+  ASSERT1(max_parallel_installs > 0);
+  reset(idle_event_, ::CreateEvent(NULL, true, true, NULL));
+  ASSERT1(valid(idle_event_));
+}
+
+InstallScheduler::~InstallScheduler() {
+  Wait();
+}
+
+void InstallScheduler::Add(App* app) {
+  ASSERT1(app);
+  ASSERT1(app->state() == STATE_WAITING_TO_INSTALL);
+
+  CORE_LOG(L3, (_T("[InstallScheduler::Add][0x%p]"), app));
+
+  // The app is queried before lock_ is acquired since the app acquires the
+  // lock of its bundle, AppBundle::lock().
+  const bool is_omaha = !!::IsEqualGUID(kGoopdateGuid, app->app_guid());
+  const bool is_msi = IsMsiApp(app);
+  const bool is_new_install = app->is_install();
+
+  AddJob(app, is_omaha, is_msi, is_new_install);
+}
+
+void InstallScheduler::AddJob(App* app,
+                              bool is_omaha,
+                              bool is_msi,
+                              bool is_new_install) {
+  ASSERT1(app);
+
+  if (!valid(idle_event_)) {
+    return;
+  }
+
+  if (!is_installer_lock_held_) {
+    install_manager_->LockInstallers();
+    is_installer_lock_held_ = true;
+  }
+
+  __mutexScope(lock_);
+
+  const int index = static_cast<int>(jobs_.size());
+  Job job;
+  job.app = app;
+  if (is_omaha) {
+    for (int i = 0; i != index; ++i) {
+      job.dependencies.push_back(i);
+    }
+    last_barrier_job_ = index;
+  } else {
+    if (last_barrier_job_ != -1) {
+      job.dependencies.push_back(last_barrier_job_);
+    }
+    if (is_msi) {
+      if (last_msi_job_ != -1) {
+        job.dependencies.push_back(last_msi_job_);
+      }
+      last_msi_job_ = index;
+    }
+    if (is_new_install) {
+      if (last_new_install_job_ != -1) {
+        job.dependencies.push_back(last_new_install_job_);
+      }
+      last_new_install_job_ = index;
+    }
+  }
+  jobs_.push_back(job);
+
+  StartReadyInstalls();
+}
+
+void InstallScheduler::Wait() {
+  if (!valid(idle_event_)) {
+    return;
+  }
+
+  Goopdate::Instance().WaitForObject(get(idle_event_));
+
+  // The event is signaled with the lock held. Acquiring the lock ensures the
+  // work items no longer use this object, which may be destroyed on return.
+  __mutexBlock(lock_) {
+    ASSERT1(!num_running_);
+  }
+
+  // The apps left in Waiting To Install are installed by the caller, which
+  // acquires the installer lock for each of them.
+  if (is_installer_lock_held_) {
+    install_manager_->UnlockInstallers();
+    is_installer_lock_held_ = false;
+  }
+}
+
+void InstallScheduler::StartReadyInstalls() {
+  for (size_t i = 0;
+       i != jobs_.size() && !is_stopped_ &&
+       num_running_ < max_parallel_installs_;
+       ++i) {
+    Job& job = jobs_[i];
+    if (job.is_running || job.is_done || !IsReady(job)) {
+      continue;
+    }
+
+    typedef ThreadPoolCallBack1<InstallScheduler, size_t> Callback;
+    scoped_ptr<Callback> callback(
+        new Callback(this, &InstallScheduler::InstallApp, i));
+
+    VERIFY1(::ResetEvent(get(idle_event_)));
+    job.is_running = true;
+    ++num_running_;
+
+    HRESULT hr = Goopdate::Instance().QueueUserWorkItem(callback.get(),
+                                                        WT_EXECUTELONGFUNCTION);
+    if (FAILED(hr)) {
+      // The apps not started remain in Waiting To Install and are installed
+      // by the caller.
+      CORE_LOG(LE, (_T("[QueueUserWorkItem failed][0x%08x]"), hr));
+      job.is_running = false;
+      --num_running_;
+      is_stopped_ = true;
+      SetIdleIfNotRunning();
+      return;
+    }
+
+    callback.release();
+  }
+}
+
+bool InstallScheduler::IsReady(const Job& job) const {
+  for (size_t i = 0; i != job.dependencies.size(); ++i) {
+    if (!jobs_[job.dependencies[i]].is_done) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void InstallScheduler::InstallApp(size_t job_index) {
+  App* app = NULL;
+  __mutexBlock(lock_) {
+    ASSERT1(job_index < jobs_.size());
+    ASSERT1(jobs_[job_index].is_running);
+    app = jobs_[job_index].app;
+  }
+
+  CORE_LOG(L3, (_T("[InstallScheduler::InstallApp][0x%p]"), app));
+
+  // This is a blocking call on the app installer. The thread pool threads run
+  // as the process, the same as the installers run by Worker.
+  app->set_is_install_scheduled(true);
+  app->Install(install_manager_);
+  app->set_is_install_scheduled(false);
+
+  ASSERT1(app->state() == STATE_INSTALL_COMPLETE ||
+          app->state() == STATE_NO_UPDATE ||
+          app->state() == STATE_ERROR);
+
+  __mutexScope(lock_);
+  jobs_[job_index].is_running = false;
+  jobs_[job_index].is_done = true;
+  --num_running_;
+  StartReadyInstalls();
+  SetIdleIfNotRunning();
+}
+
+void InstallScheduler::SetIdleIfNotRunning() {
+  if (!num_running_) {
+    VERIFY1(::SetEvent(get(idle_event_)));
+  }
+}
+
+}  // namespace omaha
@@ -0,0 +1,132 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+// InstallScheduler runs the installers of a bundle on thread pool threads so
+// that the installers which do not depend on each other run at the same time.
+//
+// The update response does not describe the dependencies between the apps, so
+// they are inferred from the bundle order as apps are added:
+//   * MSI installers run one at a time, since Windows Installer only runs one
+//     installation at a time.
+//   * New installs run in the order the apps were added, since an app may
+//     rely on an app installed before it in the same bundle.
+//   * The Omaha update runs after all the apps added before it and before all
+//     the apps added after it.
+// Updates of the apps that are already installed run in any order.
+//
+// The installer lock keeps the installers of other goopdate instances from
+// running at the same time. The scheduler acquires it when the first app is
+// added and releases it in Wait(), so Add() and Wait() must be called on the
+// same thread.
+
+#ifndef OMAHA_GOOPDATE_INSTALL_SCHEDULER_H_
+#define OMAHA_GOOPDATE_INSTALL_SCHEDULER_H_
+
+#include <windows.h>
+#include <vector>
+#include "base/basictypes.h"
+#include "omaha/base/scoped_any.h"
+#include "omaha/base/synchronized.h"
+
+namespace omaha {
+
+class App;
+class InstallManagerInterface;
+
+class InstallScheduler {
+ public:
+  InstallScheduler(InstallManagerInterface* install_manager,
+                   int max_parallel_installs);
+
+  // Waits for the installs in progress to complete.
+  ~InstallScheduler();
+
+  // Schedules the install of the app, which must be in Waiting To Install. The
+  // install starts once the apps it depends on have been installed and fewer
+  // than max_parallel_installs installers are running.
+  //
+  // The caller must not use the app until Wait() returns.
+  void Add(App* app);
+
+  // Blocks until no installer is running and no install can be started. When
+  // it returns, each app is in Install Complete or Error, or in Waiting To
+  // Install if its install could not be started. The caller installs the
+  // latter as usual.
+  void Wait();
+
+ private:
+  struct Job {
+    Job() : app(NULL), is_running(false), is_done(false) {}
+
+    App* app;
+    std::vector<int> dependencies;   // Indexes of the jobs to run first.
+    bool is_running;
+    bool is_done;
+  };
+
+  // Adds the job of the app, which depends on the previous jobs according to
+  // the kind of install the app needs.
+  void AddJob(App* app, bool is_omaha, bool is_msi, bool is_new_install);
+
+  // Starts the jobs whose dependencies are done, up to the parallel limit.
+  // Must be called with lock_ held.
+  void StartReadyInstalls();
+
+  // Returns true if all the dependencies of the job are done. Must be called
+  // with lock_ held.
+  bool IsReady(const Job& job) const;
+
+  // Runs on a thread pool thread and installs the app of the job.
+  void InstallApp(size_t job_index);
+
+  // Signals idle_event_ if no job is running. Must be called with lock_ held.
+  void SetIdleIfNotRunning();
+
+  InstallManagerInterface* install_manager_;  // Not owned.
+  const int max_parallel_installs_;
+
+  LLock lock_;
+
+  // The jobs in the order they were added. Protected by lock_.
+  std::vector<Job> jobs_;
+
+  // The number of jobs running. Protected by lock_.
+  int num_running_;
+
+  // True if a work item could not be queued, in which case no more installs
+  // are started. Protected by lock_.
+  bool is_stopped_;
+
+  // True if the installer lock is held by the thread that adds the apps.
+  // Only used by that thread.
+  bool is_installer_lock_held_;
+
+  // The last MSI install, new install, and Omaha update added, or -1.
+  // Protected by lock_.
+  int last_msi_job_;
+  int last_new_install_job_;
+  int last_barrier_job_;
+
+  // Manual reset event that is signaled when no job is running.
+  scoped_event idle_event_;
+
+  friend class InstallSchedulerTest;
+
+  DISALLOW_COPY_AND_ASSIGN(InstallScheduler);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_GOOPDATE_INSTALL_SCHEDULER_H_
@@ -0,0 +1,353 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <algorithm>
+#include <vector>
+#include "omaha/base/synchronized.h"
+#include "omaha/goopdate/app_manager.h"
+#include "omaha/goopdate/app_state_waiting_to_install.h"
+#include "omaha/goopdate/app_unittest_base.h"
+#include "omaha/goopdate/goopdate.h"
+#include "omaha/goopdate/install_manager.h"
+#include "omaha/goopdate/install_scheduler.h"
+#include "omaha/goopdate/installer_result_info.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+const TCHAR* const kAppIds[] = {
+  _T("{C4B41023-B164-420B-A4D1-96F9D52569E7}"),
+  _T("{366DED7D-1078-42C1-B88C-ED3D42704677}"),
+  _T("{CFD59657-D2E8-4601-9DA9-7B129AB7C73C}"),
+  _T("{8D1CE180-86E4-4E0F-B7AA-9BDCE1B5BADD}"),
+  _T("{E1375A46-1B3B-4FDF-ABDA-AF0F99F86B0E}"),
+};
+
+// How long each fake installer runs. It is long enough for the installers that
+// may run in parallel to overlap.
+const int kInstallTimeMs = 100;
+
+// Records the order in which the installers start and finish, how many of
+// them run at the same time, and whether they run with the installer lock
+// held.
+class RecordingInstallManager : public InstallManagerInterface {
+ public:
+  RecordingInstallManager()
+      : install_working_dir_(app_util::GetTempDir()),
+        num_running_(0),
+        max_running_(0),
+        is_locked_(false),
+        num_locks_(0),
+        num_unlocked_installs_(0) {}
+
+  virtual HRESULT Initialize() { return S_OK; }
+  virtual CString install_working_dir() const { return install_working_dir_; }
+
+  virtual void InstallApp(App* app, const CString& dir) {
+    ASSERT1(app);
+    UNREFERENCED_PARAMETER(dir);
+
+    app->Installing();
+
+    const bool is_install_scheduled = app->is_install_scheduled();
+
+    __mutexBlock(lock_) {
+      events_.push_back(Event(app, true));
+      max_running_ = std::max(++num_running_, max_running_);
+      if (!is_locked_ || !is_install_scheduled) {
+        ++num_unlocked_installs_;
+      }
+    }
+
+    ::Sleep(kInstallTimeMs);
+
+    __mutexBlock(lock_) {
+      --num_running_;
+      events_.push_back(Event(app, false));
+    }
+
+    AppManager& app_manager = *AppManager::Instance();
+    __mutexScope(app_manager.GetRegistryStableStateLock());
+
+    InstallerResultInfo result_info;
+    result_info.type = INSTALLER_RESULT_SUCCESS;
+    result_info.text = _T("success");
+    app->ReportInstallerComplete(result_info);
+  }
+
+  virtual void LockInstallers() {
+    __mutexScope(lock_);
+    ASSERT1(!is_locked_);
+    is_locked_ = true;
+    ++num_locks_;
+  }
+
+  virtual void UnlockInstallers() {
+    __mutexScope(lock_);
+    ASSERT1(is_locked_);
+    is_locked_ = false;
+  }
+
+  // Returns the position of the start or the end of the installer of the app
+  // in the recorded events, or -1 if the installer did not run.
+  int GetStart(const App* app) const { return Find(app, true); }
+  int GetEnd(const App* app) const { return Find(app, false); }
+
+  int num_installs() const {
+    __mutexScope(lock_);
+    return static_cast<int>(events_.size() / 2);
+  }
+
+  int max_running() const {
+    __mutexScope(lock_);
+    return max_running_;
+  }
+
+  bool is_locked() const {
+    __mutexScope(lock_);
+    return is_locked_;
+  }
+
+  int num_locks() const {
+    __mutexScope(lock_);
+    return num_locks_;
+  }
+
+  // Returns the number of installers that ran without the installer lock.
+  int num_unlocked_installs() const {
+    __mutexScope(lock_);
+    return num_unlocked_installs_;
+  }
+
+ private:
+  struct Event {
+    Event(const App* a, bool start) : app(a), is_start(start) {}
+
+    const App* app;
+    bool is_start;
+  };
+
+  int Find(const App* app, bool is_start) const {
+    __mutexScope(lock_);
+    for (size_t i = 0; i != events_.size(); ++i) {
+      if (events_[i].app == app && events_[i].is_start == is_start) {
+        return static_cast<int>(i);
+      }
+    }
+    return -1;
+  }
+
+  const CString install_working_dir_;
+
+  LLock lock_;
+  std::vector<Event> events_;
+  int num_running_;
+  int max_running_;
+  bool is_locked_;
+  int num_locks_;
+  int num_unlocked_installs_;
+
+  DISALLOW_COPY_AND_ASSIGN(RecordingInstallManager);
+};
+
+}  // namespace
+
+class InstallSchedulerTest : public AppTestBaseWithRegistryOverride {
+ protected:
+  InstallSchedulerTest()
+      : AppTestBaseWithRegistryOverride(false,  // Always as user for now.
+                                        false),
+        goopdate_(false) {}
+
+  virtual void SetUp() {
+    AppTestBaseWithRegistryOverride::SetUp();
+
+    for (int i = 0; i < arraysize(kAppIds); ++i) {
+      App* app = NULL;
+      ASSERT_SUCCEEDED(app_bundle_->createApp(CComBSTR(kAppIds[i]), &app));
+      SetAppStateForUnitTest(app, new fsm::AppStateWaitingToInstall);
+      apps_.push_back(app);
+    }
+  }
+
+  // Adds the app as if it were the Omaha update, an MSI install, or a new
+  // install, regardless of the app id and of the packages of the app.
+  static void AddJob(InstallScheduler* scheduler,
+                     App* app,
+                     bool is_omaha,
+                     bool is_msi,
+                     bool is_new_install) {
+    scheduler->AddJob(app, is_omaha, is_msi, is_new_install);
+  }
+
+  // Returns true if the installer of the first app finished before the
+  // installer of the second app started.
+  bool RanBefore(const App* first, const App* second) const {
+    const int end = install_manager_.GetEnd(first);
+    const int start = install_manager_.GetStart(second);
+    return end != -1 && start != -1 && end < start;
+  }
+
+  void ExpectInstalled(const App* app) const {
+    EXPECT_NE(-1, install_manager_.GetEnd(app));
+    EXPECT_NE(STATE_WAITING_TO_INSTALL, app->state());
+  }
+
+  Goopdate goopdate_;
+  RecordingInstallManager install_manager_;
+  std::vector<App*> apps_;
+};
+
+TEST_F(InstallSchedulerTest, Updates_RunInParallel) {
+  InstallScheduler scheduler(&install_manager_, 4);
+  for (int i = 0; i != 4; ++i) {
+    AddJob(&scheduler, apps_[i], false, false, false);
+  }
+  scheduler.Wait();
+
+  for (int i = 0; i != 4; ++i) {
+    ExpectInstalled(apps_[i]);
+  }
+  EXPECT_EQ(4, install_manager_.num_installs());
+  EXPECT_EQ(4, install_manager_.max_running());
+}
+
+// The installer lock is held once for all the installers of the scheduler.
+TEST_F(InstallSchedulerTest, InstallerLock_HeldUntilWait) {
+  InstallScheduler scheduler(&install_manager_, 4);
+  for (int i = 0; i != 3; ++i) {
+    AddJob(&scheduler, apps_[i], false, false, false);
+  }
+  EXPECT_TRUE(install_manager_.is_locked());
+  scheduler.Wait();
+
+  EXPECT_FALSE(install_manager_.is_locked());
+  EXPECT_EQ(1, install_manager_.num_locks());
+  EXPECT_EQ(3, install_manager_.num_installs());
+  EXPECT_EQ(0, install_manager_.num_unlocked_installs());
+  for (int i = 0; i != 3; ++i) {
+    EXPECT_FALSE(apps_[i]->is_install_scheduled());
+  }
+}
+
+TEST_F(InstallSchedulerTest, Updates_ParallelLimit) {
+  InstallScheduler scheduler(&install_manager_, 2);
+  for (int i = 0; i != 5; ++i) {
+    AddJob(&scheduler, apps_[i], false, false, false);
+  }
+  scheduler.Wait();
+
+  for (int i = 0; i != 5; ++i) {
+    ExpectInstalled(apps_[i]);
+  }
+  EXPECT_EQ(2, install_manager_.max_running());
+}
+
+TEST_F(InstallSchedulerTest, Updates_OneAtATime) {
+  InstallScheduler scheduler(&install_manager_, 1);
+  for (int i = 0; i != 3; ++i) {
+    AddJob(&scheduler, apps_[i], false, false, false);
+  }
+  scheduler.Wait();
+
+  EXPECT_EQ(3, install_manager_.num_installs());
+  EXPECT_EQ(1, install_manager_.max_running());
+}
+
+TEST_F(InstallSchedulerTest, NewInstalls_RunInOrder) {
+  InstallScheduler scheduler(&install_manager_, 4);
+  for (int i = 0; i != 3; ++i) {
+    AddJob(&scheduler, apps_[i], false, false, true);
+  }
+  scheduler.Wait();
+
+  EXPECT_TRUE(RanBefore(apps_[0], apps_[1]));
+  EXPECT_TRUE(RanBefore(apps_[1], apps_[2]));
+  EXPECT_EQ(1, install_manager_.max_running());
+}
+
+// The updates do not wait for the new installs.
+TEST_F(InstallSchedulerTest, NewInstallsAndUpdates) {
+  InstallScheduler scheduler(&install_manager_, 4);
+  AddJob(&scheduler, apps_[0], false, false, true);
+  AddJob(&scheduler, apps_[1], false, false, false);
+  AddJob(&scheduler, apps_[2], false, false, true);
+  scheduler.Wait();
+
+  EXPECT_TRUE(RanBefore(apps_[0], apps_[2]));
+  EXPECT_FALSE(RanBefore(apps_[0], apps_[1]));
+  EXPECT_EQ(2, install_manager_.max_running());
+}
+
+TEST_F(InstallSchedulerTest, MsiInstalls_RunOneAtATime) {
+  InstallScheduler scheduler(&install_manager_, 4);
+  AddJob(&scheduler, apps_[0], false, true, false);
+  AddJob(&scheduler, apps_[1], false, true, false);
+  AddJob(&scheduler, apps_[2], false, false, false);
+  AddJob(&scheduler, apps_[3], false, true, false);
+  scheduler.Wait();
+
+  EXPECT_TRUE(RanBefore(apps_[0], apps_[1]));
+  EXPECT_TRUE(RanBefore(apps_[1], apps_[3]));
+  EXPECT_FALSE(RanBefore(apps_[0], apps_[2]));
+  EXPECT_EQ(2, install_manager_.max_running());
+}
+
+TEST_F(InstallSchedulerTest, OmahaUpdate_IsBarrier) {
+  InstallScheduler scheduler(&install_manager_, 4);
+  AddJob(&scheduler, apps_[0], false, false, false);
+  AddJob(&scheduler, apps_[1], false, false, false);
+  AddJob(&scheduler, apps_[2], true, false, false);
+  AddJob(&scheduler, apps_[3], false, false, false);
+  AddJob(&scheduler, apps_[4], false, false, false);
+  scheduler.Wait();
+
+  EXPECT_TRUE(RanBefore(apps_[0], apps_[2]));
+  EXPECT_TRUE(RanBefore(apps_[1], apps_[2]));
+  EXPECT_TRUE(RanBefore(apps_[2], apps_[3]));
+  EXPECT_TRUE(RanBefore(apps_[2], apps_[4]));
+  EXPECT_EQ(2, install_manager_.max_running());
+}
+
+// The apps remain in Waiting To Install when the work items cannot be queued,
+// and the caller installs them.
+TEST_F(InstallSchedulerTest, QueueUserWorkItemFails) {
+  goopdate_.Stop();
+
+  InstallScheduler scheduler(&install_manager_, 4);
+  AddJob(&scheduler, apps_[0], false, false, false);
+  AddJob(&scheduler, apps_[1], false, false, false);
+  scheduler.Wait();
+
+  EXPECT_EQ(0, install_manager_.num_installs());
+  EXPECT_FALSE(install_manager_.is_locked());
+  EXPECT_EQ(STATE_WAITING_TO_INSTALL, apps_[0]->state());
+  EXPECT_EQ(STATE_WAITING_TO_INSTALL, apps_[1]->state());
+}
+
+TEST_F(InstallSchedulerTest, Add_WaitsInDestructor) {
+  {
+    InstallScheduler scheduler(&install_manager_, 4);
+    scheduler.Add(apps_[0]);
+    scheduler.Add(apps_[1]);
+  }
+
+  ExpectInstalled(apps_[0]);
+  ExpectInstalled(apps_[1]);
+}
+
+}  // namespace omaha
@@ -18,6 +18,7 @@
 #include "omaha/base/const_utils.h"
 #include "omaha/base/debug.h"
 #include "omaha/base/error.h"
+#include "omaha/base/highres_timer-win32.h"
 #include "omaha/base/logging.h"
 #include "omaha/base/path.h"
 #include "omaha/base/process.h"
@@ -122,11 +123,35 @@ void GetSystemErrorString(uint32 error_code,
   ASSERT1(!error_string->IsEmpty());
 }
 
+// Waits up to timeout_ms for a running Windows Installer installation to
+// release the _MSIExecute mutex. Returns true only if the mutex was held and
+// was released before the timeout. Returns false right away if the mutex does
+// not exist, is not held, or cannot be opened.
+bool WaitForMsiIdle(int timeout_ms) {
+  HRESULT hr = WaitForMSIExecute(0);
+  if (hr != HRESULT_FROM_WIN32(ERROR_TIMEOUT)) {
+    if (FAILED(hr)) {
+      CORE_LOG(LW, (_T("[WaitForMSIExecute failed][0x%08x]"), hr));
+    }
+    return false;
+  }
+
+  hr = WaitForMSIExecute(timeout_ms);
+  if (FAILED(hr)) {
+    CORE_LOG(LW, (_T("[WaitForMSIExecute failed][0x%08x]"), hr));
+    if (hr == HRESULT_FROM_WIN32(ERROR_TIMEOUT)) {
+      ++metric_worker_install_msi_queue_timeouts;
+    }
+    return false;
+  }
+
+  return true;
+}
+
 }  // namespace
 
 InstallerWrapper::InstallerWrapper(bool is_machine)
-    : is_machine_(is_machine),
-      num_tries_when_msi_busy_(1) {
+    : is_machine_(is_machine) {
   CORE_LOG(L3, (_T("[InstallerWrapper::InstallerWrapper]")));
 }
 
@@ -134,18 +159,6 @@ InstallerWrapper::~InstallerWrapper() {
   CORE_LOG(L3, (_T("[InstallerWrapper::~InstallerWrapper]")));
 }
 
-HRESULT InstallerWrapper::Initialize() {
-  NamedObjectAttributes lock_attr;
-  // TODO(omaha3): We might want to move this lock to the InstallManager.
-  GetNamedObjectAttributes(kInstallManagerSerializer, is_machine_, &lock_attr);
-  if (!installer_lock_.InitializeWithSecAttr(lock_attr.name, &lock_attr.sa)) {
-    OPT_LOG(LEVEL_ERROR, (_T("[Could not init Install Manager lock]")));
-    return GOOPDATEINSTALL_E_FAILED_INIT_INSTALLER_LOCK;
-  }
-
-  return S_OK;
-}
-
 // result_* will be populated if the installer ran and exited, regardless of the
 // return value.
 // Assumes the call is protected by some mechanism providing exclusive access
@@ -156,6 +169,7 @@ HRESULT InstallerWrapper::InstallApp(HANDLE user_token,
                                    const CString& arguments,
                                    const CString& installer_data,
                                    const CString& language,
+                                   int num_tries_when_msi_busy,
                                    InstallerResultInfo* result_info) {
   ASSERT1(result_info);
 
@@ -165,6 +179,7 @@ HRESULT InstallerWrapper::InstallApp(HANDLE user_token,
                             arguments,
                             installer_data,
                             language,
+                            num_tries_when_msi_busy,
                             result_info);
 
   ASSERT1((SUCCEEDED(hr) && result_info->type == INSTALLER_RESULT_SUCCESS) ||
@@ -237,10 +252,10 @@ CString InstallerWrapper::GetMessageForError(HRESULT error_code,
   return message;
 }
 
-void InstallerWrapper::set_num_tries_when_msi_busy(
-    int num_tries_when_msi_busy) {
-  ASSERT1(num_tries_when_msi_busy >= 1);
-  num_tries_when_msi_busy_ = num_tries_when_msi_busy;
+bool InstallerWrapper::IsMsiInstaller(const CString& installer_path) {
+  const TCHAR* ext = ::PathFindExtension(installer_path);
+  ASSERT1(ext);
+  return *ext != _T('\0') && 0 == lstrcmpi(ext + 1, _T("msi"));
 }
 
 HRESULT InstallerWrapper::BuildCommandLineFromFilename(
@@ -315,9 +330,11 @@ HRESULT InstallerWrapper::BuildCommandLineFromFilename(
   return S_OK;
 }
 
-// Calls DoExecuteAndWaitForInstaller to do the work. If an MSI installer
-// returns, ERROR_INSTALL_ALREADY_RUNNING waits and retries several times or
-// until the installation succeeds.
+// Calls DoExecuteAndWaitForInstaller to do the work. An MSI installer is only
+// started once Windows Installer is idle, for up to the time the retries below
+// would take. If an MSI installer returns ERROR_INSTALL_ALREADY_RUNNING, waits
+// for Windows Installer to be idle again and retries several times or until
+// the installation succeeds.
 HRESULT InstallerWrapper::ExecuteAndWaitForInstaller(
     HANDLE user_token,
     const GUID& app_guid,
@@ -325,31 +342,52 @@ HRESULT InstallerWrapper::ExecuteAndWaitForInstaller(
     const CString& command_line,
     InstallerType installer_type,
     const CString& language,
+    int num_tries_when_msi_busy,
     InstallerResultInfo* result_info) {
   CORE_LOG(L3, (_T("[InstallerWrapper::ExecuteAndWaitForInstaller]")));
   ASSERT1(result_info);
-  ASSERT1(num_tries_when_msi_busy_ >= 1);
+  ASSERT1(num_tries_when_msi_busy >= 1);
 
   ++metric_worker_install_execute_total;
   if (MSI_INSTALLER == installer_type) {
     ++metric_worker_install_execute_msi_total;
   }
 
+  int queued_ms = 0;
+  if (MSI_INSTALLER == installer_type && num_tries_when_msi_busy > 1) {
+    const int queue_timeout_ms = kMsiAlreadyRunningRetryDelayBaseMs *
+                                 ((1 << (num_tries_when_msi_busy - 1)) - 1);
+    HighresTimer queue_timer;
+    WaitForMsiIdle(queue_timeout_ms);
+    queued_ms += static_cast<int>(queue_timer.GetElapsedMs());
+  }
+
   // Run the installer, retrying if necessary.
   int retry_delay = kMsiAlreadyRunningRetryDelayBaseMs;
   int num_tries(0);
   HRESULT hr = GOOPDATEINSTALL_E_MSI_INSTALL_ALREADY_RUNNING;
   for (num_tries = 0;
        hr == GOOPDATEINSTALL_E_MSI_INSTALL_ALREADY_RUNNING &&
-       num_tries < num_tries_when_msi_busy_;
+       num_tries < num_tries_when_msi_busy;
        ++num_tries) {
     // Reset the result info - it contains the previous error when retrying.
     *result_info = InstallerResultInfo();
 
     if (0 < num_tries) {
-      // Retrying - wait between attempts.
+      // Retrying - wait for the running installation to complete, up to the
+      // retry delay. msiexec reports that an installation is running even when
+      // the mutex cannot be waited on, for instance before the mutex is
+      // created, so the whole retry delay is used unless the wait saw the
+      // running installation complete.
       CORE_LOG(L1, (_T("[Retrying][%d]"), num_tries));
-      ::Sleep(retry_delay);
+      HighresTimer retry_timer;
+      const int min_delay_ms = WaitForMsiIdle(retry_delay) ?
+                               kMsiAlreadyRunningMinDelayMs : retry_delay;
+      const int elapsed_ms = static_cast<int>(retry_timer.GetElapsedMs());
+      if (elapsed_ms < min_delay_ms) {
+        ::Sleep(min_delay_ms - elapsed_ms);
+      }
+      queued_ms += static_cast<int>(retry_timer.GetElapsedMs());
       retry_delay *= 2;  // Double the retry delay next time.
     }
 
@@ -375,6 +413,10 @@ HRESULT InstallerWrapper::ExecuteAndWaitForInstaller(
     }
   }
 
+  if (MSI_INSTALLER == installer_type) {
+    metric_worker_install_msi_queued_ms.AddSample(queued_ms);
+  }
+
   if (1 < num_tries) {
     // Record metrics about the ERROR_INSTALL_ALREADY_RUNNING retries.
 // TODO(omaha3): If we're willing to have a single metric for installs and
@@ -657,13 +699,13 @@ HRESULT InstallerWrapper::CheckApplicationRegistration(
   return S_OK;
 }
 
-// Assumes installer_lock_ has been initialized.
 HRESULT InstallerWrapper::DoInstallApp(HANDLE user_token,
                                      const GUID& app_guid,
                                      const CString& installer_path,
                                      const CString& arguments,
                                      const CString& installer_data,
                                      const CString& language,
+                                     int num_tries_when_msi_busy,
                                      InstallerResultInfo* result_info) {
   CORE_LOG(L1, (_T("[InstallerWrapper::DoInstallApp][%s][%s][%s]"),
                GuidToString(app_guid), installer_path, arguments));
@@ -694,17 +736,14 @@ HRESULT InstallerWrapper::DoInstallApp(HANDLE user_token,
     return hr;
   }
 
-  // Acquire the global lock here. This will ensure that we are the only
-  // installer running of the multiple goopdates.
-  __mutexBlock(installer_lock_) {
-    hr = ExecuteAndWaitForInstaller(user_token,
-                                    app_guid,
-                                    executable_path,
-                                    command_line,
-                                    installer_type,
-                                    language,
-                                    result_info);
-  }
+  hr = ExecuteAndWaitForInstaller(user_token,
+                                  app_guid,
+                                  executable_path,
+                                  command_line,
+                                  installer_type,
+                                  language,
+                                  num_tries_when_msi_busy,
+                                  result_info);
 
   if (FAILED(hr)) {
     CORE_LOG(LE, (_T("[ExecuteAndWaitForInstaller failed][0x%08x][%s]"),
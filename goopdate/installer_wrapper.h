@@ -13,8 +13,8 @@
 // limitations under the License.
 // ========================================================================
 //
-// InstallerWrapper supports installing one app at a time. Installs from
-// multiple instances are serialized by a mutex.
+// InstallerWrapper runs the installer of an app. InstallManager serializes the
+// installers across the goopdate instances.
 
 #ifndef OMAHA_GOOPDATE_INSTALLER_WRAPPER_H_
 #define OMAHA_GOOPDATE_INSTALLER_WRAPPER_H_
@@ -41,7 +41,6 @@ class InstallerWrapper {
  public:
   explicit InstallerWrapper(bool is_machine);
   ~InstallerWrapper();
-  HRESULT Initialize();
 
   // Installs the specified app.
   // This is a blocking call. All errors are reported through the return
@@ -51,12 +50,17 @@ class InstallerWrapper {
   //    information and a message for the installer error.
   //  * Other error values: Callers may use GetMessageForError() to convert the
   //    error value to an error message.
+  // An MSI installer is tried up to num_tries_when_msi_busy times when an MSI
+  // install is already running. Each retry waits for the running install to
+  // complete, up to a delay that backs off exponentially from
+  // kMsiAlreadyRunningRetryDelayBaseMs.
   HRESULT InstallApp(HANDLE user_token,
                      const GUID& app_guid,
                      const CString& installer_path,
                      const CString& arguments,
                      const CString& installer_data,
                      const CString& language,
+                     int num_tries_when_msi_busy,
                      InstallerResultInfo* result_info);
 
   // Validate that the installer wrote the client key and the product version.
@@ -71,7 +75,8 @@ class InstallerWrapper {
                                     const CString& installer_filename,
                                     const CString& language);
 
-  void set_num_tries_when_msi_busy(int num_tries_when_msi_busy);
+  // Returns true if the installer file is run by msiexec.
+  static bool IsMsiInstaller(const CString& installer_path);
 
  private:
   // Types of installers that Omaha supports.
@@ -98,6 +103,7 @@ class InstallerWrapper {
                                      const CString& command_line,
                                      InstallerType installer_type,
                                      const CString& language,
+                                     int num_tries_when_msi_busy,
                                      InstallerResultInfo* result_info);
 
   // Executes the installer for ExecuteAndWaitForInstaller.
@@ -133,31 +139,25 @@ class InstallerWrapper {
                        const CString& arguments,
                        const CString& installer_data,
                        const CString& language,
+                       int num_tries_when_msi_busy,
                        InstallerResultInfo* result_info);
 
   // Whether this object is running in a machine Goopdate instance.
   const bool is_machine_;
 
-  // The number of times to try installing an MSI when an MSI install is
-  // already running. There is an exponential backoff starting from
-  // kMsiAlreadyRunningRetryDelayBaseMs.
-  int num_tries_when_msi_busy_;
-
   // This is the base retry delay between retries when msiexec returns
   // ERROR_INSTALL_ALREADY_RUNNING. We exponentially backoff from this value.
   // Note that there is an additional delay for the MSI call, so the tries may
   // be a few seconds further apart.
   static const int kMsiAlreadyRunningRetryDelayBaseMs = 5000;
 
+  // The minimum delay before a retry once the running install has released
+  // the _MSIExecute mutex, which gives msiexec time to finish.
+  static const int kMsiAlreadyRunningMinDelayMs = 500;
+
   // Interval to wait for installer completion.
   static const int kInstallerCompleteIntervalMs = 15 * 60 * 1000;
 
-  // Ensures that a single installer is run by us at a time.
-  // Not sure if we can run installers in different sessions without
-  // interference. In that case we can use a local lock instead of a
-  // global lock.
-  GLock installer_lock_;
-
   friend class InstallerWrapperTest;
 
   DISALLOW_COPY_AND_ASSIGN(InstallerWrapper);
@@ -116,10 +116,6 @@ const int kMsiAlreadyRunningRetryDelayBaseMs = 5000;
 const int kNumMsiTriesDefault = 4;  // Up to 35 seconds.
 const int kNumMsiTriesOnBuildSystem = 7;  // Up to 6.25 minutes.
 
-int GetNumMsiTries() {
-  return IsBuildSystem() ? kNumMsiTriesOnBuildSystem : kNumMsiTriesDefault;
-}
-
 }  // namespace
 
 extern const TCHAR kRegExecutable[] = _T("reg.exe");
@@ -151,9 +147,8 @@ void VerifyStringIsMsiBusyString(const CString& str) {
 
 // Unit tests may run while other updaters are running on the build system.
 // Give the tests lots of time to run to avoid false negatives.
-void AdjustMsiTries(InstallerWrapper* installer_wrapper) {
-  ASSERT1(installer_wrapper);
-  installer_wrapper->set_num_tries_when_msi_busy(GetNumMsiTries());
+int GetNumMsiTries() {
+  return IsBuildSystem() ? kNumMsiTriesOnBuildSystem : kNumMsiTriesDefault;
 }
 
 // Waits for the uninstall to complete to avoid race conditions with other tests
@@ -217,7 +212,6 @@ class InstallerWrapperTest : public testing::Test {
     EXPECT_SUCCEEDED(AppManager::CreateInstance(is_machine_));
 
     im_.reset(new InstallerWrapper(is_machine_));
-    EXPECT_SUCCEEDED(im_->Initialize());
 
     EXPECT_SUCCEEDED(ResourceManager::Create(
           is_machine_, app_util::GetCurrentModuleDirectory(), _T("en")));
@@ -471,6 +465,15 @@ TEST(InstallerWrapperTest, GetMessageForSystemErrorCode) {
       GetMessageForSystemErrorCode(ERROR_INSTALL_PACKAGE_OPEN_FAILED));
 }
 
+TEST(InstallerWrapperTest, IsMsiInstaller) {
+  EXPECT_TRUE(InstallerWrapper::IsMsiInstaller(_T("c:\\dir\\foo.msi")));
+  EXPECT_TRUE(InstallerWrapper::IsMsiInstaller(_T("FOO.MSI")));
+  EXPECT_FALSE(InstallerWrapper::IsMsiInstaller(_T("c:\\dir\\foo.exe")));
+  EXPECT_FALSE(InstallerWrapper::IsMsiInstaller(_T("c:\\dir.msi\\foo")));
+  EXPECT_FALSE(InstallerWrapper::IsMsiInstaller(_T("foo.msix")));
+  EXPECT_FALSE(InstallerWrapper::IsMsiInstaller(_T("")));
+}
+
 // CheckApplicationRegistration does not read the registry. This is verified by
 // not setting any registry values before calling it.
 
@@ -682,6 +685,7 @@ TEST_F(InstallerWrapperUserTest, InstallApp_InstallerWithoutFilenameExtension) {
                             _T(""),  // Arguments.
                             _T(""),  // Installer data.
                             kLanguageEnglish,
+                            1,  // Tries when MSI is busy.
                             &result_info_));
 
   EXPECT_EQ(INSTALLER_RESULT_UNKNOWN, result_info_.type);
@@ -701,6 +705,7 @@ TEST_F(InstallerWrapperUserTest,
                             _T(""),  // Arguments.
                             _T(""),  // Installer data.
                             kLanguageEnglish,
+                            1,  // Tries when MSI is busy.
                             &result_info_));
 
   EXPECT_EQ(INSTALLER_RESULT_UNKNOWN, result_info_.type);
@@ -719,6 +724,7 @@ TEST_F(InstallerWrapperUserTest, InstallApp_InstallerEmtpyFilename) {
                             _T(""),  // Arguments.
                             _T(""),  // Installer data.
                             kLanguageEnglish,
+                            1,  // Tries when MSI is busy.
                             &result_info_));
 
   EXPECT_EQ(INSTALLER_RESULT_UNKNOWN, result_info_.type);
@@ -738,6 +744,7 @@ TEST_F(InstallerWrapperUserTest, InstallApp_ExeFileDoesNotExist) {
                             _T(""),  // Arguments.
                             _T(""),  // Installer data.
                             kLanguageEnglish,
+                            1,  // Tries when MSI is busy.
                             &result_info_));
 
   EXPECT_EQ(INSTALLER_RESULT_UNKNOWN, result_info_.type);
@@ -783,6 +790,7 @@ TEST_F(InstallerWrapperUserTest, InstallApp_ExeInstallerWithArgumentsSucceeds) {
                                    arguments,
                                    _T(""),  // Installer data.
                                    kLanguageEnglish,
+                                   1,  // Tries when MSI is busy.
                                    &result_info_));
 
   EXPECT_EQ(INSTALLER_RESULT_SUCCESS, result_info_.type);
@@ -821,6 +829,7 @@ TEST_F(InstallerWrapperUserTest,
                             arguments,
                             _T(""),  // Installer data.
                             kLanguageEnglish,
+                            1,  // Tries when MSI is busy.
                             &result_info_));
 
   EXPECT_EQ(INSTALLER_RESULT_ERROR_OTHER, result_info_.type);
@@ -890,8 +899,6 @@ TEST_F(InstallerWrapperMachineTest, InstallApp_MsiInstallerSucceeds) {
   // installer.
   RestoreRegistryHives();
 
-  AdjustMsiTries(im_.get());
-
   CString installer_full_path(
       ConcatenatePath(app_util::GetCurrentModuleDirectory(),
                       kSetupFooV1RelativeLocation));
@@ -915,6 +922,7 @@ TEST_F(InstallerWrapperMachineTest, InstallApp_MsiInstallerSucceeds) {
                                    _T(""),  // Arguments.
                                    _T(""),  // Installer data.
                                    kLanguageEnglish,
+                                   GetNumMsiTries(),
                                    &result_info_));
 
   EXPECT_EQ(INSTALLER_RESULT_SUCCESS, result_info_.type);
@@ -953,8 +961,6 @@ TEST_F(InstallerWrapperMachineTest,
   // installer.
   RestoreRegistryHives();
 
-  AdjustMsiTries(im_.get());
-
   CString installer_full_path(
       ConcatenatePath(app_util::GetCurrentModuleDirectory(),
                       kSetupFooV1RelativeLocation));
@@ -978,6 +984,7 @@ TEST_F(InstallerWrapperMachineTest,
                                    kFooInstallerBarPropertyArg,
                                    _T(""),  // Installer data.
                                    kLanguageEnglish,
+                                   GetNumMsiTries(),
                                    &result_info_));
 
   EXPECT_EQ(INSTALLER_RESULT_SUCCESS, result_info_.type);
@@ -1031,6 +1038,7 @@ TEST_F(InstallerWrapperUserTest, InstallApp_UpdateOmahaSucceeds) {
                                    arguments,
                                    _T(""),  // Installer data.
                                    kLanguageEnglish,
+                                   1,  // Tries when MSI is busy.
                                    &result_info_));
 
   EXPECT_EQ(INSTALLER_RESULT_SUCCESS, result_info_.type);
@@ -1066,6 +1074,7 @@ TEST_F(InstallerWrapperUserTest,
                                    arguments,
                                    _T(""),  // Installer data.
                                    kLanguageEnglish,
+                                   1,  // Tries when MSI is busy.
                                    &result_info_));
 
   EXPECT_EQ(INSTALLER_RESULT_SUCCESS, result_info_.type);
@@ -1091,6 +1100,7 @@ TEST_F(InstallerWrapperUserTest, InstallApp_InstallerDoesNotWriteClientsKey) {
                                    arguments,
                                    _T(""),  // Installer data.
                                    kLanguageEnglish,
+                                   1,  // Tries when MSI is busy.
                                    &result_info_));
 
   EXPECT_FALSE(RegKey::HasKey(kFullAppClientsKeyPath));
@@ -1113,8 +1123,6 @@ TEST_F(InstallerWrapperUserTest,
   msi_path.Append(_T("foo.msi"));
   const CString log_path = msi_path + _T(".log");
 
-  AdjustMsiTries(im_.get());
-
   ASSERT_SUCCEEDED(File::Remove(log_path));
   ASSERT_FALSE(File::Exists(log_path));
 
@@ -1126,6 +1134,7 @@ TEST_F(InstallerWrapperUserTest,
                             _T(""),  // Arguments.
                             _T(""),  // Installer data.
                             kLanguageEnglish,
+                            GetNumMsiTries(),
                             &result_info_));
 
   EXPECT_EQ(INSTALLER_RESULT_ERROR_MSI, result_info_.type);
@@ -1168,6 +1177,7 @@ TEST_F(InstallerWrapperUserTest, InstallApp_MsiIsBusy_NoRetries) {
                             arguments,
                             _T(""),  // Installer data.
                             kLanguageEnglish,
+                            1,  // Tries when MSI is busy.
                             &result_info_));
 
   EXPECT_GT(2, install_timer.GetSeconds());  // Check Omaha did not retry.
@@ -1197,8 +1207,6 @@ TEST_F(InstallerWrapperUserTest, InstallApp_MsiIsBusy_TwoTries) {
   CString arguments;
   arguments.Format(kExecuteCommandAndTerminateSwitch, commands);
 
-  im_->set_num_tries_when_msi_busy(2);
-
   LowResTimer install_timer(true);
 
   __mutexScope(AppManager::Instance()->GetRegistryStableStateLock());
@@ -1209,6 +1217,7 @@ TEST_F(InstallerWrapperUserTest, InstallApp_MsiIsBusy_TwoTries) {
                             arguments,
                             _T(""),  // Installer data.
                             kLanguageEnglish,
+                            2,  // Tries when MSI is busy.
                             &result_info_));
 
   EXPECT_LE(5, install_timer.GetSeconds());  // Check Omaha did retry.
@@ -1260,6 +1269,7 @@ TEST_F(InstallerWrapperUserTest, InstallApp_InstallMultipleApps) {
                                    arguments1,
                                    _T(""),  // Installer data.
                                    kLanguageEnglish,
+                                   1,  // Tries when MSI is busy.
                                    &result_info_));
 
   EXPECT_EQ(INSTALLER_RESULT_SUCCESS, result_info_.type);
@@ -1286,6 +1296,7 @@ TEST_F(InstallerWrapperUserTest, InstallApp_InstallMultipleApps) {
                                    arguments2,
                                    _T(""),  // Installer data.
                                    kLanguageEnglish,
+                                   1,  // Tries when MSI is busy.
                                    &result_info_));
 
   EXPECT_EQ(INSTALLER_RESULT_SUCCESS, result_info_.type);
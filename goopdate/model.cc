@@ -22,7 +22,9 @@
 
 namespace omaha {
 
-Model::Model(WorkerModelInterface* worker) : worker_(NULL) {
+Model::Model(WorkerModelInterface* worker)
+    : lock_(_T("Model")),
+      worker_(NULL) {
   CORE_LOG(L3, (_T("[Model::Model]")));
   ASSERT1(worker);
 
@@ -84,86 +86,75 @@ shared_ptr<AppBundle> Model::GetAppBundle(size_t index) const {
   return app_bundles_[index].lock();
 }
 
+// The functions that forward to the worker do not take the model lock. They
+// are called with the bundle lock held, which is below the model lock in the
+// lock hierarchy, and worker_ does not change after construction.
 HRESULT Model::CheckForUpdate(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[Model::CheckForUpdate][0x%p]"), app_bundle));
-
-  __mutexScope(lock_);
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   return worker_->CheckForUpdateAsync(app_bundle);
 }
 
 HRESULT Model::Download(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[Model::Download][0x%p]"), app_bundle));
-
-  __mutexScope(lock_);
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   return worker_->DownloadAsync(app_bundle);
 }
 
 HRESULT Model::DownloadAndInstall(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[Model::DownloadAndInstall][0x%p]"), app_bundle));
-
-  __mutexScope(lock_);
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   return worker_->DownloadAndInstallAsync(app_bundle);
 }
 
 HRESULT Model::UpdateAllApps(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[Model::UpdateAllApps][0x%p]"), app_bundle));
-
-  __mutexScope(lock_);
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   return worker_->UpdateAllAppsAsync(app_bundle);
 }
 
 HRESULT Model::Stop(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[Model::Stop][0x%p]"), app_bundle));
-
-  __mutexScope(lock_);
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   return worker_->Stop(app_bundle);
 }
 
 HRESULT Model::Pause(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[Model::Pause][0x%p]"), app_bundle));
-
-  __mutexScope(lock_);
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   return worker_->Pause(app_bundle);
 }
 
 HRESULT Model::Resume(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[Model::Resume][0x%p]"), app_bundle));
-
-  __mutexScope(lock_);
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   return worker_->Resume(app_bundle);
 }
 
 HRESULT Model::DownloadPackage(Package* package) {
   CORE_LOG(L3, (_T("[Model::DownloadPackage][0x%p]"), package));
-
-  __mutexScope(lock_);
+  ASSERT1(package->IsLockedByCaller());
 
   return worker_->DownloadPackageAsync(package);
 }
 
 HRESULT Model::GetPackage(const Package* package, const CString& dir) const {
-  __mutexScope(lock_);
-
   return worker_->GetPackage(package, dir);
 }
 
 bool Model::IsPackageAvailable(const Package* package) const {
-  __mutexScope(lock_);
-
   return worker_->IsPackageAvailable(package);
 }
 
 HRESULT Model::PurgeAppLowerVersions(const CString& app_id,
                                      const CString& version) const {
-  __mutexScope(lock_);
-
   return worker_->PurgeAppLowerVersions(app_id, version);
 }
 
@@ -26,6 +26,7 @@
 #include <vector>
 #include "base/basictypes.h"
 #include "base/debug.h"
+#include "base/lock_stats.h"
 #include "base/scoped_ptr.h"
 #include "base/synchronized.h"
 #include "omaha/goopdate/app.h"
@@ -44,6 +45,8 @@ class Model {
   explicit Model(WorkerModelInterface* worker);
   virtual ~Model();
 
+  // Protects the list of bundles. The objects in a bundle are protected by the
+  // lock of the bundle. See model_object.h for the lock hierarchy.
   const Lockable& lock() const { return lock_; }
 
   // Returns true if the model lock is held by the calling thread.
@@ -90,8 +93,8 @@ class Model {
  private:
   typedef weak_ptr<AppBundle> AppBundleWeakPtr;
 
-  // Serializes access to the model objects. Consider replacing with SWMR lock.
-  LLock lock_;
+  // Serializes access to app_bundles_.
+  InstrumentedLock<LLock> lock_;
 
   std::vector<AppBundleWeakPtr> app_bundles_;
   WorkerModelInterface* worker_;
@@ -14,24 +14,65 @@
 // ========================================================================
 
 // Defines the base class of classes in the model. Provides access to the root
-// of the model.
+// of the model and to the lock of the bundle the object belongs to.
+//
+// Locking in the model follows this hierarchy. A thread that holds a lock may
+// only acquire the locks below it:
+//   1. Model::lock(). Protects the list of bundles in the model.
+//   2. AppManager::GetRegistryStableStateLock(). Acquired before the bundle
+//      lock when the registry is read or written on behalf of an app.
+//   3. AppBundle::lock(). Protects the bundle and the apps, app versions and
+//      packages in it. Objects in different bundles are independent, so
+//      operations on one bundle do not block operations on the others.
+//   4. The locks internal to AppManager and to the other services the model
+//      objects call into, such as the registry access lock.
+// Model::lock() must not be acquired while holding a bundle lock.
+//
+// The apps, app versions and packages of a bundle are allocated from the arena
+// of the bundle, with new (arena()) T(...), and deleted as usual. Deleting them
+// does not release their memory, which is released at once when the bundle is
+// destroyed. Objects allocated with a plain new use the heap.
 
 #ifndef OMAHA_GOOPDATE_MODEL_OBJECT_H_
 #define OMAHA_GOOPDATE_MODEL_OBJECT_H_
 
 #include <windows.h>
 #include "base/basictypes.h"
+#include "omaha/base/arena.h"
 #include "omaha/base/debug.h"
+#include "omaha/base/synchronized.h"
 #include "omaha/base/utils.h"
 
 namespace omaha {
 
 class Model;
 
-bool IsModelLockedByCaller(const Model* model);
-
 class ModelObject {
  public:
+  static void* operator new(size_t size) {
+    return Allocate(size, NULL);
+  }
+
+  static void* operator new(size_t size, Arena* arena) {
+    ASSERT1(arena);
+    return Allocate(size, arena);
+  }
+
+  static void operator delete(void* p) {
+    if (!p) {
+      return;
+    }
+    char* block = static_cast<char*>(p) - kAllocationHeaderSize;
+    if (!*reinterpret_cast<Arena**>(block)) {
+      delete [] block;
+    }
+  }
+
+  // Called if the constructor of an object allocated from an arena throws.
+  static void operator delete(void* p, Arena* arena) {
+    UNREFERENCED_PARAMETER(arena);
+    operator delete(p);
+  }
 
   Model* model() {
     return omaha::interlocked_exchange_pointer(&model_, model_);
@@ -41,28 +82,79 @@ class ModelObject {
     return omaha::interlocked_exchange_pointer(&model_, model_);
   }
 
+  // Returns the lock of the bundle this object belongs to.
+  const Lockable& lock() const { return *bundle_lock_; }
+
+  // Returns true if the bundle lock is held by the calling thread.
+  bool IsLockedByCaller() const {
+    return ::GetCurrentThreadId() == bundle_lock_->GetOwner();
+  }
+
+  // Returns the arena of the bundle this object belongs to. The arena must
+  // only be used with the bundle lock held.
+  Arena* arena() const {
+    ASSERT1(IsLockedByCaller());
+    return bundle_arena_;
+  }
+
  protected:
 
-  explicit ModelObject(Model* model) : model_(NULL) {
+  // Used by AppBundle, which owns the bundle lock and the bundle arena. They
+  // are not constructed yet when this constructor runs and must not be used
+  // here.
+  ModelObject(Model* model, const LLock* bundle_lock, Arena* bundle_arena)
+      : model_(NULL),
+        bundle_lock_(bundle_lock),
+        bundle_arena_(bundle_arena) {
     ASSERT1(model);
-    ASSERT1(IsModelLockedByCaller(model));
+    ASSERT1(bundle_lock);
+    ASSERT1(bundle_arena);
 
     omaha::interlocked_exchange_pointer(&model_, model);
   }
 
+  // Used by the objects that belong to a bundle. The object shares the model
+  // and the bundle lock of its parent. The caller must hold the bundle lock.
+  explicit ModelObject(const ModelObject* parent)
+      : model_(NULL),
+        bundle_lock_(parent->bundle_lock_),
+        bundle_arena_(parent->bundle_arena_) {
+    ASSERT1(parent->IsLockedByCaller());
+
+    omaha::interlocked_exchange_pointer(&model_, parent->model_);
+  }
+
   ~ModelObject() {
     omaha::interlocked_exchange_pointer(&model_, static_cast<Model*>(NULL));
   }
 
  private:
+  // Precedes each object and records the arena the object is allocated from,
+  // or NULL for the heap. The size keeps the objects aligned.
+  static const size_t kAllocationHeaderSize = Arena::kAlignment;
+
+  static void* Allocate(size_t size, Arena* arena) {
+    COMPILE_ASSERT(kAllocationHeaderSize >= sizeof(Arena*),
+                   header_too_small_for_arena_pointer);
+    const size_t block_size = kAllocationHeaderSize + size;
+    char* block = arena ? static_cast<char*>(arena->Allocate(block_size)) :
+                          new char[block_size];
+    *reinterpret_cast<Arena**>(block) = arena;
+    return block + kAllocationHeaderSize;
+  }
 
   // C++ root of the object model. Not owned by this instance.
   mutable Model* volatile model_;
 
+  // Lock of the bundle this object belongs to. Not owned by this instance.
+  const LLock* const bundle_lock_;
+
+  // Arena of the bundle this object belongs to. Not owned by this instance.
+  Arena* const bundle_arena_;
+
   DISALLOW_COPY_AND_ASSIGN(ModelObject);
 };
 
 }  // namespace omaha
 
 #endif  // OMAHA_GOOPDATE_MODEL_OBJECT_H_
-
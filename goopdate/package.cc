@@ -25,7 +25,7 @@
 namespace omaha {
 
 Package::Package(AppVersion* app_version)
-    : ModelObject(app_version->model()),
+    : ModelObject(app_version),
       app_version_(app_version),
       expected_size_(0),
       bytes_downloaded_(0),
@@ -40,12 +40,12 @@ Package::~Package() {
 }
 
 AppVersion* Package::app_version() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return app_version_;
 }
 
 const AppVersion* Package::app_version() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return app_version_;
 }
 
@@ -60,7 +60,7 @@ STDMETHODIMP Package::get_isAvailable(VARIANT_BOOL* is_available) const {
 }
 
 STDMETHODIMP Package::get_filename(BSTR* filename_as_bstr) const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(filename_as_bstr);
   *filename_as_bstr = CComBSTR(filename()).Detach();
   return S_OK;
@@ -73,7 +73,7 @@ void Package::OnProgress(int bytes,
                          int bytes_total,
                          int status,
                          const TCHAR* status_text) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   UNREFERENCED_PARAMETER(status);
   UNREFERENCED_PARAMETER(status_text);
@@ -107,7 +107,7 @@ void Package::OnProgress(int bytes,
 }
 
 void Package::OnRequestBegin() {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   next_download_retry_time_ = 0;
   bytes_downloaded_ = 0;
   bytes_total_ = 0;
@@ -115,7 +115,7 @@ void Package::OnRequestBegin() {
 }
 
 void Package::OnRequestRetryScheduled(time64 next_download_retry_time) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(next_download_retry_time >= GetCurrent100NSTime());
   next_download_retry_time_ = next_download_retry_time;
 }
@@ -123,7 +123,7 @@ void Package::OnRequestRetryScheduled(time64 next_download_retry_time) {
 void Package::SetFileInfo(const CString& filename,
                           uint64 size,
                           const CString& hash) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   ASSERT1(!filename.IsEmpty());
   ASSERT1(0 < size);
@@ -135,34 +135,34 @@ void Package::SetFileInfo(const CString& filename,
 }
 
 CString Package::filename() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(!filename_.IsEmpty());
   return filename_;
 }
 
 uint64 Package::expected_size() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return expected_size_;
 }
 
 CString Package::expected_hash() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   ASSERT1(!expected_hash_.IsEmpty());
   return expected_hash_;
 }
 
 uint64 Package::bytes_downloaded() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return bytes_downloaded_;
 }
 
 time64 Package::next_download_retry_time() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return next_download_retry_time_;
 }
 
 LONG Package::GetEstimatedRemainingDownloadTimeMs() const {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
 
   const LONG kUnknownRemainingTime = -1;
 
@@ -189,17 +189,17 @@ LONG Package::GetEstimatedRemainingDownloadTimeMs() const {
 }
 
 STDMETHODIMP PackageWrapper::get(BSTR dir) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get(dir);
 }
 
 STDMETHODIMP PackageWrapper::get_isAvailable(VARIANT_BOOL* is_available) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_isAvailable(is_available);
 }
 
 STDMETHODIMP PackageWrapper::get_filename(BSTR* filename) {
-  __mutexScope(model()->lock());
+  __mutexScope(lock());
   return wrapped_obj()->get_filename(filename);
 }
 
@@ -15,8 +15,8 @@
 
 // Defines the Package COM object exposed by the model.
 
-// TODO(omaha3): Protect all public members with the model lock and assert in
-// all non-public members that the model has been locked by the caller.
+// TODO(omaha3): Protect all public members with the bundle lock and assert in
+// all non-public members that the bundle has been locked by the caller.
 
 #ifndef OMAHA_GOOPDATE_PACKAGE_H_
 #define OMAHA_GOOPDATE_PACKAGE_H_
@@ -22,6 +22,7 @@
 #include "omaha/base/path.h"
 #include "omaha/base/string.h"
 #include "omaha/base/signatures.h"
+#include "omaha/base/tracing.h"
 #include "omaha/base/utils.h"
 #include "omaha/common/config_manager.h"
 #include "omaha/goopdate/package_cache_internal.h"
@@ -190,6 +191,7 @@ bool PackageCache::IsCached(const Key& key, const CString& hash) const {
 HRESULT PackageCache::Put(const Key& key,
                           const CString& source_file,
                           const CString& hash) {
+  ScopedTraceSpan span("package_cache", "Put");
   ++metric_worker_package_cache_put_total;
   CORE_LOG(L3, (_T("[PackageCache::Put][key '%s'][source_file '%s'][hash %s]"),
                 key.ToString(), source_file, hash));
@@ -242,6 +244,7 @@ HRESULT PackageCache::Put(const Key& key,
 HRESULT PackageCache::Get(const Key& key,
                           const CString& destination_file,
                           const CString& hash) const {
+  ScopedTraceSpan span("package_cache", "Get");
   CORE_LOG(L3, (_T("[PackageCache::Get][key '%s'][dest file '%s'][hash '%s']"),
                 key.ToString(), destination_file, hash));
 
@@ -484,8 +487,10 @@ HRESULT PackageCache::AuthenticateFile(const CString& filename,
   std::vector<CString> files;
   files.push_back(filename);
   HRESULT hr = AuthenticateFiles(files, hash);
+  const int elapsed_ms = static_cast<int>(authentication_timer.GetElapsedMs());
+  metric_worker_package_authentication_ms.AddSample(elapsed_ms);
   CORE_LOG(L3, (_T("[PackageCache::AuthenticateFile completed][0x%08x][%d ms]"),
-                hr, authentication_timer.GetElapsedMs()));
+                hr, elapsed_ms));
 
   return hr;
 }
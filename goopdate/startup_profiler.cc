@@ -0,0 +1,93 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/goopdate/startup_profiler.h"
+#include "omaha/base/debug.h"
+#include "omaha/base/safe_format.h"
+#include "omaha/base/tracing.h"
+
+namespace omaha {
+
+StartupProfiler::StartupProfiler()
+    : num_phases_(0),
+      is_phase_open_(false) {
+  ::ZeroMemory(phases_, sizeof(phases_));
+}
+
+void StartupProfiler::StartPhase(const char* name) {
+  ASSERT1(name);
+
+  EndPhase();
+  if (num_phases_ == kMaxPhases) {
+    return;
+  }
+
+  Phase& phase = phases_[num_phases_];
+  phase.name = name;
+  phase.begin_ticks = HighresTimer::GetCurrentTicks();
+  phase.end_ticks = phase.begin_ticks;
+  is_phase_open_ = true;
+}
+
+void StartupProfiler::EndPhase() {
+  if (!is_phase_open_) {
+    return;
+  }
+
+  Phase& phase = phases_[num_phases_++];
+  phase.end_ticks = HighresTimer::GetCurrentTicks();
+  is_phase_open_ = false;
+
+  if (Tracer::IsEnabled()) {
+    TraceEvent event = {"startup",
+                        phase.name,
+                        NULL,
+                        0,
+                        phase.begin_ticks,
+                        phase.end_ticks,
+                        ::GetCurrentThreadId()};
+    Tracer::AddEvent(event);
+  }
+}
+
+const char* StartupProfiler::phase_name(int index) const {
+  ASSERT1(0 <= index && index < num_phases_);
+  return phases_[index].name;
+}
+
+int StartupProfiler::phase_ms(int index) const {
+  ASSERT1(0 <= index && index < num_phases_);
+  return TicksToMs(phases_[index].end_ticks - phases_[index].begin_ticks);
+}
+
+int StartupProfiler::GetTotalMs() const {
+  return static_cast<int>(timer_.GetElapsedMs());
+}
+
+CString StartupProfiler::ToString() const {
+  CString phases;
+  for (int i = 0; i != num_phases_; ++i) {
+    SafeCStringAppendFormat(&phases, _T("[%s %d]"),
+                            CString(phase_name(i)), phase_ms(i));
+  }
+  return phases;
+}
+
+int StartupProfiler::TicksToMs(ULONGLONG ticks) {
+  const ULONGLONG freq = HighresTimer::GetTimerFrequency();
+  return freq ? static_cast<int>((ticks * 1000 + freq / 2) / freq) : 0;
+}
+
+}  // namespace omaha
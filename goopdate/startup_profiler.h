@@ -0,0 +1,77 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+// StartupProfiler measures the cost of each step of the process startup, such
+// as installing the crash handler or loading the resources. The updater
+// starts many short-lived processes, for which the startup is a large part of
+// the run time.
+//
+// The phases are sequential: starting a phase ends the previous one. Each
+// phase is also recorded as a trace span when tracing is enabled.
+
+#ifndef OMAHA_GOOPDATE_STARTUP_PROFILER_H_
+#define OMAHA_GOOPDATE_STARTUP_PROFILER_H_
+
+#include <windows.h>
+#include <atlstr.h>
+#include "base/basictypes.h"
+#include "omaha/base/highres_timer-win32.h"
+
+namespace omaha {
+
+class StartupProfiler {
+ public:
+  static const int kMaxPhases = 16;
+
+  // The profiler starts measuring the total startup time when constructed.
+  StartupProfiler();
+
+  // Ends the current phase, if any, and starts a new phase. The name must be
+  // a string literal. Phases beyond kMaxPhases are not recorded.
+  void StartPhase(const char* name);
+
+  // Ends the current phase, if any.
+  void EndPhase();
+
+  int num_phases() const { return num_phases_; }
+  const char* phase_name(int index) const;
+  int phase_ms(int index) const;
+
+  // Returns the time since construction.
+  int GetTotalMs() const;
+
+  // Returns the phases formatted as "[name ms]" for logging.
+  CString ToString() const;
+
+ private:
+  struct Phase {
+    const char* name;
+    ULONGLONG begin_ticks;
+    ULONGLONG end_ticks;
+  };
+
+  static int TicksToMs(ULONGLONG ticks);
+
+  HighresTimer timer_;
+  Phase phases_[kMaxPhases];
+  int num_phases_;
+  bool is_phase_open_;
+
+  DISALLOW_COPY_AND_ASSIGN(StartupProfiler);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_GOOPDATE_STARTUP_PROFILER_H_
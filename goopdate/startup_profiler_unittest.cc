@@ -0,0 +1,83 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <vector>
+#include "omaha/base/tracing.h"
+#include "omaha/goopdate/startup_profiler.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+TEST(StartupProfilerTest, NoPhases) {
+  StartupProfiler profiler;
+  profiler.EndPhase();
+  EXPECT_EQ(0, profiler.num_phases());
+  EXPECT_STREQ(_T(""), profiler.ToString());
+  EXPECT_LE(0, profiler.GetTotalMs());
+}
+
+TEST(StartupProfilerTest, Phases) {
+  StartupProfiler profiler;
+  profiler.StartPhase("first");
+  ::Sleep(20);
+  profiler.StartPhase("second");
+  EXPECT_EQ(1, profiler.num_phases());
+  profiler.EndPhase();
+  profiler.EndPhase();
+
+  ASSERT_EQ(2, profiler.num_phases());
+  EXPECT_STREQ("first", profiler.phase_name(0));
+  EXPECT_STREQ("second", profiler.phase_name(1));
+
+  // Sleep may return early by up to a timer tick.
+  EXPECT_LE(10, profiler.phase_ms(0));
+  EXPECT_LE(0, profiler.phase_ms(1));
+  EXPECT_LE(profiler.phase_ms(0) + profiler.phase_ms(1),
+            profiler.GetTotalMs() + 1);
+
+  CString expected;
+  expected.Format(_T("[first %d][second %d]"),
+                  profiler.phase_ms(0), profiler.phase_ms(1));
+  EXPECT_STREQ(expected, profiler.ToString());
+}
+
+TEST(StartupProfilerTest, TooManyPhases) {
+  StartupProfiler profiler;
+  for (int i = 0; i != StartupProfiler::kMaxPhases + 2; ++i) {
+    profiler.StartPhase("phase");
+  }
+  profiler.EndPhase();
+  EXPECT_EQ(StartupProfiler::kMaxPhases, profiler.num_phases());
+}
+
+TEST(StartupProfilerTest, RecordsTraceSpans) {
+  Tracer::Clear();
+  Tracer::Enable(Tracer::kDefaultEventsPerThread);
+
+  StartupProfiler profiler;
+  profiler.StartPhase("traced");
+  profiler.EndPhase();
+
+  std::vector<TraceEvent> events;
+  Tracer::GetEvents(&events);
+  Tracer::Disable();
+  Tracer::Clear();
+
+  ASSERT_EQ(1, events.size());
+  EXPECT_STREQ("startup", events[0].category);
+  EXPECT_STREQ("traced", events[0].name);
+}
+
+}  // namespace omaha
@@ -160,7 +160,7 @@ TEST_F(UpdateRequestUtilsTest,
   RegKey key;
   ASSERT_SUCCEEDED(key.Create(kAppId1ClientStateKeyPathUser));
   ASSERT_SUCCEEDED(key.SetValue(kAppDidRunValueName, _T("1")));
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   AppManager::Instance()->ReadAppPersistentData(app_);
 
   BuildRequest(app_, false, update_request_.get());
@@ -185,7 +185,7 @@ TEST_F(UpdateRequestUtilsTest,
   RegKey key;
   ASSERT_SUCCEEDED(key.Create(kAppId1ClientStateKeyPathUser));
   ASSERT_SUCCEEDED(key.SetValue(kAppDidRunValueName, _T("1")));
-  __mutexScope(app_->model()->lock());
+  __mutexScope(app_->lock());
   AppManager::Instance()->ReadAppPersistentData(app_);
 
   BuildRequest(app_, true, update_request_.get());
@@ -23,6 +23,7 @@
 #include "omaha/base/error.h"
 #include "omaha/base/file.h"
 #include "omaha/base/firewall_product_detection.h"
+#include "omaha/base/highres_timer-win32.h"
 #include "omaha/base/logging.h"
 #include "omaha/base/path.h"
 #include "omaha/base/reactor.h"
@@ -31,6 +32,7 @@
 #include "omaha/base/system.h"
 #include "omaha/base/utils.h"
 #include "omaha/base/thread_pool_callback.h"
+#include "omaha/base/tracing.h"
 #include "omaha/base/vistautil.h"
 #include "omaha/common/app_registry_utils.h"
 #include "omaha/common/config_manager.h"
@@ -41,9 +43,12 @@
 #include "omaha/common/update_response.h"
 #include "omaha/common/web_services_client.h"
 #include "omaha/goopdate/app_manager.h"
+#include "omaha/goopdate/app_registry_snapshot.h"
 #include "omaha/goopdate/download_manager.h"
+#include "omaha/goopdate/download_pipeline.h"
 #include "omaha/goopdate/goopdate.h"
 #include "omaha/goopdate/install_manager.h"
+#include "omaha/goopdate/install_scheduler.h"
 #include "omaha/goopdate/model.h"
 #include "omaha/goopdate/offline_utils.h"
 #include "omaha/goopdate/server_resource.h"
@@ -55,6 +60,21 @@
 
 namespace omaha {
 
+namespace {
+
+// The work items of the bundles a user waits for run ahead of the automatic
+// update checks.
+ThreadPool::Priority GetWorkItemPriority(const AppBundle* app_bundle) {
+  ASSERT1(app_bundle);
+  if (app_bundle->priority() >= INSTALL_PRIORITY_HIGH) {
+    return ThreadPool::PRIORITY_HIGH;
+  }
+  return app_bundle->is_auto_update() ? ThreadPool::PRIORITY_LOW :
+                                        ThreadPool::PRIORITY_NORMAL;
+}
+
+}  // namespace
+
 namespace internal {
 
 void RecordUpdateAvailableUsageStats() {
@@ -281,7 +301,7 @@ HRESULT Worker::Initialize(bool is_machine) {
     return hr;
   }
 
-  install_manager_.reset(new InstallManager(&model_->lock(), is_machine_));
+  install_manager_.reset(new InstallManager(is_machine_));
   hr = install_manager_->Initialize();
   if (FAILED(hr)) {
     return hr;
@@ -358,7 +378,7 @@ HRESULT Worker::CheckForUpdateAsync(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[Worker::CheckForUpdateAsync][0x%p]"), app_bundle));
 
   ASSERT1(app_bundle);
-  ASSERT1(model_->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   HRESULT hr = QueueDeferredFunctionCall0(app_bundle, &Worker::CheckForUpdate);
   if (FAILED(hr)) {
@@ -378,7 +398,7 @@ void Worker::CheckForUpdate(shared_ptr<AppBundle> app_bundle) {
   ASSERT1(app_bundle.get());
 
   bool is_check_successful = false;
-  CheckForUpdateHelper(app_bundle.get(), &is_check_successful);
+  CheckForUpdateHelper(app_bundle.get(), NULL, &is_check_successful);
 
   app_bundle->CompleteAsyncCall();
 }
@@ -388,11 +408,15 @@ void Worker::CheckForUpdate(shared_ptr<AppBundle> app_bundle) {
 // but an invalid response, such as HTML from a proxy, should result in false.
 // TODO(omaha): Unit test this by mocking update_check_client.
 void Worker::CheckForUpdateHelper(AppBundle* app_bundle,
+                                  DownloadPipeline* download_pipeline,
                                   bool* is_check_successful) {
   ASSERT1(app_bundle);
   ASSERT1(is_check_successful);
   *is_check_successful = false;
 
+  ScopedTraceSpan span("worker", "CheckForUpdate");
+  span.set_arg("num_apps", app_bundle->GetNumberOfApps());
+
   if (ConfigManager::Instance()->CanUseNetwork(is_machine_)) {
     VERIFY1(SUCCEEDED(internal::SendOemInstalledPing(
         is_machine_, app_bundle->session_id())));
@@ -428,11 +452,12 @@ void Worker::CheckForUpdateHelper(AppBundle* app_bundle,
   }
   *is_check_successful = SUCCEEDED(hr);
 
-  CallAsSelfAndImpersonate3(this,
+  CallAsSelfAndImpersonate4(this,
                             &Worker::DoPostUpdateCheck,
                             app_bundle,
                             hr,
-                            update_response.get());
+                            update_response.get(),
+                            download_pipeline);
 
   CString event_description;
   event_description.Format(_T("Update check. Status = 0x%08x"), hr);
@@ -453,7 +478,7 @@ HRESULT Worker::DownloadAsync(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[Worker::DownloadAsync][0x%p]"), app_bundle));
 
   ASSERT1(app_bundle);
-  ASSERT1(model_->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   HRESULT hr = QueueDeferredFunctionCall0(app_bundle, &Worker::Download);
   if (FAILED(hr)) {
@@ -507,7 +532,7 @@ HRESULT Worker::DownloadAndInstallAsync(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[Worker::DownloadAndInstallAsync][0x%p]"), app_bundle));
 
   ASSERT1(app_bundle);
-  ASSERT1(model_->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   HRESULT hr = QueueDeferredFunctionCall0(app_bundle,
                                           &Worker::DownloadAndInstall);
@@ -530,12 +555,13 @@ void Worker::DownloadAndInstall(shared_ptr<AppBundle> app_bundle) {
   CORE_LOG(L3, (_T("[Worker::DownloadAndInstall][0x%p]"), app_bundle.get()));
   ASSERT1(app_bundle.get());
 
-  DownloadAndInstallHelper(app_bundle.get());
+  DownloadAndInstallHelper(app_bundle.get(), NULL);
 
   app_bundle->CompleteAsyncCall();
 }
 
-void Worker::DownloadAndInstallHelper(AppBundle* app_bundle) {
+void Worker::DownloadAndInstallHelper(AppBundle* app_bundle,
+                                      DownloadPipeline* download_pipeline) {
   ASSERT1(app_bundle);
 
   scoped_impersonation impersonate_user(app_bundle->impersonation_token());
@@ -547,9 +573,23 @@ void Worker::DownloadAndInstallHelper(AppBundle* app_bundle) {
 
   const size_t num_apps = app_bundle->GetNumberOfApps();
 
+  // The installers run while the next apps are downloaded. Apps are installed
+  // one at a time, in order, when parallel installs are disabled.
+  const int max_parallel_installs =
+      ConfigManager::Instance()->GetMaxParallelInstalls();
+  InstallScheduler install_scheduler(install_manager_.get(),
+                                     max_parallel_installs);
+
   for (size_t i = 0; i != num_apps; ++i) {
     App* app = app_bundle->GetApp(i);
 
+    // The app is installed as soon as its own download completes, while the
+    // pipeline downloads the next apps.
+    if (download_pipeline && app->is_download_pipelined()) {
+      download_pipeline->WaitForApp(app);
+      app->QueueDownloadOrInstall();
+    }
+
     ASSERT1(app->state() == STATE_WAITING_TO_DOWNLOAD ||
             app->state() == STATE_WAITING_TO_INSTALL ||
             app->state() == STATE_NO_UPDATE ||
@@ -566,6 +606,12 @@ void Worker::DownloadAndInstallHelper(AppBundle* app_bundle) {
 
     app->QueueInstall();
 
+    if (max_parallel_installs > 1 &&
+        app->state() == STATE_WAITING_TO_INSTALL) {
+      install_scheduler.Add(app);
+      continue;
+    }
+
     // This is a blocking call on the app installer.
     CallAsSelfAndImpersonate1(
         app,
@@ -577,6 +623,24 @@ void Worker::DownloadAndInstallHelper(AppBundle* app_bundle) {
             app->state() == STATE_ERROR);
   }
 
+  install_scheduler.Wait();
+
+  // Installs the apps the scheduler could not start.
+  for (size_t i = 0; i != num_apps; ++i) {
+    App* app = app_bundle->GetApp(i);
+    if (app->state() != STATE_WAITING_TO_INSTALL) {
+      continue;
+    }
+
+    CallAsSelfAndImpersonate1(
+        app,
+        &App::Install,
+        install_manager_.get());
+
+    ASSERT1(app->state() == STATE_INSTALL_COMPLETE ||
+            app->state() == STATE_ERROR);
+  }
+
   WriteEventLog(EVENTLOG_INFORMATION_TYPE,
                 kUpdateEventId,
                 _T("Application update/install"),
@@ -588,7 +652,7 @@ HRESULT Worker::UpdateAllAppsAsync(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[Worker::UpdateAllAppsAsync][0x%p]"), app_bundle));
 
   ASSERT1(app_bundle);
-  ASSERT1(model_->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   HRESULT hr = QueueDeferredFunctionCall0(app_bundle, &Worker::UpdateAllApps);
   if (FAILED(hr)) {
@@ -608,8 +672,15 @@ void Worker::UpdateAllApps(shared_ptr<AppBundle> app_bundle) {
   CORE_LOG(L3, (_T("[Worker::UpdateAllApps][0x%p]"), app_bundle.get()));
   ASSERT1(app_bundle.get());
 
+  // Downloads start while the update check response is being processed for
+  // the remaining apps. The apps in the pipeline are queued for install by
+  // DownloadAndInstallHelper() as their downloads complete.
+  DownloadPipeline download_pipeline(download_manager_.get(),
+                                     app_bundle->impersonation_token());
   bool is_check_successful = false;
-  CheckForUpdateHelper(app_bundle.get(), &is_check_successful);
+  CheckForUpdateHelper(app_bundle.get(),
+                       &download_pipeline,
+                       &is_check_successful);
 
   if (is_check_successful) {
     HRESULT hr = goopdate_utils::UpdateLastChecked(is_machine_);
@@ -618,10 +689,24 @@ void Worker::UpdateAllApps(shared_ptr<AppBundle> app_bundle) {
 
   for (size_t i = 0; i != app_bundle->GetNumberOfApps(); ++i) {
     App* app = app_bundle->GetApp(i);
-    app->QueueDownloadOrInstall();
+    if (!app->is_download_pipelined()) {
+      app->QueueDownloadOrInstall();
+    }
   }
 
-  DownloadAndInstallHelper(app_bundle.get());
+  DownloadAndInstallHelper(app_bundle.get(), &download_pipeline);
+  download_pipeline.Wait();
+
+  // The registry snapshot is not needed past this point. The following reads
+  // the uninstalled apps directly from the registry.
+  __mutexBlock(app_bundle->lock()) {
+    AppRegistrySnapshot* registry_snapshot = app_bundle->registry_snapshot();
+    if (registry_snapshot) {
+      VERIFY1(SUCCEEDED(AppManager::Instance()->FlushRegistrySnapshot(
+          registry_snapshot)));
+      app_bundle->set_registry_snapshot(NULL);
+    }
+  }
 
   internal::RecordUpdateAvailableUsageStats();
   CollectAmbientUsageStats();
@@ -639,7 +724,7 @@ HRESULT Worker::DownloadPackageAsync(Package* package) {
   AppBundle* app_bundle = package->app_version()->app()->app_bundle();
   ASSERT1(app_bundle);
 
-  ASSERT1(model_->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   CORE_LOG(L3, (_T("[Worker::DownloadPackageAsync][0x%p][0x%p]"),
       app_bundle, package));
@@ -698,7 +783,7 @@ HRESULT Worker::Stop(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[Worker::Stop][0x%p]"), app_bundle));
 
   ASSERT1(app_bundle);
-  ASSERT1(model_->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
 
   // Cancels update check client but not the ping client since we need to send
   // cancellation ping.
@@ -724,7 +809,7 @@ HRESULT Worker::Stop(AppBundle* app_bundle) {
 HRESULT Worker::Pause(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[Worker::Pause][0x%p]"), app_bundle));
   ASSERT1(app_bundle);
-  ASSERT1(model_->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
   UNREFERENCED_PARAMETER(app_bundle);
 
   return E_NOTIMPL;
@@ -733,7 +818,7 @@ HRESULT Worker::Pause(AppBundle* app_bundle) {
 HRESULT Worker::Resume(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[Worker::Resume][0x%p]"), app_bundle));
   ASSERT1(app_bundle);
-  ASSERT1(model_->IsLockedByCaller());
+  ASSERT1(app_bundle->IsLockedByCaller());
   UNREFERENCED_PARAMETER(app_bundle);
 
   return E_NOTIMPL;
@@ -741,13 +826,13 @@ HRESULT Worker::Resume(AppBundle* app_bundle) {
 
 HRESULT Worker::GetPackage(const Package* package, const CString& dir) {
   CORE_LOG(L3, (_T("[Worker::GetPackage]")));
-  ASSERT1(model_->IsLockedByCaller());
+  ASSERT1(package->IsLockedByCaller());
   return download_manager_->GetPackage(package, dir);
 }
 
 bool Worker::IsPackageAvailable(const Package* package) const {
   CORE_LOG(L3, (_T("[Worker::IsPackageAvailable]")));
-  ASSERT1(model_->IsLockedByCaller());
+  ASSERT1(package->IsLockedByCaller());
   return download_manager_->IsPackageAvailable(package);
 }
 
@@ -865,6 +950,7 @@ HRESULT Worker::DoUpdateCheck(AppBundle* app_bundle,
   }
 
   // This is a blocking call on the network.
+  HighresTimer update_check_timer;
   HRESULT hr = app_bundle->update_check_client()->Send(update_request,
                                                        update_response);
   if (FAILED(hr)) {
@@ -884,6 +970,8 @@ HRESULT Worker::DoUpdateCheck(AppBundle* app_bundle,
 
   if (is_update) {
     ++metric_worker_update_check_succeeded;
+    metric_worker_update_check_succeeded_ms.AddSample(
+        update_check_timer.GetElapsedMs());
   }
 
   return S_OK;
@@ -891,7 +979,8 @@ HRESULT Worker::DoUpdateCheck(AppBundle* app_bundle,
 
 void Worker::DoPostUpdateCheck(AppBundle* app_bundle,
                                HRESULT update_check_result,
-                               xml::UpdateResponse* update_response) {
+                               xml::UpdateResponse* update_response,
+                               DownloadPipeline* download_pipeline) {
   ASSERT1(app_bundle);
   ASSERT1(update_response);
 
@@ -907,12 +996,31 @@ void Worker::DoPostUpdateCheck(AppBundle* app_bundle,
            app->state() == STATE_NO_UPDATE ||
            app->state() == STATE_ERROR,
            (_T("App %Iu state is %u"), i, app->state()));
+
+    // Offline installs copy the packages to the cache below instead.
+    if (download_pipeline &&
+        !app_bundle->is_offline_install() &&
+        app->state() == STATE_UPDATE_AVAILABLE) {
+      HRESULT hr = download_pipeline->Add(app);
+      if (FAILED(hr)) {
+        CORE_LOG(LW, (_T("[DownloadPipeline::Add failed][0x%08x]"), hr));
+      }
+    }
   }
 
   if (app_bundle->is_offline_install()) {
     VERIFY1(SUCCEEDED(CacheOfflinePackages(app_bundle)));
     VERIFY1(SUCCEEDED(DeleteDirectory(app_bundle->offline_dir())));
   }
+
+  // Write the values the update check modified in the bundle's registry
+  // snapshot back to the registry in one pass.
+  __mutexScope(app_bundle->lock());
+  AppRegistrySnapshot* registry_snapshot = app_bundle->registry_snapshot();
+  if (registry_snapshot) {
+    VERIFY1(SUCCEEDED(AppManager::Instance()->FlushRegistrySnapshot(
+        registry_snapshot)));
+  }
 }
 
 // Creates a thread pool work item for deferred execution of deferred_function.
@@ -927,8 +1035,9 @@ HRESULT Worker::QueueDeferredFunctionCall0(
   scoped_ptr<Callback> callback(new Callback(this,
                                              deferred_function,
                                              app_bundle->controlling_ptr()));
-  HRESULT hr = Goopdate::Instance().QueueUserWorkItem(callback.get(),
-                                                      WT_EXECUTELONGFUNCTION);
+  HRESULT hr = Goopdate::Instance().QueueUserWorkItem(
+      callback.get(),
+      GetWorkItemPriority(app_bundle));
   if (FAILED(hr)) {
     return hr;
   }
@@ -953,8 +1062,9 @@ HRESULT Worker::QueueDeferredFunctionCall1(
                                              deferred_function,
                                              app_bundle->controlling_ptr(),
                                              p1));
-  HRESULT hr = Goopdate::Instance().QueueUserWorkItem(callback.get(),
-                                                      WT_EXECUTELONGFUNCTION);
+  HRESULT hr = Goopdate::Instance().QueueUserWorkItem(
+      callback.get(),
+      GetWorkItemPriority(app_bundle));
   if (FAILED(hr)) {
     return hr;
   }
@@ -37,6 +37,7 @@ class UpdateResponse;
 
 class AppBundle;
 class DownloadManagerInterface;
+class DownloadPipeline;
 class InstallManagerInterface;
 class Model;
 class Package;
@@ -138,8 +139,17 @@ class Worker : public WorkerModelInterface, public ShutdownCallback {
 
   // These functions do the work for the corresponding functions but do not call
   // CompleteAsyncCall().
-  void CheckForUpdateHelper(AppBundle* app_bundle, bool* is_check_successful);
-  void DownloadAndInstallHelper(AppBundle* app_bundle);
+  //
+  // If download_pipeline is not NULL, the download of each app that has an
+  // update starts as soon as the app has processed the update check response.
+  // DownloadAndInstallHelper() waits for the download of each pipelined app
+  // before it queues the app for install. The caller must not use those apps
+  // before then.
+  void CheckForUpdateHelper(AppBundle* app_bundle,
+                            DownloadPipeline* download_pipeline,
+                            bool* is_check_successful);
+  void DownloadAndInstallHelper(AppBundle* app_bundle,
+                                DownloadPipeline* download_pipeline);
 
   // Stops and destroys the Worker and its members.
   // TODO(omaha): rename this as it overloads WorkerModelInterface::Stop.
@@ -159,7 +169,8 @@ class Worker : public WorkerModelInterface, public ShutdownCallback {
                         xml::UpdateResponse* update_response);
   void DoPostUpdateCheck(AppBundle* app_bundle,
                          HRESULT update_check_result,
-                         xml::UpdateResponse* update_response);
+                         xml::UpdateResponse* update_response,
+                         DownloadPipeline* download_pipeline);
 
   HRESULT QueueDeferredFunctionCall0(
       AppBundle* app_bundle,
@@ -190,6 +201,7 @@ class Worker : public WorkerModelInterface, public ShutdownCallback {
   static Worker* instance_;
 
   friend class WorkerTest;
+  friend class WorkerLoadTest;
 
   DISALLOW_COPY_AND_ASSIGN(Worker);
 };
@@ -0,0 +1,434 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+// Load tests for the Worker and the Model/AppBundle/App state machine. The
+// tests drive concurrent bundles through update check, download and install
+// using fake network, download and install managers, so the measurements only
+// include the cost of the state machine, the thread pool and the bundle locks.
+//
+// The tests report the bundle throughput, the bundle latency percentiles, and
+// the wait and hold times of the bundle locks as seen by the COM clients that
+// poll the bundles, followed by the lock statistics of the instrumented locks
+// as seen by all threads. The soak test only runs as a large test.
+
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+#include "base/scoped_ptr.h"
+#include "omaha/base/app_util.h"
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/lock_stats.h"
+#include "omaha/common/install_manifest.h"
+#include "omaha/common/protocol_definition.h"
+#include "omaha/common/update_request.h"
+#include "omaha/common/update_response.h"
+#include "omaha/common/web_services_client.h"
+#include "omaha/goopdate/app_manager.h"
+#include "omaha/goopdate/download_manager.h"
+#include "omaha/goopdate/goopdate.h"
+#include "omaha/goopdate/install_manager.h"
+#include "omaha/goopdate/installer_result_info.h"
+#include "omaha/goopdate/model.h"
+#include "omaha/goopdate/resource_manager.h"
+#include "omaha/goopdate/worker.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+// The same apps as in worker_unittest.cc. The update response utilities assert
+// on app ids they do not expect.
+const TCHAR* const kGuid1 = _T("{ADDE8406-A0F3-4AC2-8878-ADC0BD37BD86}");
+const TCHAR* const kGuid2 = _T("{D0AB2EBC-931B-4013-9FEB-C9C4C2225C8C}");
+
+const TCHAR* const kResponseStatusOk = _T("ok");
+const TCHAR* const kUpdateVersion = _T("1.2.3.4");
+const int kHttpStatusOk = 200;
+
+// How often the clients poll the bundles.
+const int kPollPeriodMs = 1;
+
+// How long a bundle may take to complete before the test fails.
+const int kBundleTimeoutMs = 60 * 1000;
+
+// Responds to every app in the request with an update and no packages.
+class FakeWebServicesClient : public WebServicesClientInterface {
+ public:
+  FakeWebServicesClient() {}
+
+  virtual HRESULT Send(const xml::UpdateRequest* update_request,
+                       xml::UpdateResponse* update_response) {
+    ASSERT1(update_request);
+    ASSERT1(update_response);
+
+    xml::response::Response response;
+    response.protocol = _T("3.0");
+    const std::vector<xml::request::App>& apps(update_request->request().apps);
+    for (size_t i = 0; i != apps.size(); ++i) {
+      xml::response::App app;
+      app.status = kResponseStatusOk;
+      app.appid = apps[i].app_id;
+      app.update_check.status = kResponseStatusOk;
+      app.update_check.install_manifest.version = kUpdateVersion;
+      response.apps.push_back(app);
+    }
+    SetResponseForUnitTest(update_response, response);
+    return S_OK;
+  }
+
+  virtual HRESULT SendString(const CString* request_string,
+                             xml::UpdateResponse* update_response) {
+    UNREFERENCED_PARAMETER(request_string);
+    UNREFERENCED_PARAMETER(update_response);
+    return E_NOTIMPL;
+  }
+
+  virtual void Cancel() {}
+  virtual void set_proxy_auth_config(const ProxyAuthConfig& config) {
+    UNREFERENCED_PARAMETER(config);
+  }
+  virtual bool is_http_success() const { return true; }
+  virtual int http_status_code() const { return kHttpStatusOk; }
+  virtual CString http_trace() const { return CString(); }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(FakeWebServicesClient);
+};
+
+// Moves the apps through the download states without downloading anything.
+class FakeDownloadManager : public DownloadManagerInterface {
+ public:
+  FakeDownloadManager() {}
+
+  virtual HRESULT Initialize() { return S_OK; }
+  virtual HRESULT PurgeAppLowerVersions(const CString& app_id,
+                                        const CString& version) {
+    UNREFERENCED_PARAMETER(app_id);
+    UNREFERENCED_PARAMETER(version);
+    return S_OK;
+  }
+  virtual HRESULT CachePackage(const Package* package,
+                               const CString* filename_path) {
+    UNREFERENCED_PARAMETER(package);
+    UNREFERENCED_PARAMETER(filename_path);
+    return S_OK;
+  }
+  virtual HRESULT DownloadApp(App* app) {
+    ASSERT1(app);
+    app->Downloading();
+    app->DownloadComplete();
+    app->MarkReadyToInstall();
+    return S_OK;
+  }
+  virtual HRESULT DownloadPackage(Package* package) {
+    UNREFERENCED_PARAMETER(package);
+    return S_OK;
+  }
+  virtual HRESULT GetPackage(const Package* package,
+                             const CString& dir) const {
+    UNREFERENCED_PARAMETER(package);
+    UNREFERENCED_PARAMETER(dir);
+    return S_OK;
+  }
+  virtual void Cancel(App* app) { UNREFERENCED_PARAMETER(app); }
+  virtual void CancelAll() {}
+  virtual bool IsBusy() const { return false; }
+  virtual bool IsPackageAvailable(const Package* package) const {
+    UNREFERENCED_PARAMETER(package);
+    return true;
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(FakeDownloadManager);
+};
+
+// Moves the apps through the install states without running any installer.
+class FakeInstallManager : public InstallManagerInterface {
+ public:
+  FakeInstallManager() : install_working_dir_(app_util::GetTempDir()) {}
+
+  virtual HRESULT Initialize() { return S_OK; }
+  virtual CString install_working_dir() const { return install_working_dir_; }
+  virtual void InstallApp(App* app, const CString& dir) {
+    ASSERT1(app);
+    UNREFERENCED_PARAMETER(dir);
+
+    app->Installing();
+
+    AppManager& app_manager = *AppManager::Instance();
+    __mutexScope(app_manager.GetRegistryStableStateLock());
+
+    InstallerResultInfo result_info;
+    result_info.type = INSTALLER_RESULT_SUCCESS;
+    result_info.text = _T("success");
+    app->ReportInstallerComplete(result_info);
+  }
+
+  virtual void LockInstallers() {}
+  virtual void UnlockInstallers() {}
+
+ private:
+  const CString install_working_dir_;
+
+  DISALLOW_COPY_AND_ASSIGN(FakeInstallManager);
+};
+
+// Collects durations, in microseconds, and reports their distribution.
+class Samples {
+ public:
+  Samples() {}
+
+  void Add(ULONGLONG ticks) {
+    samples_.push_back(ticks * 1000000 / HighresTimer::GetTimerFrequency());
+  }
+
+  size_t size() const { return samples_.size(); }
+
+  // Returns the smallest sample that is greater than or equal to the given
+  // percentage of the samples.
+  ULONGLONG GetPercentile(int percentile) {
+    ASSERT1(percentile >= 0 && percentile <= 100);
+    if (samples_.empty()) {
+      return 0;
+    }
+    std::sort(samples_.begin(), samples_.end());
+    size_t index = samples_.size() * percentile / 100;
+    return samples_[std::min(index, samples_.size() - 1)];
+  }
+
+  void Print(const char* name) {
+    printf("  %-16s n=%-6Iu p50=%-7I64u p90=%-7I64u p99=%-7I64u max=%I64u us\n",
+           name,
+           samples_.size(),
+           GetPercentile(50),
+           GetPercentile(90),
+           GetPercentile(99),
+           GetPercentile(100));
+  }
+
+ private:
+  std::vector<ULONGLONG> samples_;
+
+  DISALLOW_COPY_AND_ASSIGN(Samples);
+};
+
+}  // namespace
+
+// All tests use a user instance of the Worker.
+class WorkerLoadTest : public testing::Test {
+ protected:
+  // The steps a bundle goes through. Each step is started by the client and
+  // completes when the bundle is no longer busy.
+  enum Step {
+    STEP_CHECK_FOR_UPDATE,
+    STEP_INSTALL,
+    STEP_DONE
+  };
+
+  struct BundleRun {
+    BundleRun() : step(STEP_CHECK_FOR_UPDATE) {}
+
+    shared_ptr<AppBundle> app_bundle;
+    Step step;
+    HighresTimer timer;
+  };
+
+  WorkerLoadTest()
+      : is_machine_(false), goopdate_(is_machine_), worker_(NULL) {}
+
+  virtual void SetUp() {
+    worker_ = &Worker::Instance();
+    worker_->Initialize(is_machine_);
+
+    EXPECT_SUCCEEDED(ResourceManager::Create(
+      is_machine_, app_util::GetCurrentModuleDirectory(), _T("en")));
+
+    // The Worker takes ownership of the managers.
+    worker_->download_manager_.reset(new FakeDownloadManager);
+    worker_->install_manager_.reset(new FakeInstallManager);
+
+    LockStats::Clear();
+    LockStats::Enable(NULL);
+  }
+
+  virtual void TearDown() {
+    LockStats::Disable();
+    LockStats::Clear();
+
+    worker_ = NULL;
+    Worker::DeleteInstance();
+    ResourceManager::Delete();
+  }
+
+  shared_ptr<AppBundle> CreateBundle(int num_apps) {
+    shared_ptr<AppBundle> app_bundle(
+        worker_->model()->CreateAppBundle(is_machine_));
+    EXPECT_TRUE(app_bundle.get());
+
+    EXPECT_SUCCEEDED(app_bundle->put_displayName(CComBSTR(_T("Load Bundle"))));
+    EXPECT_SUCCEEDED(app_bundle->put_displayLanguage(CComBSTR(_T("en"))));
+    EXPECT_SUCCEEDED(app_bundle->initialize());
+
+    // The bundle takes ownership.
+    app_bundle->update_check_client_.reset(new FakeWebServicesClient);
+
+    const TCHAR* const app_ids[] = {kGuid1, kGuid2};
+    for (int i = 0; i < num_apps; ++i) {
+      App* app = NULL;
+      EXPECT_SUCCEEDED(app_bundle->createApp(
+          CComBSTR(app_ids[i % arraysize(app_ids)]), &app));
+      EXPECT_SUCCEEDED(app->put_isEulaAccepted(VARIANT_TRUE));
+    }
+
+    return app_bundle;
+  }
+
+  // Acquires the bundle lock and records how long the caller waited for it.
+  void LockBundle(const BundleRun& run) {
+    HighresTimer timer;
+    run.app_bundle->lock().Lock();
+    lock_wait_.Add(timer.GetElapsedTicks());
+  }
+
+  void UnlockBundle(const BundleRun& run) {
+    run.app_bundle->lock().Unlock();
+  }
+
+  // Starts the next step of the bundle. The bundle lock is held across the COM
+  // call, so the time the call takes is the time the lock is held for.
+  void StartStep(BundleRun* run) {
+    LockBundle(*run);
+    HighresTimer timer;
+    HRESULT hr = run->step == STEP_CHECK_FOR_UPDATE ?
+                 run->app_bundle->checkForUpdate() :
+                 run->app_bundle->install();
+    lock_hold_.Add(timer.GetElapsedTicks());
+    UnlockBundle(*run);
+    EXPECT_SUCCEEDED(hr);
+  }
+
+  // Drives num_bundles bundles, all in flight at the same time, from a single
+  // client thread that polls each bundle in turn, the same as many on-demand
+  // clients polling for progress. Returns the elapsed time in milliseconds.
+  ULONGLONG RunBundles(int num_bundles, int num_apps) {
+    std::vector<BundleRun> runs(num_bundles);
+    for (int i = 0; i < num_bundles; ++i) {
+      runs[i].app_bundle = CreateBundle(num_apps);
+    }
+
+    HighresTimer elapsed;
+    for (size_t i = 0; i != runs.size(); ++i) {
+      runs[i].timer.Start();
+      StartStep(&runs[i]);
+    }
+
+    int num_done = 0;
+    while (num_done < num_bundles) {
+      if (elapsed.GetElapsedMs() > kBundleTimeoutMs) {
+        ADD_FAILURE() << _T("Timed out waiting for the bundles to complete.");
+        break;
+      }
+
+      ::Sleep(kPollPeriodMs);
+
+      for (size_t i = 0; i != runs.size(); ++i) {
+        BundleRun& run = runs[i];
+        if (run.step == STEP_DONE) {
+          continue;
+        }
+
+        LockBundle(run);
+        bool is_busy = run.app_bundle->IsBusy();
+        UnlockBundle(run);
+        if (is_busy) {
+          continue;
+        }
+
+        if (run.step == STEP_CHECK_FOR_UPDATE) {
+          check_latency_.Add(run.timer.GetElapsedTicks());
+          run.step = STEP_INSTALL;
+          StartStep(&run);
+        } else {
+          bundle_latency_.Add(run.timer.GetElapsedTicks());
+          run.step = STEP_DONE;
+          ++num_done;
+        }
+      }
+    }
+    const ULONGLONG elapsed_ms = elapsed.GetElapsedMs();
+
+    for (size_t i = 0; i != runs.size(); ++i) {
+      AppBundle* app_bundle = runs[i].app_bundle.get();
+      for (size_t j = 0; j != app_bundle->GetNumberOfApps(); ++j) {
+        EXPECT_EQ(STATE_INSTALL_COMPLETE, app_bundle->GetApp(j)->state());
+      }
+    }
+
+    return elapsed_ms;
+  }
+
+  void Report(int num_bundles, int num_apps, ULONGLONG elapsed_ms) {
+    printf("\n%d bundles of %d apps in %I64u ms, %.1f bundles/s\n",
+           num_bundles,
+           num_apps,
+           elapsed_ms,
+           elapsed_ms ? num_bundles * 1000.0 / elapsed_ms : 0.0);
+    check_latency_.Print("check latency");
+    bundle_latency_.Print("bundle latency");
+    lock_wait_.Print("bundle lock wait");
+    lock_hold_.Print("bundle lock hold");
+
+    CString lock_stats;
+    LockStats::Dump(&lock_stats);
+    printf("%S", lock_stats.GetString());
+  }
+
+  void RunAndReport(int num_bundles, int num_apps) {
+    ULONGLONG elapsed_ms = RunBundles(num_bundles, num_apps);
+    EXPECT_EQ(static_cast<size_t>(num_bundles), bundle_latency_.size());
+    Report(num_bundles, num_apps, elapsed_ms);
+  }
+
+  const bool is_machine_;
+  Goopdate goopdate_;
+  Worker* worker_;
+
+  Samples check_latency_;
+  Samples bundle_latency_;
+  Samples lock_wait_;
+  Samples lock_hold_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(WorkerLoadTest);
+};
+
+TEST_F(WorkerLoadTest, SingleBundle) {
+  RunAndReport(1, 2);
+}
+
+TEST_F(WorkerLoadTest, ConcurrentBundles) {
+  RunAndReport(20, 2);
+}
+
+TEST_F(WorkerLoadTest, Soak) {
+  if (!ShouldRunLargeTest()) {
+    return;
+  }
+
+  RunAndReport(500, 2);
+}
+
+}  // namespace omaha
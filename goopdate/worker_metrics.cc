@@ -20,9 +20,11 @@ namespace omaha {
 
 DEFINE_METRIC_count(worker_download_total);
 DEFINE_METRIC_count(worker_download_succeeded);
+DEFINE_METRIC_histogram(worker_download_succeeded_ms);
 
 DEFINE_METRIC_count(worker_package_cache_put_total);
 DEFINE_METRIC_count(worker_package_cache_put_succeeded);
+DEFINE_METRIC_histogram(worker_package_authentication_ms);
 
 DEFINE_METRIC_count(worker_install_execute_total);
 DEFINE_METRIC_count(worker_install_execute_msi_total);
@@ -37,6 +39,9 @@ DEFINE_METRIC_count(worker_install_msi_in_progress_retry_succeeded_install);
 DEFINE_METRIC_integer(
     worker_install_msi_in_progress_retry_succeeded_tries_install);
 
+DEFINE_METRIC_histogram(worker_install_msi_queued_ms);
+DEFINE_METRIC_count(worker_install_msi_queue_timeouts);
+
 DEFINE_METRIC_integer(worker_shell_version);
 
 DEFINE_METRIC_bool(worker_is_windows_installing);
@@ -51,6 +56,7 @@ DEFINE_METRIC_count(worker_silent_update_running_on_batteries);
 
 DEFINE_METRIC_count(worker_update_check_total);
 DEFINE_METRIC_count(worker_update_check_succeeded);
+DEFINE_METRIC_histogram(worker_update_check_succeeded_ms);
 
 DEFINE_METRIC_integer(worker_apps_not_updated_eula);
 DEFINE_METRIC_integer(worker_apps_not_updated_group_policy);
@@ -74,4 +80,8 @@ DEFINE_METRIC_integer(worker_app_max_update_responses_ms_since_first);
 DEFINE_METRIC_timing(ping_failed_ms);
 DEFINE_METRIC_timing(ping_succeeded_ms);
 
+DEFINE_METRIC_count(worker_bundle_objects_allocated);
+DEFINE_METRIC_count(worker_bundle_arena_blocks);
+DEFINE_METRIC_histogram(worker_bundle_arena_bytes);
+
 }  // namespace omaha
@@ -26,6 +26,8 @@ namespace omaha {
 DECLARE_METRIC_count(worker_download_total);
 // How many times the download manager successfully downloaded a file.
 DECLARE_METRIC_count(worker_download_succeeded);
+// Time (ms) to successfully download all the packages of an app.
+DECLARE_METRIC_histogram(worker_download_succeeded_ms);
 
 // How many times the package cache attempted to put the temporary file
 // to the cache directory.
@@ -33,6 +35,8 @@ DECLARE_METRIC_count(worker_package_cache_put_total);
 // How many times the package cache successfully copied the temporary file
 // to the cache directory.
 DECLARE_METRIC_count(worker_package_cache_put_succeeded);
+// Time (ms) to authenticate a file in the package cache.
+DECLARE_METRIC_histogram(worker_package_authentication_ms);
 
 // How many times ExecuteAndWaitForInstaller was called.
 DECLARE_METRIC_count(worker_install_execute_total);
@@ -61,6 +65,11 @@ DECLARE_METRIC_count(worker_install_msi_in_progress_retry_succeeded_install);
 DECLARE_METRIC_integer(
     worker_install_msi_in_progress_retry_succeeded_tries_install);
 
+// Time (ms) an MSI install waited for other MSI installs to complete.
+DECLARE_METRIC_histogram(worker_install_msi_queued_ms);
+// How many times the wait for other MSI installs to complete timed out.
+DECLARE_METRIC_count(worker_install_msi_queue_timeouts);
+
 // Version of the GoogleUpdate.exe shell in use.
 DECLARE_METRIC_integer(worker_shell_version);
 
@@ -84,6 +93,8 @@ DECLARE_METRIC_count(worker_silent_update_running_on_batteries);
 DECLARE_METRIC_count(worker_update_check_total);
 // How many times an update check succeeded. Does not include installs.
 DECLARE_METRIC_count(worker_update_check_succeeded);
+// Time (ms) a successful update check took. Does not include installs.
+DECLARE_METRIC_histogram(worker_update_check_succeeded_ms);
 
 // Number of apps for which update checks skipped because EULA is not accepted.
 DECLARE_METRIC_integer(worker_apps_not_updated_eula);
@@ -136,6 +147,13 @@ DECLARE_METRIC_timing(ping_failed_ms);
 // Time (ms) spent in SendPing() when the ping succeeds.
 DECLARE_METRIC_timing(ping_succeeded_ms);
 
+// How many apps, app versions and packages were allocated from bundle arenas.
+DECLARE_METRIC_count(worker_bundle_objects_allocated);
+// How many heap blocks the bundle arenas allocated for these objects.
+DECLARE_METRIC_count(worker_bundle_arena_blocks);
+// Bytes reserved by the arena of a bundle.
+DECLARE_METRIC_histogram(worker_bundle_arena_bytes);
+
 }  // namespace omaha
 
 #endif  // OMAHA_GOOPDATE_WORKER_METRICS_H__
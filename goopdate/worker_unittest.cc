@@ -140,6 +140,10 @@ class MockInstallManager : public InstallManagerInterface {
       CString());
   MOCK_METHOD2(InstallApp,
       void(App* app, const CString& dir));
+  MOCK_METHOD0(LockInstallers,
+      void());
+  MOCK_METHOD0(UnlockInstallers,
+      void());
 };
 
 ACTION(SimulateDownloadAppStateTransition) {
@@ -348,7 +352,7 @@ TEST_F(WorkerMockedManagersTest, CheckForUpdateAsync) {
   EXPECT_CALL(*mock_web_services_client_, Send(_, _))
       .Times(1);
 
-  __mutexBlock(worker_->model()->lock()) {
+  __mutexBlock(app_bundle_->lock()) {
     EXPECT_SUCCEEDED(worker_->CheckForUpdateAsync(app_bundle_.get()));
 
     EXPECT_EQ(STATE_WAITING_TO_CHECK_FOR_UPDATE, app1_->state());
@@ -381,7 +385,7 @@ TEST_F(WorkerMockedManagersTest, DownloadAsync) {
 
   // Holding the lock prevents the state from changing in the other thread,
   // ensuring consistent results.
-  __mutexBlock(worker_->model()->lock()) {
+  __mutexBlock(app_bundle_->lock()) {
     EXPECT_SUCCEEDED(worker_->DownloadAsync(app_bundle_.get()));
 
     EXPECT_EQ(STATE_WAITING_TO_DOWNLOAD, app1_->state());
@@ -412,7 +416,7 @@ TEST_F(WorkerMockedManagersTest, DownloadAndInstallAsync_AlreadyDownloaded) {
         .WillOnce(SimulateInstallAppStateTransition());
   }
 
-  __mutexBlock(worker_->model()->lock()) {
+  __mutexBlock(app_bundle_->lock()) {
     EXPECT_SUCCEEDED(worker_->DownloadAndInstallAsync(app_bundle_.get()));
 
     EXPECT_EQ(STATE_WAITING_TO_INSTALL, app1_->state());
@@ -447,7 +451,7 @@ TEST_F(WorkerMockedManagersTest, DownloadAndInstallAsync_NotAlreadyDownloaded) {
         .WillOnce(SimulateInstallAppStateTransition());
   }
 
-  __mutexBlock(worker_->model()->lock()) {
+  __mutexBlock(app_bundle_->lock()) {
     EXPECT_SUCCEEDED(worker_->DownloadAndInstallAsync(app_bundle_.get()));
 
     EXPECT_EQ(STATE_WAITING_TO_DOWNLOAD, app1_->state());
@@ -475,7 +479,7 @@ TEST_F(WorkerMockedManagersTest, DownloadAsync_Then_DownloadAndInstallAsync) {
         .WillOnce(SimulateDownloadAppStateTransition());
   }
 
-  __mutexBlock(worker_->model()->lock()) {
+  __mutexBlock(app_bundle_->lock()) {
     EXPECT_SUCCEEDED(worker_->DownloadAsync(app_bundle_.get()));
 
     EXPECT_EQ(STATE_WAITING_TO_DOWNLOAD, app1_->state());
@@ -500,7 +504,7 @@ TEST_F(WorkerMockedManagersTest, DownloadAsync_Then_DownloadAndInstallAsync) {
     EXPECT_CALL(*mock_install_manager_, InstallApp(app2_, _))
         .WillOnce(SimulateInstallAppStateTransition());
   }
-  __mutexBlock(worker_->model()->lock()) {
+  __mutexBlock(app_bundle_->lock()) {
     EXPECT_SUCCEEDED(worker_->DownloadAndInstallAsync(app_bundle_.get()));
 
     EXPECT_EQ(STATE_WAITING_TO_INSTALL, app1_->state());
@@ -520,7 +524,7 @@ TEST_F(WorkerMockedManagersTest, UpdateAllAppsAsync) {
   EXPECT_CALL(*mock_web_services_client_, Send(_, _))
       .Times(1);
 
-  __mutexBlock(worker_->model()->lock()) {
+  __mutexBlock(app_bundle_->lock()) {
     EXPECT_SUCCEEDED(worker_->UpdateAllAppsAsync(app_bundle_.get()));
 
     EXPECT_EQ(STATE_WAITING_TO_CHECK_FOR_UPDATE, app1_->state());
@@ -550,7 +554,7 @@ TEST_F(WorkerMockedManagersTest, UpdateAllAppsAsync) {
 //
 
 TEST_F(WorkerWithTwoAppsTest, CheckForUpdateAsync_Large) {
-  __mutexBlock(worker_->model()->lock()) {
+  __mutexBlock(app_bundle_->lock()) {
     EXPECT_SUCCEEDED(worker_->CheckForUpdateAsync(app_bundle_.get()));
 
     EXPECT_EQ(STATE_WAITING_TO_CHECK_FOR_UPDATE, app1_->state());
@@ -570,7 +574,7 @@ TEST_F(WorkerWithTwoAppsTest,
        DownloadAsyncThenDownloadAndInstallAsync_Large) {
   // Update Check: Request then wait for it to complete in the thread pool.
 
-  __mutexBlock(worker_->model()->lock()) {
+  __mutexBlock(app_bundle_->lock()) {
     EXPECT_SUCCEEDED(worker_->CheckForUpdateAsync(app_bundle_.get()));
 
     EXPECT_EQ(STATE_WAITING_TO_CHECK_FOR_UPDATE, app1_->state());
@@ -587,7 +591,7 @@ TEST_F(WorkerWithTwoAppsTest,
 
   // Download: Request then wait for it to complete in the thread pool.
 
-  __mutexBlock(worker_->model()->lock()) {
+  __mutexBlock(app_bundle_->lock()) {
     EXPECT_SUCCEEDED(worker_->DownloadAsync(app_bundle_.get()));
 
     EXPECT_EQ(STATE_WAITING_TO_DOWNLOAD, app1_->state());
@@ -608,7 +612,7 @@ TEST_F(WorkerWithTwoAppsTest,
   // GUID(s), and enable the code below. Be sure to uninstall the app when done.
 #if 0
 
-  __mutexBlock(worker_->model()->lock()) {
+  __mutexBlock(app_bundle_->lock()) {
     EXPECT_SUCCEEDED(worker_->DownloadAndInstallAsync(app_bundle_.get()));
 
     EXPECT_EQ(STATE_WAITING_TO_INSTALL, app1_->state());
@@ -628,7 +632,7 @@ TEST_F(WorkerWithTwoAppsTest,
 TEST_F(WorkerWithTwoAppsTest, DownloadAndInstallAsyncWithoutDownload_Large) {
   // Update Check: Request then wait for it to complete in the thread pool.
 
-  __mutexBlock(worker_->model()->lock()) {
+  __mutexBlock(app_bundle_->lock()) {
     EXPECT_SUCCEEDED(worker_->CheckForUpdateAsync(app_bundle_.get()));
 
     EXPECT_EQ(STATE_WAITING_TO_CHECK_FOR_UPDATE, app1_->state());
@@ -648,7 +652,7 @@ TEST_F(WorkerWithTwoAppsTest, DownloadAndInstallAsyncWithoutDownload_Large) {
   // TODO(omaha): Make User Foo installer available from production, change
   // GUID(s), and enable the code below. Be sure to uninstall the app when done.
 #if 0
-  __mutexBlock(worker_->model()->lock()) {
+  __mutexBlock(app_bundle_->lock()) {
     EXPECT_SUCCEEDED(worker_->DownloadAndInstallAsync(app_bundle_.get()));
 
     EXPECT_EQ(STATE_WAITING_TO_DOWNLOAD, app1_->state());
@@ -667,7 +671,7 @@ TEST_F(WorkerWithTwoAppsTest, DownloadAndInstallAsyncWithoutDownload_Large) {
 
 // Also tests cancellation of a bundle during the update check phase.
 TEST_F(WorkerWithTwoAppsTest, UpdateAllAppsAsync_Large) {
-  __mutexBlock(worker_->model()->lock()) {
+  __mutexBlock(app_bundle_->lock()) {
     EXPECT_SUCCEEDED(worker_->UpdateAllAppsAsync(app_bundle_.get()));
 
     EXPECT_EQ(STATE_WAITING_TO_CHECK_FOR_UPDATE, app1_->state());
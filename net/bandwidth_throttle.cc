@@ -0,0 +1,110 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/net/bandwidth_throttle.h"
+#include <algorithm>
+#include <climits>
+#include "omaha/base/debug.h"
+#include "omaha/base/logging.h"
+
+namespace omaha {
+
+BandwidthThrottle::BandwidthThrottle()
+    : max_bytes_per_sec_(0),
+      num_foreground_transfers_(0) {
+}
+
+void BandwidthThrottle::set_max_bytes_per_sec(int max_bytes_per_sec) {
+  ASSERT1(max_bytes_per_sec >= 0);
+  __mutexScope(lock_);
+  max_bytes_per_sec_ = std::max(max_bytes_per_sec, 0);
+}
+
+int BandwidthThrottle::max_bytes_per_sec() const {
+  __mutexScope(lock_);
+  return max_bytes_per_sec_;
+}
+
+void BandwidthThrottle::BeginForegroundTransfer() {
+  __mutexScope(lock_);
+  ++num_foreground_transfers_;
+}
+
+void BandwidthThrottle::EndForegroundTransfer() {
+  __mutexScope(lock_);
+  ASSERT1(num_foreground_transfers_ > 0);
+  if (num_foreground_transfers_ > 0) {
+    --num_foreground_transfers_;
+  }
+}
+
+int BandwidthThrottle::Consume(int priority, int num_bytes) {
+  return ConsumeAt(priority, num_bytes, ::GetTickCount());
+}
+
+int BandwidthThrottle::ConsumeAt(int priority, int num_bytes, DWORD now_ms) {
+  ASSERT1(priority >= 0 && priority < kForegroundPriority);
+  ASSERT1(num_bytes >= 0);
+  priority = std::min(std::max(priority, 0), kForegroundPriority - 1);
+
+  __mutexScope(lock_);
+
+  const int bytes_per_sec = GetBytesPerSec(priority);
+  Bucket& bucket = buckets_[priority];
+  if (!bytes_per_sec) {
+    bucket.is_initialized = false;
+    return 0;
+  }
+
+  // A bucket holds at most one second worth of data, which bounds the burst
+  // after the transfer has been idle.
+  if (!bucket.is_initialized) {
+    bucket.tokens = bytes_per_sec;
+    bucket.is_initialized = true;
+  } else {
+    // The unsigned subtraction handles the tick count wrapping around.
+    const DWORD elapsed_ms = now_ms - bucket.last_refill_ms;
+    bucket.tokens = std::min(
+        bucket.tokens + static_cast<double>(bytes_per_sec) * elapsed_ms / 1000,
+        static_cast<double>(bytes_per_sec));
+  }
+  bucket.last_refill_ms = now_ms;
+  bucket.tokens -= num_bytes;
+
+  if (bucket.tokens >= 0) {
+    return 0;
+  }
+
+  const double wait_ms = -bucket.tokens * 1000 / bytes_per_sec;
+  return static_cast<int>(std::min(wait_ms + 1, static_cast<double>(INT_MAX)));
+}
+
+int BandwidthThrottle::GetBytesPerSec(int priority) const {
+  int bytes_per_sec = max_bytes_per_sec_;
+  if (num_foreground_transfers_) {
+    bytes_per_sec = bytes_per_sec ? std::min(bytes_per_sec, kYieldBytesPerSec) :
+                                    kYieldBytesPerSec;
+  }
+  if (!bytes_per_sec) {
+    return 0;
+  }
+
+  const int64 scaled_bytes_per_sec =
+      static_cast<int64>(bytes_per_sec) * (priority + 1);
+  return static_cast<int>(std::min(scaled_bytes_per_sec,
+                                   static_cast<int64>(INT_MAX)));
+}
+
+}  // namespace omaha
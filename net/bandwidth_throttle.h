@@ -0,0 +1,92 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+// BandwidthThrottle limits the rate at which background transfers receive
+// data, independently of BITS, so that many clients updating in the background
+// do not saturate a shared link. It is a token bucket per transfer priority.
+//
+// The priority of a background transfer is the priority of the app bundle it
+// belongs to, from 0 (INSTALL_PRIORITY_LOW) to kForegroundPriority, exclusive.
+// A transfer of priority p may receive (p + 1) times the configured rate.
+// Background transfers also yield to foreground transfers: while any
+// foreground transfer runs, the rate of the lowest priority is reduced to at
+// most kYieldBytesPerSec, even when no rate is configured.
+//
+// The class is thread safe. Http requests use the process instance returned by
+// NetworkConfigManager::bandwidth_throttle().
+
+#ifndef OMAHA_NET_BANDWIDTH_THROTTLE_H_
+#define OMAHA_NET_BANDWIDTH_THROTTLE_H_
+
+#include <windows.h>
+#include <map>
+#include "base/basictypes.h"
+#include "omaha/base/synchronized.h"
+
+namespace omaha {
+
+class BandwidthThrottle {
+ public:
+  BandwidthThrottle();
+
+  // Sets the rate, in bytes per second, for background transfers of the
+  // lowest priority. Zero means the rate is not limited.
+  void set_max_bytes_per_sec(int max_bytes_per_sec);
+  int max_bytes_per_sec() const;
+
+  // Called around each foreground transfer. The calls may be nested.
+  void BeginForegroundTransfer();
+  void EndForegroundTransfer();
+
+  // Accounts for num_bytes received by a background transfer of the given
+  // priority. Returns how long the transfer should wait, in milliseconds,
+  // before receiving more data. Callers may wait in shorter intervals, calling
+  // Consume with zero bytes to get the remaining wait, which changes as
+  // foreground transfers start and end.
+  int Consume(int priority, int num_bytes);
+
+  static const int kForegroundPriority = 10;          // INSTALL_PRIORITY_HIGH.
+  static const int kYieldBytesPerSec = 32 * 1024;     // 32 KB/s.
+
+ private:
+  struct Bucket {
+    Bucket() : tokens(0), last_refill_ms(0), is_initialized(false) {}
+
+    // The bytes that can be received without waiting. It is negative when the
+    // transfer received more than its rate allows.
+    double tokens;
+    DWORD last_refill_ms;
+    bool is_initialized;
+  };
+
+  int ConsumeAt(int priority, int num_bytes, DWORD now_ms);
+
+  // Returns the rate for the priority, or zero if the rate is not limited.
+  // Must be called with lock_ held.
+  int GetBytesPerSec(int priority) const;
+
+  int max_bytes_per_sec_;
+  int num_foreground_transfers_;
+  std::map<int, Bucket> buckets_;
+
+  LLock lock_;
+
+  friend class BandwidthThrottleTest;
+  DISALLOW_COPY_AND_ASSIGN(BandwidthThrottle);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_NET_BANDWIDTH_THROTTLE_H_
@@ -0,0 +1,109 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/net/bandwidth_throttle.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+class BandwidthThrottleTest : public testing::Test {
+ protected:
+  int ConsumeAt(int priority, int num_bytes, DWORD now_ms) {
+    return throttle_.ConsumeAt(priority, num_bytes, now_ms);
+  }
+
+  BandwidthThrottle throttle_;
+};
+
+TEST_F(BandwidthThrottleTest, NotLimited) {
+  EXPECT_EQ(0, throttle_.max_bytes_per_sec());
+  EXPECT_EQ(0, ConsumeAt(0, 100 * 1024 * 1024, 1000));
+  EXPECT_EQ(0, ConsumeAt(0, 100 * 1024 * 1024, 1000));
+}
+
+TEST_F(BandwidthThrottleTest, Limited) {
+  throttle_.set_max_bytes_per_sec(1000);
+
+  // The first second worth of data is not delayed.
+  EXPECT_EQ(0, ConsumeAt(0, 1000, 1000));
+
+  // Half a second later, 500 bytes are available.
+  EXPECT_EQ(0, ConsumeAt(0, 500, 1500));
+  EXPECT_EQ(1001, ConsumeAt(0, 1000, 1500));
+
+  // The remaining wait shrinks as time passes.
+  EXPECT_EQ(501, ConsumeAt(0, 0, 2000));
+  EXPECT_EQ(0, ConsumeAt(0, 0, 2500));
+}
+
+TEST_F(BandwidthThrottleTest, BurstIsBounded) {
+  throttle_.set_max_bytes_per_sec(1000);
+  EXPECT_EQ(0, ConsumeAt(0, 1000, 1000));
+
+  // Being idle for a long time does not accumulate more than one second worth
+  // of data.
+  EXPECT_EQ(0, ConsumeAt(0, 1000, 100000));
+  EXPECT_LT(0, ConsumeAt(0, 1, 100000));
+}
+
+TEST_F(BandwidthThrottleTest, Priority) {
+  throttle_.set_max_bytes_per_sec(1000);
+
+  EXPECT_EQ(0, ConsumeAt(4, 5000, 1000));
+  EXPECT_EQ(201, ConsumeAt(4, 1000, 1000));
+
+  // Each priority has its own bucket.
+  EXPECT_EQ(0, ConsumeAt(0, 1000, 1000));
+  EXPECT_EQ(1001, ConsumeAt(0, 1000, 1000));
+}
+
+TEST_F(BandwidthThrottleTest, YieldsToForeground) {
+  throttle_.BeginForegroundTransfer();
+  EXPECT_EQ(0, ConsumeAt(0, BandwidthThrottle::kYieldBytesPerSec, 1000));
+  EXPECT_EQ(1001, ConsumeAt(0, BandwidthThrottle::kYieldBytesPerSec, 1000));
+
+  // The wait ends when the foreground transfer ends.
+  throttle_.EndForegroundTransfer();
+  EXPECT_EQ(0, ConsumeAt(0, 0, 1000));
+}
+
+TEST_F(BandwidthThrottleTest, YieldsToForeground_Limited) {
+  throttle_.set_max_bytes_per_sec(1000);
+  throttle_.BeginForegroundTransfer();
+  throttle_.BeginForegroundTransfer();
+  EXPECT_EQ(0, ConsumeAt(0, 1000, 1000));
+  EXPECT_EQ(1001, ConsumeAt(0, 1000, 1000));
+
+  throttle_.EndForegroundTransfer();
+  EXPECT_EQ(1001, ConsumeAt(0, 0, 1000));
+
+  // The configured rate still applies after the foreground transfers end.
+  throttle_.EndForegroundTransfer();
+  EXPECT_EQ(1001, ConsumeAt(0, 0, 1000));
+}
+
+TEST_F(BandwidthThrottleTest, YieldsToForeground_HighLimit) {
+  throttle_.set_max_bytes_per_sec(4 * BandwidthThrottle::kYieldBytesPerSec);
+  EXPECT_EQ(0, ConsumeAt(0, 0, 1000));
+
+  throttle_.BeginForegroundTransfer();
+  EXPECT_EQ(0, ConsumeAt(0, BandwidthThrottle::kYieldBytesPerSec, 1000));
+  EXPECT_EQ(1001, ConsumeAt(0, BandwidthThrottle::kYieldBytesPerSec, 1000));
+
+  throttle_.EndForegroundTransfer();
+  EXPECT_EQ(251, ConsumeAt(0, 0, 1000));
+}
+
+}  // namespace omaha
@@ -95,6 +95,11 @@ class BitsRequest : public HttpRequestInterface {
     low_priority_ = low_priority;
   }
 
+  // BITS throttles the background jobs itself.
+  virtual void set_throttle_priority(int throttle_priority) {
+    UNREFERENCED_PARAMETER(throttle_priority);
+  }
+
   virtual void set_callback(NetworkRequestCallback* callback) {
     callback_ = callback;
   }
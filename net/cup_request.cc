@@ -71,6 +71,7 @@ class CupRequestImpl {
   void set_proxy_configuration(const ProxyConfig& proxy_config);
   void set_filename(const CString& filename);
   void set_low_priority(bool low_priority);
+  void set_throttle_priority(int throttle_priority);
   void set_callback(NetworkRequestCallback* callback);
   void set_additional_headers(const CString& additional_headers);
   void set_preserve_protocol(bool preserve_protocol);
@@ -569,6 +570,10 @@ void CupRequestImpl::set_low_priority(bool low_priority) {
   http_request_->set_low_priority(low_priority);
 }
 
+void CupRequestImpl::set_throttle_priority(int throttle_priority) {
+  http_request_->set_throttle_priority(throttle_priority);
+}
+
 void CupRequestImpl::set_callback(NetworkRequestCallback* callback) {
   http_request_->set_callback(callback);
 }
@@ -710,6 +715,10 @@ void CupRequest::set_low_priority(bool low_priority) {
   impl_->set_low_priority(low_priority);
 }
 
+void CupRequest::set_throttle_priority(int throttle_priority) {
+  impl_->set_throttle_priority(throttle_priority);
+}
+
 void CupRequest::set_callback(NetworkRequestCallback* callback) {
   impl_->set_callback(callback);
 }
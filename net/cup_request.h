@@ -77,6 +77,8 @@ class CupRequest : public HttpRequestInterface {
 
   virtual void set_low_priority(bool low_priority);
 
+  virtual void set_throttle_priority(int throttle_priority);
+
   virtual void set_callback(NetworkRequestCallback* callback);
 
   virtual void set_additional_headers(const CString& additional_headers);
@@ -77,6 +77,10 @@ class HttpRequestInterface {
 
   virtual void set_low_priority(bool low_priority) = 0;
 
+  // Sets the priority used to throttle the bandwidth of low priority requests.
+  // See BandwidthThrottle. Requests that do not throttle ignore it.
+  virtual void set_throttle_priority(int throttle_priority) = 0;
+
   virtual void set_callback(NetworkRequestCallback* callback) = 0;
 
   virtual void set_additional_headers(const CString& additional_headers) = 0;
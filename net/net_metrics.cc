@@ -1,4 +1,4 @@
-// Copyright 2009 Google Inc.
+// Copyright 2011 Google Inc.
 //
 // Licensed under the Apache License, Version 2.0 (the "License");
 // you may not use this file except in compliance with the License.
@@ -13,14 +13,14 @@
 // limitations under the License.
 // ========================================================================
 
-#include "omaha/goopdate/model_object.h"
-#include "omaha/goopdate/model.h"
+#include "omaha/net/net_metrics.h"
 
 namespace omaha {
 
-bool IsModelLockedByCaller(const Model* model) {
-  return model->IsLockedByCaller();
-}
+DEFINE_METRIC_count(net_proxy_config_skipped);
+DEFINE_METRIC_count(net_proxy_config_skipped_ms);
 
-}  // namespace omaha
+DEFINE_METRIC_count(net_request_retry_total);
+DEFINE_METRIC_count(net_request_retry_wait_ms);
 
+}  // namespace omaha
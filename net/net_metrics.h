@@ -0,0 +1,39 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+// Declares the usage metrics used by the net module.
+
+#ifndef OMAHA_NET_NET_METRICS_H_
+#define OMAHA_NET_NET_METRICS_H_
+
+#include "omaha/statsreport/metrics.h"
+
+namespace omaha {
+
+// How many times a proxy configuration was not tried because it recently
+// failed to connect to the host.
+DECLARE_METRIC_count(net_proxy_config_skipped);
+// Total time, in milliseconds, the skipped proxy configurations took to fail
+// when they were last tried.
+DECLARE_METRIC_count(net_proxy_config_skipped_ms);
+
+// How many times a request was retried.
+DECLARE_METRIC_count(net_request_retry_total);
+// Total time, in milliseconds, spent waiting to retry requests.
+DECLARE_METRIC_count(net_request_retry_wait_ms);
+
+}  // namespace omaha
+
+#endif  // OMAHA_NET_NET_METRICS_H_
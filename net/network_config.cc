@@ -71,8 +71,16 @@ const TCHAR* const NetworkConfig::kRegValueSource = _T("source");
 const TCHAR* const NetworkConfig::kWPADIdentifier = _T("auto");
 const TCHAR* const NetworkConfig::kDirectConnectionIdentifier = _T("direct");
 
+const DWORD NetworkConfig::kProxyCacheTtlMs = 60 * kMsPerSec;
+
+// The maximum number of hosts GetProxyForUrl results are cached for.
+const size_t kMaxProxyForUrlCacheSize = 32;
+
 NetworkConfig::NetworkConfig(bool is_machine)
     : is_machine_(is_machine),
+      is_detected_(false),
+      detect_time_ms_(0),
+      proxy_cache_ttl_ms_(kProxyCacheTtlMs),
       is_initialized_(false) {}
 
 NetworkConfig::~NetworkConfig() {
@@ -162,6 +170,7 @@ void NetworkConfig::Add(ProxyDetectorInterface* detector) {
   ASSERT1(detector);
   __mutexBlock(lock_) {
     detectors_.push_back(detector);
+    is_detected_ = false;
   }
 }
 
@@ -172,11 +181,18 @@ void NetworkConfig::Clear() {
     }
     detectors_.clear();
     configurations_.clear();
+    is_detected_ = false;
+    proxy_for_url_cache_.clear();
   }
 }
 
 HRESULT NetworkConfig::Detect() {
   __mutexBlock(lock_) {
+    if (is_detected_ && IsCacheEntryFresh(detect_time_ms_)) {
+      NET_LOG(L3, (_T("[NetworkConfig::Detect][using cached configurations]")));
+      return S_OK;
+    }
+
     std::vector<ProxyConfig> configurations;
 
     for (size_t i = 0; i != detectors_.size(); ++i) {
@@ -186,11 +202,19 @@ HRESULT NetworkConfig::Detect() {
       }
     }
     configurations_.swap(configurations);
+    is_detected_ = true;
+    detect_time_ms_ = ::GetTickCount();
   }
 
   return S_OK;
 }
 
+bool NetworkConfig::IsCacheEntryFresh(DWORD time_ms) const {
+  // The unsigned subtraction gives the elapsed time even if the tick count
+  // wrapped around since the entry was cached.
+  return ::GetTickCount() - time_ms < proxy_cache_ttl_ms_;
+}
+
 void NetworkConfig::SortProxies(std::vector<ProxyConfig>* configurations) {
   ASSERT1(configurations);
 
@@ -399,6 +423,30 @@ HRESULT NetworkConfig::GetProxyForUrl(const CString& url,
 
   NET_LOG(L3, (_T("[NetworkConfig::GetProxyForUrl][%s]"), url));
 
+  const CString cache_key(GetProxyForUrlCacheKey(url, auto_config_url));
+  __mutexBlock(lock_) {
+    ProxyForUrlCache::const_iterator it = proxy_for_url_cache_.find(cache_key);
+    if (it != proxy_for_url_cache_.end() &&
+        IsCacheEntryFresh(it->second.time_ms)) {
+      NET_LOG(L3, (_T("[GetProxyForUrl][using cached result]")));
+      const TCHAR* proxy = NULL;
+      HRESULT hr = CopyToGlobalString(it->second.proxy, &proxy);
+      if (FAILED(hr)) {
+        return hr;
+      }
+      const TCHAR* proxy_bypass = NULL;
+      hr = CopyToGlobalString(it->second.proxy_bypass, &proxy_bypass);
+      if (FAILED(hr)) {
+        ::GlobalFree(const_cast<TCHAR*>(proxy));
+        return hr;
+      }
+      proxy_info->access_type = it->second.access_type;
+      proxy_info->proxy = proxy;
+      proxy_info->proxy_bypass = proxy_bypass;
+      return S_OK;
+    }
+  }
+
   HttpClient::AutoProxyOptions auto_proxy_options = {0};
   auto_proxy_options.flags = WINHTTP_AUTOPROXY_AUTO_DETECT;
   auto_proxy_options.auto_detect_flags = WINHTTP_AUTO_DETECT_TYPE_DHCP |
@@ -430,9 +478,66 @@ HRESULT NetworkConfig::GetProxyForUrl(const CString& url,
     hr = GetProxyForUrlLocal(url, local_file, proxy_info);
   }
 
+  if (SUCCEEDED(hr)) {
+    ProxyForUrlEntry entry;
+    entry.access_type = proxy_info->access_type;
+    entry.proxy = proxy_info->proxy;
+    entry.proxy_bypass = proxy_info->proxy_bypass;
+    entry.time_ms = ::GetTickCount();
+
+    __mutexBlock(lock_) {
+      // The cache only holds the hosts Omaha talks to, which are few. Start
+      // over instead of evicting individual entries if it grows anyway.
+      if (proxy_for_url_cache_.size() >= kMaxProxyForUrlCacheSize) {
+        proxy_for_url_cache_.clear();
+      }
+      proxy_for_url_cache_[cache_key] = entry;
+    }
+  }
+
   return hr;
 }
 
+// Auto-proxy scripts are given the full url but in practice choose the proxy
+// based on the scheme and the host, which is what the results are cached by.
+// The url itself is the key if it cannot be parsed.
+CString NetworkConfig::GetProxyForUrlCacheKey(
+    const CString& url,
+    const CString& auto_config_url) const {
+  CString scheme, server;
+  int port = 0;
+  CString key;
+  if (http_client_.get() &&
+      SUCCEEDED(http_client_->CrackUrl(url, 0, &scheme, &server, &port,
+                                       NULL, NULL))) {
+    key.Format(_T("%s://%s:%d"), scheme, server, port);
+  } else {
+    key = url;
+  }
+  key.MakeLower();
+
+  return JoinStrings(key, auto_config_url, _T(" "));
+}
+
+HRESULT NetworkConfig::CopyToGlobalString(const CString& str,
+                                          const TCHAR** global_str) {
+  ASSERT1(global_str);
+
+  *global_str = NULL;
+  if (str.IsEmpty()) {
+    return S_OK;
+  }
+
+  const size_t size = (str.GetLength() + 1) * sizeof(TCHAR);
+  TCHAR* buffer = static_cast<TCHAR*>(::GlobalAlloc(GPTR, size));
+  if (!buffer) {
+    return E_OUTOFMEMORY;
+  }
+  memcpy(buffer, str.GetString(), size);
+  *global_str = buffer;
+  return S_OK;
+}
+
 CString NetworkConfig::GetUserAgent() {
   CString user_agent;
   user_agent.Format(kUserAgent, GetVersionString());
@@ -724,6 +829,8 @@ HRESULT NetworkConfigManager::CreateInstance() {
     VERIFY1(SUCCEEDED(instance_->InitializeLock()));
     VERIFY1(SUCCEEDED(instance_->InitializeRegistryKey()));
     instance_->LoadCupCredentialsFromRegistry();
+    instance_->bandwidth_throttle_.set_max_bytes_per_sec(
+        ConfigManager::Instance()->GetBackgroundDownloadBytesPerSec());
   }
 
   return S_OK;
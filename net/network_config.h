@@ -28,9 +28,11 @@
 #include "base/scoped_ptr.h"
 #include "omaha/base/scoped_any.h"
 #include "omaha/base/synchronized.h"
+#include "omaha/net/bandwidth_throttle.h"
 #include "omaha/net/detector.h"
 #include "omaha/net/http_client.h"
 #include "omaha/net/proxy_auth.h"
+#include "omaha/net/proxy_health_table.h"
 
 namespace ATL {
 
@@ -123,6 +125,8 @@ class NetworkConfig {
   void Clear();
 
   // Detects the network configuration for each of the registered detectors.
+  // The detected configurations are reused for kProxyCacheTtlMs, after which
+  // the detectors run again.
   HRESULT Detect();
 
   // Detects the network configuration for the given source.
@@ -176,13 +180,18 @@ class NetworkConfig {
 
   // Runs the WPAD protocol to compute the proxy information to be used
   // for the given url. The ProxyInfo pointer members must be freed using
-  // GlobalFree.
+  // GlobalFree. Successful results are cached per scheme, host, and port for
+  // kProxyCacheTtlMs.
   HRESULT GetProxyForUrl(const CString& url,
                          const CString& auto_config_url,
                          HttpClient::ProxyInfo* proxy_info);
 
   Session session() const { return session_; }
 
+  // Returns the record of which proxy configurations work for which hosts,
+  // shared by the network requests of this user.
+  ProxyHealthTable* proxy_health_table() { return &proxy_health_table_; }
+
   // Returns the global configuration override if available.
   HRESULT GetConfigurationOverride(ProxyConfig* configuration_override);
 
@@ -251,6 +260,30 @@ class NetworkConfig {
   static void ConvertPacResponseToProxyInfo(const CStringA& response,
                                             HttpClient::ProxyInfo* proxy_info);
 
+  // The result of running the auto-proxy script for a host.
+  struct ProxyForUrlEntry {
+    ProxyForUrlEntry() : access_type(0), time_ms(0) {}
+
+    uint32 access_type;
+    CString proxy;
+    CString proxy_bypass;
+    DWORD time_ms;
+  };
+
+  typedef std::map<CString, ProxyForUrlEntry> ProxyForUrlCache;
+
+  // Returns the key the results of GetProxyForUrl are cached under.
+  CString GetProxyForUrlCacheKey(const CString& url,
+                                 const CString& auto_config_url) const;
+
+  // Returns true if an entry cached at time_ms has not expired yet.
+  bool IsCacheEntryFresh(DWORD time_ms) const;
+
+  // Copies the string in a buffer allocated with GlobalAlloc. Sets NULL for an
+  // empty string. Returns E_OUTOFMEMORY if the buffer cannot be allocated.
+  static HRESULT CopyToGlobalString(const CString& str,
+                                    const TCHAR** global_str);
+
   static const TCHAR* const kUserAgent;
 
   static const TCHAR* const kRegKeyProxy;
@@ -259,13 +292,31 @@ class NetworkConfig {
   static const TCHAR* const kWPADIdentifier;
   static const TCHAR* const kDirectConnectionIdentifier;
 
+  // How long the detected configurations and the auto-proxy results are
+  // reused. Proxy settings rarely change while Omaha runs, but a network
+  // operation issues many requests, each of which would otherwise run the
+  // detectors and the auto-proxy script again.
+  static const DWORD kProxyCacheTtlMs;
+
   bool is_machine_;     // True if the instance is initialized for machine.
 
   std::vector<ProxyConfig> configurations_;
   std::vector<ProxyDetectorInterface*> detectors_;
 
+  // True if configurations_ holds the result of running the detectors, which
+  // happened at detect_time_ms_.
+  bool is_detected_;
+  DWORD detect_time_ms_;
+
+  ProxyForUrlCache proxy_for_url_cache_;
+
+  ProxyHealthTable proxy_health_table_;
+
+  // Overrides kProxyCacheTtlMs in unit tests.
+  DWORD proxy_cache_ttl_ms_;
+
   // Synchronizes access to per-process instance data, which includes
-  // the detectors and configurations.
+  // the detectors, configurations, and caches.
   LLock lock_;
 
   bool is_initialized_;
@@ -284,6 +335,7 @@ class NetworkConfig {
   ProxyAuth proxy_auth_;
 
   friend class NetworkConfigManager;
+  friend class NetworkConfigTest;
   DISALLOW_EVIL_CONSTRUCTORS(NetworkConfig);
 };
 
@@ -305,6 +357,9 @@ class NetworkConfigManager {
 
   void ClearCupCredentials();
 
+  // Returns the throttle shared by the http requests of the process.
+  BandwidthThrottle* bandwidth_throttle() { return &bandwidth_throttle_; }
+
  private:
   explicit NetworkConfigManager();
   ~NetworkConfigManager();
@@ -324,6 +379,8 @@ class NetworkConfigManager {
   std::map<CString, NetworkConfig*> user_network_config_map_;
   scoped_ptr<CupCredentials> cup_credentials_;
 
+  BandwidthThrottle bandwidth_throttle_;
+
   LLock lock_;
 
   // Synchronizes access to CUP registry.
@@ -17,6 +17,7 @@
 #include <atlconv.h>
 #include <algorithm>
 #include <cstring>
+#include <vector>
 #include "base/basictypes.h"
 #include "omaha/base/module_utils.h"
 #include "omaha/base/omaha_version.h"
@@ -31,6 +32,29 @@
 
 namespace omaha {
 
+// Counts how many times the detection runs.
+class CountingProxyDetector : public ProxyDetectorInterface {
+ public:
+  CountingProxyDetector(const TCHAR* source, int* num_detect_calls)
+      : source_(source),
+        num_detect_calls_(num_detect_calls) {}
+
+  virtual HRESULT Detect(ProxyConfig* config) {
+    ++*num_detect_calls_;
+    config->source = source_;
+    config->proxy = _T("proxy:8080");
+    return S_OK;
+  }
+
+  virtual const TCHAR* source() { return source_; }
+
+ private:
+  const TCHAR* source_;
+  int* num_detect_calls_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(CountingProxyDetector);
+};
+
 class NetworkConfigTest : public testing::Test {
  protected:
   NetworkConfigTest() {}
@@ -42,6 +66,19 @@ class NetworkConfigTest : public testing::Test {
   virtual void SetUp() {}
 
   virtual void TearDown() {}
+
+  // Creates an uninitialized instance, which has no detectors.
+  static NetworkConfig* CreateNetworkConfig() {
+    return new NetworkConfig(false);
+  }
+
+  static void DeleteNetworkConfig(NetworkConfig* network_config) {
+    delete network_config;
+  }
+
+  static void SetProxyCacheTtl(NetworkConfig* network_config, DWORD ttl_ms) {
+    network_config->proxy_cache_ttl_ms_ = ttl_ms;
+  }
 };
 
 TEST_F(NetworkConfigTest, GetAccessType) {
@@ -227,6 +264,48 @@ TEST_F(NetworkConfigTest, ConfigurationOverride) {
   EXPECT_EQ(E_FAIL, network_config->GetConfigurationOverride(&actual));
 }
 
+TEST_F(NetworkConfigTest, Detect_UsesCachedConfigurations) {
+  NetworkConfig* network_config = CreateNetworkConfig();
+
+  int num_detect_calls = 0;
+  network_config->Add(new CountingProxyDetector(_T("Test1"),
+                                                &num_detect_calls));
+
+  EXPECT_HRESULT_SUCCEEDED(network_config->Detect());
+  EXPECT_HRESULT_SUCCEEDED(network_config->Detect());
+  EXPECT_EQ(1, num_detect_calls);
+
+  std::vector<ProxyConfig> configurations(network_config->GetConfigurations());
+  ASSERT_EQ(1, configurations.size());
+  EXPECT_STREQ(_T("Test1"), configurations[0].source);
+
+  // Adding a detector discards the cached configurations.
+  int num_detect_calls2 = 0;
+  network_config->Add(new CountingProxyDetector(_T("Test2"),
+                                                &num_detect_calls2));
+  EXPECT_HRESULT_SUCCEEDED(network_config->Detect());
+  EXPECT_EQ(2, num_detect_calls);
+  EXPECT_EQ(1, num_detect_calls2);
+  EXPECT_EQ(2, network_config->GetConfigurations().size());
+
+  DeleteNetworkConfig(network_config);
+}
+
+TEST_F(NetworkConfigTest, Detect_CacheExpired) {
+  NetworkConfig* network_config = CreateNetworkConfig();
+  SetProxyCacheTtl(network_config, 0);
+
+  int num_detect_calls = 0;
+  network_config->Add(new CountingProxyDetector(_T("Test1"),
+                                                &num_detect_calls));
+
+  EXPECT_HRESULT_SUCCEEDED(network_config->Detect());
+  EXPECT_HRESULT_SUCCEEDED(network_config->Detect());
+  EXPECT_EQ(2, num_detect_calls);
+
+  DeleteNetworkConfig(network_config);
+}
+
 TEST_F(NetworkConfigTest, GetProxyForUrlLocal) {
   TCHAR module_directory[MAX_PATH] = {0};
   ASSERT_TRUE(GetModuleDirectory(NULL, module_directory));
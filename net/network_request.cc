@@ -107,6 +107,10 @@ void NetworkRequest::set_low_priority(bool low_priority) {
   return impl_->set_low_priority(low_priority);
 }
 
+void NetworkRequest::set_throttle_priority(int throttle_priority) {
+  return impl_->set_throttle_priority(throttle_priority);
+}
+
 void NetworkRequest::set_proxy_configuration(
     const ProxyConfig* proxy_configuration) {
   return impl_->set_proxy_configuration(proxy_configuration);
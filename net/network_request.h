@@ -171,10 +171,15 @@ class NetworkRequest {
   // notification for DownloadFile only.
   void set_callback(NetworkRequestCallback* callback);
 
-  // Sets the priority of the request. Currently, only BITS requests support
-  // prioritization of requests.
+  // Sets the priority of the request. BITS requests run low priority requests
+  // as background jobs. Other requests throttle the bandwidth of low priority
+  // requests as specified by set_throttle_priority.
   void set_low_priority(bool low_priority);
 
+  // Sets the priority used by BandwidthThrottle for low priority requests,
+  // typically the priority of the app bundle the request is made for.
+  void set_throttle_priority(int throttle_priority);
+
   // Overrides detecting the network configuration and uses the configuration
   // specified. If parameter is NULL, it defaults to detecting the configuration
   // automatically.
@@ -30,9 +30,13 @@
 #include "omaha/base/scoped_any.h"
 #include "omaha/base/string.h"
 #include "omaha/base/time.h"
+#include "omaha/base/tracing.h"
+#include "omaha/base/utils.h"
 #include "omaha/net/http_client.h"
+#include "omaha/net/net_metrics.h"
 #include "omaha/net/net_utils.h"
 #include "omaha/net/network_config.h"
+#include "omaha/net/proxy_health_table.h"
 
 namespace omaha {
 
@@ -75,12 +79,14 @@ NetworkRequestImpl::NetworkRequestImpl(
       : cur_http_request_(NULL),
         cur_proxy_config_(NULL),
         cur_retry_count_(0),
+        proxy_health_table_(NULL),
         last_hr_(S_OK),
         last_http_status_code_(0),
         http_status_code_(0),
         proxy_auth_config_(NULL, CString()),
         num_retries_(0),
         low_priority_(false),
+        throttle_priority_(0),
         time_between_retries_ms_(kDefaultTimeBetweenRetriesMs),
         callback_(NULL),
         request_buffer_(NULL),
@@ -226,6 +232,14 @@ HRESULT NetworkRequestImpl::DoSendWithRetries() {
 
   SafeCStringAppendFormat(&trace_, _T("Url=%s\r\n"), url_);
 
+  host_ = GetUriHostNameHostOnly(url_, false);
+  proxy_health_table_ = NULL;
+  NetworkConfig* network_config = NULL;
+  if (SUCCEEDED(NetworkConfigManager::Instance().GetUserNetworkConfig(
+          &network_config))) {
+    proxy_health_table_ = network_config->proxy_health_table();
+  }
+
   HRESULT hr = S_OK;
   int wait_interval_ms = time_between_retries_ms_;
   for (cur_retry_count_ = 0;
@@ -240,6 +254,19 @@ HRESULT NetworkRequestImpl::DoSendWithRetries() {
 
     // Wait before retrying if there are retries to be done.
     if (cur_retry_count_ > 0) {
+      uint32 random_value = 0;
+      if (!GenRandom(&random_value, sizeof(random_value))) {
+        random_value = ::GetTickCount();
+      }
+      wait_interval_ms = GetNextRetryIntervalMs(
+          time_between_retries_ms_,
+          std::max(time_between_retries_ms_, kMaxTimeBetweenRetriesMs),
+          wait_interval_ms,
+          random_value);
+
+      ++metric_net_request_retry_total;
+      metric_net_request_retry_wait_ms += wait_interval_ms;
+
       if (callback_) {
         const time64 next_retry_time = GetCurrent100NSTime() +
                                        wait_interval_ms * kMillisecsTo100ns;
@@ -253,18 +280,11 @@ HRESULT NetworkRequestImpl::DoSendWithRetries() {
       if (callback_) {
         callback_->OnRequestBegin();
       }
-
-      // Compute the next wait interval and check for multiplication overflow.
-      if (wait_interval_ms > INT_MAX / kTimeBetweenRetriesMultiplier) {
-        ASSERT1(false);
-        hr = HRESULT_FROM_WIN32(ERROR_ARITHMETIC_OVERFLOW);
-        break;
-      }
-      wait_interval_ms *= kTimeBetweenRetriesMultiplier;
     }
 
     DetectProxyConfiguration(&proxy_configurations_);
     ASSERT1(!proxy_configurations_.empty());
+    PrioritizeProxyConfigurations();
     OPT_LOG(L2, (_T("[detected configurations][\r\n%s]"),
                  NetworkConfig::ToString(proxy_configurations_)));
 
@@ -310,13 +330,13 @@ HRESULT NetworkRequestImpl::DoSend(int* http_status_code,
   std::vector<uint8> error_response;
 
   // Tries out all the available configurations until one of them succeeds.
-  // TODO(omaha): remember the last good configuration and prefer that for
-  // future requests.
   HRESULT hr = S_OK;
   ASSERT1(!proxy_configurations_.empty());
   for (size_t i = 0; i != proxy_configurations_.size(); ++i) {
     cur_proxy_config_ = &proxy_configurations_[i];
+    const DWORD start_ms = ::GetTickCount();
     hr = DoSendWithConfig(http_status_code, response_headers, response);
+    RecordProxyHealth(hr, *http_status_code, ::GetTickCount() - start_ms);
     if (i == 0 && FAILED(hr)) {
       error_hr = hr;
       error_http_status_code = *http_status_code;
@@ -465,6 +485,7 @@ HRESULT NetworkRequestImpl::DoSendHttpRequest(
   cur_http_request_->set_url(url_);
   cur_http_request_->set_filename(filename_);
   cur_http_request_->set_low_priority(low_priority_);
+  cur_http_request_->set_throttle_priority(throttle_priority_);
   cur_http_request_->set_callback(callback_);
   cur_http_request_->set_additional_headers(BuildPerRequestHeaders());
   cur_http_request_->set_proxy_configuration(*cur_proxy_config_);
@@ -484,7 +505,11 @@ HRESULT NetworkRequestImpl::DoSendHttpRequest(
   // it may not make sense to retry at all, for example, let's say the
   // error is ERROR_DISK_FULL.
   NET_LOG(L3, (_T("[%s]"), url_));
-  last_hr_ = cur_http_request_->Send();
+  {
+    ScopedTraceSpan span("net", "HttpRequest");
+    last_hr_ = cur_http_request_->Send();
+    span.set_arg("hr", last_hr_);
+  }
   NET_LOG(L3, (_T("[HttpRequestInterface::Send returned 0x%08x]"), last_hr_));
 
   if (last_hr_ == GOOPDATE_E_CANCELLED) {
@@ -525,6 +550,47 @@ HRESULT NetworkRequestImpl::DoSendHttpRequest(
   return last_hr_;
 }
 
+void NetworkRequestImpl::PrioritizeProxyConfigurations() {
+  if (!proxy_health_table_) {
+    return;
+  }
+
+  int num_skipped = 0;
+  int skipped_elapsed_ms = 0;
+  proxy_health_table_->Prioritize(host_,
+                                  &proxy_configurations_,
+                                  &num_skipped,
+                                  &skipped_elapsed_ms);
+  if (num_skipped) {
+    metric_net_proxy_config_skipped += num_skipped;
+    metric_net_proxy_config_skipped_ms += skipped_elapsed_ms;
+    SafeCStringAppendFormat(&trace_,
+                            _T("Skipped %d configs failing for %s.\r\n"),
+                            num_skipped, host_);
+  }
+}
+
+// Only failures to connect count against the configuration. An http error
+// means the host was reached, and the other failures are not specific to the
+// configuration.
+void NetworkRequestImpl::RecordProxyHealth(HRESULT hr,
+                                           int http_status_code,
+                                           int elapsed_ms) const {
+  ASSERT1(cur_proxy_config_);
+  if (!proxy_health_table_) {
+    return;
+  }
+
+  if (SUCCEEDED(hr)) {
+    proxy_health_table_->RecordSuccess(host_, *cur_proxy_config_);
+  } else if (!http_status_code &&
+             hr != GOOPDATE_E_CANCELLED &&
+             hr != GOOPDATE_E_NO_NETWORK &&
+             hr != CI_E_BITS_DISABLED) {
+    proxy_health_table_->RecordFailure(host_, *cur_proxy_config_, elapsed_ms);
+  }
+}
+
 CString NetworkRequestImpl::BuildPerRequestHeaders() const {
   CString headers(additional_headers_);
 
@@ -613,6 +679,20 @@ void NetworkRequestImpl::DetectProxyConfiguration(
   ASSERT1(!proxy_configurations->empty());
 }
 
+int GetNextRetryIntervalMs(int min_interval_ms,
+                           int max_interval_ms,
+                           int prev_interval_ms,
+                           uint32 random_value) {
+  ASSERT1(0 <= min_interval_ms && min_interval_ms <= max_interval_ms);
+
+  // Computes in 64 bits to avoid overflowing when prev_interval_ms is large.
+  const int64 upper_bound = std::min(
+      static_cast<int64>(std::max(prev_interval_ms, min_interval_ms)) * 3,
+      static_cast<int64>(max_interval_ms));
+  const int64 range = upper_bound - min_interval_ms + 1;
+  return static_cast<int>(min_interval_ms + random_value % range);
+}
+
 HRESULT PostRequest(NetworkRequest* network_request,
                     bool fallback_to_https,
                     const CString& url,
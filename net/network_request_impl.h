@@ -39,6 +39,8 @@
 
 namespace omaha {
 
+class ProxyHealthTable;
+
 namespace detail {
 
 class NetworkRequestImpl {
@@ -87,6 +89,10 @@ class NetworkRequestImpl {
 
   void set_low_priority(bool low_priority) { low_priority_ = low_priority; }
 
+  void set_throttle_priority(int throttle_priority) {
+    throttle_priority_ = throttle_priority;
+  }
+
   void set_proxy_configuration(const ProxyConfig* proxy_configuration) {
     if (proxy_configuration) {
       proxy_configuration_.reset(new ProxyConfig);
@@ -139,6 +145,15 @@ class NetworkRequestImpl {
   // Builds headers for the current HttpRequest and network configuration.
   CString BuildPerRequestHeaders() const;
 
+  // Orders the detected proxy configurations by how well they worked for the
+  // host of the url in prior requests.
+  void PrioritizeProxyConfigurations();
+
+  // Records whether the current network configuration could reach the host.
+  void RecordProxyHealth(HRESULT hr,
+                         int http_status_code,
+                         int elapsed_ms) const;
+
   // Specifies the chain of HttpRequestInterface to handle the request.
   std::vector<HttpRequestInterface*> http_request_chain_;
 
@@ -160,6 +175,7 @@ class NetworkRequestImpl {
   ProxyAuthConfig proxy_auth_config_;
   int      num_retries_;
   bool     low_priority_;
+  int      throttle_priority_;
   int time_between_retries_ms_;
 
   // Output data members.
@@ -182,6 +198,12 @@ class NetworkRequestImpl {
   // The current retry count defined by the outermost DoSendWithRetries() call.
   int cur_retry_count_;
 
+  // The host of the url and the health table of the user's network
+  // configuration. The table is not owned and it is NULL if the network
+  // configuration is not available.
+  CString host_;
+  ProxyHealthTable* proxy_health_table_;
+
   volatile LONG is_canceled_;
   scoped_event event_cancel_;
 
@@ -193,11 +215,20 @@ class NetworkRequestImpl {
   mutable CString trace_;
 
   static const int kDefaultTimeBetweenRetriesMs   = 5000;     // 5 seconds.
-  static const int kTimeBetweenRetriesMultiplier  = 2;
+  static const int kMaxTimeBetweenRetriesMs       = 120000;   // 2 minutes.
 
   DISALLOW_EVIL_CONSTRUCTORS(NetworkRequestImpl);
 };
 
+// Returns the time to wait before the next retry, using exponential backoff
+// with decorrelated jitter: a random interval between min_interval_ms and three
+// times prev_interval_ms, capped at max_interval_ms. The jitter keeps the
+// clients that failed at the same time from retrying at the same time.
+int GetNextRetryIntervalMs(int min_interval_ms,
+                           int max_interval_ms,
+                           int prev_interval_ms,
+                           uint32 random_value);
+
 HRESULT PostRequest(NetworkRequest* network_request,
                     bool fallback_to_https,
                     const CString& url,
@@ -34,6 +34,7 @@
 #include "omaha/net/cup_request.h"
 #include "omaha/net/network_config.h"
 #include "omaha/net/network_request.h"
+#include "omaha/net/network_request_impl.h"
 #include "omaha/net/simple_request.h"
 #include "omaha/net/urlmon_request.h"
 #include "omaha/testing/unit_test.h"
@@ -441,5 +442,27 @@ TEST_F(NetworkRequestTest, CancelTest_Get) {
   CancelTest_GetHelper();
 }
 
-}  // namespace omaha
+TEST(NetworkRequestImplTest, GetNextRetryIntervalMs) {
+  // The smallest random value gives the minimum interval.
+  EXPECT_EQ(1000, detail::GetNextRetryIntervalMs(1000, 120000, 1000, 0));
+
+  // The interval is at most three times the previous interval.
+  EXPECT_EQ(3000, detail::GetNextRetryIntervalMs(1000, 120000, 1000, 2000));
+  EXPECT_EQ(1000, detail::GetNextRetryIntervalMs(1000, 120000, 1000, 2001));
+  EXPECT_EQ(6000, detail::GetNextRetryIntervalMs(1000, 120000, 2000, 5000));
+
+  // The interval is capped.
+  EXPECT_EQ(120000,
+            detail::GetNextRetryIntervalMs(1000, 120000, 100000, 119000));
+  EXPECT_EQ(120000,
+            detail::GetNextRetryIntervalMs(1000, 120000, INT_MAX, 119000));
+
+  for (uint32 i = 0; i != 1000; ++i) {
+    const int interval_ms =
+        detail::GetNextRetryIntervalMs(5000, 120000, 10000, i * 7919);
+    EXPECT_LE(5000, interval_ms);
+    EXPECT_GE(30000, interval_ms);
+  }
+}
 
+}  // namespace omaha
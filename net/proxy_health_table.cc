@@ -0,0 +1,168 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/net/proxy_health_table.h"
+#include <algorithm>
+#include "omaha/base/debug.h"
+#include "omaha/base/logging.h"
+#include "omaha/net/network_config.h"
+
+namespace omaha {
+
+void ProxyHealthTable::Prioritize(const CString& host,
+                                  std::vector<ProxyConfig>* configurations,
+                                  int* num_skipped,
+                                  int* skipped_elapsed_ms) const {
+  PrioritizeAt(host,
+               ::GetTickCount(),
+               configurations,
+               num_skipped,
+               skipped_elapsed_ms);
+}
+
+void ProxyHealthTable::PrioritizeAt(const CString& host,
+                                    DWORD now_ms,
+                                    std::vector<ProxyConfig>* configurations,
+                                    int* num_skipped,
+                                    int* skipped_elapsed_ms) const {
+  ASSERT1(configurations);
+  ASSERT1(num_skipped);
+  ASSERT1(skipped_elapsed_ms);
+
+  *num_skipped = 0;
+  *skipped_elapsed_ms = 0;
+
+  std::vector<ProxyConfig> healthy;
+  int elapsed_ms = 0;
+
+  __mutexScope(lock_);
+
+  CString last_good_key;
+  std::map<CString, CString>::const_iterator last_good =
+      last_good_configs_.find(host);
+  if (last_good != last_good_configs_.end()) {
+    last_good_key = last_good->second;
+  }
+
+  // Position after the override configurations, which always go first.
+  size_t front = 0;
+  for (size_t i = 0; i != configurations->size(); ++i) {
+    const ProxyConfig& config = (*configurations)[i];
+
+    HealthMap::const_iterator it = health_.find(GetHealthKey(host, config));
+    if (it != health_.end() && IsCoolingDown(it->second, now_ms)) {
+      NET_LOG(L3, (_T("[skipping config][%s][%s]"),
+                   host, NetworkConfig::ToString(config)));
+      elapsed_ms += it->second.last_failure_elapsed_ms;
+      continue;
+    }
+
+    if (config.priority == ProxyConfig::PROXY_PRIORITY_OVERRIDE) {
+      healthy.insert(healthy.begin() + front++, config);
+    } else if (!last_good_key.IsEmpty() &&
+               GetConfigKey(config) == last_good_key) {
+      healthy.insert(healthy.begin() + front, config);
+      last_good_key.Empty();
+    } else {
+      healthy.push_back(config);
+    }
+  }
+
+  // Fail open. Trying a combination that is cooling down is better than not
+  // trying anything.
+  if (healthy.empty()) {
+    return;
+  }
+
+  *num_skipped = configurations->size() - healthy.size();
+  *skipped_elapsed_ms = elapsed_ms;
+  configurations->swap(healthy);
+}
+
+void ProxyHealthTable::RecordSuccess(const CString& host,
+                                     const ProxyConfig& config) {
+  __mutexScope(lock_);
+  health_.erase(GetHealthKey(host, config));
+  last_good_configs_[host] = GetConfigKey(config);
+}
+
+void ProxyHealthTable::RecordFailure(const CString& host,
+                                     const ProxyConfig& config,
+                                     int elapsed_ms) {
+  RecordFailureAt(host, config, elapsed_ms, ::GetTickCount());
+}
+
+void ProxyHealthTable::RecordFailureAt(const CString& host,
+                                       const ProxyConfig& config,
+                                       int elapsed_ms,
+                                       DWORD now_ms) {
+  __mutexScope(lock_);
+
+  Health& health = health_[GetHealthKey(host, config)];
+  ++health.num_failures;
+  health.last_failure_ms = now_ms;
+  health.last_failure_elapsed_ms = std::max(elapsed_ms, 0);
+
+  std::map<CString, CString>::iterator last_good =
+      last_good_configs_.find(host);
+  if (last_good != last_good_configs_.end() &&
+      last_good->second == GetConfigKey(config)) {
+    last_good_configs_.erase(last_good);
+  }
+}
+
+bool ProxyHealthTable::IsCoolingDown(const Health& health, DWORD now_ms) {
+  if (health.num_failures < kFailureThreshold) {
+    return false;
+  }
+
+  // Doubles the cool down for each failure past the threshold.
+  int cool_down_ms = kMinCoolDownMs;
+  for (int i = kFailureThreshold;
+       i < health.num_failures && cool_down_ms < kMaxCoolDownMs;
+       ++i) {
+    cool_down_ms *= 2;
+  }
+  cool_down_ms = std::min(cool_down_ms, kMaxCoolDownMs);
+
+  // The unsigned subtraction handles the tick count wrapping around.
+  return now_ms - health.last_failure_ms < static_cast<DWORD>(cool_down_ms);
+}
+
+CString ProxyHealthTable::GetConfigKey(const ProxyConfig& config) {
+  CString key;
+  switch (NetworkConfig::GetAccessType(config)) {
+    case WINHTTP_ACCESS_TYPE_NAMED_PROXY:
+      key.Format(_T("proxy=%s;bypass=%s"), config.proxy, config.proxy_bypass);
+      break;
+    case WINHTTP_ACCESS_TYPE_AUTO_DETECT:
+      key.Format(_T("wpad=%d;script=%s"),
+                 config.auto_detect, config.auto_config_url);
+      break;
+    default:
+      key = _T("direct");
+      break;
+  }
+  return key;
+}
+
+CString ProxyHealthTable::GetHealthKey(const CString& host,
+                                       const ProxyConfig& config) {
+  CString key;
+  key.Format(_T("%s|%s"), host, GetConfigKey(config));
+  return key;
+}
+
+}  // namespace omaha
@@ -0,0 +1,113 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+// ProxyHealthTable remembers, across network requests, which proxy
+// configurations can reach a host. It is used to try the configuration that
+// last worked for the host first and to stop trying, for a while, the
+// configurations that repeatedly failed to connect to the host.
+//
+// A host and proxy configuration combination is skipped after
+// kFailureThreshold consecutive connection failures. It is tried again once
+// the cool down period expires, and the period doubles with each subsequent
+// failure. Any success resets the combination.
+
+#ifndef OMAHA_NET_PROXY_HEALTH_TABLE_H_
+#define OMAHA_NET_PROXY_HEALTH_TABLE_H_
+
+#include <windows.h>
+#include <atlstr.h>
+#include <map>
+#include <vector>
+#include "base/basictypes.h"
+#include "omaha/base/synchronized.h"
+
+namespace omaha {
+
+struct ProxyConfig;
+
+class ProxyHealthTable {
+ public:
+  ProxyHealthTable() {}
+
+  // Orders the configurations to be tried for the host. The configuration that
+  // last succeeded for the host is moved to the front, after any override
+  // configurations. The configurations that are cooling down are removed,
+  // unless this would remove all configurations. Returns the number of
+  // configurations removed and the time they took to fail when they were last
+  // tried, which is an estimate of the time saved by not trying them.
+  void Prioritize(const CString& host,
+                  std::vector<ProxyConfig>* configurations,
+                  int* num_skipped,
+                  int* skipped_elapsed_ms) const;
+
+  void RecordSuccess(const CString& host, const ProxyConfig& config);
+
+  // Records a failure to connect to the host. elapsed_ms is how long the
+  // attempt took.
+  void RecordFailure(const CString& host,
+                     const ProxyConfig& config,
+                     int elapsed_ms);
+
+  static const int kFailureThreshold = 2;
+  static const int kMinCoolDownMs = 30 * 1000;        // 30 seconds.
+  static const int kMaxCoolDownMs = 30 * 60 * 1000;   // 30 minutes.
+
+ private:
+  struct Health {
+    Health()
+        : num_failures(0),
+          last_failure_ms(0),
+          last_failure_elapsed_ms(0) {}
+
+    int num_failures;               // Consecutive connection failures.
+    DWORD last_failure_ms;          // Tick count of the last failure.
+    int last_failure_elapsed_ms;    // How long the last failure took.
+  };
+
+  typedef std::map<CString, Health> HealthMap;
+
+  void PrioritizeAt(const CString& host,
+                    DWORD now_ms,
+                    std::vector<ProxyConfig>* configurations,
+                    int* num_skipped,
+                    int* skipped_elapsed_ms) const;
+  void RecordFailureAt(const CString& host,
+                       const ProxyConfig& config,
+                       int elapsed_ms,
+                       DWORD now_ms);
+
+  // Returns true if the combination must not be tried at now_ms.
+  static bool IsCoolingDown(const Health& health, DWORD now_ms);
+
+  // Identifies the proxy settings the configuration resolves to, regardless
+  // of the source or the priority of the configuration.
+  static CString GetConfigKey(const ProxyConfig& config);
+  static CString GetHealthKey(const CString& host, const ProxyConfig& config);
+
+  // Keyed by host and configuration.
+  HealthMap health_;
+
+  // Maps a host to the key of the configuration that last succeeded for it.
+  std::map<CString, CString> last_good_configs_;
+
+  LLock lock_;
+
+  friend class ProxyHealthTableTest;
+  DISALLOW_COPY_AND_ASSIGN(ProxyHealthTable);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_NET_PROXY_HEALTH_TABLE_H_
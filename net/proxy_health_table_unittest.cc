@@ -0,0 +1,232 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <vector>
+#include "omaha/net/network_config.h"
+#include "omaha/net/proxy_health_table.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+const TCHAR* const kHost = _T("tools.google.com");
+const TCHAR* const kOtherHost = _T("dl.google.com");
+
+ProxyConfig MakeNamedProxy(const TCHAR* proxy) {
+  ProxyConfig config;
+  config.source = proxy;
+  config.proxy = proxy;
+  return config;
+}
+
+ProxyConfig MakeDirect() {
+  ProxyConfig config;
+  config.source = _T("direct");
+  return config;
+}
+
+}  // namespace
+
+class ProxyHealthTableTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    configurations_.push_back(MakeNamedProxy(_T("proxy1:80")));
+    configurations_.push_back(MakeNamedProxy(_T("proxy2:80")));
+    configurations_.push_back(MakeDirect());
+  }
+
+  void PrioritizeAt(const CString& host,
+                    DWORD now_ms,
+                    std::vector<ProxyConfig>* configurations,
+                    int* num_skipped,
+                    int* skipped_elapsed_ms) {
+    table_.PrioritizeAt(host,
+                        now_ms,
+                        configurations,
+                        num_skipped,
+                        skipped_elapsed_ms);
+  }
+
+  void RecordFailureAt(const CString& host,
+                       const ProxyConfig& config,
+                       int elapsed_ms,
+                       DWORD now_ms) {
+    table_.RecordFailureAt(host, config, elapsed_ms, now_ms);
+  }
+
+  ProxyHealthTable table_;
+  std::vector<ProxyConfig> configurations_;
+};
+
+TEST_F(ProxyHealthTableTest, Prioritize_NoHistory) {
+  std::vector<ProxyConfig> configurations(configurations_);
+  int num_skipped = -1;
+  int skipped_elapsed_ms = -1;
+  PrioritizeAt(kHost, 1000, &configurations, &num_skipped, &skipped_elapsed_ms);
+
+  ASSERT_EQ(3, configurations.size());
+  EXPECT_STREQ(_T("proxy1:80"), configurations[0].source);
+  EXPECT_STREQ(_T("proxy2:80"), configurations[1].source);
+  EXPECT_STREQ(_T("direct"), configurations[2].source);
+  EXPECT_EQ(0, num_skipped);
+  EXPECT_EQ(0, skipped_elapsed_ms);
+}
+
+TEST_F(ProxyHealthTableTest, Prioritize_LastGoodFirst) {
+  table_.RecordSuccess(kHost, MakeDirect());
+
+  std::vector<ProxyConfig> configurations(configurations_);
+  int num_skipped = 0;
+  int skipped_elapsed_ms = 0;
+  PrioritizeAt(kHost, 1000, &configurations, &num_skipped, &skipped_elapsed_ms);
+
+  ASSERT_EQ(3, configurations.size());
+  EXPECT_STREQ(_T("direct"), configurations[0].source);
+  EXPECT_STREQ(_T("proxy1:80"), configurations[1].source);
+  EXPECT_STREQ(_T("proxy2:80"), configurations[2].source);
+
+  // The last good configuration is tracked per host.
+  configurations = configurations_;
+  PrioritizeAt(kOtherHost, 1000, &configurations, &num_skipped,
+               &skipped_elapsed_ms);
+  EXPECT_STREQ(_T("proxy1:80"), configurations[0].source);
+}
+
+TEST_F(ProxyHealthTableTest, Prioritize_OverrideStaysFirst) {
+  ProxyConfig override_config(MakeNamedProxy(_T("override:80")));
+  override_config.priority = ProxyConfig::PROXY_PRIORITY_OVERRIDE;
+  configurations_.insert(configurations_.begin(), override_config);
+
+  table_.RecordSuccess(kHost, MakeNamedProxy(_T("proxy2:80")));
+
+  int num_skipped = 0;
+  int skipped_elapsed_ms = 0;
+  PrioritizeAt(kHost, 1000, &configurations_, &num_skipped,
+               &skipped_elapsed_ms);
+
+  ASSERT_EQ(4, configurations_.size());
+  EXPECT_STREQ(_T("override:80"), configurations_[0].source);
+  EXPECT_STREQ(_T("proxy2:80"), configurations_[1].source);
+  EXPECT_STREQ(_T("proxy1:80"), configurations_[2].source);
+  EXPECT_STREQ(_T("direct"), configurations_[3].source);
+}
+
+TEST_F(ProxyHealthTableTest, Prioritize_SkipsFailingConfig) {
+  const ProxyConfig proxy1(MakeNamedProxy(_T("proxy1:80")));
+
+  // A single failure is not enough to skip the configuration.
+  RecordFailureAt(kHost, proxy1, 2000, 1000);
+  std::vector<ProxyConfig> configurations(configurations_);
+  int num_skipped = 0;
+  int skipped_elapsed_ms = 0;
+  PrioritizeAt(kHost, 1000, &configurations, &num_skipped, &skipped_elapsed_ms);
+  EXPECT_EQ(3, configurations.size());
+  EXPECT_EQ(0, num_skipped);
+
+  RecordFailureAt(kHost, proxy1, 3000, 2000);
+  configurations = configurations_;
+  PrioritizeAt(kHost, 2000, &configurations, &num_skipped, &skipped_elapsed_ms);
+  ASSERT_EQ(2, configurations.size());
+  EXPECT_STREQ(_T("proxy2:80"), configurations[0].source);
+  EXPECT_STREQ(_T("direct"), configurations[1].source);
+  EXPECT_EQ(1, num_skipped);
+  EXPECT_EQ(3000, skipped_elapsed_ms);
+
+  // Other hosts are not affected.
+  configurations = configurations_;
+  PrioritizeAt(kOtherHost, 2000, &configurations, &num_skipped,
+               &skipped_elapsed_ms);
+  EXPECT_EQ(3, configurations.size());
+
+  // The configuration is tried again after the cool down.
+  configurations = configurations_;
+  PrioritizeAt(kHost,
+               2000 + ProxyHealthTable::kMinCoolDownMs,
+               &configurations,
+               &num_skipped,
+               &skipped_elapsed_ms);
+  EXPECT_EQ(3, configurations.size());
+  EXPECT_EQ(0, num_skipped);
+}
+
+TEST_F(ProxyHealthTableTest, Prioritize_CoolDownDoubles) {
+  const ProxyConfig proxy1(MakeNamedProxy(_T("proxy1:80")));
+  RecordFailureAt(kHost, proxy1, 10, 1000);
+  RecordFailureAt(kHost, proxy1, 10, 1000);
+  RecordFailureAt(kHost, proxy1, 10, 1000);
+
+  std::vector<ProxyConfig> configurations(configurations_);
+  int num_skipped = 0;
+  int skipped_elapsed_ms = 0;
+  PrioritizeAt(kHost,
+               1000 + ProxyHealthTable::kMinCoolDownMs,
+               &configurations,
+               &num_skipped,
+               &skipped_elapsed_ms);
+  EXPECT_EQ(1, num_skipped);
+
+  configurations = configurations_;
+  PrioritizeAt(kHost,
+               1000 + 2 * ProxyHealthTable::kMinCoolDownMs,
+               &configurations,
+               &num_skipped,
+               &skipped_elapsed_ms);
+  EXPECT_EQ(0, num_skipped);
+}
+
+TEST_F(ProxyHealthTableTest, Prioritize_SuccessResets) {
+  const ProxyConfig proxy1(MakeNamedProxy(_T("proxy1:80")));
+  RecordFailureAt(kHost, proxy1, 10, 1000);
+  RecordFailureAt(kHost, proxy1, 10, 1000);
+  table_.RecordSuccess(kHost, proxy1);
+
+  std::vector<ProxyConfig> configurations(configurations_);
+  int num_skipped = 0;
+  int skipped_elapsed_ms = 0;
+  PrioritizeAt(kHost, 1000, &configurations, &num_skipped, &skipped_elapsed_ms);
+  EXPECT_EQ(3, configurations.size());
+  EXPECT_EQ(0, num_skipped);
+}
+
+TEST_F(ProxyHealthTableTest, Prioritize_AllFailing) {
+  for (size_t i = 0; i != configurations_.size(); ++i) {
+    RecordFailureAt(kHost, configurations_[i], 10, 1000);
+    RecordFailureAt(kHost, configurations_[i], 10, 1000);
+  }
+
+  // All configurations are kept when all of them are cooling down.
+  std::vector<ProxyConfig> configurations(configurations_);
+  int num_skipped = 0;
+  int skipped_elapsed_ms = 0;
+  PrioritizeAt(kHost, 1000, &configurations, &num_skipped, &skipped_elapsed_ms);
+  EXPECT_EQ(3, configurations.size());
+  EXPECT_EQ(0, num_skipped);
+  EXPECT_EQ(0, skipped_elapsed_ms);
+}
+
+TEST_F(ProxyHealthTableTest, RecordFailure_ForgetsLastGood) {
+  const ProxyConfig direct(MakeDirect());
+  table_.RecordSuccess(kHost, direct);
+  RecordFailureAt(kHost, direct, 10, 1000);
+
+  std::vector<ProxyConfig> configurations(configurations_);
+  int num_skipped = 0;
+  int skipped_elapsed_ms = 0;
+  PrioritizeAt(kHost, 1000, &configurations, &num_skipped, &skipped_elapsed_ms);
+  EXPECT_STREQ(_T("proxy1:80"), configurations[0].source);
+}
+
+}  // namespace omaha
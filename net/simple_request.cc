@@ -28,6 +28,7 @@
 
 #include "omaha/net/simple_request.h"
 #include <atlconv.h>
+#include <algorithm>
 #include <climits>
 #include <memory>
 #include <vector>
@@ -39,6 +40,8 @@
 #include "omaha/base/scoped_any.h"
 #include "omaha/base/scope_guard.h"
 #include "omaha/base/string.h"
+#include "omaha/base/tracing.h"
+#include "omaha/net/bandwidth_throttle.h"
 #include "omaha/net/network_config.h"
 #include "omaha/net/network_request.h"
 #include "omaha/net/proxy_auth.h"
@@ -54,6 +57,7 @@ SimpleRequest::SimpleRequest()
       is_closed_(false),
       session_handle_(NULL),
       low_priority_(false),
+      throttle_priority_(0),
       callback_(NULL),
       download_completed_(false),
       pause_happened_(false) {
@@ -271,6 +275,7 @@ HRESULT SimpleRequest::Send() {
 }
 
 HRESULT SimpleRequest::Connect() {
+  ScopedTraceSpan span("net", "Connect");
   HRESULT hr = winhttp_adapter_->CrackUrl(url_,
                                           ICU_DECODE,
                                           &request_state_->scheme,
@@ -395,6 +400,7 @@ HRESULT SimpleRequest::OpenDestinationFile(HANDLE* file_handle) {
 }
 
 HRESULT SimpleRequest::SendRequest() {
+  ScopedTraceSpan span("net", "SendRequest");
   int proxy_retry_count = 0;
   int max_proxy_retries = 1;
   CString username;
@@ -552,6 +558,8 @@ HRESULT SimpleRequest::SendRequest() {
 HRESULT SimpleRequest::ReceiveData(HANDLE file_handle) {
   ASSERT1(file_handle != INVALID_HANDLE_VALUE || filename_.IsEmpty());
 
+  ScopedTraceSpan span("net", "ReceiveData");
+
   HRESULT hr = S_OK;
 
   // In the case of a "204 No Content" response, WinHttp blocks when
@@ -579,6 +587,18 @@ HRESULT SimpleRequest::ReceiveData(HANDLE file_handle) {
       request_state_->http_status_code == HTTP_STATUS_OK ||
       request_state_->http_status_code == HTTP_STATUS_PARTIAL_CONTENT;
 
+  // Low priority requests are throttled while the other requests are counted
+  // as foreground transfers, which the low priority requests yield to.
+  BandwidthThrottle* throttle =
+      NetworkConfigManager::Instance().bandwidth_throttle();
+  ScopeGuard foreground_guard = MakeObjGuard(
+      *throttle, &BandwidthThrottle::EndForegroundTransfer);
+  if (low_priority_) {
+    foreground_guard.Dismiss();
+  } else {
+    throttle->BeginForegroundTransfer();
+  }
+
   std::vector<uint8> buffer;
   do  {
     DWORD bytes_available(0);
@@ -623,9 +643,14 @@ HRESULT SimpleRequest::ReceiveData(HANDLE file_handle) {
                             WINHTTP_CALLBACK_STATUS_READ_COMPLETE,
                             NULL);
     }
+
+    if (low_priority_ && !buffer.empty()) {
+      WaitForBandwidth(throttle, buffer.size());
+    }
   } while (!buffer.empty());
 
   NET_LOG(L3, (_T("[bytes downloaded %d]"), request_state_->current_bytes));
+  span.set_arg("bytes", request_state_->current_bytes);
   if (file_handle != INVALID_HANDLE_VALUE) {
     // All bytes must be written to the file in the file download case.
     ASSERT1(::SetFilePointer(file_handle, 0, NULL, FILE_CURRENT) ==
@@ -636,6 +661,22 @@ HRESULT SimpleRequest::ReceiveData(HANDLE file_handle) {
   return hr;
 }
 
+// Waits in short intervals so that the request reacts promptly to the rate
+// changing when foreground transfers start or end, and to being canceled,
+// closed, or paused.
+void SimpleRequest::WaitForBandwidth(BandwidthThrottle* throttle,
+                                     int num_bytes) {
+  ASSERT1(throttle);
+
+  const int kMaxWaitIntervalMs = 250;
+
+  int wait_ms = throttle->Consume(throttle_priority_, num_bytes);
+  while (wait_ms > 0 && !is_canceled_ && !is_closed_ && !pause_happened_) {
+    ::Sleep(std::min(wait_ms, kMaxWaitIntervalMs));
+    wait_ms = throttle->Consume(throttle_priority_, 0);
+  }
+}
+
 HRESULT SimpleRequest::PrepareRequest(HANDLE* file_handle) {
   // Read the remaining bytes of the body. If we have a file to save the
   // response into, create the file.
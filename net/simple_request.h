@@ -35,6 +35,7 @@
 
 namespace omaha {
 
+class BandwidthThrottle;
 class WinHttpAdapter;
 
 class SimpleRequest : public HttpRequestInterface {
@@ -88,6 +89,10 @@ class SimpleRequest : public HttpRequestInterface {
     low_priority_ = low_priority;
   }
 
+  virtual void set_throttle_priority(int throttle_priority) {
+    throttle_priority_ = throttle_priority;
+  }
+
   virtual void set_callback(NetworkRequestCallback* callback) {
     callback_ = callback;
   }
@@ -122,6 +127,10 @@ class SimpleRequest : public HttpRequestInterface {
   bool IsResumeNeeded() const;
   bool IsPauseSupported() const;
 
+  // Blocks while the low priority request exceeds its bandwidth after
+  // receiving num_bytes.
+  void WaitForBandwidth(BandwidthThrottle* throttle, int num_bytes);
+
   void LogResponseHeaders();
 
   // Sets proxy information for the request.
@@ -181,6 +190,7 @@ class SimpleRequest : public HttpRequestInterface {
   ProxyAuthConfig proxy_auth_config_;
   ProxyConfig proxy_config_;
   bool low_priority_;
+  int throttle_priority_;
   NetworkRequestCallback* callback_;
   scoped_ptr<WinHttpAdapter> winhttp_adapter_;
   scoped_ptr<TransientRequestState> request_state_;
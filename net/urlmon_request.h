@@ -101,6 +101,10 @@ class UrlmonRequest : public HttpRequestInterface {
     UNREFERENCED_PARAMETER(low_priority);
   }
 
+  virtual void set_throttle_priority(int throttle_priority) {
+    UNREFERENCED_PARAMETER(throttle_priority);
+  }
+
   virtual void set_callback(NetworkRequestCallback* callback) {
     // TODO(Omaha) - Provide events.
     UNREFERENCED_PARAMETER(callback);
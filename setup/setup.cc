@@ -31,6 +31,7 @@
 #include "omaha/base/logging.h"
 #include "omaha/base/omaha_version.h"
 #include "omaha/base/process.h"
+#include "omaha/base/process_index.h"
 #include "omaha/base/reg_key.h"
 #include "omaha/base/scoped_any.h"
 #include "omaha/base/scope_guard.h"
@@ -1002,12 +1003,14 @@ HRESULT Setup::GetPidsToWaitForUsingCommandLine(Pids* pids) const {
                         cm->GetUserGoopdateInstallDirNoCreate());
   ASSERT1(!official_path.IsEmpty());
 
-  // Only include processes running under the official path.
+  // Only include processes running under the official path. The command lines
+  // were read and cached by FindProcesses.
   Pids pids_to_wait_for;
   for (size_t i = 0; i < google_update_process_ids.size(); ++i) {
     CString cmd_line;
     const uint32 process_id = google_update_process_ids[i];
-    if (SUCCEEDED(Process::GetCommandLine(process_id, &cmd_line))) {
+    if (SUCCEEDED(ProcessIndex::Instance().GetCommandLine(process_id,
+                                                          &cmd_line))) {
       cmd_line.MakeLower();
 
       CString exe_path;
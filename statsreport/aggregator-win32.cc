@@ -58,6 +58,7 @@ void MetricsAggregatorWin32::EndAggregation() {
   timing_key_.Close();
   integer_key_.Close();
   bool_key_.Close();
+  histogram_key_.Close();
 
   key_.Close();
 }
@@ -144,4 +145,24 @@ void MetricsAggregatorWin32::Aggregate(BoolMetric &metric) {
                                       &value, sizeof(value));
 }
 
+void MetricsAggregatorWin32::Aggregate(HistogramMetric &metric) {
+  // do as little as possible if no value
+  HistogramMetric::HistogramData value = metric.Reset();
+  if (0 == value.count)
+    return;
+
+  if (!EnsureKey(kHistogramsKeyName, &histogram_key_))
+    return;
+
+  CString name(metric.name());
+  HistogramMetric::HistogramData reg_value;
+  if (!GetData(histogram_key_, name, &reg_value)) {
+    memcpy(&reg_value, &value, sizeof(value));
+  } else {
+    HistogramMetric::Merge(value, &reg_value);
+  }
+
+  LONG err = histogram_key_.SetBinaryValue(name, &reg_value, sizeof(reg_value));
+}
+
 } // namespace stats_report
@@ -37,6 +37,8 @@ const wchar_t MetricsAggregatorWin32Test::kIntegersKeyName[] =
                                                       KEY_STRING L"\\Integers";
 const wchar_t MetricsAggregatorWin32Test::kBoolsKeyName[] = 
                                                       KEY_STRING L"\\Booleans";
+const wchar_t MetricsAggregatorWin32Test::kHistogramsKeyName[] =
+                                                    KEY_STRING L"\\Histograms";
 
 
 #define EXPECT_REGVAL_EQ(value, key_name, value_name) do { \
@@ -72,6 +74,14 @@ TEST_F(MetricsAggregatorWin32Test, AggregateWin32) {
     int32 bool_true = 1, bool_false = 0;
     EXPECT_REGVAL_EQ(bool_true, kBoolsKeyName, L"b1");
     EXPECT_REGVAL_EQ(bool_false, kBoolsKeyName, L"b2");
+
+    HistogramMetric::HistogramData hist1 = { 2, 0, 30, 10, 20 };
+    hist1.buckets[HistogramMetric::GetBucketIndex(10)] = 1;
+    hist1.buckets[HistogramMetric::GetBucketIndex(20)] = 1;
+    HistogramMetric::HistogramData hist2 = { 1, 0, 3000, 3000, 3000 };
+    hist2.buckets[HistogramMetric::GetBucketIndex(3000)] = 1;
+    EXPECT_REGVAL_EQ(hist1, kHistogramsKeyName, L"h1");
+    EXPECT_REGVAL_EQ(hist2, kHistogramsKeyName, L"h2");
   }
   
   AddStats();  
@@ -94,5 +104,13 @@ TEST_F(MetricsAggregatorWin32Test, AggregateWin32) {
     int32 bool_true = 1, bool_false = 0;
     EXPECT_REGVAL_EQ(bool_true, kBoolsKeyName, L"b1");
     EXPECT_REGVAL_EQ(bool_false, kBoolsKeyName, L"b2");
+
+    HistogramMetric::HistogramData hist1 = { 4, 0, 60, 10, 20 };
+    hist1.buckets[HistogramMetric::GetBucketIndex(10)] = 2;
+    hist1.buckets[HistogramMetric::GetBucketIndex(20)] = 2;
+    HistogramMetric::HistogramData hist2 = { 2, 0, 6000, 3000, 3000 };
+    hist2.buckets[HistogramMetric::GetBucketIndex(3000)] = 2;
+    EXPECT_REGVAL_EQ(hist1, kHistogramsKeyName, L"h1");
+    EXPECT_REGVAL_EQ(hist2, kHistogramsKeyName, L"h2");
   }
 }
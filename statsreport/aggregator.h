@@ -48,6 +48,7 @@ protected:
   virtual void Aggregate(TimingMetric &metric) = 0;
   virtual void Aggregate(IntegerMetric &metric) = 0;
   virtual void Aggregate(BoolMetric &metric) = 0;
+  virtual void Aggregate(HistogramMetric &metric) = 0;
 
 private:
   DISALLOW_EVIL_CONSTRUCTORS(MetricsAggregator);
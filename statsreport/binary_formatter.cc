@@ -0,0 +1,363 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+//
+#include "binary_formatter.h"
+
+namespace stats_report {
+
+namespace {
+
+// The number of values that are delta encoded, which excludes the histogram
+// buckets.
+size_t GetNumFixedValues(MetricType type) {
+  switch (type) {
+    case kCountType:
+    case kIntegerType:
+      return 1;
+    case kTimingType:
+    case kHistogramType:
+      return 4;
+    default:
+      return 0;
+  }
+}
+
+// Wrap around instead of overflowing.
+int64 SubtractWrapping(int64 a, int64 b) {
+  return static_cast<int64>(static_cast<uint64>(a) - static_cast<uint64>(b));
+}
+
+int64 AddWrapping(int64 a, int64 b) {
+  return static_cast<int64>(static_cast<uint64>(a) + static_cast<uint64>(b));
+}
+
+bool ReadString(const std::string &in, size_t *pos, uint64 length,
+                std::string *value) {
+  if (length > in.size() - *pos)
+    return false;
+  value->assign(in, *pos, static_cast<size_t>(length));
+  *pos += static_cast<size_t>(length);
+  return true;
+}
+
+} // namespace
+
+uint32 BinaryBaseline::Intern(const std::string &name, bool *is_new) {
+  std::map<std::string, uint32>::const_iterator it = ids_.find(name);
+  if (it != ids_.end()) {
+    *is_new = false;
+    return it->second;
+  }
+
+  uint32 id = static_cast<uint32>(entries_.size());
+  entries_.push_back(Entry());
+  entries_.back().name = name;
+  ids_[name] = id;
+  *is_new = true;
+  return id;
+}
+
+BinaryFormatter::BinaryFormatter(const char *name, uint32 measurement_secs,
+                                 const BinaryBaseline &baseline)
+    : next_baseline_(baseline) {
+  next_baseline_.id_ = baseline.id_ + 1;
+  if (0 == next_baseline_.id_)
+    next_baseline_.id_ = 1;
+
+  output_.push_back(static_cast<char>(kVersion));
+  AppendVarint(baseline.id_, &output_);
+  AppendVarint(measurement_secs, &output_);
+  std::string app_name(name);
+  AppendVarint(app_name.size(), &output_);
+  output_.append(app_name);
+}
+
+BinaryFormatter::~BinaryFormatter() {
+}
+
+void BinaryFormatter::AddCount(const char *name, int64 value) {
+  std::vector<int64> values(1, value);
+  Add(name, kCountType, false, values, 1);
+}
+
+void BinaryFormatter::AddTiming(const char *name, int64 num, int64 avg,
+                                int64 min, int64 max) {
+  std::vector<int64> values;
+  values.push_back(num);
+  values.push_back(avg);
+  values.push_back(min);
+  values.push_back(max);
+  Add(name, kTimingType, false, values, 4);
+}
+
+void BinaryFormatter::AddInteger(const char *name, int64 value) {
+  std::vector<int64> values(1, value);
+  Add(name, kIntegerType, false, values, 1);
+}
+
+void BinaryFormatter::AddBoolean(const char *name, bool value) {
+  std::vector<int64> values(1, value ? 1 : 0);
+  Add(name, kBoolType, value, values, 0);
+}
+
+void BinaryFormatter::AddHistogram(
+    const char *name, const HistogramMetric::HistogramData &data) {
+  std::vector<int64> values;
+  values.push_back(data.count);
+  values.push_back(data.sum);
+  values.push_back(data.minimum);
+  values.push_back(data.maximum);
+  for (int i = 0; i < HistogramMetric::kNumBuckets; ++i) {
+    if (0 == data.buckets[i])
+      continue;
+    values.push_back(i);
+    values.push_back(data.buckets[i]);
+  }
+  Add(name, kHistogramType, false, values, 4);
+}
+
+void BinaryFormatter::AddMetric(MetricBase *metric) {
+  switch (metric->type()) {
+    case kCountType: {
+      CountMetric &count = metric->AsCount();
+      AddCount(count.name(), count.value());
+    }
+    break;
+
+    case kTimingType: {
+      TimingMetric &timing = metric->AsTiming();
+      AddTiming(timing.name(), timing.count(), timing.average(),
+                timing.minimum(), timing.maximum());
+    }
+    break;
+
+    case kIntegerType: {
+      IntegerMetric &integer = metric->AsInteger();
+      AddInteger(integer.name(), integer.value());
+    }
+    break;
+
+    case kBoolType: {
+      BoolMetric &boolean = metric->AsBool();
+      DCHECK_NE(boolean.value(), BoolMetric::kBoolUnset);
+      AddBoolean(boolean.name(), boolean.value() != BoolMetric::kBoolFalse);
+    }
+    break;
+
+    case kHistogramType: {
+      HistogramMetric &histogram = metric->AsHistogram();
+      AddHistogram(histogram.name(), histogram.data());
+    }
+    break;
+
+    default:
+      DCHECK(false && "Impossible metric type");
+  }
+}
+
+void BinaryFormatter::Add(const char *name, MetricType type, bool is_true,
+                          const std::vector<int64> &values,
+                          size_t num_fixed) {
+  std::string metric_name(name);
+  bool is_new = false;
+  uint32 id = next_baseline_.Intern(metric_name, &is_new);
+  if (is_new) {
+    AppendVarint((static_cast<uint64>(metric_name.size()) << 1) | 1,
+                 &output_);
+    output_.append(metric_name);
+  } else {
+    AppendVarint(static_cast<uint64>(id) << 1, &output_);
+  }
+
+  BinaryBaseline::Entry &entry = next_baseline_.entries_[id];
+
+  std::string plain;
+  for (size_t i = 0; i < num_fixed; ++i)
+    AppendSignedVarint(values[i], &plain);
+
+  std::string delta;
+  if (num_fixed && entry.type == type) {
+    for (size_t i = 0; i < num_fixed; ++i)
+      AppendSignedVarint(SubtractWrapping(values[i], entry.values[i]),
+                         &delta);
+  }
+
+  uint8 type_byte = static_cast<uint8>(type);
+  if (is_true)
+    type_byte |= kTrueFlag;
+  if (!delta.empty() && delta.size() < plain.size()) {
+    type_byte |= kDeltaFlag;
+    plain.swap(delta);
+  }
+  output_.push_back(static_cast<char>(type_byte));
+  output_.append(plain);
+
+  if (kHistogramType == type) {
+    AppendVarint((values.size() - num_fixed) / 2, &output_);
+    int64 previous_index = 0;
+    for (size_t i = num_fixed; i + 1 < values.size(); i += 2) {
+      AppendVarint(static_cast<uint64>(values[i] - previous_index), &output_);
+      AppendVarint(static_cast<uint64>(values[i + 1]), &output_);
+      previous_index = values[i];
+    }
+  }
+
+  entry.type = type;
+  entry.values = values;
+}
+
+void BinaryFormatter::AppendVarint(uint64 value, std::string *out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+void BinaryFormatter::AppendSignedVarint(int64 value, std::string *out) {
+  // Zigzag encoding maps small negative values to small unsigned values.
+  uint64 zigzag = (static_cast<uint64>(value) << 1) ^
+                  static_cast<uint64>(value >> 63);
+  AppendVarint(zigzag, out);
+}
+
+bool BinaryFormatter::ReadVarint(const std::string &in, size_t *pos,
+                                 uint64 *value) {
+  uint64 result = 0;
+  for (int shift = 0; shift < 64 && *pos < in.size(); shift += 7) {
+    uint8 byte = static_cast<uint8>(in[(*pos)++]);
+    result |= static_cast<uint64>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool BinaryFormatter::ReadSignedVarint(const std::string &in, size_t *pos,
+                                       int64 *value) {
+  uint64 zigzag = 0;
+  if (!ReadVarint(in, pos, &zigzag))
+    return false;
+  *value = static_cast<int64>(zigzag >> 1) ^ -static_cast<int64>(zigzag & 1);
+  return true;
+}
+
+bool ParseBinaryMetrics(const std::string &payload,
+                        const BinaryBaseline &baseline,
+                        std::string *app_name,
+                        uint32 *measurement_secs,
+                        std::vector<BinaryMetric> *metrics,
+                        BinaryBaseline *next_baseline) {
+  size_t pos = 0;
+  if (payload.empty() ||
+      static_cast<uint8>(payload[pos++]) != BinaryFormatter::kVersion)
+    return false;
+
+  uint64 baseline_id = 0;
+  uint64 secs = 0;
+  uint64 length = 0;
+  if (!BinaryFormatter::ReadVarint(payload, &pos, &baseline_id) ||
+      baseline_id != baseline.id_ ||
+      !BinaryFormatter::ReadVarint(payload, &pos, &secs) ||
+      secs > kuint32max ||
+      !BinaryFormatter::ReadVarint(payload, &pos, &length) ||
+      !ReadString(payload, &pos, length, app_name))
+    return false;
+  *measurement_secs = static_cast<uint32>(secs);
+
+  BinaryBaseline next(baseline);
+  next.id_ = baseline.id_ + 1;
+  if (0 == next.id_)
+    next.id_ = 1;
+
+  metrics->clear();
+  while (pos < payload.size()) {
+    uint64 name_ref = 0;
+    if (!BinaryFormatter::ReadVarint(payload, &pos, &name_ref))
+      return false;
+
+    uint32 id = 0;
+    if (name_ref & 1) {
+      std::string name;
+      bool is_new = false;
+      if (!ReadString(payload, &pos, name_ref >> 1, &name))
+        return false;
+      id = next.Intern(name, &is_new);
+      if (!is_new)
+        return false;
+    } else {
+      if ((name_ref >> 1) >= next.entries_.size())
+        return false;
+      id = static_cast<uint32>(name_ref >> 1);
+    }
+    BinaryBaseline::Entry &entry = next.entries_[id];
+
+    if (pos >= payload.size())
+      return false;
+    uint8 type_byte = static_cast<uint8>(payload[pos++]);
+    int type = type_byte & BinaryFormatter::kTypeMask;
+    if (type < kCountType || type > kHistogramType)
+      return false;
+
+    BinaryMetric metric;
+    metric.name = entry.name;
+    metric.type = static_cast<MetricType>(type);
+
+    size_t num_fixed = GetNumFixedValues(metric.type);
+    bool is_delta = 0 != (type_byte & BinaryFormatter::kDeltaFlag);
+    if (is_delta && (entry.type != metric.type || !num_fixed))
+      return false;
+    for (size_t i = 0; i < num_fixed; ++i) {
+      int64 value = 0;
+      if (!BinaryFormatter::ReadSignedVarint(payload, &pos, &value))
+        return false;
+      metric.values.push_back(is_delta ? AddWrapping(entry.values[i], value) :
+                                         value);
+    }
+
+    if (kBoolType == metric.type) {
+      metric.values.push_back(
+          (type_byte & BinaryFormatter::kTrueFlag) ? 1 : 0);
+    } else if (kHistogramType == metric.type) {
+      uint64 num_buckets = 0;
+      if (!BinaryFormatter::ReadVarint(payload, &pos, &num_buckets) ||
+          num_buckets > payload.size() - pos)
+        return false;
+      int64 index = 0;
+      for (uint64 i = 0; i < num_buckets; ++i) {
+        uint64 index_delta = 0;
+        uint64 count = 0;
+        if (!BinaryFormatter::ReadVarint(payload, &pos, &index_delta) ||
+            !BinaryFormatter::ReadVarint(payload, &pos, &count))
+          return false;
+        index = AddWrapping(index, static_cast<int64>(index_delta));
+        metric.values.push_back(index);
+        metric.values.push_back(static_cast<int64>(count));
+      }
+    }
+
+    entry.type = metric.type;
+    entry.values = metric.values;
+    metrics->push_back(metric);
+  }
+
+  *next_baseline = next;
+  return true;
+}
+
+} // namespace stats_report
@@ -0,0 +1,162 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// A compact alternative to Formatter. Metric names are interned: a name sent
+// in an upload the server acknowledged is sent as a small integer afterwards.
+// Integers are zigzag varints, and the fixed values of a metric are sent as
+// the difference to its values in the acknowledged upload when that is
+// shorter.
+//
+// Payload layout, where varint is a base 128 varint and svarint a zigzag
+// encoded varint:
+//   payload  := version:byte baseline_id:varint measurement_secs:varint
+//               app_name:string metric*
+//   string   := length:varint byte*
+//   metric   := name_ref type:byte value*
+//   name_ref := varint, (id << 1) for an interned name, or
+//               (length << 1 | 1) followed by the bytes of a new name, which
+//               gets the next id
+//   type     := MetricType | kDeltaFlag | kTrueFlag for true booleans
+//   values   := count:     svarint
+//               timing:    count avg min max as svarint
+//               integer:   svarint
+//               boolean:   none
+//               histogram: count sum min max as svarint, num_buckets:varint,
+//                          (index_delta:varint count:varint)*
+// With kDeltaFlag set, the svarint values, except the histogram buckets, are
+// the differences to the values of the same metric in the baseline.
+#ifndef OMAHA_STATSREPORT_BINARY_FORMATTER_H__
+#define OMAHA_STATSREPORT_BINARY_FORMATTER_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include "base/basictypes.h"
+#include "metrics.h"
+
+namespace stats_report {
+
+/// A metric as sent in a binary payload. Booleans have one value, 0 or 1.
+/// Histograms have count, sum, min and max followed by pairs of bucket index
+/// and sample count for the non-empty buckets.
+struct BinaryMetric {
+  std::string name;
+  MetricType type;
+  std::vector<int64> values;
+};
+
+/// The state both ends share after the server acknowledges an upload: the
+/// interned names and the last values of each metric. Id 0 is the empty
+/// baseline, which the first upload and any upload after a lost
+/// acknowledgement are encoded against.
+class BinaryBaseline {
+public:
+  BinaryBaseline() : id_(0) {}
+
+  uint32 id() const { return id_; }
+  size_t num_names() const { return entries_.size(); }
+
+private:
+  friend class BinaryFormatter;
+  friend bool ParseBinaryMetrics(const std::string &payload,
+                                 const BinaryBaseline &baseline,
+                                 std::string *app_name,
+                                 uint32 *measurement_secs,
+                                 std::vector<BinaryMetric> *metrics,
+                                 BinaryBaseline *next_baseline);
+
+  struct Entry {
+    Entry() : type(kInvalidType) {}
+
+    std::string name;
+    MetricType type;          // kInvalidType until a value is sent.
+    std::vector<int64> values;
+  };
+
+  /// Returns the id of the name, interning it if needed.
+  uint32 Intern(const std::string &name, bool *is_new);
+
+  uint32 id_;
+  std::vector<Entry> entries_;            // Indexed by name id.
+  std::map<std::string, uint32> ids_;
+};
+
+class BinaryFormatter {
+public:
+  /// @param name the name of the application to report stats against
+  /// @param baseline the state of the last acknowledged upload
+  BinaryFormatter(const char *name, uint32 measurement_secs,
+                  const BinaryBaseline &baseline);
+  ~BinaryFormatter();
+
+  /// Add metric to the output
+  void AddMetric(MetricBase *metric);
+
+  /// Add typed metrics to the output
+  /// @{
+  void AddCount(const char *name, int64 value);
+  void AddTiming(const char *name, int64 num, int64 avg, int64 min,
+                 int64 max);
+  void AddInteger(const char *name, int64 value);
+  void AddBoolean(const char *name, bool value);
+  void AddHistogram(const char *name,
+                    const HistogramMetric::HistogramData &data);
+  /// @}
+
+  /// Returns the payload.
+  const std::string &output() const { return output_; }
+
+  /// Returns the baseline for the next upload, once the server acknowledged
+  /// this one.
+  const BinaryBaseline &next_baseline() const { return next_baseline_; }
+
+  static const uint8 kVersion = 1;
+  static const uint8 kTypeMask = 0x07;
+  static const uint8 kDeltaFlag = 0x08;
+  static const uint8 kTrueFlag = 0x10;
+
+  /// Encoding primitives.
+  /// @{
+  static void AppendVarint(uint64 value, std::string *out);
+  static void AppendSignedVarint(int64 value, std::string *out);
+  static bool ReadVarint(const std::string &in, size_t *pos, uint64 *value);
+  static bool ReadSignedVarint(const std::string &in, size_t *pos,
+                               int64 *value);
+  /// @}
+
+private:
+  DISALLOW_EVIL_CONSTRUCTORS(BinaryFormatter);
+
+  /// Encodes the metric. The first 'num_fixed' values are delta encoded
+  /// against the baseline when that is shorter.
+  void Add(const char *name, MetricType type, bool is_true,
+           const std::vector<int64> &values, size_t num_fixed);
+
+  BinaryBaseline next_baseline_;
+  std::string output_;
+};
+
+/// Decodes a payload encoded against the baseline. Returns false if the
+/// payload is malformed or was encoded against another baseline.
+bool ParseBinaryMetrics(const std::string &payload,
+                        const BinaryBaseline &baseline,
+                        std::string *app_name,
+                        uint32 *measurement_secs,
+                        std::vector<BinaryMetric> *metrics,
+                        BinaryBaseline *next_baseline);
+
+} // namespace stats_report
+
+#endif  // OMAHA_STATSREPORT_BINARY_FORMATTER_H__
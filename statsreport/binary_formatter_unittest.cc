@@ -0,0 +1,200 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <string>
+#include <vector>
+#include "omaha/third_party/gtest/include/gtest/gtest.h"
+#include "binary_formatter.h"
+#include "formatter.h"
+
+using stats_report::BinaryBaseline;
+using stats_report::BinaryFormatter;
+using stats_report::BinaryMetric;
+using stats_report::Formatter;
+using stats_report::HistogramMetric;
+using stats_report::ParseBinaryMetrics;
+
+namespace {
+
+HistogramMetric::HistogramData MakeHistogram() {
+  HistogramMetric::HistogramData histogram = { 3, 0, 330, 10, 300 };
+  histogram.buckets[HistogramMetric::GetBucketIndex(10)] = 1;
+  histogram.buckets[HistogramMetric::GetBucketIndex(20)] = 1;
+  histogram.buckets[HistogramMetric::GetBucketIndex(300)] = 1;
+  return histogram;
+}
+
+template <typename T>
+void AddMetrics(T *formatter, int64 scale) {
+  formatter->AddCount("worker_apps_installed", 10 * scale);
+  formatter->AddTiming("worker_download_time_ms", 2, 150 * scale, 50, 200);
+  formatter->AddInteger("core_cr_expected_timer_interval_ms", 86400000);
+  formatter->AddBoolean("goopdate_is_machine", true);
+  formatter->AddBoolean("goopdate_has_admin", false);
+  formatter->AddHistogram("goopdate_startup_ms", MakeHistogram());
+}
+
+} // namespace
+
+TEST(BinaryFormatter, Varint) {
+  const uint64 kValues[] = { 0, 1, 127, 128, 300, 16383, 16384, kuint32max,
+                             kuint64max };
+  for (size_t i = 0; i < arraysize(kValues); ++i) {
+    std::string encoded;
+    BinaryFormatter::AppendVarint(kValues[i], &encoded);
+    size_t pos = 0;
+    uint64 value = 0;
+    EXPECT_TRUE(BinaryFormatter::ReadVarint(encoded, &pos, &value));
+    EXPECT_EQ(kValues[i], value);
+    EXPECT_EQ(encoded.size(), pos);
+  }
+
+  std::string encoded;
+  BinaryFormatter::AppendVarint(127, &encoded);
+  EXPECT_EQ(1, encoded.size());
+  BinaryFormatter::AppendVarint(128, &encoded);
+  EXPECT_EQ(3, encoded.size());
+
+  // Truncated.
+  encoded.resize(2);
+  size_t pos = 1;
+  uint64 value = 0;
+  EXPECT_FALSE(BinaryFormatter::ReadVarint(encoded, &pos, &value));
+}
+
+TEST(BinaryFormatter, SignedVarint) {
+  const int64 kValues[] = { 0, -1, 1, -64, 63, -65, 64, kint64min,
+                            kint64max };
+  for (size_t i = 0; i < arraysize(kValues); ++i) {
+    std::string encoded;
+    BinaryFormatter::AppendSignedVarint(kValues[i], &encoded);
+    size_t pos = 0;
+    int64 value = 0;
+    EXPECT_TRUE(BinaryFormatter::ReadSignedVarint(encoded, &pos, &value));
+    EXPECT_EQ(kValues[i], value);
+  }
+
+  std::string encoded;
+  BinaryFormatter::AppendSignedVarint(-64, &encoded);
+  EXPECT_EQ(1, encoded.size());
+}
+
+TEST(BinaryFormatter, RoundTrip) {
+  BinaryBaseline baseline;
+  BinaryFormatter formatter("test_application", 86400, baseline);
+  AddMetrics(&formatter, 1);
+
+  std::string app_name;
+  uint32 measurement_secs = 0;
+  std::vector<BinaryMetric> metrics;
+  BinaryBaseline next_baseline;
+  ASSERT_TRUE(ParseBinaryMetrics(formatter.output(), baseline, &app_name,
+                                 &measurement_secs, &metrics,
+                                 &next_baseline));
+  EXPECT_EQ("test_application", app_name);
+  EXPECT_EQ(86400, measurement_secs);
+  EXPECT_EQ(1, next_baseline.id());
+  EXPECT_EQ(6, next_baseline.num_names());
+  EXPECT_EQ(formatter.next_baseline().id(), next_baseline.id());
+
+  ASSERT_EQ(6, metrics.size());
+  EXPECT_EQ("worker_apps_installed", metrics[0].name);
+  EXPECT_EQ(stats_report::kCountType, metrics[0].type);
+  ASSERT_EQ(1, metrics[0].values.size());
+  EXPECT_EQ(10, metrics[0].values[0]);
+
+  EXPECT_EQ(stats_report::kTimingType, metrics[1].type);
+  ASSERT_EQ(4, metrics[1].values.size());
+  EXPECT_EQ(150, metrics[1].values[1]);
+
+  EXPECT_EQ(86400000, metrics[2].values[0]);
+  EXPECT_EQ(1, metrics[3].values[0]);
+  EXPECT_EQ(0, metrics[4].values[0]);
+
+  EXPECT_EQ(stats_report::kHistogramType, metrics[5].type);
+  ASSERT_EQ(10, metrics[5].values.size());
+  EXPECT_EQ(3, metrics[5].values[0]);
+  EXPECT_EQ(330, metrics[5].values[1]);
+  EXPECT_EQ(HistogramMetric::GetBucketIndex(300), metrics[5].values[8]);
+  EXPECT_EQ(1, metrics[5].values[9]);
+}
+
+// The second upload sends interned names and deltas, and is decoded against
+// the baseline of the first upload.
+TEST(BinaryFormatter, Baseline) {
+  BinaryFormatter first("test_application", 86400, BinaryBaseline());
+  AddMetrics(&first, 1);
+  const BinaryBaseline &baseline = first.next_baseline();
+
+  BinaryFormatter second("test_application", 86400, baseline);
+  AddMetrics(&second, 2);
+  second.AddCount("worker_apps_uninstalled", 1);
+  EXPECT_LT(second.output().size(), first.output().size() / 2);
+
+  std::string app_name;
+  uint32 measurement_secs = 0;
+  std::vector<BinaryMetric> metrics;
+  BinaryBaseline next_baseline;
+
+  // Decoding against the wrong baseline fails.
+  EXPECT_FALSE(ParseBinaryMetrics(second.output(), BinaryBaseline(),
+                                  &app_name, &measurement_secs, &metrics,
+                                  &next_baseline));
+
+  ASSERT_TRUE(ParseBinaryMetrics(second.output(), baseline, &app_name,
+                                 &measurement_secs, &metrics,
+                                 &next_baseline));
+  ASSERT_EQ(7, metrics.size());
+  EXPECT_EQ("worker_apps_installed", metrics[0].name);
+  EXPECT_EQ(20, metrics[0].values[0]);
+  EXPECT_EQ(300, metrics[1].values[1]);
+  EXPECT_EQ("worker_apps_uninstalled", metrics[6].name);
+  EXPECT_EQ(1, metrics[6].values[0]);
+  EXPECT_EQ(2, next_baseline.id());
+  EXPECT_EQ(7, next_baseline.num_names());
+}
+
+TEST(BinaryFormatter, SmallerThanText) {
+  Formatter text("test_application", 86400);
+  AddMetrics(&text, 1);
+  BinaryFormatter binary("test_application", 86400, BinaryBaseline());
+  AddMetrics(&binary, 1);
+  EXPECT_LT(binary.output().size(), strlen(text.output()));
+}
+
+TEST(BinaryFormatter, Malformed) {
+  BinaryFormatter formatter("test_application", 86400, BinaryBaseline());
+  AddMetrics(&formatter, 1);
+  const std::string &payload = formatter.output();
+
+  std::string app_name;
+  uint32 measurement_secs = 0;
+  std::vector<BinaryMetric> metrics;
+  BinaryBaseline next_baseline;
+  // A payload truncated at a metric boundary is valid.
+  for (size_t size = 0; size < payload.size(); ++size) {
+    std::string truncated(payload, 0, size);
+    if (ParseBinaryMetrics(truncated, BinaryBaseline(), &app_name,
+                           &measurement_secs, &metrics, &next_baseline)) {
+      EXPECT_GT(6, metrics.size());
+    }
+  }
+
+  std::string bad_version(payload);
+  bad_version[0] = 2;
+  EXPECT_FALSE(ParseBinaryMetrics(bad_version, BinaryBaseline(), &app_name,
+                                  &measurement_secs, &metrics,
+                                  &next_baseline));
+}
@@ -23,6 +23,7 @@ extern const wchar_t kCountsKeyName[];
 extern const wchar_t kTimingsKeyName[];
 extern const wchar_t kIntegersKeyName[];
 extern const wchar_t kBooleansKeyName[];
+extern const wchar_t kHistogramsKeyName[];
 extern const wchar_t kStatsKeyFormatString[];
 extern const wchar_t kLastTransmissionTimeValueName[];
 
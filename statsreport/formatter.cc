@@ -43,6 +43,26 @@ void Formatter::AddBoolean(const char *name, bool value) {
   output_ << "&" << name << ":b=" << (value ? "t" : "f");
 }
 
+// Formats the same values as a timing, followed by the non-empty buckets as
+// pairs of bucket lower bound and sample count, so that the server can merge
+// the histograms without knowing the bucket layout.
+void Formatter::AddHistogram(const char *name,
+                             const HistogramMetric::HistogramData &data) {
+  int64 avg = data.count ? data.sum / data.count : 0;
+  output_ << "&" << name << ":h=" << data.count << ";" << avg << ";"
+                                  << data.minimum << ";" << data.maximum
+                                  << ";";
+
+  const char *separator = "";
+  for (int i = 0; i < HistogramMetric::kNumBuckets; ++i) {
+    if (0 == data.buckets[i])
+      continue;
+    output_ << separator << HistogramMetric::GetBucketLowerBound(i) << ":"
+            << data.buckets[i];
+    separator = ",";
+  }
+}
+
 void Formatter::AddMetric(MetricBase *metric) {
   switch (metric->type()) {
     case kCountType: {
@@ -73,6 +93,12 @@ void Formatter::AddMetric(MetricBase *metric) {
     }
     break;
 
+    case kHistogramType: {
+      HistogramMetric &histogram = metric->AsHistogram();
+      AddHistogram(histogram.name(), histogram.data());
+    }
+    break;
+
     default:
       DCHECK(false && "Impossible metric type");
   }
@@ -43,6 +43,8 @@ public:
                  int64 max);
   void AddInteger(const char *name, int64 value);
   void AddBoolean(const char *name, bool value);
+  void AddHistogram(const char *name,
+                    const HistogramMetric::HistogramData &data);
   /// @}
 
   /// Terminates the output string and returns it.
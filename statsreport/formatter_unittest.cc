@@ -16,6 +16,7 @@
 #include "formatter.h"
 
 using stats_report::Formatter;
+using stats_report::HistogramMetric;
 
 TEST(Formatter, Format) {
   Formatter formatter("test_application", 86400);
@@ -25,12 +26,19 @@ TEST(Formatter, Format) {
   formatter.AddInteger("integer1", 3000);
   formatter.AddBoolean("boolean1", true);
   formatter.AddBoolean("boolean2", false);
-  
+
+  HistogramMetric::HistogramData histogram = { 3, 0, 330, 10, 300 };
+  histogram.buckets[HistogramMetric::GetBucketIndex(10)] = 1;
+  histogram.buckets[HistogramMetric::GetBucketIndex(20)] = 1;
+  histogram.buckets[HistogramMetric::GetBucketIndex(300)] = 1;
+  formatter.AddHistogram("histogram1", histogram);
+
   EXPECT_STREQ("test_application&86400"
                "&count1:c=10"
                "&timing1:t=2;150;50;200"
                "&integer1:i=3000"
                "&boolean1:b=t"
-               "&boolean2:b=f",
+               "&boolean2:b=f"
+               "&histogram1:h=3;110;10;300;10:1,20:1,288:1",
                formatter.output());
 }
\ No newline at end of file
@@ -15,8 +15,12 @@
 //
 // Implements metrics and metrics collections
 #include "omaha/statsreport/metrics.h"
+#include <intrin.h>
+#include <algorithm>
 #include "omaha/base/synchronized.h"
 
+#pragma intrinsic(_InterlockedCompareExchange64)
+
 namespace stats_report {
 // Make sure global stats collection is placed in zeroed storage so as to avoid
 // initialization order snafus.
@@ -212,6 +216,233 @@ void TimingMetric::Clear() {
   memset(&data_, 0, sizeof(data_));
 }
 
+namespace {
+
+// Histograms are updated with interlocked operations instead of g_lock. The
+// 64 bit operations are built on the compare-exchange intrinsic, which is
+// available on all the supported platforms.
+LONG volatile *AsLong(uint32 *value) {
+  return reinterpret_cast<LONG volatile*>(value);
+}
+
+uint32 AtomicRead(uint32 *target) {
+  return static_cast<uint32>(
+      ::InterlockedCompareExchange(AsLong(target), 0, 0));
+}
+
+uint32 AtomicExchange(uint32 *target, uint32 value) {
+  return static_cast<uint32>(::InterlockedExchange(AsLong(target),
+                                                   static_cast<LONG>(value)));
+}
+
+int64 AtomicRead(int64 *target) {
+  return _InterlockedCompareExchange64(target, 0, 0);
+}
+
+int64 AtomicExchange(int64 *target, int64 value) {
+  int64 old_value = AtomicRead(target);
+  for (;;) {
+    int64 prev = _InterlockedCompareExchange64(target, value, old_value);
+    if (prev == old_value)
+      return old_value;
+    old_value = prev;
+  }
+}
+
+void AtomicAdd(int64 *target, int64 addend) {
+  int64 old_value = AtomicRead(target);
+  for (;;) {
+    int64 prev = _InterlockedCompareExchange64(target,
+                                               old_value + addend,
+                                               old_value);
+    if (prev == old_value)
+      return;
+    old_value = prev;
+  }
+}
+
+void AtomicMin(int64 *target, int64 value) {
+  int64 old_value = AtomicRead(target);
+  while (value < old_value) {
+    int64 prev = _InterlockedCompareExchange64(target, value, old_value);
+    if (prev == old_value)
+      return;
+    old_value = prev;
+  }
+}
+
+void AtomicMax(int64 *target, int64 value) {
+  int64 old_value = AtomicRead(target);
+  while (value > old_value) {
+    int64 prev = _InterlockedCompareExchange64(target, value, old_value);
+    if (prev == old_value)
+      return;
+    old_value = prev;
+  }
+}
+
+}  // namespace
+
+HistogramMetric::HistogramMetric(const char *name, const HistogramData &value)
+    : MetricBase(name, kHistogramType), data_(value) {
+  if (0 == data_.count) {
+    data_.minimum = kint64max;
+    data_.maximum = kint64min;
+  }
+}
+
+uint32 HistogramMetric::count() const {
+  return AtomicRead(const_cast<uint32*>(&data_.count));
+}
+
+int64 HistogramMetric::sum() const {
+  return AtomicRead(const_cast<int64*>(&data_.sum));
+}
+
+int64 HistogramMetric::minimum() const {
+  return data().minimum;
+}
+
+int64 HistogramMetric::maximum() const {
+  return data().maximum;
+}
+
+int64 HistogramMetric::average() const {
+  HistogramData snapshot = data();
+  return snapshot.count ? snapshot.sum / snapshot.count : 0;
+}
+
+int64 HistogramMetric::Percentile(int percent) const {
+  return Percentile(data(), percent);
+}
+
+HistogramMetric::HistogramData HistogramMetric::data() const {
+  HistogramData *data = const_cast<HistogramData*>(&data_);
+
+  HistogramData ret;
+  ret.count = AtomicRead(&data->count);
+  ret.align = 0;
+  ret.sum = AtomicRead(&data->sum);
+  ret.minimum = AtomicRead(&data->minimum);
+  ret.maximum = AtomicRead(&data->maximum);
+  for (int i = 0; i < kNumBuckets; ++i)
+    ret.buckets[i] = AtomicRead(&data->buckets[i]);
+
+  if (0 == ret.count) {
+    ret.minimum = 0;
+    ret.maximum = 0;
+  }
+  return ret;
+}
+
+void HistogramMetric::AddSample(int64 value) {
+  ::InterlockedIncrement(AsLong(&data_.buckets[GetBucketIndex(value)]));
+  AtomicAdd(&data_.sum, value);
+  AtomicMin(&data_.minimum, value);
+  AtomicMax(&data_.maximum, value);
+
+  // The count is updated last so that a non-zero count implies valid minimum
+  // and maximum values.
+  ::InterlockedIncrement(AsLong(&data_.count));
+}
+
+HistogramMetric::HistogramData HistogramMetric::Reset() {
+  HistogramData ret;
+  ret.count = AtomicExchange(&data_.count, 0);
+  ret.align = 0;
+  ret.sum = AtomicExchange(&data_.sum, 0);
+  ret.minimum = AtomicExchange(&data_.minimum, kint64max);
+  ret.maximum = AtomicExchange(&data_.maximum, kint64min);
+  for (int i = 0; i < kNumBuckets; ++i)
+    ret.buckets[i] = AtomicExchange(&data_.buckets[i], 0);
+
+  if (0 == ret.count) {
+    ret.minimum = 0;
+    ret.maximum = 0;
+  }
+  return ret;
+}
+
+void HistogramMetric::Merge(const HistogramData &from, HistogramData *to) {
+  DCHECK(NULL != to);
+
+  if (0 == from.count)
+    return;
+
+  if (0 == to->count) {
+    *to = from;
+    return;
+  }
+
+  to->count += from.count;
+  to->sum += from.sum;
+  to->minimum = std::min(to->minimum, from.minimum);
+  to->maximum = std::max(to->maximum, from.maximum);
+  for (int i = 0; i < kNumBuckets; ++i)
+    to->buckets[i] += from.buckets[i];
+}
+
+int64 HistogramMetric::Percentile(const HistogramData &data, int percent) {
+  DCHECK(0 <= percent && percent <= 100);
+
+  // The buckets are used rather than count, which may differ slightly.
+  uint64 total = 0;
+  for (int i = 0; i < kNumBuckets; ++i)
+    total += data.buckets[i];
+  if (0 == total || 0 == data.count)
+    return 0;
+
+  // The rank of the sample at the percentile, from 1 to total.
+  percent = std::min(std::max(percent, 0), 100);
+  uint64 rank = std::max<uint64>((total * percent + 99) / 100, 1);
+
+  int index = 0;
+  for (uint64 seen = 0; index < kNumBuckets - 1; ++index) {
+    seen += data.buckets[index];
+    if (seen >= rank)
+      break;
+  }
+
+  // Estimates the sample with the upper bound of its bucket.
+  int64 value = (index == kNumBuckets - 1) ?
+                data.maximum : GetBucketLowerBound(index + 1) - 1;
+  return std::min(std::max(value, data.minimum), data.maximum);
+}
+
+int HistogramMetric::GetBucketIndex(int64 value) {
+  if (value < kNumSubBuckets)
+    return value < 0 ? 0 : static_cast<int>(value);
+  if (value >= (static_cast<int64>(1) << kMaxValueBits))
+    return kNumBuckets - 1;
+
+  // The position of the most significant bit, at least kSubBucketBits.
+  int msb = 0;
+  for (int64 v = value >> 1; v; v >>= 1)
+    ++msb;
+
+  // The bits after the most significant bit select the linear sub-bucket.
+  const int shift = msb - kSubBucketBits;
+  const int sub_bucket = static_cast<int>(value >> shift) - kNumSubBuckets;
+  return (shift + 1) * kNumSubBuckets + sub_bucket;
+}
+
+int64 HistogramMetric::GetBucketLowerBound(int index) {
+  DCHECK(0 <= index && index < kNumBuckets);
+
+  if (index < kNumSubBuckets)
+    return index;
+
+  const int shift = index / kNumSubBuckets - 1;
+  const int sub_bucket = index % kNumSubBuckets;
+  return static_cast<int64>(kNumSubBuckets + sub_bucket) << shift;
+}
+
+void HistogramMetric::Clear() {
+  memset(&data_, 0, sizeof(data_));
+  data_.minimum = kint64max;
+  data_.maximum = kint64min;
+}
+
 void BoolMetric::Set(bool value) {
   ObjectLock lock(this);
   value_ = value ? kBoolTrue : kBoolFalse;
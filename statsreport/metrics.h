@@ -50,6 +50,21 @@
 #define TIME_SCOPE(timing) \
   stats_report::TimingSample __xxsample__(timing)
 
+/// Use histogram metrics to report on the distribution of important values,
+/// typically times, when the average is not enough. A histogram metric reports
+/// the same values as a timing metric, plus the number of samples in each of
+/// a fixed set of log-linear buckets, from which percentiles can be computed.
+/// Samples can be added concurrently without locking.
+/// A timing metric can be switched over by changing its declaration,
+/// definition, and any TIME_SCOPE to TIME_SCOPE_HISTOGRAM.
+#define DECLARE_METRIC_histogram(name)  DECLARE_METRIC(HistogramMetric, name)
+#define DEFINE_METRIC_histogram(name)  DEFINE_METRIC(HistogramMetric, name)
+
+/// Collects a sample from here to the end of the current scope, and
+/// adds the sample to the histogram metric supplied
+#define TIME_SCOPE_HISTOGRAM(histogram) \
+  stats_report::HistogramSample __xxhistogramsample__(histogram)
+
 /// Use integer metrics to report runtime values that fluctuate.
 /// Examples:
 ///    # object count
@@ -93,7 +108,8 @@ enum MetricType {
   kCountType,
   kTimingType,
   kIntegerType,
-  kBoolType
+  kBoolType,
+  kHistogramType
 };
 
 // fwd.
@@ -105,6 +121,7 @@ class CountMetric;
 class TimingMetric;
 class IntegerMetric;
 class BoolMetric;
+class HistogramMetric;
 
 /// Base class for all stats instances.
 /// Stats instances are chained together against a MetricCollection to
@@ -120,11 +137,13 @@ public:
   TimingMetric &AsTiming();
   IntegerMetric &AsInteger();
   BoolMetric &AsBool();
+  HistogramMetric &AsHistogram();
 
   const CountMetric &AsCount() const;
   const TimingMetric &AsTiming() const;
   const IntegerMetric &AsInteger() const;
   const BoolMetric &AsBool() const;
+  const HistogramMetric &AsHistogram() const;
   /// @}
 
   /// @name Accessors
@@ -486,6 +505,107 @@ private:
   TristateBoolValue value_;
 };
 
+/// A histogram metric counts samples in log-linear buckets: the values from
+/// 0 to kNumSubBuckets - 1 have a bucket each, and each power of two range
+/// above is split in kNumSubBuckets linear buckets. The bucket of a value is
+/// within 1 / kNumSubBuckets of the value, and the memory used is fixed.
+/// Values above 2^kMaxValueBits are counted in the last bucket, negative
+/// values in the first.
+///
+/// Recording is lock-free. A sample recorded concurrently with Reset() may be
+/// partially counted in both periods, so the bucket counts may not add up
+/// exactly to count.
+class HistogramMetric: public MetricBase {
+public:
+  enum {
+    kSubBucketBits = 3,
+    kNumSubBuckets = 1 << kSubBucketBits,
+    kMaxValueBits = 31,
+    kNumBuckets = kNumSubBuckets * (kMaxValueBits - kSubBucketBits + 1),
+  };
+
+  /// This is also the persisted form of the metric.
+  struct HistogramData {
+    uint32 count;
+    uint32 align; // allow access to the alignment gap between count and sum,
+                  // makes it esier to unittest.
+    int64 sum;
+    int64 minimum;
+    int64 maximum;
+    uint32 buckets[kNumBuckets];
+  };
+
+  HistogramMetric(const char *name, MetricCollectionBase *coll)
+      : MetricBase(name, kHistogramType, coll) {
+    Clear();
+  }
+
+  HistogramMetric(const char *name, const HistogramData &value);
+
+  uint32 count() const;
+  int64 sum() const;
+  int64 minimum() const;
+  int64 maximum() const;
+  int64 average() const;
+
+  /// Returns an estimate of the value below which the given percent of the
+  /// samples fall, or zero if there are no samples.
+  int64 Percentile(int percent) const;
+
+  /// Returns a snapshot of the metric.
+  HistogramData data() const;
+
+  /// Adds a single sample to the metric
+  void AddSample(int64 value);
+
+  /// Nulls the metric and returns the current values.
+  HistogramData Reset();
+
+  /// Adds the samples in from to the samples in to.
+  static void Merge(const HistogramData &from, HistogramData *to);
+
+  /// Returns the estimated percentile of the samples in data.
+  static int64 Percentile(const HistogramData &data, int percent);
+
+  /// Returns the bucket a value is counted in.
+  static int GetBucketIndex(int64 value);
+
+  /// Returns the smallest value counted in the bucket.
+  static int64 GetBucketLowerBound(int index);
+
+private:
+  DISALLOW_EVIL_CONSTRUCTORS(HistogramMetric);
+
+  void Clear();
+
+  /// Updated with interlocked operations. The minimum and maximum hold
+  /// sentinel values while count is zero.
+  HistogramData data_;
+};
+
+/// A convenience class to sample the time from construction to destruction
+/// against a given histogram metric.
+class HistogramSample {
+public:
+  /// @param histogram the metric the sample is to be tallied against
+  explicit HistogramSample(HistogramMetric &histogram)
+      : histogram_(histogram) {
+  }
+
+  ~HistogramSample() {
+    histogram_.AddSample(timer_.GetElapsedMs());
+  }
+
+private:
+  /// Collects the sample for us.
+  omaha::HighresTimer timer_;
+
+  /// The metric we tally against.
+  HistogramMetric &histogram_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(HistogramSample);
+};
+
 inline CountMetric &MetricBase::AsCount() {
   DCHECK_EQ(kCountType, type());
 
@@ -510,6 +630,12 @@ inline BoolMetric &MetricBase::AsBool() {
   return static_cast<BoolMetric&>(*this);
 }
 
+inline HistogramMetric &MetricBase::AsHistogram() {
+  DCHECK_EQ(kHistogramType, type());
+
+  return static_cast<HistogramMetric&>(*this);
+}
+
 inline const CountMetric &MetricBase::AsCount() const {
   DCHECK_EQ(kCountType, type());
 
@@ -534,6 +660,12 @@ inline const BoolMetric &MetricBase::AsBool() const {
   return static_cast<const BoolMetric&>(*this);
 }
 
+inline const HistogramMetric &MetricBase::AsHistogram() const {
+  DCHECK_EQ(kHistogramType, type());
+
+  return static_cast<const HistogramMetric&>(*this);
+}
+
 } // namespace stats_report
 
 #endif  // OMAHA_STATSREPORT_METRICS_H__
@@ -31,6 +31,9 @@ DEFINE_METRIC_integer(integer);
 DECLARE_METRIC_bool(bool);
 DEFINE_METRIC_bool(bool);
 
+DECLARE_METRIC_histogram(histogram);
+DEFINE_METRIC_histogram(histogram);
+
 using namespace stats_report;
 
 namespace {
@@ -52,13 +55,15 @@ public:
 
 protected:
   MetricsEnumTest(): count_("count", &coll_), timing_("timing", &coll_),
-       integer_("integer", &coll_), bool_("bool", &coll_){
+       integer_("integer", &coll_), bool_("bool", &coll_),
+       histogram_("histogram", &coll_) {
   }
 
   CountMetric count_;
   TimingMetric timing_;
   IntegerMetric integer_;
   BoolMetric bool_;
+  HistogramMetric histogram_;
 };
 
 } // namespace
@@ -76,11 +81,18 @@ TEST_F(MetricsTest, Globals) {
   EXPECT_EQ(0, ::metric_integer.value());
   EXPECT_EQ(BoolMetric::kBoolUnset, ::metric_bool.Reset());
 
+  HistogramMetric::HistogramData histogram_data = ::metric_histogram.Reset();
+  EXPECT_EQ(0, histogram_data.count);
+  EXPECT_EQ(0, histogram_data.maximum);
+  EXPECT_EQ(0, histogram_data.minimum);
+  EXPECT_EQ(0, histogram_data.sum);
+
   // Check for correct initialization
   EXPECT_STREQ("count", metric_count.name());
   EXPECT_STREQ("timing", metric_timing.name());
   EXPECT_STREQ("integer", metric_integer.name());
   EXPECT_STREQ("bool", metric_bool.name());
+  EXPECT_STREQ("histogram", metric_histogram.name());
 }
 
 
@@ -215,6 +227,133 @@ TEST_F(MetricsTest, TimingSample) {
   EXPECT_EQ(0, data.count);
 }
 
+TEST_F(MetricsTest, Histogram) {
+  HistogramMetric foo("foo", &coll_);
+
+  EXPECT_EQ(kHistogramType, foo.type());
+  HistogramMetric &foo_ref = foo.AsHistogram();
+
+  EXPECT_EQ(0, foo.count());
+  EXPECT_EQ(0, foo.minimum());
+  EXPECT_EQ(0, foo.maximum());
+  EXPECT_EQ(0, foo.Percentile(50));
+
+  foo.AddSample(100);
+  foo.AddSample(50);
+
+  EXPECT_EQ(2, foo.count());
+  EXPECT_EQ(150, foo.sum());
+  EXPECT_EQ(100, foo.maximum());
+  EXPECT_EQ(50, foo.minimum());
+  EXPECT_EQ(75, foo.average());
+
+  HistogramMetric::HistogramData data = foo.Reset();
+  EXPECT_EQ(2, data.count);
+  EXPECT_EQ(150, data.sum);
+  EXPECT_EQ(100, data.maximum);
+  EXPECT_EQ(50, data.minimum);
+  EXPECT_EQ(1, data.buckets[HistogramMetric::GetBucketIndex(50)]);
+  EXPECT_EQ(1, data.buckets[HistogramMetric::GetBucketIndex(100)]);
+
+  EXPECT_EQ(0, foo.count());
+  EXPECT_EQ(0, foo.sum());
+  EXPECT_EQ(0, foo.maximum());
+  EXPECT_EQ(0, foo.minimum());
+  EXPECT_EQ(0, foo.average());
+
+  // Negative samples are counted in the first bucket.
+  foo.AddSample(-10);
+  EXPECT_EQ(-10, foo.minimum());
+  EXPECT_EQ(1, foo.data().buckets[0]);
+}
+
+TEST_F(MetricsTest, HistogramBuckets) {
+  // Small values have a bucket each.
+  for (int i = 0; i < HistogramMetric::kNumSubBuckets; ++i) {
+    EXPECT_EQ(i, HistogramMetric::GetBucketIndex(i));
+    EXPECT_EQ(i, HistogramMetric::GetBucketLowerBound(i));
+  }
+
+  EXPECT_EQ(HistogramMetric::kNumBuckets - 1,
+            HistogramMetric::GetBucketIndex(kint64max));
+  EXPECT_EQ(HistogramMetric::kNumBuckets - 1,
+            HistogramMetric::GetBucketIndex(
+                static_cast<int64>(1) << HistogramMetric::kMaxValueBits));
+
+  // The lower bounds increase, and each value maps back to its bucket with
+  // an error within the bucket resolution.
+  for (int i = 1; i < HistogramMetric::kNumBuckets; ++i) {
+    const int64 lower = HistogramMetric::GetBucketLowerBound(i);
+    EXPECT_LT(HistogramMetric::GetBucketLowerBound(i - 1), lower);
+    EXPECT_EQ(i, HistogramMetric::GetBucketIndex(lower));
+    EXPECT_EQ(i - 1, HistogramMetric::GetBucketIndex(lower - 1));
+    EXPECT_LE(lower - HistogramMetric::GetBucketLowerBound(i - 1),
+              std::max<int64>(1, lower / HistogramMetric::kNumSubBuckets));
+  }
+}
+
+TEST_F(MetricsTest, HistogramPercentile) {
+  HistogramMetric foo("foo", &coll_);
+
+  for (int i = 1; i <= 100; ++i)
+    foo.AddSample(i);
+
+  EXPECT_EQ(1, foo.Percentile(0));
+  EXPECT_EQ(100, foo.Percentile(100));
+
+  // The estimates are within the bucket resolution.
+  EXPECT_LE(50, foo.Percentile(50));
+  EXPECT_GE(50 + 50 / HistogramMetric::kNumSubBuckets, foo.Percentile(50));
+  EXPECT_LE(95, foo.Percentile(95));
+  EXPECT_GE(95 + 95 / HistogramMetric::kNumSubBuckets, foo.Percentile(95));
+  EXPECT_LE(99, foo.Percentile(99));
+  EXPECT_GE(100, foo.Percentile(99));
+}
+
+TEST_F(MetricsTest, HistogramMerge) {
+  HistogramMetric::HistogramData to = { 0 };
+  HistogramMetric::HistogramData from = { 2, 0, 300, 100, 200 };
+  from.buckets[HistogramMetric::GetBucketIndex(100)] = 1;
+  from.buckets[HistogramMetric::GetBucketIndex(200)] = 1;
+
+  HistogramMetric::Merge(from, &to);
+  EXPECT_EQ(0, memcmp(&from, &to, sizeof(to)));
+
+  HistogramMetric::HistogramData other = { 1, 0, 10, 10, 10 };
+  other.buckets[HistogramMetric::GetBucketIndex(10)] = 1;
+  HistogramMetric::Merge(other, &to);
+  EXPECT_EQ(3, to.count);
+  EXPECT_EQ(310, to.sum);
+  EXPECT_EQ(10, to.minimum);
+  EXPECT_EQ(200, to.maximum);
+  EXPECT_EQ(1, to.buckets[HistogramMetric::GetBucketIndex(10)]);
+  EXPECT_EQ(1, to.buckets[HistogramMetric::GetBucketIndex(100)]);
+  EXPECT_EQ(1, to.buckets[HistogramMetric::GetBucketIndex(200)]);
+
+  // Merging an empty histogram is a no-op.
+  HistogramMetric::HistogramData empty = { 0 };
+  HistogramMetric::HistogramData copy = to;
+  HistogramMetric::Merge(empty, &to);
+  EXPECT_EQ(0, memcmp(&copy, &to, sizeof(to)));
+}
+
+TEST_F(MetricsTest, HistogramSample) {
+  HistogramMetric foo("foo", &coll_);
+
+  {
+    HistogramSample sample(foo);
+
+    ::Sleep(30);
+  }
+
+  HistogramMetric::HistogramData data = foo.Reset();
+  EXPECT_EQ(1, data.count);
+
+  // See the comments in the TimingSample test.
+  EXPECT_GE(30 + 70, data.sum);
+  EXPECT_LE(14, data.sum);
+}
+
 TEST_F(MetricsTest, Integer) {
   IntegerMetric foo("foo", &coll_);
 
@@ -265,6 +404,7 @@ TEST_F(MetricsEnumTest, Enumeration) {
         &timing_,
         &integer_,
         &bool_,
+        &histogram_,
   };
 
   for (int i = 0; i < sizeof(metrics) / sizeof(metrics[0]); ++i) {
@@ -283,7 +423,9 @@ TEST_F(MetricsEnumTest, Enumeration) {
 
 TEST_F(MetricsEnumTest, Iterator) {
   typedef MetricBase *MetricBasePtr;
-  MetricBasePtr metrics[] = { &count_, &timing_, &integer_, &bool_, };
+  MetricBasePtr metrics[] = {
+      &count_, &timing_, &integer_, &bool_, &histogram_,
+  };
   int num_stats = sizeof(metrics) / sizeof(metrics[0]);
 
   MetricIterator it(coll_), end;
@@ -357,5 +499,19 @@ TEST_F(MetricsTest, SimpleConstruction) {
   EXPECT_EQ(kBoolType, bool_false.type());
   EXPECT_STREQ("bool_false", bool_false.name());
   EXPECT_TRUE(NULL == bool_false.next());
+
+  HistogramMetric::HistogramData histogram_data = { 2, 0, 30, 10, 20 };
+  histogram_data.buckets[HistogramMetric::GetBucketIndex(10)] = 1;
+  histogram_data.buckets[HistogramMetric::GetBucketIndex(20)] = 1;
+  const HistogramMetric h("h", histogram_data);
+
+  EXPECT_EQ(2, h.count());
+  EXPECT_EQ(30, h.sum());
+  EXPECT_EQ(10, h.minimum());
+  EXPECT_EQ(20, h.maximum());
+  EXPECT_EQ(20, h.Percentile(99));
+  EXPECT_EQ(kHistogramType, h.type());
+  EXPECT_STREQ("h", h.name());
+  EXPECT_TRUE(NULL == h.next());
 }
 
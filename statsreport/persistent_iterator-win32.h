@@ -89,6 +89,7 @@ private:
     kTimings,
     kIntegers,
     kBooleans,
+    kHistograms,
     kFinished,
   };
 
@@ -79,6 +79,13 @@ bool equals(MetricBase *a, MetricBase *b) {
    case kBoolType:
     return a->AsBool().value() == b->AsBool().value();
     break;
+   case kHistogramType: {
+      HistogramMetric::HistogramData ah = a->AsHistogram().data();
+      HistogramMetric::HistogramData bh = b->AsHistogram().data();
+
+      return 0 == memcmp(&ah, &bh, sizeof(ah));
+    }
+    break;
 
    case kInvalidType:
    default:
@@ -0,0 +1,546 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/testing/http_test_server.h"
+#include <ws2tcpip.h>
+#include <algorithm>
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/string.h"
+
+namespace omaha {
+
+namespace {
+
+// Requests with larger headers are rejected.
+const int kMaxHeaderBytes = 64 * 1024;
+
+// The body is sent in slices of this size, which is also the granularity of
+// the throttling.
+const size_t kSendSliceBytes = 4 * 1024;
+
+const char* GetReasonPhrase(int status_code) {
+  switch (status_code) {
+    case 200: return "OK";
+    case 206: return "Partial Content";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 416: return "Requested Range Not Satisfiable";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    default:  return "Unknown";
+  }
+}
+
+}  // namespace
+
+CStringA HttpTestRequest::GetHeader(const char* name) const {
+  ASSERT1(name);
+  CStringA key(name);
+  key.MakeLower();
+  std::map<CStringA, CStringA>::const_iterator it = headers.find(key);
+  return it != headers.end() ? it->second : CStringA();
+}
+
+void StaticContentHandler::HandleRequest(const HttpTestRequest& request,
+                                         HttpTestResponse* response) {
+  UNREFERENCED_PARAMETER(request);
+  ASSERT1(response);
+
+  response->headers.push_back(std::make_pair(CStringA("Content-Type"),
+                                             content_type_));
+  response->body = content_;
+  response->supports_ranges = true;
+  response->is_chunked = is_chunked_;
+  response->bytes_per_sec = bytes_per_sec_;
+}
+
+// Serves a connection on its own thread.
+class HttpTestServer::Connection : public Runnable {
+ public:
+  Connection(HttpTestServer* server, SOCKET socket)
+      : server_(server),
+        socket_(socket) {
+    ASSERT1(server);
+    ASSERT1(socket != INVALID_SOCKET);
+  }
+
+  virtual ~Connection() {
+    VERIFY1(!::closesocket(socket_));
+  }
+
+  bool Start() { return thread_.Start(this); }
+
+  // Unblocks the thread of the connection and waits for it to exit.
+  void Stop() {
+    ::shutdown(socket_, SD_BOTH);
+    VERIFY1(thread_.WaitTillExit(INFINITE));
+  }
+
+ private:
+  virtual void Run() { server_->ServeConnection(socket_); }
+
+  HttpTestServer* server_;
+  const SOCKET socket_;
+  Thread thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(Connection);
+};
+
+HttpTestServer::HttpTestServer()
+    : listen_socket_(INVALID_SOCKET),
+      port_(0),
+      is_winsock_initialized_(false),
+      num_requests_(0),
+      is_stopping_(false) {
+}
+
+HttpTestServer::~HttpTestServer() {
+  Stop();
+}
+
+void HttpTestServer::AddHandler(const char* path, HttpTestHandler* handler) {
+  ASSERT1(path);
+  ASSERT1(handler);
+
+  __mutexScope(lock_);
+  handlers_[path] = handler;
+}
+
+void HttpTestServer::set_faults(const HttpTestFaults& faults) {
+  __mutexScope(lock_);
+  faults_ = faults;
+}
+
+HRESULT HttpTestServer::Start() {
+  ASSERT1(listen_socket_ == INVALID_SOCKET);
+
+  WSADATA wsa_data = {0};
+  int error = ::WSAStartup(MAKEWORD(2, 2), &wsa_data);
+  if (error) {
+    return HRESULT_FROM_WIN32(error);
+  }
+  is_winsock_initialized_ = true;
+
+  listen_socket_ = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (listen_socket_ == INVALID_SOCKET) {
+    return HRESULT_FROM_WIN32(::WSAGetLastError());
+  }
+
+  sockaddr_in address = {0};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+  address.sin_port = 0;
+  int address_size = sizeof(address);
+  if (::bind(listen_socket_,
+             reinterpret_cast<sockaddr*>(&address),
+             sizeof(address)) ||
+      ::listen(listen_socket_, SOMAXCONN) ||
+      ::getsockname(listen_socket_,
+                    reinterpret_cast<sockaddr*>(&address),
+                    &address_size)) {
+    HRESULT hr = HRESULT_FROM_WIN32(::WSAGetLastError());
+    Stop();
+    return hr;
+  }
+  port_ = ::ntohs(address.sin_port);
+
+  if (!accept_thread_.Start(this)) {
+    HRESULT hr = HRESULTFromLastError();
+    Stop();
+    return hr;
+  }
+
+  CORE_LOG(L3, (_T("[HttpTestServer::Start][port %d]"), port_));
+  return S_OK;
+}
+
+void HttpTestServer::Stop() {
+  __mutexBlock(lock_) {
+    is_stopping_ = true;
+  }
+
+  if (listen_socket_ != INVALID_SOCKET) {
+    // Closing the socket makes accept() fail in the accept thread.
+    VERIFY1(!::closesocket(listen_socket_));
+    listen_socket_ = INVALID_SOCKET;
+    if (accept_thread_.GetThreadHandle()) {
+      VERIFY1(accept_thread_.WaitTillExit(INFINITE));
+    }
+  }
+
+  // The accept thread has exited, so no connection is added from now on.
+  std::vector<Connection*> connections;
+  __mutexBlock(lock_) {
+    connections.swap(connections_);
+  }
+  for (size_t i = 0; i != connections.size(); ++i) {
+    connections[i]->Stop();
+    delete connections[i];
+  }
+
+  if (is_winsock_initialized_) {
+    VERIFY1(!::WSACleanup());
+    is_winsock_initialized_ = false;
+  }
+}
+
+CString HttpTestServer::GetUrl(const CString& path) const {
+  CString url;
+  url.Format(_T("http://127.0.0.1:%d%s"), port_, path);
+  return url;
+}
+
+int HttpTestServer::num_requests() const {
+  __mutexScope(lock_);
+  return num_requests_;
+}
+
+void HttpTestServer::Run() {
+  for (;;) {
+    SOCKET socket = ::accept(listen_socket_, NULL, NULL);
+    if (socket == INVALID_SOCKET) {
+      CORE_LOG(L3, (_T("[accept failed][%d]"), ::WSAGetLastError()));
+      return;
+    }
+
+    const BOOL no_delay = TRUE;
+    ::setsockopt(socket,
+                 IPPROTO_TCP,
+                 TCP_NODELAY,
+                 reinterpret_cast<const char*>(&no_delay),
+                 sizeof(no_delay));
+
+    Connection* connection = new Connection(this, socket);
+    __mutexBlock(lock_) {
+      if (is_stopping_ || !connection->Start()) {
+        delete connection;
+        return;
+      }
+      connections_.push_back(connection);
+    }
+  }
+}
+
+void HttpTestServer::ServeConnection(SOCKET socket) {
+  CStringA buffer;
+  for (;;) {
+    HttpTestRequest request;
+    if (!ReadRequest(socket, &buffer, &request)) {
+      break;
+    }
+    if (!ServeRequest(socket, request)) {
+      break;
+    }
+  }
+
+  // Lets the client see the end of the stream. The socket is closed when the
+  // server stops.
+  ::shutdown(socket, SD_SEND);
+}
+
+bool HttpTestServer::ServeRequest(SOCKET socket,
+                                  const HttpTestRequest& request) {
+  int request_number = 0;
+  __mutexBlock(lock_) {
+    request_number = ++num_requests_;
+  }
+  const HttpTestFaults faults = GetFaults();
+
+  CORE_LOG(L3, (_T("[HttpTestServer][request %d][%s %s]"),
+                request_number,
+                CString(request.method),
+                CString(request.path)));
+
+  if (faults.response_delay_ms) {
+    ::Sleep(faults.response_delay_ms);
+  }
+
+  if (faults.drop_every_n && request_number % faults.drop_every_n == 0) {
+    return false;
+  }
+
+  HttpTestResponse response;
+  if (faults.error_every_n && request_number % faults.error_every_n == 0) {
+    response.status_code = faults.error_status_code;
+  } else {
+    HttpTestHandler* handler = GetHandler(request.path);
+    if (handler) {
+      handler->HandleRequest(request, &response);
+    } else {
+      response.status_code = 404;
+    }
+  }
+
+  if (!SendResponse(socket, request, response, faults.truncate_body_bytes)) {
+    return false;
+  }
+
+  return request.GetHeader("Connection").CompareNoCase("close") != 0;
+}
+
+HttpTestHandler* HttpTestServer::GetHandler(const CStringA& path) const {
+  __mutexScope(lock_);
+  std::map<CStringA, HttpTestHandler*>::const_iterator it =
+      handlers_.find(path);
+  return it != handlers_.end() ? it->second : NULL;
+}
+
+HttpTestFaults HttpTestServer::GetFaults() const {
+  __mutexScope(lock_);
+  return faults_;
+}
+
+// Reads a request from the socket. buffer holds the bytes received and not
+// consumed yet, which may belong to the next request of the connection.
+bool HttpTestServer::ReadRequest(SOCKET socket,
+                                 CStringA* buffer,
+                                 HttpTestRequest* request) {
+  ASSERT1(buffer);
+  ASSERT1(request);
+
+  char data[kSendSliceBytes] = {0};
+  int header_end = -1;
+  while ((header_end = buffer->Find("\r\n\r\n")) == -1) {
+    if (buffer->GetLength() > kMaxHeaderBytes) {
+      return false;
+    }
+    const int bytes = ::recv(socket, data, sizeof(data), 0);
+    if (bytes <= 0) {
+      return false;
+    }
+    buffer->Append(data, bytes);
+  }
+
+  const CStringA header = buffer->Left(header_end);
+  buffer->Delete(0, header_end + 4);
+
+  int position = 0;
+  const CStringA request_line = header.Tokenize("\r\n", position);
+  int request_line_position = 0;
+  request->method = request_line.Tokenize(" ", request_line_position);
+  CStringA target = request_line.Tokenize(" ", request_line_position);
+  if (request->method.IsEmpty() || target.IsEmpty()) {
+    return false;
+  }
+
+  const int query_start = target.Find('?');
+  if (query_start != -1) {
+    request->query = target.Mid(query_start + 1);
+    target.Truncate(query_start);
+  }
+  request->path = target;
+
+  for (CStringA line = header.Tokenize("\r\n", position);
+       position != -1;
+       line = header.Tokenize("\r\n", position)) {
+    const int colon = line.Find(':');
+    if (colon <= 0) {
+      continue;
+    }
+    CStringA name = line.Left(colon);
+    name.Trim();
+    name.MakeLower();
+    CStringA value = line.Mid(colon + 1);
+    value.Trim();
+    request->headers[name] = value;
+  }
+
+  // Only bodies with a Content-Length are supported.
+  const int content_length = atoi(request->GetHeader("Content-Length"));
+  while (buffer->GetLength() < content_length) {
+    const int bytes = ::recv(socket, data, sizeof(data), 0);
+    if (bytes <= 0) {
+      return false;
+    }
+    buffer->Append(data, bytes);
+  }
+  if (content_length > 0) {
+    request->body.assign(buffer->GetString(),
+                         buffer->GetString() + content_length);
+    buffer->Delete(0, content_length);
+  }
+
+  return true;
+}
+
+bool HttpTestServer::SendResponse(SOCKET socket,
+                                  const HttpTestRequest& request,
+                                  const HttpTestResponse& response,
+                                  int truncate_body_bytes) {
+  int status_code = response.status_code;
+  size_t first = 0;
+  size_t last = response.body.empty() ? 0 : response.body.size() - 1;
+  size_t body_size = response.body.size();
+
+  CStringA headers;
+  const CStringA range = request.GetHeader("Range");
+  if (response.supports_ranges && status_code == 200 && !range.IsEmpty()) {
+    if (ParseRange(range, response.body.size(), &first, &last)) {
+      status_code = 206;
+      body_size = last - first + 1;
+      headers.AppendFormat("Content-Range: bytes %Iu-%Iu/%Iu\r\n",
+                           first, last, response.body.size());
+    } else {
+      status_code = 416;
+      body_size = 0;
+      headers.AppendFormat("Content-Range: bytes */%Iu\r\n",
+                           response.body.size());
+    }
+  }
+
+  if (response.supports_ranges) {
+    headers.Append("Accept-Ranges: bytes\r\n");
+  }
+  for (size_t i = 0; i != response.headers.size(); ++i) {
+    headers.AppendFormat("%s: %s\r\n",
+                         response.headers[i].first,
+                         response.headers[i].second);
+  }
+  if (response.is_chunked) {
+    headers.Append("Transfer-Encoding: chunked\r\n");
+  } else {
+    headers.AppendFormat("Content-Length: %Iu\r\n", body_size);
+  }
+
+  CStringA head;
+  head.Format("HTTP/1.1 %d %s\r\n%s\r\n",
+              status_code, GetReasonPhrase(status_code), headers);
+  if (!SendAll(socket, head.GetString(), head.GetLength())) {
+    return false;
+  }
+
+  if (request.method == "HEAD") {
+    return true;
+  }
+  if (!body_size) {
+    return !response.is_chunked || SendAll(socket, "0\r\n\r\n", 5);
+  }
+
+  return SendBody(socket,
+                  &response.body[first],
+                  body_size,
+                  response.is_chunked,
+                  response.bytes_per_sec,
+                  truncate_body_bytes);
+}
+
+bool HttpTestServer::SendBody(SOCKET socket,
+                              const uint8* data,
+                              size_t size,
+                              bool is_chunked,
+                              int bytes_per_sec,
+                              int truncate_body_bytes) {
+  ASSERT1(data);
+
+  const DWORD start_ms = ::GetTickCount();
+  size_t sent = 0;
+  while (sent != size) {
+    size_t slice = std::min(kSendSliceBytes, size - sent);
+    if (truncate_body_bytes >= 0) {
+      if (sent >= static_cast<size_t>(truncate_body_bytes)) {
+        return false;
+      }
+      slice = std::min(slice,
+                       static_cast<size_t>(truncate_body_bytes) - sent);
+    }
+
+    if (is_chunked) {
+      CStringA chunk_size;
+      chunk_size.Format("%Ix\r\n", slice);
+      if (!SendAll(socket, chunk_size.GetString(), chunk_size.GetLength())) {
+        return false;
+      }
+    }
+    if (!SendAll(socket, data + sent, slice) ||
+        (is_chunked && !SendAll(socket, "\r\n", 2))) {
+      return false;
+    }
+    sent += slice;
+
+    if (bytes_per_sec > 0) {
+      // Sleeps until the bytes sent so far are due at the throttled rate.
+      const DWORD due_ms =
+          static_cast<DWORD>(static_cast<uint64>(sent) * 1000 / bytes_per_sec);
+      const DWORD elapsed_ms = ::GetTickCount() - start_ms;
+      if (due_ms > elapsed_ms) {
+        ::Sleep(due_ms - elapsed_ms);
+      }
+    }
+  }
+
+  if (truncate_body_bytes >= 0 &&
+      sent >= static_cast<size_t>(truncate_body_bytes)) {
+    return false;
+  }
+
+  return !is_chunked || SendAll(socket, "0\r\n\r\n", 5);
+}
+
+bool HttpTestServer::SendAll(SOCKET socket, const void* data, size_t size) {
+  const char* p = static_cast<const char*>(data);
+  while (size) {
+    const int bytes = ::send(socket, p, static_cast<int>(size), 0);
+    if (bytes <= 0) {
+      return false;
+    }
+    p += bytes;
+    size -= bytes;
+  }
+  return true;
+}
+
+bool HttpTestServer::ParseRange(const CStringA& range,
+                                size_t content_length,
+                                size_t* first,
+                                size_t* last) {
+  ASSERT1(first);
+  ASSERT1(last);
+
+  // Only a single range is supported.
+  const char kPrefix[] = "bytes=";
+  if (range.Left(arraysize(kPrefix) - 1) != kPrefix ||
+      range.Find(',') != -1 ||
+      !content_length) {
+    return false;
+  }
+  const CStringA spec = range.Mid(arraysize(kPrefix) - 1);
+  const int dash = spec.Find('-');
+  if (dash == -1) {
+    return false;
+  }
+  const CStringA first_str = spec.Left(dash);
+  const CStringA last_str = spec.Mid(dash + 1);
+
+  if (first_str.IsEmpty()) {
+    // The suffix range "bytes=-n" requests the last n bytes.
+    const size_t suffix = static_cast<size_t>(_atoi64(last_str));
+    if (last_str.IsEmpty() || !suffix) {
+      return false;
+    }
+    *first = content_length - std::min(suffix, content_length);
+    *last = content_length - 1;
+    return true;
+  }
+
+  *first = static_cast<size_t>(_atoi64(first_str));
+  *last = last_str.IsEmpty() ?
+          content_length - 1 :
+          std::min(static_cast<size_t>(_atoi64(last_str)), content_length - 1);
+  return *first <= *last;
+}
+
+}  // namespace omaha
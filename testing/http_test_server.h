@@ -0,0 +1,232 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// HttpTestServer is an HTTP/1.1 server that listens on the loopback interface
+// so that the network code can be tested and benchmarked without an external
+// service. It uses Winsock directly and, unlike the HTTP Server API used by
+// tools/OmahaCompatibility, it does not require a URL reservation or
+// administrator rights.
+//
+// Requests are dispatched to the handler registered for their path, in the
+// same way the UrlHandlers of tools/OmahaCompatibility are. Each connection
+// is served on its own thread and supports keep-alive. The server supports
+// range requests, chunked and throttled responses, and can inject faults and
+// latency into the responses.
+//
+// Typical use:
+//   HttpTestServer server;
+//   StaticContentHandler handler(content, "application/octet-stream");
+//   server.AddHandler("/download", &handler);
+//   ASSERT_SUCCEEDED(server.Start());
+//   ... request server.GetUrl(_T("/download")) ...
+
+#ifndef OMAHA_TESTING_HTTP_TEST_SERVER_H_
+#define OMAHA_TESTING_HTTP_TEST_SERVER_H_
+
+#include <winsock2.h>
+#include <windows.h>
+#include <atlstr.h>
+#include <map>
+#include <utility>
+#include <vector>
+#include "base/basictypes.h"
+#include "omaha/base/synchronized.h"
+#include "omaha/base/thread.h"
+
+namespace omaha {
+
+struct HttpTestRequest {
+  CStringA method;
+  CStringA path;
+  CStringA query;
+
+  // Keyed by the lowercase header name.
+  std::map<CStringA, CStringA> headers;
+
+  std::vector<uint8> body;
+
+  // Returns the value of the header, or an empty string if it is not present.
+  CStringA GetHeader(const char* name) const;
+};
+
+struct HttpTestResponse {
+  HttpTestResponse()
+      : status_code(200),
+        supports_ranges(false),
+        is_chunked(false),
+        bytes_per_sec(0) {}
+
+  int status_code;
+  std::vector<std::pair<CStringA, CStringA> > headers;
+  std::vector<uint8> body;
+
+  // Serves the Range header of the request from the body.
+  bool supports_ranges;
+
+  // Sends the body with the chunked transfer encoding.
+  bool is_chunked;
+
+  // Throttles the sending of the body. 0 does not throttle.
+  int bytes_per_sec;
+};
+
+// Serves the requests for a path. Called concurrently on the threads of the
+// connections.
+class HttpTestHandler {
+ public:
+  virtual ~HttpTestHandler() {}
+  virtual void HandleRequest(const HttpTestRequest& request,
+                             HttpTestResponse* response) = 0;
+};
+
+// Serves the same content for every request, with range support. Plays the
+// role of the DownloadHandler of tools/OmahaCompatibility.
+class StaticContentHandler : public HttpTestHandler {
+ public:
+  StaticContentHandler(const std::vector<uint8>& content,
+                       const char* content_type)
+      : content_(content),
+        content_type_(content_type),
+        is_chunked_(false),
+        bytes_per_sec_(0) {}
+
+  void set_is_chunked(bool is_chunked) { is_chunked_ = is_chunked; }
+  void set_bytes_per_sec(int bytes_per_sec) { bytes_per_sec_ = bytes_per_sec; }
+
+  virtual void HandleRequest(const HttpTestRequest& request,
+                             HttpTestResponse* response);
+
+ private:
+  const std::vector<uint8> content_;
+  const CStringA content_type_;
+  bool is_chunked_;
+  int bytes_per_sec_;
+
+  DISALLOW_COPY_AND_ASSIGN(StaticContentHandler);
+};
+
+// The faults and latency the server adds to the responses. Request numbers
+// start at 1 and count the requests for all the paths.
+struct HttpTestFaults {
+  HttpTestFaults()
+      : response_delay_ms(0),
+        drop_every_n(0),
+        error_every_n(0),
+        error_status_code(503),
+        truncate_body_bytes(-1) {}
+
+  // Delay before the response is sent.
+  int response_delay_ms;
+
+  // Closes the connection without a response for every n-th request.
+  int drop_every_n;
+
+  // Responds with error_status_code and no body for every n-th request.
+  int error_every_n;
+  int error_status_code;
+
+  // Closes the connection after sending this many bytes of a body. -1 sends
+  // the whole body.
+  int truncate_body_bytes;
+};
+
+class HttpTestServer : public Runnable {
+ public:
+  HttpTestServer();
+
+  // Stops the server.
+  virtual ~HttpTestServer();
+
+  // The handler is not owned and must outlive the server. Requests for paths
+  // without a handler get a 404 response.
+  void AddHandler(const char* path, HttpTestHandler* handler);
+
+  void set_faults(const HttpTestFaults& faults);
+
+  // Listens on 127.0.0.1, on a port chosen by the system, and starts accepting
+  // connections.
+  HRESULT Start();
+
+  // Closes the listening socket and the connections and waits for their
+  // threads to exit.
+  void Stop();
+
+  int port() const { return port_; }
+
+  // Returns the url of the path on this server, for instance
+  // http://127.0.0.1:1234/download.
+  CString GetUrl(const CString& path) const;
+
+  // The number of requests received.
+  int num_requests() const;
+
+ private:
+  class Connection;
+
+  // Accepts the connections. Runs on accept_thread_.
+  virtual void Run();
+
+  // Serves the requests of a connection until it is closed. Runs on the
+  // thread of the connection.
+  void ServeConnection(SOCKET socket);
+
+  // Returns false if the connection must be closed.
+  bool ServeRequest(SOCKET socket, const HttpTestRequest& request);
+
+  HttpTestHandler* GetHandler(const CStringA& path) const;
+  HttpTestFaults GetFaults() const;
+
+  static bool ReadRequest(SOCKET socket,
+                          CStringA* buffer,
+                          HttpTestRequest* request);
+  static bool SendResponse(SOCKET socket,
+                           const HttpTestRequest& request,
+                           const HttpTestResponse& response,
+                           int truncate_body_bytes);
+  static bool SendBody(SOCKET socket,
+                       const uint8* data,
+                       size_t size,
+                       bool is_chunked,
+                       int bytes_per_sec,
+                       int truncate_body_bytes);
+  static bool SendAll(SOCKET socket, const void* data, size_t size);
+
+  // Parses the Range header for a body of content_length bytes. Returns false
+  // if the range cannot be satisfied. first and last are inclusive.
+  static bool ParseRange(const CStringA& range,
+                         size_t content_length,
+                         size_t* first,
+                         size_t* last);
+
+  SOCKET listen_socket_;
+  int port_;
+  bool is_winsock_initialized_;
+  Thread accept_thread_;
+
+  mutable LLock lock_;
+
+  // Protected by lock_.
+  std::map<CStringA, HttpTestHandler*> handlers_;
+  HttpTestFaults faults_;
+  std::vector<Connection*> connections_;
+  int num_requests_;
+  bool is_stopping_;
+
+  DISALLOW_COPY_AND_ASSIGN(HttpTestServer);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_TESTING_HTTP_TEST_SERVER_H_
@@ -0,0 +1,241 @@
+// Copyright 2011 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/testing/http_test_server.h"
+#include "omaha/base/timer.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+const char kContent[] = "0123456789";
+
+// Echoes the method, the query and the body of the request.
+class EchoHandler : public HttpTestHandler {
+ public:
+  virtual void HandleRequest(const HttpTestRequest& request,
+                             HttpTestResponse* response) {
+    CStringA echo;
+    echo.Format("%s?%s:", request.method, request.query);
+    response->body.assign(echo.GetString(),
+                          echo.GetString() + echo.GetLength());
+    response->body.insert(response->body.end(),
+                          request.body.begin(),
+                          request.body.end());
+  }
+};
+
+}  // namespace
+
+class HttpTestServerTest : public testing::Test {
+ protected:
+  HttpTestServerTest()
+      : content_handler_(std::vector<uint8>(kContent,
+                                            kContent + arraysize(kContent) - 1),
+                         "text/plain") {}
+
+  virtual void SetUp() {
+    server_.AddHandler("/content", &content_handler_);
+    server_.AddHandler("/echo", &echo_handler_);
+    ASSERT_SUCCEEDED(server_.Start());
+    EXPECT_NE(0, server_.port());
+  }
+
+  virtual void TearDown() {
+    server_.Stop();
+  }
+
+  // Sends the raw request on a new connection and returns everything the
+  // server sends until it closes the connection.
+  CStringA SendRequest(const CStringA& request) {
+    SOCKET s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    EXPECT_NE(INVALID_SOCKET, s);
+
+    sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+    address.sin_port = ::htons(static_cast<u_short>(server_.port()));
+    EXPECT_EQ(0, ::connect(s,
+                           reinterpret_cast<sockaddr*>(&address),
+                           sizeof(address)));
+    EXPECT_EQ(request.GetLength(),
+              ::send(s, request.GetString(), request.GetLength(), 0));
+
+    CStringA response;
+    char data[1024] = {0};
+    int bytes = 0;
+    while ((bytes = ::recv(s, data, sizeof(data), 0)) > 0) {
+      response.Append(data, bytes);
+    }
+    EXPECT_EQ(0, ::closesocket(s));
+    return response;
+  }
+
+  CStringA Get(const char* path, const char* extra_headers) {
+    CStringA request;
+    request.Format("GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\n%s"
+                   "Connection: close\r\n\r\n",
+                   path, extra_headers);
+    return SendRequest(request);
+  }
+
+  static CStringA GetBody(const CStringA& response) {
+    const int body_start = response.Find("\r\n\r\n");
+    return body_start == -1 ? CStringA() : response.Mid(body_start + 4);
+  }
+
+  HttpTestServer server_;
+  StaticContentHandler content_handler_;
+  EchoHandler echo_handler_;
+};
+
+TEST_F(HttpTestServerTest, GetUrl) {
+  CString expected_url;
+  expected_url.Format(_T("http://127.0.0.1:%d/content"), server_.port());
+  EXPECT_STREQ(expected_url, server_.GetUrl(_T("/content")));
+}
+
+TEST_F(HttpTestServerTest, Get) {
+  const CStringA response = Get("/content", "");
+  EXPECT_EQ(0, response.Find("HTTP/1.1 200 OK\r\n"));
+  EXPECT_NE(-1, response.Find("Content-Length: 10\r\n"));
+  EXPECT_NE(-1, response.Find("Content-Type: text/plain\r\n"));
+  EXPECT_NE(-1, response.Find("Accept-Ranges: bytes\r\n"));
+  EXPECT_STREQ(kContent, GetBody(response));
+  EXPECT_EQ(1, server_.num_requests());
+}
+
+TEST_F(HttpTestServerTest, Get_NotFound) {
+  const CStringA response = Get("/missing", "");
+  EXPECT_EQ(0, response.Find("HTTP/1.1 404 Not Found\r\n"));
+  EXPECT_TRUE(GetBody(response).IsEmpty());
+}
+
+TEST_F(HttpTestServerTest, Head) {
+  CStringA response = SendRequest("HEAD /content HTTP/1.1\r\n"
+                                  "Connection: close\r\n\r\n");
+  EXPECT_EQ(0, response.Find("HTTP/1.1 200 OK\r\n"));
+  EXPECT_NE(-1, response.Find("Content-Length: 10\r\n"));
+  EXPECT_TRUE(GetBody(response).IsEmpty());
+}
+
+TEST_F(HttpTestServerTest, Post) {
+  const CStringA response = SendRequest("POST /echo?x=1 HTTP/1.1\r\n"
+                                        "Content-Length: 5\r\n"
+                                        "Connection: close\r\n\r\n"
+                                        "hello");
+  EXPECT_EQ(0, response.Find("HTTP/1.1 200 OK\r\n"));
+  EXPECT_STREQ("POST?x=1:hello", GetBody(response));
+}
+
+TEST_F(HttpTestServerTest, Range) {
+  CStringA response = Get("/content", "Range: bytes=2-5\r\n");
+  EXPECT_EQ(0, response.Find("HTTP/1.1 206 Partial Content\r\n"));
+  EXPECT_NE(-1, response.Find("Content-Range: bytes 2-5/10\r\n"));
+  EXPECT_NE(-1, response.Find("Content-Length: 4\r\n"));
+  EXPECT_STREQ("2345", GetBody(response));
+
+  response = Get("/content", "Range: bytes=7-\r\n");
+  EXPECT_NE(-1, response.Find("Content-Range: bytes 7-9/10\r\n"));
+  EXPECT_STREQ("789", GetBody(response));
+
+  response = Get("/content", "Range: bytes=-2\r\n");
+  EXPECT_NE(-1, response.Find("Content-Range: bytes 8-9/10\r\n"));
+  EXPECT_STREQ("89", GetBody(response));
+
+  response = Get("/content", "Range: bytes=5-100\r\n");
+  EXPECT_STREQ("56789", GetBody(response));
+}
+
+TEST_F(HttpTestServerTest, Range_NotSatisfiable) {
+  const CStringA response = Get("/content", "Range: bytes=10-\r\n");
+  EXPECT_EQ(0, response.Find("HTTP/1.1 416 "));
+  EXPECT_NE(-1, response.Find("Content-Range: bytes */10\r\n"));
+  EXPECT_TRUE(GetBody(response).IsEmpty());
+}
+
+TEST_F(HttpTestServerTest, Chunked) {
+  content_handler_.set_is_chunked(true);
+  const CStringA response = Get("/content", "");
+  EXPECT_NE(-1, response.Find("Transfer-Encoding: chunked\r\n"));
+  EXPECT_EQ(-1, response.Find("Content-Length:"));
+  EXPECT_STREQ("a\r\n0123456789\r\n0\r\n\r\n", GetBody(response));
+}
+
+TEST_F(HttpTestServerTest, Throttled) {
+  content_handler_.set_bytes_per_sec(20);
+
+  LowResTimer timer(true);
+  const CStringA response = Get("/content", "");
+  EXPECT_STREQ(kContent, GetBody(response));
+
+  // 10 bytes at 20 bytes per second take half a second.
+  EXPECT_LE(400u, timer.GetMilliseconds());
+}
+
+TEST_F(HttpTestServerTest, KeepAlive) {
+  const CStringA response = SendRequest("GET /content HTTP/1.1\r\n\r\n"
+                                        "GET /content HTTP/1.1\r\n"
+                                        "Connection: close\r\n\r\n");
+  const int second_response = response.Find("HTTP/1.1 200 OK\r\n", 1);
+  EXPECT_EQ(0, response.Find("HTTP/1.1 200 OK\r\n"));
+  EXPECT_NE(-1, second_response);
+  EXPECT_STREQ(kContent, GetBody(response.Mid(second_response)));
+  EXPECT_EQ(2, server_.num_requests());
+}
+
+TEST_F(HttpTestServerTest, Faults_Error) {
+  HttpTestFaults faults;
+  faults.error_every_n = 2;
+  server_.set_faults(faults);
+
+  EXPECT_EQ(0, Get("/content", "").Find("HTTP/1.1 200 OK\r\n"));
+  const CStringA response = Get("/content", "");
+  EXPECT_EQ(0, response.Find("HTTP/1.1 503 Service Unavailable\r\n"));
+  EXPECT_TRUE(GetBody(response).IsEmpty());
+  EXPECT_EQ(0, Get("/content", "").Find("HTTP/1.1 200 OK\r\n"));
+}
+
+TEST_F(HttpTestServerTest, Faults_Drop) {
+  HttpTestFaults faults;
+  faults.drop_every_n = 1;
+  server_.set_faults(faults);
+
+  EXPECT_TRUE(Get("/content", "").IsEmpty());
+  EXPECT_EQ(1, server_.num_requests());
+}
+
+TEST_F(HttpTestServerTest, Faults_Truncate) {
+  HttpTestFaults faults;
+  faults.truncate_body_bytes = 4;
+  server_.set_faults(faults);
+
+  const CStringA response = Get("/content", "");
+  EXPECT_NE(-1, response.Find("Content-Length: 10\r\n"));
+  EXPECT_STREQ("0123", GetBody(response));
+}
+
+TEST_F(HttpTestServerTest, Faults_Delay) {
+  HttpTestFaults faults;
+  faults.response_delay_ms = 500;
+  server_.set_faults(faults);
+
+  LowResTimer timer(true);
+  EXPECT_STREQ(kContent, GetBody(Get("/content", "")));
+  EXPECT_LE(500u, timer.GetMilliseconds());
+}
+
+}  // namespace omaha
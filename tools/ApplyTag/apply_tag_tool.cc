@@ -16,6 +16,7 @@
 // The main file for a simple tool to apply a tag to a signed file.
 #include <Windows.h>
 #include <TCHAR.h>
+#include <vector>
 #include "omaha/base/apply_tag.h"
 #include "omaha/base/file.h"
 #include "omaha/base/path.h"
@@ -28,10 +29,102 @@ using omaha::GetCurrentDir;
 using omaha::GetDirectoryFromPath;
 using omaha::GetFileFromPath;
 
+namespace {
+
+const TCHAR kUsage[] =
+    _T("Usage: ApplyTag <signed_file> <outputfile> <tag> [append]\n")
+    _T("       ApplyTag <signed_file> /batch <listfile> [append]\n")
+    _T("Each line of the list file is: <outputfile> <tag>\n");
+
+// Returns the absolute path of the output file, creating its directory if
+// needed.
+HRESULT GetOutputPath(const TCHAR* output_file, CString* out_path) {
+  ASSERT1(output_file);
+  ASSERT1(out_path);
+
+  CString dir = GetDirectoryFromPath(output_file);
+  CString path = ConcatenatePath(GetCurrentDir(), dir);
+  ASSERT1(!path.IsEmpty());
+  if (!File::Exists(path)) {
+    HRESULT hr = CreateDir(path, NULL);
+    if (FAILED(hr)) {
+      _tprintf(_T("Could not create dir %s\n"), path);
+      return hr;
+    }
+  }
+
+  CString file_name = GetFileFromPath(output_file);
+  *out_path = ConcatenatePath(path, file_name);
+  ASSERT1(!out_path->IsEmpty());
+  ASSERT1(File::Exists(path));
+  return S_OK;
+}
+
+// Tags a copy of the signed file for each line of the list file, and prints
+// the throughput.
+int BatchTag(const TCHAR* signed_file, const TCHAR* list_file, bool append) {
+  std::vector<byte> list;
+  HRESULT hr = omaha::ReadEntireFile(list_file, 0, &list);
+  if (FAILED(hr)) {
+    _tprintf(_T("Could not read the list file %s hr = %x\n"), list_file, hr);
+    return hr;
+  }
+  CStringA lines;
+  if (!list.empty()) {
+    lines.SetString(reinterpret_cast<const char*>(&list.front()), list.size());
+  }
+
+  omaha::BatchApplyTag batch;
+  hr = batch.Init(signed_file, append);
+  if (FAILED(hr)) {
+    _tprintf(_T("BatchApplyTag.Init Failed hr = %x\n"), hr);
+    return hr;
+  }
+
+  const DWORD start_ms = ::GetTickCount();
+  int num_files = 0;
+  int pos = 0;
+  for (CStringA line = lines.Tokenize("\r\n", pos);
+       pos != -1;
+       line = lines.Tokenize("\r\n", pos)) {
+    int line_pos = 0;
+    const CStringA output_file = line.Tokenize(" \t", line_pos);
+    const CStringA tag = line_pos == -1 ? CStringA() :
+                                          line.Tokenize(" \t", line_pos);
+    if (tag.IsEmpty()) {
+      _tprintf(_T("Invalid line: %hs\n"), line);
+      return E_INVALIDARG;
+    }
+
+    CString out_path;
+    hr = GetOutputPath(CA2T(output_file), &out_path);
+    if (FAILED(hr)) {
+      return hr;
+    }
+
+    hr = batch.EmbedTagString(tag, tag.GetLength(), out_path);
+    if (FAILED(hr)) {
+      _tprintf(_T("Could not tag %s hr = %x\n"), out_path, hr);
+      return hr;
+    }
+    ++num_files;
+  }
+
+  const DWORD elapsed_ms = ::GetTickCount() - start_ms;
+  _tprintf(_T("Tagged %d files in %u ms"), num_files, elapsed_ms);
+  if (elapsed_ms) {
+    _tprintf(_T(", %u files/s"), num_files * 1000 / elapsed_ms);
+  }
+  _tprintf(_T("\n"));
+  return 0;
+}
+
+}  // namespace
+
 int _tmain(int argc, TCHAR* argv[]) {
   if (argc != 4 && argc != 5) {
     _tprintf(_T("Incorrect number of arguments!\n"));
-    _tprintf(_T("Usage: ApplyTag <signed_file> <outputfile> <tag> [append]\n"));
+    _tprintf(kUsage);
     return -1;
   }
 
@@ -46,27 +139,22 @@ int _tmain(int argc, TCHAR* argv[]) {
     append = true;
   }
 
-  CString dir = GetDirectoryFromPath(argv[2]);
-  CString path = ConcatenatePath(GetCurrentDir(), dir);
-  ASSERT1(!path.IsEmpty());
-  if (!File::Exists(path)) {
-    HRESULT hr = CreateDir(path, NULL);
-    if (FAILED(hr)) {
-      _tprintf(_T("Could not create dir %s\n"), path);
-      return hr;
-    }
+  if (_tcsicmp(argv[2], _T("/batch")) == 0) {
+    return BatchTag(file, argv[3], append);
+  }
+
+  CString out_path;
+  HRESULT hr = GetOutputPath(argv[2], &out_path);
+  if (FAILED(hr)) {
+    return hr;
   }
 
-  CString file_name = GetFileFromPath(argv[2]);
-  CString out_path = ConcatenatePath(path, file_name);
-  ASSERT1(!out_path.IsEmpty());
-  ASSERT1(File::Exists(path));
   omaha::ApplyTag tag;
-  HRESULT hr = tag.Init(argv[1],
-                        CT2CA(argv[3]),
-                        lstrlenA(CT2CA(argv[3])),
-                        out_path,
-                        append);
+  hr = tag.Init(argv[1],
+                CT2CA(argv[3]),
+                lstrlenA(CT2CA(argv[3])),
+                out_path,
+                append);
   if (hr == E_INVALIDARG) {
     _tprintf(_T("The tag_string %s contains invalid characters."), argv[3]);
     _tprintf(_T("  We accept the following ATL RegEx '[-%{}/\a&=._]*'\n"));
@@ -82,7 +170,7 @@ int _tmain(int argc, TCHAR* argv[]) {
   if (hr == APPLYTAG_E_ALREADY_TAGGED) {
     _tprintf(_T("The binary %s is already tagged."), argv[1]);
     _tprintf(_T(" In order to append the tag string, use the append flag.\n"));
-    _tprintf(_T("Usage: ApplyTag <signed_file> <outputfile> <tag> [append]\n"));
+    _tprintf(kUsage);
   }
 
   return 0;